@@ -0,0 +1,87 @@
+// UDP datagram cache benchmark
+// Listens on UDP port 44000 and consumes every datagram through the
+// zero copy peek view. Flood it from a PC, e.g.:
+//     iperf -u -c <board ip> -p 44000 -b 10M -l 512
+// Every second it prints the datagrams/s cached and consumed, the drops
+// and the average time spent in the stack per datagram.
+#include <NetworkShield.h>
+#include <DNETcK.h>
+#include <utility/DNETcKAPI.h>
+
+#define BENCH_PORT    44000
+#define UDP_OPEN_SERVER 0
+
+byte rgbCache[4096];
+byte hUDP = INVALID_UDP_SOCKET;
+
+unsigned long tStart = 0;
+unsigned long usInStack = 0;
+unsigned long cConsumed = 0;
+unsigned long cbConsumed = 0;
+unsigned long cCachedLast = 0;
+unsigned long cDroppedLast = 0;
+unsigned long checksum = 0;
+
+void setup()
+{
+  Serial.begin(115200);
+
+  DNETcK::begin();
+  while (!DNETcK::isInitialized())
+  {
+    DNETcK::periodicTasks();
+  }
+
+  hUDP = UDPOpenEx(NULL, UDP_OPEN_SERVER, BENCH_PORT, 0);
+  ExchangeCacheBuffer(hUDP, rgbCache, sizeof(rgbCache));
+
+  Serial.println("UDP cache benchmark ready");
+  tStart = millis();
+}
+
+void loop()
+{
+  const byte * pbView = NULL;
+  unsigned short cbView = 0;
+  unsigned short i = 0;
+  unsigned long usT = 0;
+  unsigned long cCached = 0;
+  unsigned long cDropped = 0;
+  unsigned long cbCached = 0;
+
+  usT = micros();
+  DNETcK::periodicTasks();
+  usInStack += micros() - usT;
+
+  // consume in place, touching every byte so the view is really read
+  while ((cbView = UdpClientPeekView(hUDP, &pbView)) > 0)
+  {
+    for (i = 0; i < cbView; i++) checksum += pbView[i];
+    UdpClientEmptyNextDataGram(hUDP);
+    cConsumed++;
+    cbConsumed += cbView;
+  }
+
+  if (millis() - tStart >= 1000)
+  {
+    UdpCacheGetStats(&cCached, &cDropped, &cbCached);
+
+    Serial.print("cached/s=");
+    Serial.print(cCached - cCachedLast);
+    Serial.print("\tconsumed/s=");
+    Serial.print(cConsumed);
+    Serial.print("\tKB/s=");
+    Serial.print(cbConsumed / 1024);
+    Serial.print("\tdropped/s=");
+    Serial.print(cDropped - cDroppedLast);
+    Serial.print("\tus/datagram=");
+    Serial.println(cConsumed ? usInStack / cConsumed : 0);
+
+    cCachedLast = cCached;
+    cDroppedLast = cDropped;
+    cConsumed = 0;
+    cbConsumed = 0;
+    usInStack = 0;
+    tStart = millis();
+  }
+}
@@ -55,6 +55,8 @@
 #include "../DNETcK.h"
 #include "./DNETcKAPI.h"
 
+#include "checksum.h"
+
 #if defined(DWIFIcK_WiFi_Network)
     #include "../../DWIFIcK/DWIFIcK.h"
     #include "../../DWIFIcK/utility/DWIFIcKAPI.h"
@@ -82,26 +84,57 @@ APP_CONFIG AppConfig;
 // Here is where the chipKIT static variables and typedefs are implemented
 //***************************************************************************/
 
+// The socket cache buffer is carved into fixed size slots. A datagram takes
+// consecutive slots and never wraps the end of the cache, so its payload is
+// always contiguous and can be handed out as a direct view.
+// UDP_CACHE_SLOT_SIZE must be a multiple of 4 to keep the slots aligned.
+#ifndef UDP_CACHE_SLOT_SIZE
+    #define UDP_CACHE_SLOT_SIZE     32
+#endif
+
+// depth of the per socket datagram descriptor queue
+#ifndef UDP_CACHE_MAX_DATAGRAMS
+    #define UDP_CACHE_MAX_DATAGRAMS 8
+#endif
+
+typedef struct _UDPDataGram
+{
+    WORD    iSlot;                  // first slot of the datagram
+    WORD    cSlots;                 // slots charged, including any skipped at the end of the cache
+    WORD    iData;                  // offset of the first unread byte from the start of iSlot
+    WORD    cbData;                 // unread bytes left in the datagram
+} UDPDataGram;
+
 typedef struct _UDPCacheEntry
 {
-    byte *  rgbBuffer;
+    byte *  rgbBuffer;              // the buffer as given to ExchangeCacheBuffer
     WORD    cbBuffer;
-    WORD    iStart;
-    WORD    cbInUse;                // total including headers
+    byte *  rgbSlots;               // rgbBuffer rounded up to a 4 byte boundary
+    WORD    cSlots;
+    WORD    iSlotFree;              // next slot to hand out
+    WORD    cSlotsInUse;
+    byte    iDataGram;              // head of the descriptor queue
+    byte    cDataGrams;
+    bool    fPartiallyRead;         // the head datagram has been partially read
+    UDPDataGram rgDataGram[UDP_CACHE_MAX_DATAGRAMS];
 } UDPCacheEntry;
 
 #define NormalizeIndex(a, b) ((a) % (b))
-#define DataGramSize(a, b, c) (((WORD) a[NormalizeIndex(b, c)]) + (((WORD) a[NormalizeIndex(b+1, c)]) << 8))
+#define DataGramSlots(cb) (((cb) + UDP_CACHE_SLOT_SIZE - 1) / UDP_CACHE_SLOT_SIZE)
+#define SlotAddress(pUDPE, iSlot) (&(pUDPE)->rgbSlots[(iSlot) * UDP_CACHE_SLOT_SIZE])
+#define HeadDataGram(pUDPE) (&(pUDPE)->rgDataGram[(pUDPE)->iDataGram])
 #define Min(a, b) ((a) < (b) ? (a) : (b))
 #define Max(a, b) ((a) > (b) ? (a) : (b))
 
 static UDPCacheEntry UDPCache[MAX_UDP_SOCKETS];
+static unsigned long cUDPDataGramsCached = 0;
+static unsigned long cUDPDataGramsDropped = 0;
+static unsigned long cbUDPDataGramsCached = 0;
 static const char * szDNSNameResolving = NULL;
 static STATUS statusDNS = DNSUninitialized;
 static IP_ADDR DNSLastResolvedHostIP;
 
 static bool fIsEthernetEngineStopped = TRUE;
-static bool fDatagramPartiallyRead = FALSE;
 static bool fMacIsSet = FALSE;
 static bool fMACInitialized = FALSE;
 
@@ -307,6 +340,9 @@ void DNETcK_Init(void)
     // clear my UDP cache and DNS state so PeriodicTasks will run correctly
     memset(UDPCache, 0, sizeof(UDPCache));
 
+    // pick the checksum engine used by IP/TCP/UDP
+    checksum_begin();
+
     // make sure we only call this once!
     if(fIsInit)
     {
@@ -317,7 +353,6 @@ void DNETcK_Init(void)
     szDNSNameResolving = NULL;
     DNSLastResolvedHostIP.Val = 0;
     statusDNS = DNSUninitialized;
-    fDatagramPartiallyRead = FALSE;
     fMACInitialized = FALSE;
 
     // Init the static memory in the stack subsytems
@@ -551,34 +586,145 @@ void EthernetPeriodicTasks(void)
 
 /*****************************************************************************
   Function:
-	void PutDataGramSize(WORD cbSize, WORD iSize, byte * rgbBuffer, WORD cbBuffer)
+	void InitUDPCacheEntry(UDPCacheEntry * pUDPE, byte * rgbBuffer, WORD cbBuffer)
 
   Summary:
-	Puts the datagram size in the UDP Cache where the 2 byte size may wrap the cache
+	Sets up an empty socket cache over the supplied buffer
 
   Description:
  
   Precondition:
 
   Parameters:
-	cbSize - The size of the following datagram, not including this 2 byte size field
-    iSize - index into the cache buffer to put the size, iSize only has to be the modulo of the index
-    rgbBuffer - the UDP cache buffer
-    cbBuffer - The size of the UDP cache
+    pUDPE - the socket cache to initialize
+    rgbBuffer - the cache buffer, may be NULL
+    cbBuffer - The size of the cache buffer
  
   Returns:
 	None
 
   Remarks:
-    This will nomalize iSize before indexing in the cache; the size can span the end
-    of the cache and wrap to the start.
+    The slots start on the first 4 byte boundary in the buffer; any bytes
+    left over after the last whole slot are not used.
 
  ***************************************************************************/
-static void PutDataGramSize(WORD cbSize, WORD iSize, byte * rgbBuffer, WORD cbBuffer)
+static void InitUDPCacheEntry(UDPCacheEntry * pUDPE, byte * rgbBuffer, WORD cbBuffer)
 {
-    rgbBuffer[NormalizeIndex(iSize, cbBuffer)] = (byte) (cbSize & 0x00FF);
-    iSize++;
-    rgbBuffer[NormalizeIndex(iSize, cbBuffer)] = (byte) ((cbSize & 0xFF00) >> 8);
+    WORD cbAlign = 0;
+
+    memset(pUDPE, 0, sizeof(UDPCacheEntry));
+    pUDPE->rgbBuffer = rgbBuffer;
+    pUDPE->cbBuffer = cbBuffer;
+
+    if(rgbBuffer == NULL)
+    {
+        return;
+    }
+
+    cbAlign = (WORD) ((4 - (((DWORD) rgbBuffer) & 3)) & 3);
+    if(cbBuffer > cbAlign)
+    {
+        pUDPE->rgbSlots = &rgbBuffer[cbAlign];
+        pUDPE->cSlots = (cbBuffer - cbAlign) / UDP_CACHE_SLOT_SIZE;
+    }
+}
+
+/*****************************************************************************
+  Function:
+	UDPDataGram * AllocUDPDataGram(UDPCacheEntry * pUDPE, WORD cbDataGram)
+
+  Summary:
+	Reserves slots and a descriptor for a datagram at the tail of the socket cache
+
+  Description:
+ 
+  Precondition:
+
+  Parameters:
+    pUDPE - the socket cache
+    cbDataGram - the size of the datagram to reserve room for
+ 
+  Returns:
+	The new descriptor, or NULL if there is not enough room
+
+  Remarks:
+    A datagram never wraps the end of the cache; if it does not fit in the
+    slots left at the end, those slots are skipped and charged to the datagram
+    so they are given back when it is freed.
+
+ ***************************************************************************/
+static UDPDataGram * AllocUDPDataGram(UDPCacheEntry * pUDPE, WORD cbDataGram)
+{
+    UDPDataGram * pDG = NULL;
+    WORD cSlots = DataGramSlots(cbDataGram);
+    WORD cSlotsCharged = cSlots;
+    WORD iSlot = 0;
+
+    // an empty cache starts over at slot 0 so we get the longest contiguous run
+    if(pUDPE->cDataGrams == 0)
+    {
+        pUDPE->iSlotFree = 0;
+        pUDPE->cSlotsInUse = 0;
+    }
+    else if(pUDPE->cDataGrams == UDP_CACHE_MAX_DATAGRAMS)
+    {
+        return(NULL);
+    }
+
+    iSlot = pUDPE->iSlotFree;
+    if(iSlot + cSlots > pUDPE->cSlots)
+    {
+        cSlotsCharged += pUDPE->cSlots - iSlot;
+        iSlot = 0;
+    }
+
+    if(cSlotsCharged > pUDPE->cSlots - pUDPE->cSlotsInUse)
+    {
+        return(NULL);
+    }
+
+    pDG = &pUDPE->rgDataGram[NormalizeIndex(pUDPE->iDataGram + pUDPE->cDataGrams, UDP_CACHE_MAX_DATAGRAMS)];
+    pDG->iSlot = iSlot;
+    pDG->cSlots = cSlotsCharged;
+    pDG->iData = 0;
+    pDG->cbData = cbDataGram;
+
+    pUDPE->cDataGrams++;
+    pUDPE->cSlotsInUse += cSlotsCharged;
+    pUDPE->iSlotFree = NormalizeIndex(iSlot + cSlots, pUDPE->cSlots);
+
+    return(pDG);
+}
+
+/*****************************************************************************
+  Function:
+	void FreeUDPDataGram(UDPCacheEntry * pUDPE)
+
+  Summary:
+	Removes the datagram at the head of the socket cache
+
+  Description:
+ 
+  Precondition:
+    The cache holds at least one datagram
+
+  Parameters:
+    pUDPE - the socket cache
+ 
+  Returns:
+	None
+
+  Remarks:
+
+ ***************************************************************************/
+static void FreeUDPDataGram(UDPCacheEntry * pUDPE)
+{
+    pUDPE->cSlotsInUse -= HeadDataGram(pUDPE)->cSlots;
+    pUDPE->iDataGram = NormalizeIndex(pUDPE->iDataGram + 1, UDP_CACHE_MAX_DATAGRAMS);
+    pUDPE->cDataGrams--;
+
+    // we are clean to a new datagram
+    pUDPE->fPartiallyRead = FALSE;
 }
 
 /*****************************************************************************
@@ -600,23 +746,22 @@ static void PutDataGramSize(WORD cbSize, WORD iSize, byte * rgbBuffer, WORD cbBu
 	None
 
   Remarks:
-    This needs to be called with each pass of periodicTasks() to keep the socket caches up to date.
+    The datagram is read from the MAL straight into its slots, this is the only copy
+    made until the sketch reads it out.
 
  ***************************************************************************/
 static void UpdateUDPEntryCache(UDP_SOCKET hUDP, UDPCacheEntry * pUDPE)
 {
     WORD cbReady = 0;
-    DWORD cbT = 0;
-    DWORD iEnd = 0;
+    UDPDataGram * pDG = NULL;
 
-    if(pUDPE->rgbBuffer == NULL)
+    if(pUDPE->cSlots == 0)
     {
         return;
     }
 
     // see what we need to read
     cbReady = UDPIsGetReady(hUDP);
-    cbT = cbReady + pUDPE->cbInUse + sizeof(WORD);
 
     // if there is nothing to read, we are done
     if(cbReady == 0) 
@@ -624,60 +769,33 @@ static void UpdateUDPEntryCache(UDP_SOCKET hUDP, UDPCacheEntry * pUDPE)
         return;
     }
 
-    // too big for us to cache it, just dump it; but don't purge existing data in the cache
-    // or we have freezed the cache and we don't have room for this datagram
-    else if(cbReady + sizeof(WORD) > pUDPE->cbBuffer  || (fDatagramPartiallyRead && cbT > pUDPE->cbBuffer))
+    // too big for us to cache it, just dump it
+    if(DataGramSlots(cbReady) > pUDPE->cSlots)
     {
-        void UDPDiscard();
+        UDPDiscard();
+        cUDPDataGramsDropped++;
         return;
     }
 
-    // or we need to dump some old datagrams
-    else if(cbT > pUDPE->cbBuffer) 
+    // we want to maintain the integrity of datagrams, do not chop them
+    // so when we make room, dump whole old datagrams; but don't purge one
+    // that is partially read, or we have frozen the cache and must drop the new one.
+    while((pDG = AllocUDPDataGram(pUDPE, cbReady)) == NULL)
     {
-        DWORD iStart = pUDPE->iStart;
-        DWORD cbDump = cbT - pUDPE->cbBuffer;
-        DWORD cbDumped = 0;
-        DWORD cbDataGram = 0;
-
-        // we want to maintian the integrity of datagrams, do not chop them
-        // so when we dump, dump the whole datagram.            
-        do
+        if(pUDPE->fPartiallyRead)
         {
-            cbDataGram = DataGramSize(pUDPE->rgbBuffer, iStart, pUDPE->cbBuffer) + sizeof(WORD);
-            cbDumped += cbDataGram;
-            iStart += cbDataGram;
-        } while(cbDump > cbDumped);
-        
-        pUDPE->iStart = NormalizeIndex(iStart, pUDPE->cbBuffer);          
-        pUDPE->cbInUse -= cbDumped;
-    }
-
-    // at this point we have the room in the cache, and we can save the whole datagram and header
-
-    // put the datagram length in, in two steps in case we are wrapping in the cache
-    iEnd = NormalizeIndex(pUDPE->iStart + pUDPE->cbInUse, pUDPE->cbBuffer);
-    PutDataGramSize(cbReady, iEnd, pUDPE->rgbBuffer, pUDPE->cbBuffer);
-    iEnd += sizeof(WORD);
-    pUDPE->cbInUse += sizeof(WORD);
-
-    // see how much we can read in the first pass.
-    iEnd = NormalizeIndex(iEnd, pUDPE->cbBuffer);
-    cbT = pUDPE->cbBuffer - iEnd;
-    cbT = Min(cbT, cbReady);
+            UDPDiscard();
+            cUDPDataGramsDropped++;
+            return;
+        }
 
-    // 1st pass read
-    UDPGetArray(&pUDPE->rgbBuffer[iEnd], cbT);
-    cbReady -= cbT;
-    pUDPE->cbInUse += cbT;
+        FreeUDPDataGram(pUDPE);
+        cUDPDataGramsDropped++;
+    }
 
-    // the rest of the bytes should be able to read in the 2nd pass
-    if(cbReady > 0)
-    {
-        iEnd = NormalizeIndex(iEnd + cbT, pUDPE->cbBuffer);
-        UDPGetArray(&pUDPE->rgbBuffer[iEnd], cbReady);
-        pUDPE->cbInUse += cbReady;
-    }  
+    UDPGetArray(SlotAddress(pUDPE, pDG->iSlot), cbReady);
+    cUDPDataGramsCached++;
+    cbUDPDataGramsCached += cbReady;
 }
 
 /*****************************************************************************
@@ -685,7 +803,7 @@ static void UpdateUDPEntryCache(UDP_SOCKET hUDP, UDPCacheEntry * pUDPE)
 	static void UpdateUDPCache(void)
 
   Summary:
-	enumerates all sockets held by DNETcK and updates the socket cache for each socket
+	Moves the datagram currently held by the MAL into its socket cache
 
   Description:
  
@@ -699,13 +817,15 @@ static void UpdateUDPEntryCache(UDP_SOCKET hUDP, UDPCacheEntry * pUDPE)
 
   Remarks:
     This needs to be called with each pass of periodicTasks() to keep the socket caches up to date.
+    The MAL holds at most one datagram at a time, so only the socket it was matched to is
+    looked at; sockets with nothing pending cost nothing.
 
  ***************************************************************************/
 static void UpdateUDPCache(void)
 {
-    byte hUDP = 0;
+    UDP_SOCKET hUDP = UDPGetRxSocket();
 
-    for(hUDP = 0; hUDP < MAX_UDP_SOCKETS; hUDP++)
+    if(hUDP < MAX_UDP_SOCKETS)
     {
         UpdateUDPEntryCache(hUDP, &UDPCache[hUDP]);
     }
@@ -737,57 +857,32 @@ static void UpdateUDPCache(void)
 byte * ExchangeCacheBuffer(byte hUDP, byte *rgbBufferNew, unsigned short cbBufferNew)
 {
     UDPCacheEntry * pUDPE = &UDPCache[hUDP];
-
+    UDPCacheEntry udpeNew;
     byte * rgbBuffOld = pUDPE->rgbBuffer;
-    WORD cbLeftToCheck = pUDPE->cbInUse;;
-    WORD iOldBuff = 0;
-
-    WORD cbInUseNew = 0;
-    WORD iNewBuff = 0;
-    WORD cbRemaining = cbBufferNew;
+    UDPDataGram * pDGOld = NULL;
+    UDPDataGram * pDGNew = NULL;
+    byte i = 0;
 
-    WORD cbDataGram = 0;
+    InitUDPCacheEntry(&udpeNew, rgbBufferNew, cbBufferNew);
 
-    // if nothing to copy or blanking out 
-    if(rgbBufferNew == NULL || pUDPE->rgbBuffer == NULL || pUDPE->cbInUse == 0  || pUDPE->cbBuffer == 0)
+    // copy over the unread part of the datagrams that fit
+    for(i = 0; i < pUDPE->cDataGrams && udpeNew.cSlots > 0; i++)
     {
-        pUDPE->cbInUse = 0; 
-    }
-
-    else
-    {
-
-        // copy over datagrams that fit
-        iOldBuff = NormalizeIndex(pUDPE->iStart, pUDPE->cbBuffer);
-        while(cbLeftToCheck > 0)
+        pDGOld = &pUDPE->rgDataGram[NormalizeIndex(pUDPE->iDataGram + i, UDP_CACHE_MAX_DATAGRAMS)];
+        if((pDGNew = AllocUDPDataGram(&udpeNew, pDGOld->cbData)) != NULL)
         {
-            cbDataGram = DataGramSize(pUDPE->rgbBuffer, iOldBuff, pUDPE->cbBuffer) + sizeof(WORD);
-            if(cbDataGram < cbRemaining)
-            {
-                WORD i = 0;
+            memcpy(SlotAddress(&udpeNew, pDGNew->iSlot), SlotAddress(pUDPE, pDGOld->iSlot) + pDGOld->iData, pDGOld->cbData);
 
-                // copy the bytes
-                for(i = 0; i < cbDataGram; i++)
-                {
-                    rgbBufferNew[iNewBuff] = pUDPE->rgbBuffer[iOldBuff];
-                    iNewBuff++;
-                    iOldBuff = NormalizeIndex(iOldBuff+1, pUDPE->cbBuffer);
-                }
-          
-                cbInUseNew += cbDataGram;
-                cbRemaining -= cbDataGram;
+            // a partial read is only still in progress if the head made it over
+            if(i == 0)
+            {
+                udpeNew.fPartiallyRead = pUDPE->fPartiallyRead;
             }
-            cbLeftToCheck -= cbDataGram;
         }
-
-        // fix up the new pointers
-        pUDPE->cbInUse = cbInUseNew; 
     }
 
     // everything is fixed up to the start of the cache
-    pUDPE->rgbBuffer = rgbBufferNew;
-    pUDPE->cbBuffer = cbBufferNew;
-    pUDPE->iStart = 0;
+    *pUDPE = udpeNew;
 
     return(rgbBuffOld);
 }
@@ -1357,12 +1452,12 @@ unsigned short UdpClientAvailable(byte hUDP)
     EthernetPeriodicTasks();
 
     // not a valid request
-    if(hUDP >= MAX_UDP_SOCKETS || UDPCache[hUDP].rgbBuffer == NULL || UDPCache[hUDP].cbInUse == 0)
+    if(hUDP >= MAX_UDP_SOCKETS || UDPCache[hUDP].cDataGrams == 0)
     {
         return(0);
     }
 
-    return(DataGramSize(UDPCache[hUDP].rgbBuffer, UDPCache[hUDP].iStart, UDPCache[hUDP].cbBuffer));
+    return(HeadDataGram(&UDPCache[hUDP])->cbData);
 }
 
 /****************************************************************************
@@ -1385,23 +1480,13 @@ unsigned short UdpClientAvailable(byte hUDP)
   ***************************************************************************/
 void UdpClientEmptyNextDataGram(byte hUDP)
 {
-    WORD cbDataGram = 0;
-
     // not a valid request
-    if(hUDP >= MAX_UDP_SOCKETS || UDPCache[hUDP].rgbBuffer == NULL || UDPCache[hUDP].cbInUse == 0)
+    if(hUDP >= MAX_UDP_SOCKETS || UDPCache[hUDP].cDataGrams == 0)
     {
         return;
     }
 
-    // get the length to the next datagarm
-    cbDataGram = DataGramSize(UDPCache[hUDP].rgbBuffer, UDPCache[hUDP].iStart, UDPCache[hUDP].cbBuffer) + sizeof(WORD);
-
-    // fixup the buffer to remove this data gram
-    UDPCache[hUDP].cbInUse -= cbDataGram;
-    UDPCache[hUDP].iStart = NormalizeIndex(UDPCache[hUDP].iStart + cbDataGram, UDPCache[hUDP].cbBuffer);
-
-    // we are clean to a new datagram
-    fDatagramPartiallyRead = FALSE;
+    FreeUDPDataGram(&UDPCache[hUDP]);
 }
 
 /****************************************************************************
@@ -1425,52 +1510,98 @@ void UdpClientEmptyNextDataGram(byte hUDP)
   ***************************************************************************/
 unsigned short UdpClientRemoveBytesFromDataGram(byte hUDP, unsigned short cbRemove)
 {
-    WORD cbDataGram = 0;
+    UDPDataGram * pDG = NULL;
 
     // not a valid request
-    if(hUDP >= MAX_UDP_SOCKETS || UDPCache[hUDP].rgbBuffer == NULL || UDPCache[hUDP].cbInUse == 0)
+    if(hUDP >= MAX_UDP_SOCKETS || UDPCache[hUDP].cDataGrams == 0)
     {
-        return;
+        return(0);
     }
 
-    cbDataGram = DataGramSize(UDPCache[hUDP].rgbBuffer, UDPCache[hUDP].iStart, UDPCache[hUDP].cbBuffer);
-    cbRemove = Min(cbRemove, cbDataGram);
+    pDG = HeadDataGram(&UDPCache[hUDP]);
+    cbRemove = Min(cbRemove, pDG->cbData);
 
     // we are removing the whole datagram
-    if(cbRemove == cbDataGram)
+    if(cbRemove == pDG->cbData)
     {
-        // we are removing the header, remove it as well
-        cbDataGram += sizeof(WORD);
+        FreeUDPDataGram(&UDPCache[hUDP]);
+        return(0);
+    }
+
+    // it is a partial datagram, just move the read point along
+    pDG->iData += cbRemove;
+    pDG->cbData -= cbRemove;
+
+    // partially read datagram, free the cache if we overflow
+    UDPCache[hUDP].fPartiallyRead = TRUE;
+
+    // return how much is left in there
+    return(pDG->cbData);
+}
+
+/****************************************************************************
+  Function:
+    unsigned short UdpClientPeekView(byte hUDP, const byte ** ppbView)
+
+  Description:
+    Gets a pointer to the unread bytes of the next datagram in the socket cache
+
+  Precondition:
+ 
+  Parameters:
+    hUDP        - The socket to get the cache for
+    ppbView     - receives a pointer to the first unread byte of the datagram
 
-        // fixup the buffer to remove this data gram
-        UDPCache[hUDP].cbInUse -= cbDataGram;
-        UDPCache[hUDP].iStart = NormalizeIndex(UDPCache[hUDP].iStart + cbDataGram, UDPCache[hUDP].cbBuffer);
+  Returns:
+    The number of contiguous bytes readable through the view.
 
-        // we are clean to a new datagram
-        fDatagramPartiallyRead = FALSE;
+  Remarks:  
+    Nothing is copied. The view is valid until the datagram is removed, the
+    cache buffer is exchanged or the stack is run again (which may dump the
+    datagram to make room for new ones).
+  ***************************************************************************/
+unsigned short UdpClientPeekView(byte hUDP, const byte ** ppbView)
+{
+    UDPDataGram * pDG = NULL;
 
+    // not a valid request
+    if(hUDP >= MAX_UDP_SOCKETS || UDPCache[hUDP].cDataGrams == 0)
+    {
+        *ppbView = NULL;
         return(0);
     }
 
-    // it is a partial datagram
-    else
-    {
-    WORD cbLeft = cbDataGram - cbRemove;
+    pDG = HeadDataGram(&UDPCache[hUDP]);
+    *ppbView = SlotAddress(&UDPCache[hUDP], pDG->iSlot) + pDG->iData;
 
-    // fixup the buffer to remove this data gram
-    UDPCache[hUDP].cbInUse -= cbRemove;
-    UDPCache[hUDP].iStart = NormalizeIndex(UDPCache[hUDP].iStart + cbRemove, UDPCache[hUDP].cbBuffer);
+    return(pDG->cbData);
+}
 
-    // iStart points to were the size needs to be put, but we must write the updated size there.
-    PutDataGramSize(cbLeft, UDPCache[hUDP].iStart, UDPCache[hUDP].rgbBuffer, UDPCache[hUDP].cbBuffer);
+/****************************************************************************
+  Function:
+    void UdpCacheGetStats(unsigned long * pcDataGramsCached, unsigned long * pcDataGramsDropped, unsigned long * pcbCached)
 
+  Description:
+    Returns the running totals kept by the datagram cache
 
-    // partially read datagram, free the cache if we overflow
-    fDatagramPartiallyRead = TRUE;
+  Precondition:
+ 
+  Parameters:
+    pcDataGramsCached   - receives the number of datagrams moved into a socket cache
+    pcDataGramsDropped  - receives the number of datagrams dropped for lack of room
+    pcbCached           - receives the number of payload bytes moved into a socket cache
 
-    // return how much is left in there
-    return(cbLeft);
-    }
+  Returns:
+    None
+
+  Remarks:  
+    The totals are for all sockets since the stack was started and wrap at 2^32.
+  ***************************************************************************/
+void UdpCacheGetStats(unsigned long * pcDataGramsCached, unsigned long * pcDataGramsDropped, unsigned long * pcbCached)
+{
+    *pcDataGramsCached = cUDPDataGramsCached;
+    *pcDataGramsDropped = cUDPDataGramsDropped;
+    *pcbCached = cbUDPDataGramsCached;
 }
 
 /****************************************************************************
@@ -1496,45 +1627,18 @@ unsigned short UdpClientRemoveBytesFromDataGram(byte hUDP, unsigned short cbRemo
   ***************************************************************************/
 unsigned short UdpClientPeek(byte hUDP, byte *rgbPeek, unsigned short cbPeekMax, unsigned short iIndex)
 {
-    WORD cbDataGram = 0;
-    WORD iStart = 0;
-    WORD cbRead = 0;
-
-    // not a valid request
-    if(hUDP >= MAX_UDP_SOCKETS || UDPCache[hUDP].rgbBuffer == NULL || UDPCache[hUDP].cbInUse == 0)
-    {
-        return(0);
-    }
-
-    cbDataGram = DataGramSize(UDPCache[hUDP].rgbBuffer, UDPCache[hUDP].iStart, UDPCache[hUDP].cbBuffer);
+    const byte * pbView = NULL;
+    WORD cbDataGram = UdpClientPeekView(hUDP, &pbView);
  
     // see if we are peeking with an offset
     if(iIndex >= cbDataGram)
     {
         return(0);
     }
-    else 
-    {
-        cbDataGram -= iIndex;
-    }
-   cbPeekMax = Min(cbPeekMax, cbDataGram);
-
-    // Skip the size and get to the data
-    iStart = NormalizeIndex(UDPCache[hUDP].iStart + iIndex + sizeof(WORD), UDPCache[hUDP].cbBuffer);
+    cbPeekMax = Min(cbPeekMax, cbDataGram - iIndex);
 
-    // Read what I can until the end of the buffer
-    cbRead = Min(UDPCache[hUDP].cbBuffer - iStart, cbPeekMax);
-    memcpy(rgbPeek, &UDPCache[hUDP].rgbBuffer[iStart], cbRead);
-
-    // and then from the start of the buffer read the rest
-    if(cbRead < cbPeekMax)
-    {
-        // this should calculate to zero; as we wrapping in the cache
-        iStart = NormalizeIndex(iStart + cbRead, UDPCache[hUDP].cbBuffer);
-
-        // read the rest of the data
-        memcpy(&rgbPeek[cbRead], &UDPCache[hUDP].rgbBuffer[iStart], cbPeekMax - cbRead);
-    }
+    // the datagram is contiguous in the cache, one copy does it
+    memcpy(rgbPeek, &pbView[iIndex], cbPeekMax);
 
     // return how many bytes read
     return(cbPeekMax);
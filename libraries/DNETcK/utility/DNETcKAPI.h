@@ -138,6 +138,8 @@ extern "C"
     void UdpClientEmptyNextDataGram(byte hUDP);
     unsigned short UdpClientRemoveBytesFromDataGram(byte hUDP, unsigned short cbRemove);
     unsigned short UdpClientPeek(byte hUDP, byte *rgbPeek, unsigned short cbPeekMax, unsigned short iIndex);
+    unsigned short UdpClientPeekView(byte hUDP, const byte ** ppbView);
+    void UdpCacheGetStats(unsigned long * pcDataGramsCached, unsigned long * pcDataGramsDropped, unsigned long * pcbCached);
 
     // this is a helper macro to insure that timers handle rollover conditions
     // this calcuates the difference of 32 bit counters with 
@@ -51,12 +51,14 @@
               btohexa_high(), and btohexa_low(); Optimized swapl();
               Added leftRotateDWORD()
   5.36        Updated compile time check for ultoa();
+              CalcIPChecksum() now goes through the checksum service
 
  ********************************************************************/
 #define __HELPERS_C
 
 #include <stdarg.h>
 #include "TCPIP Stack/TCPIP.h"
+#include "checksum.h"
 
 
 // Default Random Number Generator seed. 0x41FE9F9E corresponds to calling LFSRSeedRand(1)
@@ -1153,39 +1155,14 @@ DWORD swapl(DWORD v)
 	The calculated checksum.
 	
   Internal:
-	This function could be improved to do 32-bit sums on PIC32 platforms.
+	The sum is done by the checksum service, which uses 32-bit sums in
+	software or the DMA CRC generator where the part supports it.  All the
+	IP, ICMP, TCP and UDP checksums, and CalcIPBufferChecksum() in the PIC32
+	MAC driver, come through here.
   ***************************************************************************/
 WORD CalcIPChecksum(BYTE* buffer, WORD count)
 {
-	WORD i;
-	WORD *val;
-	union
-	{
-		WORD w[2];
-		DWORD dw;
-	} sum;
-
-	i = count >> 1;
-	val = (WORD*)buffer;
-
-	// Calculate the sum of all words
-	sum.dw = 0x00000000ul;
-	while(i--)
-		sum.dw += (DWORD)*val++;
-
-	// Add in the sum of the remaining byte, if present
-	if(count & 0x1)
-		sum.dw += (DWORD)*(BYTE*)val;
-
-	// Do an end-around carry (one's complement arrithmatic)
-	sum.dw = (DWORD)sum.w[0] + (DWORD)sum.w[1];
-
-	// Do another end-around carry in case if the prior add 
-	// caused a carry out
-	sum.w[0] += sum.w[1];
-
-	// Return the resulting checksum
-	return ~sum.w[0];
+	return checksum_ip(buffer, count);
 }
 
 
@@ -168,6 +168,7 @@ void UDPFlush(void);
 #endif
 
 WORD UDPIsGetReady(UDP_SOCKET s);
+UDP_SOCKET UDPGetRxSocket(void);
 BOOL UDPGet(BYTE *v);
 WORD UDPGetArray(BYTE *cData, WORD wDataLen);
 void UDPDiscard(void);
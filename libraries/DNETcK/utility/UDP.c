@@ -1067,6 +1067,33 @@ WORD UDPIsGetReady(UDP_SOCKET s)
     return UDPRxCount - wGetOffset;
 }
 
+/*****************************************************************************
+  Function:
+	UDP_SOCKET UDPGetRxSocket(void)
+
+  Summary:
+	Returns the socket that currently holds received data.
+	
+  Description:
+	Only one UDP segment is held in the MAC buffer at a time.  This function
+	returns the socket that segment was matched to so that callers do not
+	have to poll every socket with UDPIsGetReady() to find it.
+
+  Precondition:
+	UDPInit() must have been previously called.
+
+  Parameters:
+	None
+
+  Returns:
+  	The socket with pending received data, or INVALID_UDP_SOCKET if no
+  	segment is waiting.
+  ***************************************************************************/
+UDP_SOCKET UDPGetRxSocket(void)
+{
+	return SocketWithRxData;
+}
+
 /*****************************************************************************
   Function:
 	BOOL UDPGet(BYTE *v)
@@ -0,0 +1,253 @@
+/*
+  checksum.c - Checksum and CRC service with a pluggable engine
+  Released into the public domain.
+*/
+
+#include "checksum.h"
+
+#if defined(__PIC32MX__)
+  #include <p32xxxx.h>
+  #include <sys/kmem.h>
+#endif
+
+
+/****************************************************************************/
+/*   Software engine                                                        */
+/****************************************************************************/
+
+// CCITT CRC-16, LSB first (poly 0x1021 reflected = 0x8408)
+static const uint16_t crc_ccitt_table[256] = {
+  0x0000, 0x1189, 0x2312, 0x329b, 0x4624, 0x57ad, 0x6536, 0x74bf,
+  0x8c48, 0x9dc1, 0xaf5a, 0xbed3, 0xca6c, 0xdbe5, 0xe97e, 0xf8f7,
+  0x1081, 0x0108, 0x3393, 0x221a, 0x56a5, 0x472c, 0x75b7, 0x643e,
+  0x9cc9, 0x8d40, 0xbfdb, 0xae52, 0xdaed, 0xcb64, 0xf9ff, 0xe876,
+  0x2102, 0x308b, 0x0210, 0x1399, 0x6726, 0x76af, 0x4434, 0x55bd,
+  0xad4a, 0xbcc3, 0x8e58, 0x9fd1, 0xeb6e, 0xfae7, 0xc87c, 0xd9f5,
+  0x3183, 0x200a, 0x1291, 0x0318, 0x77a7, 0x662e, 0x54b5, 0x453c,
+  0xbdcb, 0xac42, 0x9ed9, 0x8f50, 0xfbef, 0xea66, 0xd8fd, 0xc974,
+  0x4204, 0x538d, 0x6116, 0x709f, 0x0420, 0x15a9, 0x2732, 0x36bb,
+  0xce4c, 0xdfc5, 0xed5e, 0xfcd7, 0x8868, 0x99e1, 0xab7a, 0xbaf3,
+  0x5285, 0x430c, 0x7197, 0x601e, 0x14a1, 0x0528, 0x37b3, 0x263a,
+  0xdecd, 0xcf44, 0xfddf, 0xec56, 0x98e9, 0x8960, 0xbbfb, 0xaa72,
+  0x6306, 0x728f, 0x4014, 0x519d, 0x2522, 0x34ab, 0x0630, 0x17b9,
+  0xef4e, 0xfec7, 0xcc5c, 0xddd5, 0xa96a, 0xb8e3, 0x8a78, 0x9bf1,
+  0x7387, 0x620e, 0x5095, 0x411c, 0x35a3, 0x242a, 0x16b1, 0x0738,
+  0xffcf, 0xee46, 0xdcdd, 0xcd54, 0xb9eb, 0xa862, 0x9af9, 0x8b70,
+  0x8408, 0x9581, 0xa71a, 0xb693, 0xc22c, 0xd3a5, 0xe13e, 0xf0b7,
+  0x0840, 0x19c9, 0x2b52, 0x3adb, 0x4e64, 0x5fed, 0x6d76, 0x7cff,
+  0x9489, 0x8500, 0xb79b, 0xa612, 0xd2ad, 0xc324, 0xf1bf, 0xe036,
+  0x18c1, 0x0948, 0x3bd3, 0x2a5a, 0x5ee5, 0x4f6c, 0x7df7, 0x6c7e,
+  0xa50a, 0xb483, 0x8618, 0x9791, 0xe32e, 0xf2a7, 0xc03c, 0xd1b5,
+  0x2942, 0x38cb, 0x0a50, 0x1bd9, 0x6f66, 0x7eef, 0x4c74, 0x5dfd,
+  0xb58b, 0xa402, 0x9699, 0x8710, 0xf3af, 0xe226, 0xd0bd, 0xc134,
+  0x39c3, 0x284a, 0x1ad1, 0x0b58, 0x7fe7, 0x6e6e, 0x5cf5, 0x4d7c,
+  0xc60c, 0xd785, 0xe51e, 0xf497, 0x8028, 0x91a1, 0xa33a, 0xb2b3,
+  0x4a44, 0x5bcd, 0x6956, 0x78df, 0x0c60, 0x1de9, 0x2f72, 0x3efb,
+  0xd68d, 0xc704, 0xf59f, 0xe416, 0x90a9, 0x8120, 0xb3bb, 0xa232,
+  0x5ac5, 0x4b4c, 0x79d7, 0x685e, 0x1ce1, 0x0d68, 0x3ff3, 0x2e7a,
+  0xe70e, 0xf687, 0xc41c, 0xd595, 0xa12a, 0xb0a3, 0x8238, 0x93b1,
+  0x6b46, 0x7acf, 0x4854, 0x59dd, 0x2d62, 0x3ceb, 0x0e70, 0x1ff9,
+  0xf78f, 0xe606, 0xd49d, 0xc514, 0xb1ab, 0xa022, 0x92b9, 0x8330,
+  0x7bc7, 0x6a4e, 0x58d5, 0x495c, 0x3de3, 0x2c6a, 0x1ef1, 0x0f78,
+};
+
+static uint16_t sw_crc_ccitt(uint16_t crc, const uint8_t *buf, uint16_t len)
+{
+  while (len-- > 0)
+    crc = (crc >> 8) ^ crc_ccitt_table[(uint8_t)(crc ^ *buf++)];
+  return crc;
+}
+
+// One's complement sum of the 16 bit words of buf (native byte order), folded
+// to 16 bits. The bulk is summed 32 bits at a time with an end around carry,
+// which gives the same result modulo 0xFFFF as summing 16 bit words.
+static uint16_t sw_ip_sum(const uint8_t *buf, uint16_t len)
+{
+  const uint16_t *p16 = (const uint16_t *)buf;
+  const uint32_t *p32;
+  uint32_t sum = 0;
+  uint32_t w;
+
+  // get to a 32 bit boundary
+  if (((uintptr_t)p16 & 2) && len >= 2) {
+    sum = *p16++;
+    len -= 2;
+  }
+
+  p32 = (const uint32_t *)p16;
+  while (len >= 16) {
+    w = p32[0]; sum += w; if (sum < w) sum++;
+    w = p32[1]; sum += w; if (sum < w) sum++;
+    w = p32[2]; sum += w; if (sum < w) sum++;
+    w = p32[3]; sum += w; if (sum < w) sum++;
+    p32 += 4;
+    len -= 16;
+  }
+  while (len >= 4) {
+    w = *p32++; sum += w; if (sum < w) sum++;
+    len -= 4;
+  }
+
+  p16 = (const uint16_t *)p32;
+  if (len >= 2) {
+    w = *p16++; sum += w; if (sum < w) sum++;
+    len -= 2;
+  }
+  if (len) {
+    w = *(const uint8_t *)p16; sum += w; if (sum < w) sum++;
+  }
+
+  sum = (sum & 0xFFFF) + (sum >> 16);
+  sum = (sum & 0xFFFF) + (sum >> 16);
+  return (uint16_t)sum;
+}
+
+const checksum_engine_t checksum_sw_engine CHECKSUM_WEAK = {
+  "software",
+  sw_crc_ccitt,
+  sw_ip_sum
+};
+
+
+/****************************************************************************/
+/*   PIC32 DMA engine                                                       */
+/****************************************************************************/
+#if defined(__PIC32MX__)
+
+#define DMA_CAT(a, b, c)   a##b##c
+#define DMA_XCAT(a, b, c)  DMA_CAT(a, b, c)
+#define DCH(reg)           DMA_XCAT(DCH, CHECKSUM_DMA_CHANNEL, reg)
+
+// largest block per transfer, DCHxSSIZ is only 8 bits on the smaller parts
+#ifndef CHECKSUM_DMA_MAX_XFER
+  #define CHECKSUM_DMA_MAX_XFER 256
+#endif
+
+static uint8_t dma_sink;         // the CRC is computed on the fly, data goes nowhere
+uint8_t checksum_dma_crc_ok CHECKSUM_WEAK = 0;   // set by the self test, shared by the copies
+uint8_t checksum_dma_ip_ok CHECKSUM_WEAK = 0;
+
+// Run buf through the DMA channel attached to the CRC generator
+static void dma_run(const uint8_t *buf, uint16_t len)
+{
+  uint16_t n;
+
+  while (len > 0) {
+    n = (len > CHECKSUM_DMA_MAX_XFER) ? CHECKSUM_DMA_MAX_XFER : len;
+
+    DCH(CON)  = 0;
+    DCH(ECON) = 0;
+    DCH(SSA)  = KVA_TO_PA(buf);
+    DCH(DSA)  = KVA_TO_PA(&dma_sink);
+    DCH(SSIZ) = n;
+    DCH(DSIZ) = 1;
+    DCH(CSIZ) = n;
+    DCH(INTCLR) = 0x00FF00FF;
+
+    DCH(CONSET)  = _DCH0CON_CHEN_MASK;
+    DCH(ECONSET) = _DCH0ECON_CFORCE_MASK;
+    while (!(DCH(INT) & _DCH0INT_CHBCIF_MASK))
+      ;
+
+    buf += n;
+    len -= n;
+  }
+  DCH(CONCLR) = _DCH0CON_CHEN_MASK;
+}
+
+static uint16_t dma_crc_ccitt(uint16_t crc, const uint8_t *buf, uint16_t len)
+{
+#if defined(_DCRCCON_BITO_MASK)
+  if (checksum_dma_crc_ok && len >= CHECKSUM_DMA_MIN_LEN) {
+    DMACONSET = _DMACON_ON_MASK;
+    DCRCCON   = ((16 - 1) << _DCRCCON_PLEN_POSITION) | _DCRCCON_BITO_MASK |
+                (CHECKSUM_DMA_CHANNEL << _DCRCCON_CRCCH_POSITION) | _DCRCCON_CRCEN_MASK;
+    DCRCXOR   = 0x1021;
+    DCRCDATA  = crc;
+    dma_run(buf, len);
+    crc = (uint16_t)DCRCDATA;
+    DCRCCONCLR = _DCRCCON_CRCEN_MASK;
+    return crc;
+  }
+#endif
+  return sw_crc_ccitt(crc, buf, len);
+}
+
+static uint16_t dma_ip_sum(const uint8_t *buf, uint16_t len)
+{
+#if defined(_DCRCCON_CRCTYP_MASK)
+  // only the parts with an IP header checksum mode in the CRC generator
+  uint16_t sum;
+
+  if (checksum_dma_ip_ok && len >= CHECKSUM_DMA_MIN_LEN && !((uintptr_t)buf & 1)) {
+    DMACONSET = _DMACON_ON_MASK;
+    DCRCCON   = _DCRCCON_CRCTYP_MASK |
+                (CHECKSUM_DMA_CHANNEL << _DCRCCON_CRCCH_POSITION) | _DCRCCON_CRCEN_MASK;
+    DCRCDATA  = 0;
+    dma_run(buf, len);
+    sum = (uint16_t)DCRCDATA;
+    DCRCCONCLR = _DCRCCON_CRCEN_MASK;
+    // the generator sums network order words, the MAL wants native order
+    return (uint16_t)((sum >> 8) | (sum << 8));
+  }
+#endif
+  return sw_ip_sum(buf, len);
+}
+
+const checksum_engine_t checksum_dma_engine CHECKSUM_WEAK = {
+  "PIC32 DMA",
+  dma_crc_ccitt,
+  dma_ip_sum
+};
+
+#endif // __PIC32MX__
+
+
+/****************************************************************************/
+/*   Service                                                                */
+/****************************************************************************/
+
+const checksum_engine_t *checksum_engine CHECKSUM_WEAK = &checksum_sw_engine;   // shared by the copies
+
+void CHECKSUM_WEAK checksum_begin(void)
+{
+#if defined(__PIC32MX__)
+  // known pattern, long enough to go through the DMA path
+  static uint32_t pattern[32];
+  const uint8_t *p = (const uint8_t *)pattern;
+  uint8_t i;
+
+  for (i = 0; i < 32; i++)
+    pattern[i] = 0x9E3779B9UL * (i + 1);
+
+  // each DMA function is only trusted once it matches the software engine
+  checksum_dma_crc_ok = 1;
+  checksum_dma_crc_ok = (dma_crc_ccitt(0xFFFF, p, sizeof(pattern)) == sw_crc_ccitt(0xFFFF, p, sizeof(pattern)));
+  checksum_dma_ip_ok = 1;
+  checksum_dma_ip_ok = (dma_ip_sum(p, sizeof(pattern)) == sw_ip_sum(p, sizeof(pattern)));
+
+  checksum_engine = &checksum_dma_engine;
+#else
+  checksum_engine = &checksum_sw_engine;
+#endif
+}
+
+void CHECKSUM_WEAK checksum_set_engine(const checksum_engine_t *e)
+{
+  checksum_engine = e;
+}
+
+const checksum_engine_t * CHECKSUM_WEAK checksum_get_engine(void)
+{
+  return checksum_engine;
+}
+
+uint16_t CHECKSUM_WEAK checksum_crc_ccitt(uint16_t crc, const uint8_t *buf, uint16_t len)
+{
+  return checksum_engine->crc_ccitt(crc, buf, len);
+}
+
+uint16_t CHECKSUM_WEAK checksum_ip(const uint8_t *buf, uint16_t len)
+{
+  return (uint16_t)~checksum_engine->ip_sum(buf, len);
+}
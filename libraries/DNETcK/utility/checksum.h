@@ -0,0 +1,91 @@
+/*
+  checksum.h - Checksum and CRC service with a pluggable engine
+  Released into the public domain.
+
+  The DNETcK IP/TCP/UDP checksums and the VirtualWire FCS go through this
+  service. Two engines are provided:
+    - checksum_sw_engine : portable software (table CRC, 32 bit IP sum),
+                           used on the host and on any MCU
+    - checksum_dma_engine: PIC32 DMA CRC engine, only built on __PIC32MX__
+  checksum_begin() picks the DMA engine if it passes a self test against
+  the software engine, so results are always identical whatever the engine.
+
+  DNETcK and VirtualWire each carry a copy of checksum.c and checksum.h in
+  their utility folder, so that their sketches need no other include: keep
+  the copies the same as libraries/Checksum. All the symbols are weak, so a
+  sketch linking several copies keeps one of each, and one engine.
+*/
+
+
+#ifndef CHECKSUM_h
+#define CHECKSUM_h
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// one definition of each symbol is kept when several copies are linked
+#define CHECKSUM_WEAK __attribute__((weak))
+
+// DMA channel used by the DMA engine, keep it free from other users
+#ifndef CHECKSUM_DMA_CHANNEL
+  #define CHECKSUM_DMA_CHANNEL 7
+#endif
+
+// Buffers shorter than this are not worth setting up a DMA transfer
+#ifndef CHECKSUM_DMA_MIN_LEN
+  #define CHECKSUM_DMA_MIN_LEN 32
+#endif
+
+typedef struct {
+  const char *name;
+  uint16_t (*crc_ccitt)(uint16_t crc, const uint8_t *buf, uint16_t len);
+  uint16_t (*ip_sum)(const uint8_t *buf, uint16_t len);
+} checksum_engine_t;
+
+extern const checksum_engine_t checksum_sw_engine;
+#if defined(__PIC32MX__)
+extern const checksum_engine_t checksum_dma_engine;
+#endif
+
+void checksum_begin(void);
+/* Description: select the fastest engine that passes the self test          */
+/* input:       none                                                          */
+/* output:      none                                                          */
+/* lib:         none                                                          */
+
+void checksum_set_engine(const checksum_engine_t *engine);
+/* Description: force an engine (e.g. checksum_sw_engine for a benchmark)     */
+/* input:       engine = engine to use from now on                            */
+/* output:      none                                                          */
+/* lib:         none                                                          */
+
+const checksum_engine_t *checksum_get_engine(void);
+/* Description: engine currently in use                                       */
+/* input:       none                                                          */
+/* output:      return = engine in use                                        */
+/* lib:         none                                                          */
+
+uint16_t checksum_crc_ccitt(uint16_t crc, const uint8_t *buf, uint16_t len);
+/* Description: CCITT CRC-16 over a buffer, same result as calling avr-libc  */
+/*              _crc_ccitt_update() on each byte (poly 0x8408, LSB first)     */
+/* input:       crc = running CRC (0xffff to start)                           */
+/*              buf = data                                                    */
+/*              len = number of bytes                                         */
+/* output:      return = updated CRC                                          */
+/* lib:         engine crc_ccitt                                              */
+
+uint16_t checksum_ip(const uint8_t *buf, uint16_t len);
+/* Description: RFC 793 checksum, same result as the MAL CalcIPChecksum()     */
+/* input:       buf = data, 16 bit aligned                                    */
+/*              len = number of bytes                                         */
+/* output:      return = one's complement of the one's complement sum         */
+/* lib:         engine ip_sum                                                 */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
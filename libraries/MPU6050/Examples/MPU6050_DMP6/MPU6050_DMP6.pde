@@ -89,16 +89,13 @@ int dmpReady = 0;  // set true if DMP init was successful
 uint8_t mpuIntStatus;   // holds actual interrupt status byte from MPU
 uint8_t ret;            // return status after each device operation (0 = success, !0 = error)
 uint16_t packetSize;    // expected DMP packet size (default is 42 bytes)
-uint16_t fifoCount;     // count of all bytes currently in FIFO
-uint8_t fifoBuffer[64]; // FIFO storage buffer
+DMPPacketBatch batch;   // packets decoded from the FIFO ring of mpu
+uint16_t overflows;     // FIFO overflows seen by mpu.dmpFIFODrain()
+uint32_t printTime;     // millis() of the last output
 
 // orientation/motion vars
 Quaternion q;           // [w, x, y, z]         quaternion container
-VectorInt16 aa;         // [x, y, z]            accel sensor measurements
-VectorInt16 aaReal;     // [x, y, z]            gravity-free accel sensor measurements
-VectorFloat gravity;    // [x, y, z]            gravity vector
 float euler[3];         // [psi, theta, phi]    Euler angle container
-float ypr[3];           // [yaw, pitch, roll]   yaw/pitch/roll container and gravity vector
 double temperature;
 
 
@@ -106,9 +103,10 @@ double temperature;
 // ===               INTERRUPT DETECTION ROUTINE                ===
 // ================================================================
 
-volatile int mpuInterrupt = 0;     // indicates whether MPU interrupt pin has gone high
+// counts the pulse: the FIFO is read by mpu.dmpFIFODrain() in loop(), Wire
+// cannot run from this handler
 void dmpDataReady() {
-    mpuInterrupt = 1;
+    mpu.dmpFIFOInterrupt();
 }
 
 
@@ -178,64 +176,37 @@ void loop() {
     // if programming failed, don't try to do anything
     if (dmpReady==0) return;
 
-    // wait for MPU interrupt or extra packet(s) available
-    while (mpuInterrupt==0 && fifoCount < packetSize) {
-        // other program behavior stuff here
-        // .
-        // .
-        // .
-        // if you are really paranoid you can frequently test in between other
-        // stuff to see if mpuInterrupt is true, and if so, "break;" from the
-        // while() loop to immediately process the MPU data
-        // .
-        // .
-        // .
-    }
-
-    // reset interrupt flag and get INT_STATUS byte
-    mpuInterrupt = 0;
-    mpuIntStatus = mpu.getIntStatus();
-
-    // get current FIFO count
-    fifoCount = mpu.getFIFOCount();
- 
-    // check for overflow (this should never happen unless our code is too inefficient)
-    if ((mpuIntStatus & 0x10) || fifoCount == 1024) {
-        // reset so we can continue cleanly
-        mpu.resetFIFO();
+    // after an INT pulse, move all the complete packets of the FIFO to the
+    // ring of mpu, in long reads; the FIFO is reset if it overflowed
+    mpu.dmpFIFODrain();
+    if (mpu.dmpGetFIFOOverflows() != overflows) {
+        overflows = mpu.dmpGetFIFOOverflows();
         Serial.println("FIFO overflow!");
+    }
 
-    // otherwise, check for DMP data ready interrupt (this should happen frequently)
-    } else if (mpuIntStatus & 0x02) {
-        // wait for correct available data length, should be a VERY short wait
-        while (fifoCount < packetSize) fifoCount = mpu.getFIFOCount();
-
-        // read a packet from FIFO
-        mpu.getFIFOBytes(fifoBuffer, packetSize);
-        Serial.print("packetSize: ");Serial.println((int)packetSize);
-        Serial.print("fifoCount: ");Serial.println((int)fifoCount);
-        Serial.print("mpuIntStatus: ");Serial.println((int)mpuIntStatus);
-        
-        // track FIFO count here in case there is > 1 packet available
-        // (this lets us immediately read more without waiting for an interrupt)
-        fifoCount -= packetSize;
+    // decode the packets of the ring in one pass, oldest first
+    while (mpu.dmpFIFODecode(&batch, MPU6050_DMP_DECODE_YPR | MPU6050_DMP_DECODE_REALACCEL) > 0) {
+        // the samples of batch are all there for the application; at 9600
+        // bauds, the last one is printed twice a second
+        if (millis() - printTime < 500) continue;
+        printTime = millis();
+        uint8_t i = batch.count - 1;
 
         #ifdef OUTPUT_READABLE_QUATERNION
             // display quaternion values in easy matrix form: w x y z
-            mpu.dmpGetQuaternion(&q, fifoBuffer);
             Serial.print("quat\t");
-            Serial.print(q.w);
+            Serial.print(batch.qw[i] / 16384.0f);
             Serial.print("\t");
-            Serial.print(q.x);
+            Serial.print(batch.qx[i] / 16384.0f);
             Serial.print("\t");
-            Serial.print(q.y);
+            Serial.print(batch.qy[i] / 16384.0f);
             Serial.print("\t");
-            Serial.println(q.z);
+            Serial.println(batch.qz[i] / 16384.0f);
         #endif
 
         #ifdef OUTPUT_READABLE_EULER
             // display Euler angles in degrees
-            mpu.dmpGetQuaternion(&q, fifoBuffer);
+            q = Quaternion(batch.qw[i] / 16384.0f, batch.qx[i] / 16384.0f, batch.qy[i] / 16384.0f, batch.qz[i] / 16384.0f);
             mpu.dmpGetEuler(euler, &q);
             Serial.print("euler\t");
             Serial.print(euler[0] * 180/M_PI);
@@ -247,31 +218,24 @@ void loop() {
 
         #ifdef OUTPUT_READABLE_YAWPITCHROLL
             // display Euler angles in degrees
-            mpu.dmpGetQuaternion(&q, fifoBuffer);
-            mpu.dmpGetGravity(&gravity, &q);
-            mpu.dmpGetYawPitchRoll(ypr, &q, &gravity);
             Serial.print("ypr\t");
-            Serial.print(ypr[0] * 180/M_PI);
+            Serial.print(batch.yaw[i] * 180/M_PI);
             Serial.print("\t");
-            Serial.print(ypr[1] * 180/M_PI);
+            Serial.print(batch.pitch[i] * 180/M_PI);
             Serial.print("\t");
-            Serial.println(ypr[2] * 180/M_PI);
+            Serial.println(batch.roll[i] * 180/M_PI);
         #endif
 
         #ifdef OUTPUT_READABLE_REALACCEL
             // display real acceleration, adjusted to remove gravity
-            mpu.dmpGetQuaternion(&q, fifoBuffer);
-            mpu.dmpGetAccel(&aa, fifoBuffer);
-            mpu.dmpGetGravity(&gravity, &q);
-            mpu.dmpGetLinearAccel(&aaReal, &aa, &gravity);
             Serial.print("areal\t");
-            Serial.print(aaReal.x);
+            Serial.print((int)batch.rx[i]);
             Serial.print("\t");
-            Serial.print(aaReal.y);
+            Serial.print((int)batch.ry[i]);
             Serial.print("\t");
-            Serial.println(aaReal.z);
+            Serial.println((int)batch.rz[i]);
         #endif
-        delay(1000);
-
     }
-}
\ No newline at end of file
+
+    // other program behavior stuff here
+}
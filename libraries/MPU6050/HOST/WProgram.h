@@ -0,0 +1,69 @@
+/*
+  WProgram.h - MPIDE 0023 core API for the HOST build of the MPU6050 library
+
+  Stands in for the chipKIT core when the library is compiled on a PC with
+  -DHOST -IHOST. Time is the host_us of host.h, Serial counts its bytes and
+  the MPU6050 is the model of host_hal.cpp behind Wire.
+*/
+
+#ifndef WProgram_h
+#define WProgram_h
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "host.h"
+
+#define F_CPU 80000000L
+
+#define HIGH 0x1
+#define LOW  0x0
+#define CHANGE  2
+#define FALLING 3
+#define RISING  4
+
+#define DEC 10
+#define HEX 16
+
+#define min(a,b) ((a)<(b)?(a):(b))
+#define max(a,b) ((a)>(b)?(a):(b))
+
+#define PROGMEM
+#define pgm_read_byte(addr) (*(const uint8_t *)(addr))
+
+typedef uint8_t byte;
+typedef uint8_t boolean;
+
+unsigned long millis(void);
+unsigned long micros(void);
+void delay(unsigned long ms);
+
+// the handler is called by host_mpu_fifo_push(), as the INT pin of the MPU6050 would
+void attachInterrupt(uint8_t irq, void (*handler)(void), int mode);
+void detachInterrupt(uint8_t irq);
+
+class HardwareSerial {
+  public:
+    void begin(unsigned long baud);
+    void print(const char *s);
+    void print(char c);
+    void print(int n, int base = DEC);
+    void print(unsigned int n, int base = DEC);
+    void print(long n, int base = DEC);
+    void print(unsigned long n, int base = DEC);
+    void print(double n, int digits = 2);
+    void println(void);
+    void println(const char *s);
+    void println(char c);
+    void println(int n, int base = DEC);
+    void println(unsigned int n, int base = DEC);
+    void println(long n, int base = DEC);
+    void println(unsigned long n, int base = DEC);
+    void println(double n, int digits = 2);
+};
+
+extern HardwareSerial Serial;
+
+#endif
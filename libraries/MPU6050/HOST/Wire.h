@@ -0,0 +1,25 @@
+/*
+  Wire.h - I2C master of the MPIDE 0023 core for the HOST build of the MPU6050
+  library: the transfers go to the MPU6050 model of host_hal.cpp and are
+  counted in host_i2c.
+*/
+
+#ifndef TwoWire_h
+#define TwoWire_h
+
+#include <stdint.h>
+
+class TwoWire {
+  public:
+    void begin();
+    void beginTransmission(uint8_t address);
+    void send(uint8_t data);
+    uint8_t endTransmission(void);
+    uint8_t requestFrom(uint8_t address, uint8_t quantity);
+    uint8_t available(void);
+    uint8_t receive(void);
+};
+
+extern TwoWire Wire;
+
+#endif
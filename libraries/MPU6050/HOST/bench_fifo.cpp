@@ -0,0 +1,296 @@
+/*
+  bench_fifo.cpp - the FIFO engine of MPU6050_6Axis_MotionApps20.h against the
+  loop of the MPU6050_DMP6 example, on the PC
+
+  The DMP puts a 42 byte packet in the FIFO of the MPU6050 model at the rate
+  of -r, while the sketch spends -l us per loop() on its other work, and
+  Wire takes the time of its bytes at the bus clock of -c:
+    example  loop() of MPU6050_DMP6.pde, kept below without its prints: the
+             INT flag, getIntStatus(), getFIFOCount(), one getFIFOBytes() and
+             the dmpGet...() calls of the quaternion, yaw/pitch/roll and real
+             accel outputs per interrupt
+    engine   dmpFIFODrain() and dmpFIFODecode(MPU6050_DMP_DECODE_YPR |
+             MPU6050_DMP_DECODE_REALACCEL)
+  The gyro Z of a packet is its number + 1: each sample decoded is checked
+  against the dmpGet...() calls on the packet it came from. Then the decoding
+  alone of both is timed over all the packets, best of -p passes.
+
+  bench_fifo [-t seconds] [-r Hz] [-l us] [-c Hz] [-s seed] [-p passes]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <chrono>
+
+#include "WProgram.h"
+#include "MPU6050_6Axis_MotionApps20.h"
+
+typedef std::chrono::steady_clock host_clock;
+
+static MPU6050 mpu;
+
+static uint8_t  *packets;                // all the packets of the run, by number
+static uint32_t  packetCount, packetNext;
+
+static void putBE32(uint8_t *p, int32_t v) {
+  p[0] = (uint32_t)v >> 24; p[1] = (uint32_t)v >> 16; p[2] = (uint32_t)v >> 8; p[3] = v;
+}
+
+static double noise(double amplitude) {
+  return amplitude * (2.0 * rand() / RAND_MAX - 1.0);
+}
+
+// yaw turning at 20deg/s, pitch and roll swinging, with the gyro and the accel of the motion
+static void makePackets(uint32_t seconds, uint32_t rate) {
+  packetCount = seconds * rate;
+  packets = (uint8_t *)calloc(packetCount, MPU6050_DMP_PACKET_SIZE);
+  for (uint32_t i = 0; i < packetCount; i++) {
+    double t = (double)i / rate;
+    double yaw = 20.0 * M_PI / 180 * t - M_PI;
+    double pitch = 0.5 * sin(2 * M_PI * 0.3 * t) + noise(0.01);
+    double roll = 0.4 * sin(2 * M_PI * 0.7 * t + 1.0) + noise(0.01);
+    double cy = cos(yaw / 2), sy = sin(yaw / 2), cp = cos(pitch / 2), sp = sin(pitch / 2);
+    double cr = cos(roll / 2), sr = sin(roll / 2);
+    double q[4] = {cr * cp * cy + sr * sp * sy, sr * cp * cy - cr * sp * sy,
+                   cr * sp * cy + sr * cp * sy, cr * cp * sy - sr * sp * cy};
+    uint8_t *p = packets + i * MPU6050_DMP_PACKET_SIZE;
+    for (uint8_t k = 0; k < 4; k++) putBE32(p + 4 * k, (int32_t)lround(q[k] * 1073741824.0 * 0.999));  // Q30
+    putBE32(p + 16, (int32_t)(int16_t)(noise(300)) << 16);
+    putBE32(p + 20, (int32_t)(int16_t)(noise(300)) << 16);
+    putBE32(p + 24, (int32_t)(uint16_t)(i + 1) << 16);               // gyro Z: the packet number + 1
+    putBE32(p + 28, (int32_t)(int16_t)(4096 * sin(pitch) + noise(200)) << 16);
+    putBE32(p + 32, (int32_t)(int16_t)(4096 * sin(roll) + noise(200)) << 16);
+    putBE32(p + 36, (int32_t)(int16_t)(4096 * cos(pitch) * cos(roll) + noise(200)) << 16);
+  }
+}
+
+// the DMP of the model, zeros after the last packet
+static const uint8_t *dmpPacket(void) {
+  return packetNext < packetCount ? packets + packetNext++ * MPU6050_DMP_PACKET_SIZE : NULL;
+}
+
+/***************           the samples of a run           ********************/
+typedef struct {
+  const char *name;
+  uint32_t samples, bad, overflows;
+  int32_t  lastNumber;
+  uint32_t outOfOrder;
+  host_i2c_t i2c;
+  uint32_t delayMs, serialBytes, busUs;
+} run_t;
+
+static run_t *run;
+
+// the outputs of the example for the packet: the reference of the check
+static void reference(const uint8_t *packet, Quaternion *q, float ypr[3], VectorInt16 *aaReal) {
+  VectorInt16 aa;
+  VectorFloat gravity;
+  mpu.dmpGetQuaternion(q, packet);
+  mpu.dmpGetGravity(&gravity, q);
+  mpu.dmpGetYawPitchRoll(ypr, q, &gravity);
+  mpu.dmpGetAccel(&aa, packet);
+  mpu.dmpGetLinearAccel(aaReal, &aa, &gravity);
+}
+
+static void sample(int16_t gz, const float q[4], const float ypr[3], const int16_t real[3]) {
+  if (gz == 0) return;                   // a packet of zeros, after the last one
+  uint16_t number = (uint16_t)gz - 1;
+  run->samples++;
+  if (number >= packetCount) { run->bad++; return; }
+  if ((int32_t)number <= run->lastNumber) run->outOfOrder++;
+  run->lastNumber = number;
+
+  Quaternion rq;
+  float rypr[3];
+  VectorInt16 rreal;
+  reference(packets + number * MPU6050_DMP_PACKET_SIZE, &rq, rypr, &rreal);
+  if (q[0] != rq.w || q[1] != rq.x || q[2] != rq.y || q[3] != rq.z
+      || ypr[0] != rypr[0] || ypr[1] != rypr[1] || ypr[2] != rypr[2]
+      || real[0] != rreal.x || real[1] != rreal.y || real[2] != rreal.z) run->bad++;
+}
+
+/***************      loop() of the MPU6050_DMP6 example      ****************/
+static volatile int mpuInterrupt = 0;
+static uint16_t fifoCount;
+static uint8_t fifoBuffer[64];
+
+static void dmpDataReady() { mpuInterrupt = 1; }
+
+// OUTPUT_READABLE_QUATERNION, OUTPUT_READABLE_YAWPITCHROLL and OUTPUT_READABLE_REALACCEL
+static void exampleDecode(const uint8_t *packet, Quaternion *q, float ypr[3], VectorInt16 *aaReal) {
+  VectorInt16 aa;
+  VectorFloat gravity;
+  mpu.dmpGetQuaternion(q, packet);
+  mpu.dmpGetQuaternion(q, packet);
+  mpu.dmpGetGravity(&gravity, q);
+  mpu.dmpGetYawPitchRoll(ypr, q, &gravity);
+  mpu.dmpGetQuaternion(q, packet);
+  mpu.dmpGetAccel(&aa, packet);
+  mpu.dmpGetGravity(&gravity, q);
+  mpu.dmpGetLinearAccel(aaReal, &aa, &gravity);
+}
+
+static void exampleLoop(void) {
+  uint16_t packetSize = mpu.dmpGetFIFOPacketSize();
+  Quaternion q;
+  VectorInt16 aaReal;
+  float ypr[3];
+
+  if (mpuInterrupt == 0 && fifoCount < packetSize) return;
+  mpuInterrupt = 0;
+  uint8_t mpuIntStatus = mpu.getIntStatus();
+  fifoCount = mpu.getFIFOCount();
+  if ((mpuIntStatus & 0x10) || fifoCount == 1024) {
+    mpu.resetFIFO();
+    run->overflows++;
+  } else if (mpuIntStatus & 0x02) {
+    while (fifoCount < packetSize) fifoCount = mpu.getFIFOCount();
+    mpu.getFIFOBytes(fifoBuffer, packetSize);
+    fifoCount -= packetSize;
+    exampleDecode(fifoBuffer, &q, ypr, &aaReal);
+
+    int16_t gyro[3];
+    mpu.dmpGetGyro(gyro, fifoBuffer);
+    float qf[4] = {q.w, q.x, q.y, q.z};
+    int16_t real[3] = {aaReal.x, aaReal.y, aaReal.z};
+    sample(gyro[2], qf, ypr, real);
+  }
+}
+
+/***************              the FIFO engine             ********************/
+static void engineISR() { mpu.dmpFIFOInterrupt(); }
+
+static void engineLoop(void) {
+  static DMPPacketBatch batch;
+  mpu.dmpFIFODrain();
+  uint8_t n = mpu.dmpFIFODecode(&batch, MPU6050_DMP_DECODE_YPR | MPU6050_DMP_DECODE_REALACCEL);
+  for (uint8_t i = 0; i < n; i++) {
+    float qf[4] = {batch.qw[i] / 16384.0f, batch.qx[i] / 16384.0f, batch.qy[i] / 16384.0f, batch.qz[i] / 16384.0f};
+    float ypr[3] = {batch.yaw[i], batch.pitch[i], batch.roll[i]};
+    int16_t real[3] = {batch.rx[i], batch.ry[i], batch.rz[i]};
+    sample(batch.gz[i], qf, ypr, real);
+  }
+  run->overflows = mpu.dmpGetFIFOOverflows();
+}
+
+/***************                    run                   ********************/
+static void flight(run_t *r, void (*isr)(void), void (*loop)(void), uint32_t loopUs) {
+  run = r;
+  r->lastNumber = -1;
+  mpu.setDMPEnabled(false);
+  mpu.dmpFIFOReset();
+  fifoCount = 0;
+  mpuInterrupt = 0;
+  packetNext = 0;
+  attachInterrupt(3, isr, FALLING);
+  mpu.setDMPEnabled(true);
+  mpu.getIntStatus();
+  host_i2c_clear();
+
+  while (packetNext < packetCount) {
+    loop();
+    host_us += loopUs;                                               // the rest of loop()
+    host_mpu_time();
+  }
+  r->i2c = host_i2c;
+  r->delayMs = host_delay_ms;
+  r->serialBytes = host_serial_bytes;
+  r->busUs = (uint32_t)((9.0 * host_i2c.bytes + 2.0 * host_i2c.transactions) * 1e6 / host_i2c_clock);
+}
+
+static void report(const run_t *r) {
+  double n = r->samples ? r->samples : 1;
+  printf("%-8s %7u %6u %4u %5u %9.2f %9.1f %8.0f %8.2f %9.1f\n", r->name, r->samples,
+         packetCount - r->samples, r->bad + r->outOfOrder, r->overflows, r->i2c.transactions / n,
+         r->i2c.bytes / n, r->busUs / n, r->delayMs / n, r->serialBytes / n);
+}
+
+// the decoding alone, ns per packet: the engine gets its ring filled by 8 packets
+static void decodeTime(uint8_t passes, double *exampleNs, double *engineNs) {
+  static DMPPacketBatch batch;
+  static volatile float sink;
+  Quaternion q;
+  VectorInt16 aaReal;
+  float ypr[3];
+
+  mpu.setDMPEnabled(false);
+  mpu.dmpFIFOReset();
+  attachInterrupt(3, engineISR, FALLING);
+  *exampleNs = *engineNs = 1e30;
+  for (uint8_t pass = 0; pass < passes; pass++) {
+    host_clock::time_point t0 = host_clock::now();
+    for (uint32_t i = 0; i < packetCount; i++) {
+      exampleDecode(packets + i * MPU6050_DMP_PACKET_SIZE, &q, ypr, &aaReal);
+      sink = ypr[0] + aaReal.x;
+    }
+    double ns = std::chrono::duration<double, std::nano>(host_clock::now() - t0).count();
+    if (ns < *exampleNs) *exampleNs = ns;
+
+    ns = 0;
+    for (uint32_t i = 0; i + MPU6050_DMP_RING_PACKETS <= packetCount; i += MPU6050_DMP_RING_PACKETS) {
+      host_mpu_fifo_push(packets + i * MPU6050_DMP_PACKET_SIZE, MPU6050_DMP_RING_PACKETS * MPU6050_DMP_PACKET_SIZE);
+      mpu.dmpFIFODrain();
+      t0 = host_clock::now();
+      mpu.dmpFIFODecode(&batch, MPU6050_DMP_DECODE_YPR | MPU6050_DMP_DECODE_REALACCEL);
+      sink = batch.yaw[0] + batch.rx[0];
+      ns += std::chrono::duration<double, std::nano>(host_clock::now() - t0).count();
+    }
+    if (ns < *engineNs) *engineNs = ns;
+  }
+  (void)sink;   // read once: the decoded values are only there to keep the decoding
+  *exampleNs /= packetCount;
+  *engineNs /= packetCount - packetCount % MPU6050_DMP_RING_PACKETS;
+}
+
+int main(int argc, char **argv) {
+  uint32_t seconds = 60, rate = 100, loopUs = 2000, seed = 1, passes = 5;
+  int c;
+
+  while ((c = getopt(argc, argv, "t:r:l:c:s:p:h")) != -1) {
+    switch (c) {
+      case 't': seconds = atoi(optarg); break;
+      case 'r': rate = atoi(optarg); break;
+      case 'l': loopUs = atoi(optarg); break;
+      case 'c': host_i2c_clock = atoi(optarg); break;
+      case 's': seed = atoi(optarg); break;
+      case 'p': passes = atoi(optarg); break;
+      default:
+        fprintf(stderr, "bench_fifo [-t seconds] [-r Hz] [-l us] [-c Hz] [-s seed] [-p passes]\n");
+        return 2;
+    }
+  }
+  if (seconds * rate > 65535 || seconds * rate < MPU6050_DMP_RING_PACKETS || host_i2c_clock == 0) {
+    fprintf(stderr, "bench_fifo: 8 to 65535 packets\n");
+    return 2;
+  }
+  srand(seed);
+  makePackets(seconds, rate);
+  host_dmp_period_us = 1000000 / rate;
+
+  host_mpu_reset();
+  mpu.initialize();
+  if (mpu.dmpInitialize() != 0) {
+    fprintf(stderr, "bench_fifo: dmpInitialize() failed\n");
+    return 1;
+  }
+  host_dmp_packet = dmpPacket;
+
+  run_t example = {"example"}, engine = {"engine"};
+  flight(&example, dmpDataReady, exampleLoop, loopUs);
+  flight(&engine, engineISR, engineLoop, loopUs);
+  double exampleNs, engineNs;
+  decodeTime(passes, &exampleNs, &engineNs);
+
+  printf("%us of DMP packets at %uHz, %uus of other work per loop(), I2C at %ukHz\n\n",
+         seconds, rate, loopUs, host_i2c_clock / 1000);
+  printf("                         bad  FIFO    ----------------- per sample -----------------\n");
+  printf("         samples   lost      reset  transfers     bytes   bus us  delay ms  Serial B\n");
+  report(&example);
+  report(&engine);
+  printf("\ndecoding per packet on the PC: example %.0fns, engine %.0fns\n", exampleNs, engineNs);
+
+  int ok = engine.bad == 0 && engine.outOfOrder == 0 && engine.overflows == 0 && engine.samples + 8 >= packetCount;
+  printf("\nengine: %s\n", ok ? "ok" : "FAILED");
+  return ok ? 0 : 1;
+}
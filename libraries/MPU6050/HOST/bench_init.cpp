@@ -0,0 +1,130 @@
+/*
+  bench_init.cpp - the register shadow of MPU6050.cpp on the start of the
+  MPU6050, on the PC
+
+  initialize() then dmpInitialize() of MPU6050_6Axis_MotionApps20.h, from the
+  power up state of the MPU6050 model, then a switch from the DMP to the raw
+  sensors through the FIFO (14 setters), with the I2C clock of -c:
+    read-modify-write  setRegisterShadowEnabled(false): each bit update reads
+                       its register before writing it, as I2Cdev::writeBits()
+    shadow             the register shadow, the default
+  The registers and the DMP memory of the model are compared after both:
+  exit status 1 if they differ or if dmpInitialize() fails.
+
+  bench_init [-c Hz]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "WProgram.h"
+#include "MPU6050_6Axis_MotionApps20.h"
+
+static MPU6050 mpu;
+
+typedef struct {
+  const char *name;
+  uint8_t     status;              // of dmpInitialize()
+  host_i2c_t  i2c[3];              // initialize(), dmpInitialize(), the switch
+  uint32_t    delayMs[3];
+  uint32_t    serialBytes[3];
+  uint32_t    us[3];
+  uint8_t     reg[128];            // the model after the start
+  uint8_t     mem[32][256];
+} run_t;
+
+static void measure(run_t *r, uint8_t phase, uint32_t t0) {
+  r->i2c[phase] = host_i2c;
+  r->delayMs[phase] = host_delay_ms;
+  r->serialBytes[phase] = host_serial_bytes;
+  r->us[phase] = host_us - t0;
+}
+
+// gyro at 2000deg/s and accel at 8g into the FIFO at 200Hz, data ready interrupt
+static void rawSensors(void) {
+  mpu.setDMPEnabled(false);
+  mpu.setFIFOEnabled(false);
+  mpu.resetFIFO();
+  mpu.setDLPFMode(MPU6050_DLPF_BW_42);
+  mpu.setRate(4);
+  mpu.setFullScaleGyroRange(MPU6050_GYRO_FS_2000);
+  mpu.setFullScaleAccelRange(MPU6050_ACCEL_FS_8);
+  mpu.setXGyroFIFOEnabled(true);
+  mpu.setYGyroFIFOEnabled(true);
+  mpu.setZGyroFIFOEnabled(true);
+  mpu.setAccelFIFOEnabled(true);
+  mpu.setInterruptLatch(true);
+  mpu.setIntDataReadyEnabled(true);
+  mpu.setFIFOEnabled(true);
+}
+
+static void start(run_t *r, bool shadow) {
+  host_mpu_reset();
+  memset(host_mpu_mem, 0, sizeof(host_mpu_mem));
+  mpu.setRegisterShadowEnabled(shadow);
+
+  host_i2c_clear();
+  uint32_t t0 = host_us;
+  mpu.initialize();
+  measure(r, 0, t0);
+
+  host_i2c_clear();
+  t0 = host_us;
+  r->status = mpu.dmpInitialize();
+  measure(r, 1, t0);
+
+  host_i2c_clear();
+  t0 = host_us;
+  rawSensors();
+  measure(r, 2, t0);
+
+  memcpy(r->reg, host_mpu_reg, sizeof(r->reg));
+  memcpy(r->mem, host_mpu_mem, sizeof(r->mem));
+  r->reg[MPU6050_RA_INT_STATUS] = 0;                 // the DMP packets until the switch
+}
+
+static void report(const run_t *r) {
+  static const char *phases[3] = {"initialize()", "dmpInitialize()", "raw sensors"};
+  for (uint8_t i = 0; i < 3; i++) {
+    const host_i2c_t *c = &r->i2c[i];
+    uint32_t busUs = (uint32_t)((9.0 * c->bytes + 2.0 * c->transactions) * 1e6 / host_i2c_clock);
+    printf("%-18s %-16s %6u %6u %7u %8.1f %8u %8u %8.1f\n", i ? "" : r->name, phases[i],
+           c->transactions, c->reads, c->bytes, busUs / 1000.0, r->delayMs[i], r->serialBytes[i],
+           r->us[i] / 1000.0);
+  }
+}
+
+int main(int argc, char **argv) {
+  int c;
+
+  while ((c = getopt(argc, argv, "c:h")) != -1) {
+    switch (c) {
+      case 'c': host_i2c_clock = atoi(optarg); break;
+      default:
+        fprintf(stderr, "bench_init [-c Hz]\n");
+        return 2;
+    }
+  }
+  if (host_i2c_clock == 0) {
+    fprintf(stderr, "bench_init: -c 0\n");
+    return 2;
+  }
+
+  static run_t rmw = {"read-modify-write"}, shadow = {"shadow"};
+  start(&rmw, false);
+  start(&shadow, true);
+
+  printf("I2C at %ukHz\n\n", host_i2c_clock / 1000);
+  printf("                                    transfers   reads   bytes   bus ms delay ms Serial B  time ms\n");
+  report(&rmw);
+  report(&shadow);
+
+  int same = memcmp(rmw.reg, shadow.reg, sizeof(rmw.reg)) == 0 && memcmp(rmw.mem, shadow.mem, sizeof(rmw.mem)) == 0;
+  int ok = rmw.status == 0 && shadow.status == 0 && same;
+  printf("\ndmpInitialize(): %u, %u; registers and DMP memory %s\n", rmw.status, shadow.status,
+         same ? "the same" : "DIFFERENT");
+  printf("shadow: %s\n", ok ? "ok" : "FAILED");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,118 @@
+/*
+  bench_upload.cpp - the upload of the DMP memory of MPU6050_6Axis_MotionApps20.h
+  to the MPU6050 model, on the PC
+
+  dmpMemory[] and dmpConfig[], with the I2C clock of -c:
+    writeMemoryBlock   writeProgMemoryBlock() and writeProgDMPConfigurationSet():
+                       16 byte chunks, the bank and the address set for each,
+                       each chunk read back
+    upload             uploadMemoryBlock() and uploadDMPConfigurationSet()
+    upload, no verify  the same without the read back
+  The DMP memory of the model must be the same after each. Then a byte of the
+  memory misses its write: the paths that verify must fail.
+  Exit status 1 if one of the checks fails.
+
+  bench_upload [-c Hz]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "WProgram.h"
+#include "MPU6050_6Axis_MotionApps20.h"
+
+static MPU6050 mpu;
+
+typedef struct {
+  const char *name;
+  uint8_t     path;                // 0: writeMemoryBlock, 1: upload, 2: upload without verify
+  uint8_t     status;              // both parts written (and verified)
+  host_i2c_t  i2c;
+  uint32_t    delayMs;
+  uint32_t    us;
+} run_t;
+
+static uint8_t reference[32][256];
+
+static bool upload(uint8_t path) {
+  if (path == 0)
+    return mpu.writeProgMemoryBlock(dmpMemory, MPU6050_DMP_CODE_SIZE, 0, 0, true)
+        && mpu.writeProgDMPConfigurationSet(dmpConfig, MPU6050_DMP_CONFIG_SIZE);
+  return mpu.uploadMemoryBlock(dmpMemory, MPU6050_DMP_CODE_SIZE, 0, 0, path == 1, true)
+      && mpu.uploadDMPConfigurationSet(dmpConfig, MPU6050_DMP_CONFIG_SIZE, path == 1, true);
+}
+
+static void run(run_t *r) {
+  host_mpu_reset();
+  memset(host_mpu_mem, 0, sizeof(host_mpu_mem));
+  mpu.invalidateRegisterShadow();
+  host_i2c_clear();
+  uint32_t t0 = host_us;
+  r->status = upload(r->path);
+  r->i2c = host_i2c;
+  r->delayMs = host_delay_ms;
+  r->us = host_us - t0;
+}
+
+static void report(const run_t *r) {
+  uint32_t busUs = (uint32_t)((9.0 * r->i2c.bytes + 2.0 * r->i2c.transactions) * 1e6 / host_i2c_clock);
+  printf("%-18s %9u %7u %7u %8.1f %8u %8.1f\n", r->name, r->i2c.transactions, r->i2c.reads,
+         r->i2c.bytes, busUs / 1000.0, r->delayMs, r->us / 1000.0);
+}
+
+int main(int argc, char **argv) {
+  int c;
+
+  while ((c = getopt(argc, argv, "c:h")) != -1) {
+    switch (c) {
+      case 'c': host_i2c_clock = atoi(optarg); break;
+      default:
+        fprintf(stderr, "bench_upload [-c Hz]\n");
+        return 2;
+    }
+  }
+  if (host_i2c_clock == 0) {
+    fprintf(stderr, "bench_upload: -c 0\n");
+    return 2;
+  }
+
+  run_t runs[3] = {{"writeMemoryBlock", 0}, {"upload", 1}, {"upload, no verify", 2}};
+  int ok = 1;
+  printf("dmpMemory[] (%u bytes) and dmpConfig[] (%u bytes), I2C at %ukHz\n\n",
+         MPU6050_DMP_CODE_SIZE, MPU6050_DMP_CONFIG_SIZE, host_i2c_clock / 1000);
+  printf("                   transfers   reads   bytes   bus ms delay ms  time ms\n");
+  for (uint8_t i = 0; i < 3; i++) {
+    run(&runs[i]);
+    report(&runs[i]);
+    if (i == 0) memcpy(reference, host_mpu_mem, sizeof(reference));
+    if (!runs[i].status || memcmp(reference, host_mpu_mem, sizeof(reference)) != 0) {
+      printf("  %s: %s\n", runs[i].name, runs[i].status ? "DMP memory DIFFERENT" : "FAILED");
+      ok = 0;
+    }
+  }
+
+  // the last byte of the code that is not 0, then the first byte of the configuration
+  int32_t stuck[2];
+  uint16_t last = MPU6050_DMP_CODE_SIZE - 1;
+  while (last > 0 && dmpMemory[last] == 0) last--;
+  stuck[0] = last;
+  uint16_t block = 0;
+  while (dmpConfig[block + 2] == 0 || dmpConfig[block + 3] == 0) block += 3 + (dmpConfig[block + 2] ? dmpConfig[block + 2] : 1);
+  stuck[1] = dmpConfig[block] << 8 | dmpConfig[block + 1];
+  printf("\na memory byte missing its write, verified:");
+  for (uint8_t k = 0; k < 2; k++) {
+    for (uint8_t i = 0; i < 2; i++) {
+      host_mpu_mem_stuck = stuck[k];
+      run(&runs[i]);
+      host_mpu_mem_stuck = -1;
+      printf(" %s %s", runs[i].name, runs[i].status ? "PASSED" : "failed");
+      if (runs[i].status) ok = 0;
+    }
+    printf(k ? "\n" : ";");
+  }
+
+  printf("\nupload: %s\n", ok ? "ok" : "FAILED");
+  return ok ? 0 : 1;
+}
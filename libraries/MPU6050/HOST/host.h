@@ -0,0 +1,39 @@
+/*
+  host.h - what the host programs of HOST/ drive in the MPU6050 library
+*/
+
+#ifndef HOST_H_
+#define HOST_H_
+
+#include <stdint.h>
+#include <stdio.h>
+
+// I2C traffic of Wire, counted since the last host_i2c_clear()
+typedef struct {
+  uint32_t transactions;   // START to STOP: a register address written, or a read
+  uint32_t reads;          // the read transactions
+  uint32_t bytes;          // on the bus, the address bytes included
+} host_i2c_t;
+
+extern uint32_t   host_us;            // micros() of the target; delay() and the I2C transfers move it
+extern uint32_t   host_i2c_clock;     // bus clock in Hz, 100kHz by default: the time of the transfers
+extern host_i2c_t host_i2c;
+extern uint32_t   host_delay_ms;      // delay() since the last host_i2c_clear()
+extern uint32_t   host_serial_bytes;  // bytes printed on Serial since the last host_i2c_clear()
+extern uint8_t    host_echo;          // 1: Serial prints to stdout
+
+void host_i2c_clear(void);
+
+// the MPU6050: the registers, the DMP memory banks, the 1024 byte FIFO and the INT pin
+extern uint8_t  host_mpu_reg[128];
+extern uint8_t  host_mpu_mem[32][256];
+extern uint32_t host_dmp_period_us;                 // packet period of the DMP, 10000 by default
+extern const uint8_t *(*host_dmp_packet)(void);     // the next 42 byte packet of the DMP, NULL: zeros
+extern int32_t  host_mpu_mem_stuck;                 // bank << 8 | address of a memory byte the writes miss, -1: none
+
+void host_mpu_reset(void);
+void host_mpu_time(void);       // with DMP_EN and FIFO_EN, the packets due at host_us; delay() and Wire call it
+void host_mpu_fifo_push(const uint8_t *data, uint16_t n);   // DMP_INT, FIFO_OFLOW and the INT pulse
+uint16_t host_mpu_fifo_count(void);
+
+#endif /* HOST_H_ */
@@ -0,0 +1,192 @@
+/*
+  host_hal.cpp - the chipKIT core and the MPU6050 for the HOST build of the
+  MPU6050 library
+*/
+
+#include <stdio.h>
+
+#include "WProgram.h"
+#include "Wire.h"
+
+uint32_t   host_us = 0;
+uint32_t   host_i2c_clock = 100000;
+host_i2c_t host_i2c;
+uint32_t   host_delay_ms = 0;
+uint32_t   host_serial_bytes = 0;
+uint8_t    host_echo = 0;
+uint8_t    host_mpu_reg[128];
+uint8_t    host_mpu_mem[32][256];
+uint32_t   host_dmp_period_us = 10000;
+const uint8_t *(*host_dmp_packet)(void) = NULL;
+int32_t    host_mpu_mem_stuck = -1;
+
+HardwareSerial Serial;
+TwoWire Wire;
+
+static void (*intHandler)(void);
+
+unsigned long micros(void) { return host_us; }
+unsigned long millis(void) { return host_us / 1000; }
+void delay(unsigned long ms) {
+  host_us += ms * 1000;
+  host_delay_ms += ms;
+  host_mpu_time();
+}
+void attachInterrupt(uint8_t irq, void (*handler)(void), int mode) { intHandler = handler; }
+void detachInterrupt(uint8_t irq) { intHandler = NULL; }
+
+void host_i2c_clear(void) {
+  memset(&host_i2c, 0, sizeof(host_i2c));
+  host_delay_ms = 0;
+  host_serial_bytes = 0;
+}
+
+/***************                  MPU6050                 ********************/
+#define MPU_INT_STATUS  0x3A
+#define MPU_USER_CTRL   0x6A
+#define MPU_PWR_MGMT_1  0x6B
+#define MPU_BANK_SEL    0x6D
+#define MPU_MEM_ADDR    0x6E
+#define MPU_MEM_R_W     0x6F
+#define MPU_FIFO_COUNTH 0x72
+#define MPU_FIFO_COUNTL 0x73
+#define MPU_FIFO_R_W    0x74
+#define MPU_WHO_AM_I    0x75
+
+#define MPU_DMP_FIFO    0xC0            // USER_CTRL: DMP_EN and FIFO_EN
+
+static uint8_t  fifo[1024];
+static uint16_t fifoTail, fifoCount;
+static uint32_t dmpDueUs;
+
+// the DMP memory is kept: dmpInitialize() loads it after the reset
+void host_mpu_reset(void) {
+  memset(host_mpu_reg, 0, sizeof(host_mpu_reg));
+  host_mpu_reg[MPU_PWR_MGMT_1] = 0x40;   // sleeping
+  host_mpu_reg[MPU_WHO_AM_I]   = 0x68;
+  fifoTail = fifoCount = 0;
+}
+
+void host_mpu_time(void) {
+  static const uint8_t zeros[42] = {0};
+  if ((host_mpu_reg[MPU_USER_CTRL] & MPU_DMP_FIFO) != MPU_DMP_FIFO) return;
+  while ((int32_t)(host_us - dmpDueUs) >= 0) {
+    const uint8_t *packet = host_dmp_packet ? host_dmp_packet() : NULL;
+    host_mpu_fifo_push(packet ? packet : zeros, sizeof(zeros));
+    dmpDueUs += host_dmp_period_us;
+  }
+}
+
+uint16_t host_mpu_fifo_count(void) { return fifoCount; }
+
+// full, the FIFO keeps the newest bytes: the packets read after it are no longer aligned
+void host_mpu_fifo_push(const uint8_t *data, uint16_t n) {
+  uint8_t status = 0x02;                 // DMP_INT
+  while (n--) {
+    if (fifoCount == sizeof(fifo)) { fifoTail = (fifoTail + 1) & 1023; fifoCount--; status |= 0x10; }  // FIFO_OFLOW
+    fifo[(fifoTail + fifoCount++) & 1023] = *data++;
+  }
+  host_mpu_reg[MPU_INT_STATUS] |= status;
+  if (intHandler) intHandler();
+}
+
+static uint8_t mpuRead(uint8_t reg) {
+  uint8_t v;
+  switch (reg) {
+    case MPU_INT_STATUS:  v = host_mpu_reg[reg]; host_mpu_reg[reg] = 0; return v;   // cleared by the read
+    case MPU_FIFO_COUNTH: return fifoCount >> 8;
+    case MPU_FIFO_COUNTL: return fifoCount & 0xFF;
+    case MPU_MEM_R_W:     return host_mpu_mem[host_mpu_reg[MPU_BANK_SEL] & 0x1F][host_mpu_reg[MPU_MEM_ADDR]++];
+    case MPU_FIFO_R_W:
+      if (fifoCount == 0) return 0;
+      v = fifo[fifoTail];
+      fifoTail = (fifoTail + 1) & 1023;
+      fifoCount--;
+      return v;
+    default:              return host_mpu_reg[reg & 0x7F];
+  }
+}
+
+static void mpuWrite(uint8_t reg, uint8_t v) {
+  switch (reg) {
+    case MPU_USER_CTRL:
+      if (v & 0x04) fifoTail = fifoCount = 0;                  // FIFO_RESET
+      if ((v & ~host_mpu_reg[reg] & MPU_DMP_FIFO) != 0) dmpDueUs = host_us + host_dmp_period_us;
+      host_mpu_reg[reg] = v & ~0x0F;                           // the reset bits clear themselves
+      break;
+    case MPU_MEM_R_W:
+      if (((host_mpu_reg[MPU_BANK_SEL] & 0x1F) << 8 | host_mpu_reg[MPU_MEM_ADDR]) != host_mpu_mem_stuck)
+        host_mpu_mem[host_mpu_reg[MPU_BANK_SEL] & 0x1F][host_mpu_reg[MPU_MEM_ADDR]] = v;
+      host_mpu_reg[MPU_MEM_ADDR]++;
+      break;
+    case MPU_PWR_MGMT_1:
+      if (v & 0x80) host_mpu_reset();                          // DEVICE_RESET
+      else host_mpu_reg[reg] = v;
+      break;
+    case MPU_FIFO_R_W:
+      break;
+    default:
+      host_mpu_reg[reg & 0x7F] = v;
+  }
+}
+
+// the register address goes on after each byte, except on FIFO_R_W and MEM_R_W
+static uint8_t mpuNext(uint8_t reg) { return reg == MPU_FIFO_R_W || reg == MPU_MEM_R_W ? reg : reg + 1; }
+
+/***************                   Wire                   ********************/
+static uint8_t  wireReg, wireFirst, wireSent;
+static uint8_t  wireRx[256], wireRxCount, wireRxNext;
+static uint32_t wireBusNs;
+
+// START, the bytes of 8 bits and an ACK, STOP
+static void wireTransaction(uint16_t bytes) {
+  host_i2c.transactions++;
+  host_i2c.bytes += bytes;
+  wireBusNs += (uint32_t)((9ULL * bytes + 2) * 1000000000ULL / host_i2c_clock);
+  host_us += wireBusNs / 1000;
+  wireBusNs %= 1000;
+  host_mpu_time();
+}
+
+void TwoWire::begin() { }
+void TwoWire::beginTransmission(uint8_t address) { wireFirst = 1; wireSent = 0; }
+void TwoWire::send(uint8_t data) {
+  if (wireFirst) wireReg = data;             // the register address, then the values written
+  else { mpuWrite(wireReg, data); wireReg = mpuNext(wireReg); }
+  wireFirst = 0;
+  wireSent++;
+}
+uint8_t TwoWire::endTransmission(void) { wireTransaction(1 + wireSent); return 0; }
+uint8_t TwoWire::requestFrom(uint8_t address, uint8_t quantity) {
+  for (uint8_t i = 0; i < quantity; i++) { wireRx[i] = mpuRead(wireReg); wireReg = mpuNext(wireReg); }
+  wireRxCount = quantity;
+  wireRxNext = 0;
+  host_i2c.reads++;
+  wireTransaction(1 + quantity);
+  return quantity;
+}
+uint8_t TwoWire::available(void) { return wireRxCount - wireRxNext; }
+uint8_t TwoWire::receive(void) { return wireRxNext < wireRxCount ? wireRx[wireRxNext++] : 0; }
+
+/***************                   Serial                 ********************/
+static void serialOut(const char *s) {
+  host_serial_bytes += strlen(s);
+  if (host_echo) fputs(s, stdout);
+}
+
+void HardwareSerial::begin(unsigned long baud) { }
+void HardwareSerial::print(const char *s) { serialOut(s); }
+void HardwareSerial::print(char c) { char s[2] = {c, 0}; serialOut(s); }
+void HardwareSerial::print(int n, int base) { print((long)n, base); }
+void HardwareSerial::print(unsigned int n, int base) { print((unsigned long)n, base); }
+void HardwareSerial::print(long n, int base) { char s[24]; snprintf(s, sizeof(s), base == HEX ? "%lX" : "%ld", n); serialOut(s); }
+void HardwareSerial::print(unsigned long n, int base) { char s[24]; snprintf(s, sizeof(s), base == HEX ? "%lX" : "%lu", n); serialOut(s); }
+void HardwareSerial::print(double n, int digits) { char s[48]; snprintf(s, sizeof(s), "%.*f", digits, n); serialOut(s); }
+void HardwareSerial::println(void) { print("\r\n"); }
+void HardwareSerial::println(const char *s) { print(s); println(); }
+void HardwareSerial::println(char c) { print(c); println(); }
+void HardwareSerial::println(int n, int base) { print(n, base); println(); }
+void HardwareSerial::println(unsigned int n, int base) { print(n, base); println(); }
+void HardwareSerial::println(long n, int base) { print(n, base); println(); }
+void HardwareSerial::println(unsigned long n, int base) { print(n, base); println(); }
+void HardwareSerial::println(double n, int digits) { print(n, digits); println(); }
@@ -398,6 +398,8 @@ THE SOFTWARE.
 
 #define BUFFER_LENGTH   32
 
+#define MPU6050_SHADOW_SIZE             0x78    // registers 0x00 to WHO_AM_I, multiple of 8
+
 
 class I2Cdev {
     public:
@@ -426,6 +428,31 @@ class I2Cdev {
 
 // note: DMP code memory blocks defined at end of header file
 
+// FIFO engine of MotionApps 2.0: the packets drained on the INT pin into a ring
+// of the object, then decoded by batches (MPU6050_6Axis_MotionApps20.h). Defined
+// in every build, as the ring members of the class
+#define MPU6050_DMP_PACKET_SIZE         42
+#define MPU6050_DMP_RING_PACKETS        8       // power of 2
+#define MPU6050_FIFO_SIZE               1024
+
+#define MPU6050_DMP_DECODE_YPR          0x01    // yaw[], pitch[], roll[] of the batch
+#define MPU6050_DMP_DECODE_REALACCEL    0x02    // rx[], ry[], rz[] of the batch
+
+// one field per array, one entry per packet
+struct DMPPacketBatch {
+    uint8_t count;
+    int16_t qw[MPU6050_DMP_RING_PACKETS], qx[MPU6050_DMP_RING_PACKETS];    // quaternion, 1.0 = 16384
+    int16_t qy[MPU6050_DMP_RING_PACKETS], qz[MPU6050_DMP_RING_PACKETS];
+    int16_t gx[MPU6050_DMP_RING_PACKETS], gy[MPU6050_DMP_RING_PACKETS];    // gyro, as dmpGetGyro()
+    int16_t gz[MPU6050_DMP_RING_PACKETS];
+    int16_t ax[MPU6050_DMP_RING_PACKETS], ay[MPU6050_DMP_RING_PACKETS];    // accel, as dmpGetAccel()
+    int16_t az[MPU6050_DMP_RING_PACKETS];
+    int16_t rx[MPU6050_DMP_RING_PACKETS], ry[MPU6050_DMP_RING_PACKETS];    // accel without gravity, as dmpGetLinearAccel()
+    int16_t rz[MPU6050_DMP_RING_PACKETS];
+    float yaw[MPU6050_DMP_RING_PACKETS], pitch[MPU6050_DMP_RING_PACKETS];  // radians, as dmpGetYawPitchRoll()
+    float roll[MPU6050_DMP_RING_PACKETS];
+};
+
 class MPU6050 {
     public:
         MPU6050();
@@ -434,6 +461,12 @@ class MPU6050 {
         void initialize();
         bool testConnection();
 
+        // register shadow
+        bool getRegisterShadowEnabled();
+        void setRegisterShadowEnabled(bool enabled);
+        void invalidateRegisterShadow();
+        void invalidateRegister(uint8_t regAddr);
+
         // AUX_VDDIO register
         uint8_t getAuxVDDIOLevel();
         void setAuxVDDIOLevel(uint8_t level);
@@ -796,6 +829,10 @@ class MPU6050 {
         bool writeDMPConfigurationSet(const uint8_t *data, uint16_t dataSize, bool useProgMem=false);
         bool writeProgDMPConfigurationSet(const uint8_t *data, uint16_t dataSize);
 
+        // DMP upload: writes of BUFFER_LENGTH - 1 bytes, one read back with a CRC
+        bool uploadMemoryBlock(const uint8_t *data, uint16_t dataSize, uint8_t bank=0, uint8_t address=0, bool verify=true, bool useProgMem=false);
+        bool uploadDMPConfigurationSet(const uint8_t *data, uint16_t dataSize, bool verify=true, bool useProgMem=false);
+
         // DMP_CFG_1 register
         uint8_t getDMPConfig1();
         void setDMPConfig1(uint8_t config);
@@ -804,11 +841,13 @@ class MPU6050 {
         uint8_t getDMPConfig2();
         void setDMPConfig2(uint8_t config);
 
+        // declared in every build: MPU6050.cpp is compiled without the MotionApps
+        // defines and must see the members of the class at the same offsets
+        uint8_t *dmpPacketBuffer;
+        uint16_t dmpPacketSize;
+
         // special methods for MotionApps 2.0 implementation
         #ifdef MPU6050_INCLUDE_DMP_MOTIONAPPS20
-            uint8_t *dmpPacketBuffer;
-            uint16_t dmpPacketSize;
-
             uint8_t dmpInitialize();
             bool dmpPacketAvailable();
 
@@ -903,13 +942,17 @@ class MPU6050 {
             uint32_t dmpGetAccelSumOfSquare();
             void dmpOverrideQuaternion(long *q);
             uint16_t dmpGetFIFOPacketSize();
+
+            // FIFO engine
+            void dmpFIFOInterrupt();
+            void dmpFIFOReset();
+            uint8_t dmpFIFODrain();
+            uint8_t dmpFIFODecode(DMPPacketBatch *batch, uint8_t fields=0);
+            uint16_t dmpGetFIFOOverflows();
         #endif
 
         // special methods for MotionApps 4.1 implementation
         #ifdef MPU6050_INCLUDE_DMP_MOTIONAPPS41
-            uint8_t *dmpPacketBuffer;
-            uint16_t dmpPacketSize;
-
             uint8_t dmpInitialize();
             bool dmpPacketAvailable();
 
@@ -1010,6 +1053,33 @@ class MPU6050 {
     private:
         uint8_t devAddr;
         uint8_t buffer[14];
+
+        // shadow of the registers, one valid bit per register: the bit updates of
+        // the setters are single writes once a register is known, and the writes
+        // that would not change it are skipped
+        uint8_t regShadow[MPU6050_SHADOW_SIZE];
+        uint8_t regShadowValid[MPU6050_SHADOW_SIZE / 8];
+        bool regShadowEnabled;
+
+        bool readShadow(uint8_t regAddr, uint8_t *data);
+        void keepShadow(uint8_t regAddr, uint8_t data);
+        bool isShadowed(uint8_t regAddr, uint8_t data);
+        bool writeRegBit(uint8_t regAddr, uint8_t bitNum, uint8_t data);
+        bool writeRegBits(uint8_t regAddr, uint8_t bitStart, uint8_t length, uint8_t data);
+        bool writeReg(uint8_t regAddr, uint8_t data);
+        bool writeRegWord(uint8_t regAddr, uint16_t data);
+
+        bool writeMemoryPosition(uint8_t bankSel, uint8_t address);
+        bool streamMemoryBlock(const uint8_t *data, uint16_t dataSize, uint8_t bank, uint8_t address, bool useProgMem, bool readBack, uint16_t *position, uint16_t *crc);
+
+        // ring of the MotionApps 2.0 FIFO engine: declared in every build, as dmpPacketBuffer,
+        // and zeroed by the constructors
+        uint8_t dmpRing[MPU6050_DMP_RING_PACKETS * MPU6050_DMP_PACKET_SIZE];
+        uint8_t dmpRingHead, dmpRingTail;       // packets written, packets decoded
+        volatile uint8_t dmpIntPulses;          // counted by dmpFIFOInterrupt()
+        uint8_t dmpIntSeen;                     // pulses dmpFIFODrain() answered
+        uint8_t dmpFIFOLeft;                    // packets left in the FIFO by a full ring
+        uint16_t dmpFIFOOverflows;
 };
 
 #endif /* _MPU6050_H_ */
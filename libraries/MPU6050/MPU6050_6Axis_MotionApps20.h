@@ -72,6 +72,12 @@ THE SOFTWARE.
 #define MPU6050_DMP_CONFIG_SIZE     192     // dmpConfig[]
 #define MPU6050_DMP_UPDATES_SIZE    47      // dmpUpdates[]
 
+// dmpInitialize() reads the DMP memory back once after its upload, checked by
+// a CRC; define it false before including this file for a quicker, unchecked start
+#ifndef MPU6050_DMP_UPLOAD_VERIFY
+#define MPU6050_DMP_UPLOAD_VERIFY   true
+#endif
+
 /* ================================================================================================ *
  | Default MotionApps v2.0 42-byte FIFO packet structure:                                           |
  |                                                                                                  |
@@ -332,14 +338,14 @@ uint8_t MPU6050::dmpInitialize() {
     DEBUG_PRINT(("Writing DMP code to MPU memory banks ("));
     DEBUG_PRINT(MPU6050_DMP_CODE_SIZE);
     DEBUG_PRINTLN((" bytes)"));
-    if (writeProgMemoryBlock(dmpMemory, (uint16_t)MPU6050_DMP_CODE_SIZE,(uint8_t)0,(uint8_t)0, (bool)true)) {
+    if (uploadMemoryBlock(dmpMemory, MPU6050_DMP_CODE_SIZE, 0, 0, MPU6050_DMP_UPLOAD_VERIFY, true)) {
         DEBUG_PRINTLN(("Success! DMP code written and verified."));
 
         // write DMP configuration
         DEBUG_PRINT(("Writing DMP configuration to MPU memory banks ("));
         DEBUG_PRINT(MPU6050_DMP_CONFIG_SIZE);
         DEBUG_PRINTLN((" bytes in config def)"));
-        if (writeProgDMPConfigurationSet(dmpConfig, (uint16_t)MPU6050_DMP_CONFIG_SIZE)) {
+        if (uploadDMPConfigurationSet(dmpConfig, MPU6050_DMP_CONFIG_SIZE, MPU6050_DMP_UPLOAD_VERIFY, true)) {
             DEBUG_PRINTLN(("Success! DMP configuration written and verified."));
 
             DEBUG_PRINTLN(("Setting clock source to Z Gyro..."));
@@ -381,11 +387,11 @@ uint8_t MPU6050::dmpInitialize() {
             uint8_t dmpUpdate[16], j;
             uint16_t pos = 0;
             for (j = 0; j < 4 || j < dmpUpdate[2] + 3; j++, pos++) dmpUpdate[j] = pgm_read_byte(&dmpUpdates[pos]);
-            writeMemoryBlock(dmpUpdate + 3, dmpUpdate[2], dmpUpdate[0], dmpUpdate[1]);
+            uploadMemoryBlock(dmpUpdate + 3, dmpUpdate[2], dmpUpdate[0], dmpUpdate[1], MPU6050_DMP_UPLOAD_VERIFY);
 
             DEBUG_PRINTLN(("Writing final memory update 2/7 (function unknown)..."));
             for (j = 0; j < 4 || j < dmpUpdate[2] + 3; j++, pos++) dmpUpdate[j] = pgm_read_byte(&dmpUpdates[pos]);
-            writeMemoryBlock(dmpUpdate + 3, dmpUpdate[2], dmpUpdate[0], dmpUpdate[1]);
+            uploadMemoryBlock(dmpUpdate + 3, dmpUpdate[2], dmpUpdate[0], dmpUpdate[1], MPU6050_DMP_UPLOAD_VERIFY);
 
             DEBUG_PRINTLN(("Resetting FIFO..."));
             resetFIFO();
@@ -424,15 +430,15 @@ uint8_t MPU6050::dmpInitialize() {
 
             DEBUG_PRINTLN(("Writing final memory update 3/7 (function unknown)..."));
             for (j = 0; j < 4 || j < dmpUpdate[2] + 3; j++, pos++) dmpUpdate[j] = pgm_read_byte(&dmpUpdates[pos]);
-            writeMemoryBlock(dmpUpdate + 3, dmpUpdate[2], dmpUpdate[0], dmpUpdate[1]);
+            uploadMemoryBlock(dmpUpdate + 3, dmpUpdate[2], dmpUpdate[0], dmpUpdate[1], MPU6050_DMP_UPLOAD_VERIFY);
 
             DEBUG_PRINTLN(("Writing final memory update 4/7 (function unknown)..."));
             for (j = 0; j < 4 || j < dmpUpdate[2] + 3; j++, pos++) dmpUpdate[j] = pgm_read_byte(&dmpUpdates[pos]);
-            writeMemoryBlock(dmpUpdate + 3, dmpUpdate[2], dmpUpdate[0], dmpUpdate[1]);
+            uploadMemoryBlock(dmpUpdate + 3, dmpUpdate[2], dmpUpdate[0], dmpUpdate[1], MPU6050_DMP_UPLOAD_VERIFY);
 
             DEBUG_PRINTLN(("Writing final memory update 5/7 (function unknown)..."));
             for (j = 0; j < 4 || j < dmpUpdate[2] + 3; j++, pos++) dmpUpdate[j] = pgm_read_byte(&dmpUpdates[pos]);
-            writeMemoryBlock(dmpUpdate + 3, dmpUpdate[2], dmpUpdate[0], dmpUpdate[1]);
+            uploadMemoryBlock(dmpUpdate + 3, dmpUpdate[2], dmpUpdate[0], dmpUpdate[1], MPU6050_DMP_UPLOAD_VERIFY);
 
             DEBUG_PRINTLN(("Waiting for FIFO count > 2..."));
             while ((fifoCount = getFIFOCount()) < 3);
@@ -469,7 +475,7 @@ uint8_t MPU6050::dmpInitialize() {
 
             DEBUG_PRINTLN(("Writing final memory update 7/7 (function unknown)..."));
             for (j = 0; j < 4 || j < dmpUpdate[2] + 3; j++, pos++) dmpUpdate[j] = pgm_read_byte(&dmpUpdates[pos]);
-            writeMemoryBlock(dmpUpdate + 3, dmpUpdate[2], dmpUpdate[0], dmpUpdate[1]);
+            uploadMemoryBlock(dmpUpdate + 3, dmpUpdate[2], dmpUpdate[0], dmpUpdate[1], MPU6050_DMP_UPLOAD_VERIFY);
 
             DEBUG_PRINTLN(("DMP is good to go! Finally."));
 
@@ -477,11 +483,11 @@ uint8_t MPU6050::dmpInitialize() {
             setDMPEnabled(false);
 
             DEBUG_PRINTLN(("Setting up internal 42-byte (default) DMP packet buffer..."));
-            dmpPacketSize = 42;
+            dmpPacketSize = MPU6050_DMP_PACKET_SIZE;
 
 
             DEBUG_PRINTLN(("Resetting FIFO and clearing INT status one last time..."));
-            resetFIFO();
+            dmpFIFOReset();
             getIntStatus();
         } else {
             DEBUG_PRINTLN(("ERROR! DMP configuration verification failed."));
@@ -685,4 +691,115 @@ uint16_t MPU6050::dmpGetFIFOPacketSize() {
     return dmpPacketSize;
 }
 
+/* FIFO engine
+ *
+ * The INT pin pulses at each packet the DMP puts in the FIFO. The handler
+ * given to attachInterrupt() only calls dmpFIFOInterrupt(), which counts the
+ * pulse: Wire runs on the I2C interrupt and cannot be used from another
+ * handler. dmpFIFODrain(), from loop(), then reads FIFO_COUNT once and every
+ * complete packet in long reads into the ring, without the INT_STATUS read and
+ * the count polling of each packet in the DMP6 example, and dmpFIFODecode()
+ * decodes what the ring holds in one pass.
+ *
+ *     void dmpDataReady() { mpu.dmpFIFOInterrupt(); }
+ *     ...
+ *     attachInterrupt(3, dmpDataReady, FALLING);
+ *     ...
+ *     mpu.dmpFIFODrain();
+ *     while (mpu.dmpFIFODecode(&batch, MPU6050_DMP_DECODE_YPR)) ...
+ */
+void MPU6050::dmpFIFOInterrupt() {
+    dmpIntPulses++;
+}
+/** Reset the FIFO and empty the ring.
+ */
+void MPU6050::dmpFIFOReset() {
+    resetFIFO();
+    dmpRingHead = dmpRingTail = 0;
+    dmpIntSeen = dmpIntPulses;
+    dmpFIFOLeft = 0;
+}
+/** Move the complete packets of the FIFO to the ring.
+ * Nothing is read unless an INT pulse came, or a full ring left packets in
+ * the FIFO at the last call. A FIFO that overflowed dropped its oldest bytes:
+ * the packet boundaries are lost, it is reset and the overflow counted.
+ * @return Packets moved to the ring
+ */
+uint8_t MPU6050::dmpFIFODrain() {
+    uint8_t pulses = dmpIntPulses;
+    if (pulses == dmpIntSeen && dmpFIFOLeft == 0) return 0;
+    dmpIntSeen = pulses;
+
+    uint16_t count = getFIFOCount();
+    if (count > MPU6050_FIFO_SIZE - MPU6050_FIFO_SIZE % MPU6050_DMP_PACKET_SIZE) {
+        dmpFIFOReset();
+        dmpFIFOOverflows++;
+        return 0;
+    }
+    uint8_t packets = count / MPU6050_DMP_PACKET_SIZE, moved = 0;
+    while (packets > 0) {
+        uint8_t space = MPU6050_DMP_RING_PACKETS - (uint8_t)(dmpRingHead - dmpRingTail);
+        if (space == 0) break; // the rest waits in the FIFO for dmpFIFODecode()
+        uint8_t slot = dmpRingHead & (MPU6050_DMP_RING_PACKETS - 1);
+        uint8_t n = min(packets, space);
+        n = min(n, MPU6050_DMP_RING_PACKETS - slot); // contiguous in the ring
+        n = min(n, 127 / MPU6050_DMP_PACKET_SIZE);    // readBytes() counts in an int8_t
+        getFIFOBytes(dmpRing + slot * MPU6050_DMP_PACKET_SIZE, n * MPU6050_DMP_PACKET_SIZE);
+        dmpRingHead += n;
+        packets -= n;
+        moved += n;
+    }
+    dmpFIFOLeft = packets;
+    return moved;
+}
+/** Decode the packets of the ring, oldest first.
+ * The quaternion, gyro and accel are always decoded; the gravity vector is
+ * computed once per packet for the fields asked.
+ * @param batch Arrays of the decoded packets, batch->count of them
+ * @param fields MPU6050_DMP_DECODE_YPR and/or MPU6050_DMP_DECODE_REALACCEL
+ * @return Packets decoded, 0 when the ring is empty
+ */
+uint8_t MPU6050::dmpFIFODecode(DMPPacketBatch *batch, uint8_t fields) {
+    uint8_t n = 0;
+    for (; dmpRingTail != dmpRingHead; dmpRingTail++, n++) {
+        const uint8_t *packet = dmpRing + (dmpRingTail & (MPU6050_DMP_RING_PACKETS - 1)) * MPU6050_DMP_PACKET_SIZE;
+        int16_t qw = (packet[0] << 8) + packet[1], qx = (packet[4] << 8) + packet[5];
+        int16_t qy = (packet[8] << 8) + packet[9], qz = (packet[12] << 8) + packet[13];
+        int16_t ax = (packet[28] << 8) + packet[29], ay = (packet[32] << 8) + packet[33];
+        int16_t az = (packet[36] << 8) + packet[37];
+        batch -> qw[n] = qw;
+        batch -> qx[n] = qx;
+        batch -> qy[n] = qy;
+        batch -> qz[n] = qz;
+        batch -> gx[n] = (packet[16] << 8) + packet[17];
+        batch -> gy[n] = (packet[20] << 8) + packet[21];
+        batch -> gz[n] = (packet[24] << 8) + packet[25];
+        batch -> ax[n] = ax;
+        batch -> ay[n] = ay;
+        batch -> az[n] = az;
+        if (fields == 0) continue;
+
+        // dmpGetQuaternion() and dmpGetGravity()
+        float w = qw / 16384.0f, x = qx / 16384.0f, y = qy / 16384.0f, z = qz / 16384.0f;
+        float gravX = 2 * (x*z - w*y);
+        float gravY = 2 * (w*x + y*z);
+        float gravZ = w*w - x*x - y*y + z*z;
+        if (fields & MPU6050_DMP_DECODE_YPR) {
+            batch -> yaw[n]   = atan2(2*x*y - 2*w*z, 2*w*w + 2*x*x - 1);
+            batch -> pitch[n] = atan(gravX / sqrt(gravY*gravY + gravZ*gravZ));
+            batch -> roll[n]  = atan(gravY / sqrt(gravX*gravX + gravZ*gravZ));
+        }
+        if (fields & MPU6050_DMP_DECODE_REALACCEL) {
+            batch -> rx[n] = ax - gravX*4096;
+            batch -> ry[n] = ay - gravY*4096;
+            batch -> rz[n] = az - gravZ*4096;
+        }
+    }
+    batch -> count = n;
+    return n;
+}
+uint16_t MPU6050::dmpGetFIFOOverflows() {
+    return dmpFIFOOverflows;
+}
+
 #endif /* _MPU6050_6AXIS_MOTIONAPPS20_H_ */
@@ -0,0 +1,243 @@
+#if defined(ARDUINO) && ARDUINO >= 100
+#include "Arduino.h"
+#else
+#include "WProgram.h"
+#endif
+
+#include "config.h"
+#include "def.h"
+#include "types.h"
+#include "MultiWii.h"
+
+#if defined(BLACKBOX)
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+#include <peripheral/nvm.h>
+#ifdef __cplusplus
+}
+#endif
+#include <sys/kmem.h>
+
+/*
+  Flight recorder: while armed, every BLACKBOX_RATE cycles, the fields below are coded into a RAM ring,
+  which blackboxFlush() writes to BLACKBOX_PAGES pages of program flash, one word at a time, in the
+  interleaving delay of computeIMU() and within BLACKBOX_FLUSH_US at the end of the cycle.
+
+  Log, the flights one after the other from the last erase, read with MSP_BLACKBOX_READ:
+    'H' version rate fields names       at arming: names comma separated, 0 terminated
+    'I' value * fields                  zigzag varint of each field
+    'P' delta * fields                  zigzag varint of each field minus its value in the frame before
+    'E' frames dropped                  at disarming, varints, then 0xFF up to the next flash word
+  A frame is an 'I' one every BLACKBOX_IFRAME frames and after dropped frames, the decoder can start
+  again from there. tools/blackbox_decode.py turns the log into CSV files.
+*/
+
+#define BLACKBOX_IFRAME  32
+#define BLACKBOX_WORDS   (BLACKBOX_PAGES * 1024UL)
+#define BLACKBOX_WORD_US 25   // flash word write, before it is measured
+
+#define BLACKBOX_FIELDS  (23 + NUMBER_MOTOR)
+static const char blackboxNames[] PROGMEM =
+  "loopIteration,time,rcCommand[0],rcCommand[1],rcCommand[2],rcCommand[3],"
+  "gyroData[0],gyroData[1],gyroData[2],accSmooth[0],accSmooth[1],accSmooth[2],angle[0],angle[1],"
+  "axisP[0],axisI[0],axisD[0],axisP[1],axisI[1],axisD[1],axisP[2],axisI[2],axisD[2]";
+
+// the log pages: zeros in the program image, erased at the first boot
+#if defined(SITL)
+  static uint32_t bbFlash[BLACKBOX_WORDS] __attribute__ ((aligned(4096)));
+#else
+  static const uint32_t bbFlash[BLACKBOX_WORDS] __attribute__ ((aligned(4096))) = {0};
+#endif
+#define BB_FLASH ((const volatile uint32_t *)KVA0_TO_KVA1(bbFlash)) // reads see the words written since boot
+
+blackbox_t blackbox;
+int16_t blackboxPID[3][3];
+
+static uint8_t bbRing[BLACKBOX_RING];
+static uint16_t bbHead, bbTail;           // bbTail is always on a flash word
+static uint32_t bbWrite;                  // next flash word
+static int32_t bbLast[BLACKBOX_FIELDS];
+static uint32_t bbIteration;
+static uint8_t bbUntilI;                  // frames until the next 'I' one, 0: next one
+
+uint16_t blackboxPending() {
+  return (bbHead - bbTail) & (BLACKBOX_RING - 1);
+}
+
+static uint16_t bbRoom() {
+  return BLACKBOX_RING - 1 - ((bbHead - bbTail) & (BLACKBOX_RING - 1));
+}
+
+static void bbPut(uint8_t c) {
+  bbRing[bbHead] = c;
+  bbHead = (bbHead + 1) & (BLACKBOX_RING - 1);
+}
+
+static uint8_t *bbVarint(uint8_t *p, uint32_t v) {
+  while (v >= 0x80) {
+    *p++ = v | 0x80;
+    v >>= 7;
+  }
+  *p++ = v;
+  return p;
+}
+
+static uint8_t *bbSigned(uint8_t *p, int32_t v) {
+  return bbVarint(p, (v << 1) ^ (v >> 31));  // zigzag: small values of both signs stay short
+}
+
+static void bbCapture(int32_t *v) {
+  uint8_t n = 0, i;
+  v[n++] = bbIteration;
+  v[n++] = currentTime;
+  for (i = 0; i < 4; i++) v[n++] = rcCommand[i];
+  for (i = 0; i < 3; i++) v[n++] = imu.gyroData[i];
+  for (i = 0; i < 3; i++) v[n++] = imu.accSmooth[i];
+  for (i = 0; i < 2; i++) v[n++] = att.angle[i];
+  for (i = 0; i < 3; i++) {
+    v[n++] = blackboxPID[i][0];
+    v[n++] = blackboxPID[i][1];
+    v[n++] = blackboxPID[i][2];
+  }
+  for (i = 0; i < NUMBER_MOTOR; i++) v[n++] = motor[i];
+}
+
+static void bbBegin() {
+  uint8_t i;
+  if (bbRoom() < sizeof(blackboxNames) + 12 * NUMBER_MOTOR + 8) return; // the last flight is still in the ring: next cycle
+  blackbox.state = (blackbox.state & BLACKBOX_FULL) | BLACKBOX_RECORDING;
+  blackbox.frames = blackbox.dropped = 0;
+  blackbox.ringMax = blackbox.logMax = blackbox.flushMax = 0;
+  bbIteration = 0;
+  bbUntilI = 0;
+  bbPut('H');
+  bbPut(BLACKBOX_VERSION);
+  bbPut(BLACKBOX_RATE);
+  bbPut(BLACKBOX_FIELDS);
+  for (const char *c = blackboxNames; pgm_read_byte(c); c++) bbPut(pgm_read_byte(c));
+  for (i = 0; i < NUMBER_MOTOR; i++) {
+    bbPut(','); bbPut('m'); bbPut('o'); bbPut('t'); bbPut('o'); bbPut('r'); bbPut('[');
+    bbPut('0' + i); bbPut(']');
+  }
+  bbPut(0);
+}
+
+static void bbEnd() {
+  uint8_t buf[12], *p = buf;
+  blackbox.state &= ~BLACKBOX_RECORDING;
+  *p++ = 'E';
+  p = bbVarint(p, blackbox.frames);
+  p = bbVarint(p, blackbox.dropped);
+  for (uint8_t *q = buf; q < p; q++) bbPut(*q);  // the frames leave 12 bytes for it
+  while (bbHead & 3) bbPut(0xFF);
+}
+
+// at the end of each cycle: a frame every BLACKBOX_RATE cycles while armed
+void blackboxLog() {
+  static uint8_t rate = 0;
+  int32_t v[BLACKBOX_FIELDS];
+  uint8_t frame[1 + 5 * BLACKBOX_FIELDS], *p = frame, i;
+
+  if (f.ARMED && !(blackbox.state & BLACKBOX_RECORDING)) {
+    bbBegin();
+    if (!(blackbox.state & BLACKBOX_RECORDING)) return;
+    rate = 0;
+  } else if (!f.ARMED) {
+    if (blackbox.state & BLACKBOX_RECORDING) bbEnd();
+    return;
+  }
+  bbIteration++;
+  if (rate++) {
+    if (rate >= BLACKBOX_RATE) rate = 0;
+    return;
+  }
+  if (rate >= BLACKBOX_RATE) rate = 0;
+
+  uint16_t start = micros();
+  if (blackbox.state & BLACKBOX_FULL) {
+    blackbox.dropped++;
+    return;
+  }
+  bbCapture(v);
+  if (bbUntilI == 0) {
+    *p++ = 'I';
+    for (i = 0; i < BLACKBOX_FIELDS; i++) p = bbSigned(p, v[i]);
+    bbUntilI = BLACKBOX_IFRAME;
+  } else {
+    *p++ = 'P';
+    for (i = 0; i < BLACKBOX_FIELDS; i++) p = bbSigned(p, v[i] - bbLast[i]);
+  }
+  uint16_t n = p - frame;
+  if (n > bbRoom() - 12) {                // keep room for the 'E' frame
+    blackbox.dropped++;
+    blackbox.state |= BLACKBOX_OVERRUN;
+    bbUntilI = 0;                         // the next frame must not depend on this one
+  } else {
+    for (i = 0; i < n; i++) bbPut(frame[i]);
+    memcpy(bbLast, v, sizeof(bbLast));
+    bbUntilI--;
+    blackbox.frames++;
+  }
+  uint16_t fill = BLACKBOX_RING - 1 - bbRoom();
+  if (fill > blackbox.ringMax) blackbox.ringMax = fill;
+  uint16_t t = (uint16_t)micros() - start;
+  if (t > blackbox.logMax) blackbox.logMax = t;
+}
+
+// write flash words from the ring while the next one ends before spacing us after start
+void blackboxFlush(uint32_t start, uint16_t spacing) {
+  uint16_t begin = (uint16_t)micros() - start, now = begin;
+
+  while (blackboxPending() >= 4 && now + blackbox.wordCost <= spacing) {
+    uint32_t w = bbRing[bbTail] | (uint32_t)bbRing[bbTail + 1] << 8 | (uint32_t)bbRing[bbTail + 2] << 16
+                 | (uint32_t)bbRing[bbTail + 3] << 24;
+    bbTail = (bbTail + 4) & (BLACKBOX_RING - 1);
+    if (bbWrite >= BLACKBOX_WORDS) {
+      blackbox.state |= BLACKBOX_FULL;  // what is left in the ring is lost
+      continue;
+    }
+    NVMWriteWord((void *)&bbFlash[bbWrite++], w);
+    blackbox.used += 4;
+    uint16_t t = (uint16_t)micros() - start;
+    uint16_t cost = min(t - now, 4 * BLACKBOX_WORD_US);  // an interrupt in the write is not flash time
+    if (cost > blackbox.wordCost) blackbox.wordCost = cost;
+    else blackbox.wordCost -= (blackbox.wordCost - cost) >> 6;  // slow decay, as the task costs of the loop
+    now = t;
+  }
+  if (now - begin > blackbox.flushMax) blackbox.flushMax = now - begin;
+}
+
+uint8_t blackboxRead(uint32_t address, uint8_t *buf, uint8_t len) {
+  uint32_t used = bbWrite * 4;
+  if (address >= used) return 0;
+  if (len > used - address) len = used - address;
+  for (uint8_t i = 0; i < len; i++, address++)
+    buf[i] = BB_FLASH[address >> 2] >> (8 * (address & 3));
+  return len;
+}
+
+uint32_t blackboxSize() {
+  return BLACKBOX_WORDS * 4;
+}
+
+// about 20ms per page: only on the ground
+void blackboxErase() {
+  for (uint16_t p = 0; p < BLACKBOX_PAGES; p++) NVMErasePage((void *)&bbFlash[p * 1024UL]);
+  bbWrite = 0;
+  blackbox.used = 0;
+  blackbox.state &= ~BLACKBOX_FULL;
+}
+
+void blackboxInit() {
+  if (BB_FLASH[0] == 0) blackboxErase(); // first boot after programming
+  uint32_t w = BLACKBOX_WORDS;
+  while (w && BB_FLASH[w - 1] == 0xFFFFFFFF) w--;
+  bbWrite = w;
+  blackbox.used = w * 4;
+  if (w == BLACKBOX_WORDS) blackbox.state |= BLACKBOX_FULL;
+  blackbox.wordCost = BLACKBOX_WORD_US;
+}
+
+#endif
@@ -0,0 +1,38 @@
+#ifndef BLACKBOX_H_
+#define BLACKBOX_H_
+
+#if !defined(CHIPKIT)
+  #error "BLACKBOX needs the program flash of a CHIPKIT board"
+#endif
+
+#define BLACKBOX_VERSION 1
+#define BLACKBOX_RING    2048 // bytes coded and not yet in flash, a power of 2
+
+// log state, read with MSP_BLACKBOX
+#define BLACKBOX_RECORDING 1  // armed, frames go to the ring
+#define BLACKBOX_FULL      2  // the flash pages are full: nothing more is kept until MSP_BLACKBOX_ERASE
+#define BLACKBOX_OVERRUN   4  // the ring was full at least once since arming: frames were dropped
+
+typedef struct {
+  uint8_t  state;
+  uint32_t used;        // bytes of flash written, all the flights since the last erase
+  uint32_t frames;      // frames coded since arming
+  uint32_t dropped;     // frames lost since arming: ring or flash full
+  uint16_t ringMax;     // bytes, highest ring fill since arming
+  uint16_t logMax;      // us, longest blackboxLog() since arming: capture and coding of a frame
+  uint16_t flushMax;    // us, longest blackboxFlush() since arming
+  uint16_t wordCost;    // us, flash word write time the flush plans with
+} blackbox_t;
+
+extern blackbox_t blackbox;
+extern int16_t blackboxPID[3][3];   // P, I and D of each axis, axisPID = P + I + D
+
+void blackboxInit();
+void blackboxLog();
+void blackboxFlush(uint32_t start, uint16_t spacing);
+uint16_t blackboxPending();  // bytes in the ring
+uint8_t blackboxRead(uint32_t address, uint8_t *buf, uint8_t len);
+uint32_t blackboxSize();
+void blackboxErase();
+
+#endif /* BLACKBOX_H_ */
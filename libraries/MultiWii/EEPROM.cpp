@@ -3,7 +3,6 @@
 #include "Arduino.h"
 #else
 #include "WProgram.h"
-#include "Deeprom.h"
 #endif
 
 #include "config.h"
@@ -11,50 +10,19 @@
 #include "types.h"
 #include "EEPROM.h"
 #include "MultiWii.h"
+#include "Output.h"
 #include "Alarms.h"
 #include "GPS.h"
 
 #if defined(CHIPKIT)  //EDH
-void eeprom_read_block (void* __dst, const void* __src, size_t size){
- uint8_t data;
- uint32_t* address;
-// Serial.println("Start eeprom_read_block");
- 
- address = (uint32_t*) __src;
-
- //Serial.print("size=");Serial.println(size);
- //Serial.print("address=");Serial.println((int)address);
- 
- for(int i=0; i < size; i++) {
-     BOOL ret = readEeprom((uint32_t)address, &data);
-     address++;
- }
- __dst = (uint32_t*)data;
-
- 
-//  Serial.println("End eeprom_read_block");
-}
-
-void eeprom_write_block (const void* __src, void* __dst, size_t size){
- uint8_t* data;
- uint8_t address;
- 
-// Serial.println("eeprom_write_block");
-// Serial.print("size=");Serial.println(size);   
- //address =  *__dst;
- address = 0;
- //Serial.print("address=");Serial.println((int)address);
- data = (uint8_t*) __src;
- 
- for(int i=0; i < size; i++) {
-     int ret = writeEeprom(address, *data);
-     address = address +1;
- }
-
-}
-
+// a record per struct in the flash store of Store.cpp instead of the AVR eeprom addresses
+#include "Store.h"
 #endif
   
+// bytes covered by the checksum of a stored struct: those before the checksum byte,
+// not sizeof(), since a 32 bit target pads the structs after it
+#define CHECKSUM_SIZE(s) ((uint8_t*)&(s).checksum - (uint8_t*)&(s) + 1)
+
 uint8_t calculate_sum(uint8_t *cb , uint8_t siz) {
   uint8_t sum=0x55;  // checksum init
   while(--siz) sum += *cb++;  // calculate checksum (without checksum byte)
@@ -62,8 +30,12 @@ uint8_t calculate_sum(uint8_t *cb , uint8_t siz) {
 }
 
 void readGlobalSet() {
-  eeprom_read_block((void*)&global_conf, (void*)0, sizeof(global_conf));
-  if(calculate_sum((uint8_t*)&global_conf, sizeof(global_conf)) != global_conf.checksum) {
+  #if defined(CHIPKIT)
+    storeRead(STORE_GLOBAL, &global_conf, sizeof(global_conf));
+  #else
+    eeprom_read_block((void*)&global_conf, (void*)0, sizeof(global_conf));
+  #endif
+  if(calculate_sum((uint8_t*)&global_conf, CHECKSUM_SIZE(global_conf)) != global_conf.checksum) {
     global_conf.currentSet = 0;
     // EDH global_conf.accZero[ROLL] = 5000;    // for config error signalization
   }
@@ -76,8 +48,12 @@ bool readEEPROM() {
   #else
     global_conf.currentSet=0;
   #endif
-  eeprom_read_block((void*)&conf, (void*)(global_conf.currentSet * sizeof(conf) + sizeof(global_conf)), sizeof(conf));
-  if(calculate_sum((uint8_t*)&conf, sizeof(conf)) != conf.checksum) {
+  #if defined(CHIPKIT)
+    storeRead(STORE_CONF + global_conf.currentSet, &conf, sizeof(conf));
+  #else
+    eeprom_read_block((void*)&conf, (void*)(global_conf.currentSet * sizeof(conf) + sizeof(global_conf)), sizeof(conf));
+  #endif
+  if(calculate_sum((uint8_t*)&conf, CHECKSUM_SIZE(conf)) != conf.checksum) {
     blinkLED(6,100,3);    
     #if defined(BUZZER)
       alarmArray[7] = 3;
@@ -85,6 +61,9 @@ bool readEEPROM() {
     LoadDefaults();                 // force load defaults 
     return false;                   // defaults loaded, don't reload constants (EEPROM life saving)
   }
+  #if defined(MOTOR_MIXER)
+    checkMixer();
+  #endif
   // 500/128 = 3.90625    3.9062 * 3.9062 = 15.259   1526*100/128 = 1192
   for(i=0;i<5;i++) {
     lookupPitchRollRC[i] = (1526+conf.rcExpo8*(i*i-15))*i*(int32_t)conf.rcRate8/1192;
@@ -111,12 +90,12 @@ bool readEEPROM() {
 }
 
 void writeGlobalSet(uint8_t b) {
-  global_conf.checksum = calculate_sum((uint8_t*)&global_conf, sizeof(global_conf));
-  #if defined(CHIPKIT)  
-    eeprom_write_block((const uint8_t*)&global_conf, (uint8_t*)0, sizeof(global_conf));
-  #else    
+  global_conf.checksum = calculate_sum((uint8_t*)&global_conf, CHECKSUM_SIZE(global_conf));
+  #if defined(CHIPKIT)
+    storeWrite(STORE_GLOBAL, &global_conf, sizeof(global_conf));
+  #else
     eeprom_write_block((const void*)&global_conf, (void*)0, sizeof(global_conf));
-  #endif    
+  #endif
   if (b == 1) blinkLED(15,20,1);
   #if defined(BUZZER)
     alarmArray[7] = 1; 
@@ -131,9 +110,13 @@ void writeParams(uint8_t b) {
   #else
     global_conf.currentSet=0;
   #endif
-  conf.checksum = calculate_sum((uint8_t*)&conf, sizeof(conf));
-  eeprom_write_block((const void*)&conf, (void*)(global_conf.currentSet * sizeof(conf) + sizeof(global_conf)), sizeof(conf));   
-  //readEEPROM();
+  conf.checksum = calculate_sum((uint8_t*)&conf, CHECKSUM_SIZE(conf));
+  #if defined(CHIPKIT)
+    storeWrite(STORE_CONF + global_conf.currentSet, &conf, sizeof(conf));
+  #else
+    eeprom_write_block((const void*)&conf, (void*)(global_conf.currentSet * sizeof(conf) + sizeof(global_conf)), sizeof(conf));
+  #endif
+  readEEPROM();
   if (b == 1) blinkLED(15,20,1);
   #if defined(BUZZER)
     alarmArray[7] = 1; //beep if loaded from gui or android
@@ -237,13 +220,20 @@ void LoadDefaults() {
     conf.dynThrPID = 50;
     conf.rcExpo8   =  0;
   #endif
+  #if defined(MOTOR_MIXER)
+    loadDefaultMixer();
+  #endif
   update_constants();
 }
 
 #ifdef LOG_PERMANENT
 void readPLog(void) {
-  eeprom_read_block((void*)&plog, (void*)(E2END - 4 - sizeof(plog)), sizeof(plog));
-  if(calculate_sum((uint8_t*)&plog, sizeof(plog)) != plog.checksum) {
+  #if defined(CHIPKIT)
+    storeRead(STORE_PLOG, &plog, sizeof(plog));
+  #else
+    eeprom_read_block((void*)&plog, (void*)(E2END - 4 - sizeof(plog)), sizeof(plog));
+  #endif
+  if(calculate_sum((uint8_t*)&plog, CHECKSUM_SIZE(plog)) != plog.checksum) {
     blinkLED(9,100,3);
     #if defined(BUZZER)
       alarmArray[7] = 3;
@@ -256,8 +246,12 @@ void readPLog(void) {
   }
 }
 void writePLog(void) {
-  plog.checksum = calculate_sum((uint8_t*)&plog, sizeof(plog));
-  eeprom_write_block((const void*)&plog, (void*)(E2END - 4 - sizeof(plog)), sizeof(plog));
+  plog.checksum = calculate_sum((uint8_t*)&plog, CHECKSUM_SIZE(plog));
+  #if defined(CHIPKIT)
+    storeWrite(STORE_PLOG, &plog, sizeof(plog));
+  #else
+    eeprom_write_block((const void*)&plog, (void*)(E2END - 4 - sizeof(plog)), sizeof(plog));
+  #endif
 }
 #endif
 
@@ -270,8 +264,12 @@ void storeWP() {
     #define PROFILES 1
 #endif
 	if (mission_step.number >254) return;
-	mission_step.checksum = calculate_sum((uint8_t*)&mission_step, sizeof(mission_step));
-	eeprom_write_block((void*)&mission_step, (void*)(PROFILES * sizeof(conf) + sizeof(global_conf)+(sizeof(mission_step)*mission_step.number)),sizeof(mission_step));
+	mission_step.checksum = calculate_sum((uint8_t*)&mission_step, CHECKSUM_SIZE(mission_step));
+	#if defined(CHIPKIT)
+	  storeWrite(STORE_WP + mission_step.number, &mission_step, sizeof(mission_step));
+	#else
+	  eeprom_write_block((void*)&mission_step, (void*)(PROFILES * sizeof(conf) + sizeof(global_conf)+(sizeof(mission_step)*mission_step.number)),sizeof(mission_step));
+	#endif
 }
 
 // Read the given number of WP from the eeprom, supposedly we can use this during flight.
@@ -284,8 +282,12 @@ bool recallWP(uint8_t wp_number) {
 #endif
 	if (wp_number > 254) return false;
 
-	eeprom_read_block((void*)&mission_step, (void*)(PROFILES * sizeof(conf) + sizeof(global_conf)+(sizeof(mission_step)*wp_number)), sizeof(mission_step));
-	if(calculate_sum((uint8_t*)&mission_step, sizeof(mission_step)) != mission_step.checksum) return false;
+	#if defined(CHIPKIT)
+	  storeRead(STORE_WP + wp_number, &mission_step, sizeof(mission_step));
+	#else
+	  eeprom_read_block((void*)&mission_step, (void*)(PROFILES * sizeof(conf) + sizeof(global_conf)+(sizeof(mission_step)*wp_number)), sizeof(mission_step));
+	#endif
+	if(calculate_sum((uint8_t*)&mission_step, CHECKSUM_SIZE(mission_step)) != mission_step.checksum) return false;
 
 	return true;
 }
@@ -303,9 +305,16 @@ uint8_t getMaxWPNumber() {
 	#define PROFILES 1
 #endif
 
+#if defined(CHIPKIT)
+	// a record takes its size rounded up to a word, plus a header and a CRC word
+	#define RECORD(s) (((s) + 3) / 4 * 4 + 8)
+	uint16_t first_avail = PROFILES*RECORD(sizeof(conf)) + RECORD(sizeof(global_conf)) + (PLOG_SIZE ? RECORD(PLOG_SIZE) : 0);
+	uint16_t wp_num = (store.capacity - first_avail)/RECORD(sizeof(mission_step));
+#else
 	uint16_t first_avail = PROFILES*sizeof(conf) + sizeof(global_conf)+ 1; //Add one byte for addtnl separation
 	uint16_t last_avail  = E2END - PLOG_SIZE - 4;										  //keep the last 4 bytes intakt
 	uint16_t wp_num = (last_avail-first_avail)/sizeof(mission_step);
+#endif
 	if (wp_num>254) wp_num = 254;
 	return wp_num;
 }
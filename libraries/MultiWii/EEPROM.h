@@ -9,5 +9,10 @@ void writeParams(uint8_t b);
 void LoadDefaults();
 void readPLog(void);
 void writePLog(void);
+#if defined(GPS_NAV)
+  void storeWP(void);
+  bool recallWP(uint8_t wp_number);
+  uint8_t getMaxWPNumber(void);
+#endif
 
 #endif /* EEPROM_H_ */
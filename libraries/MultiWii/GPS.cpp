@@ -8,18 +8,20 @@
 #include "def.h"
 #include "types.h"
 #include "GPS.h"
+#include "NavMath.h"
 #include "Serial.h"
 #include "Sensors.h"
 #include "MultiWii.h"
+#include "EEPROM.h"
 
 #if GPS
 
-bool GPS_newFrame(char c);
+static bool GPS_serialFrame(void);
 #if defined(NMEA)
-  bool GPS_NMEA_newFrame(char c);
+  uint8_t GPS_NMEA_parse(const uint8_t *data, uint8_t len, uint8_t *fix);
 #endif
 #if defined(UBLOX)
-  bool GPS_UBLOX_newFrame(uint8_t data);
+  uint8_t GPS_UBLOX_parse(const uint8_t *data, uint8_t len, uint8_t *fix);
   bool UBLOX_parse_gps(void);
 #endif
 #if defined(MTK_BINARY16) || defined(MTK_BINARY19)
@@ -27,14 +29,11 @@ bool GPS_newFrame(char c);
 #endif
 void GPS_distance_cm_bearing(int32_t* lat1, int32_t* lon1, int32_t* lat2, int32_t* lon2,uint32_t* dist, int32_t* bearing);
 static void GPS_calc_velocity(void);
-static void GPS_calc_location_error( int32_t* target_lat, int32_t* target_lng, int32_t* gps_lat, int32_t* gps_lng );
 static void GPS_calc_poshold(void);
 static uint16_t GPS_calc_desired_speed(uint16_t max_speed, bool _slow);
 static void GPS_calc_nav_rate(uint16_t max_speed);
 int32_t wrap_18000(int32_t ang);
-static bool check_missed_wp(void);
 void GPS_calc_longitude_scaling(int32_t lat);
-static void GPS_update_crosstrack(void);
 int32_t wrap_36000(int32_t ang);
 
 #if defined(TINY_GPS)
@@ -59,9 +58,9 @@ int32_t wrap_36000(int32_t ang);
 #if defined(GPS_LEAD_FILTER)
 // Set up gps lag
 #if defined(UBLOX)
-  #define GPS_LAG 0.5f                          //UBLOX GPS has a smaller lag than MTK and other
+  #define GPS_LAG 128                           //UBLOX GPS has a smaller lag than MTK and other (s << 8)
 #else 
-  #define GPS_LAG 1.0f                          //We assumes that MTK GPS has a 1 sec lag
+  #define GPS_LAG 256                           //We assumes that MTK GPS has a 1 sec lag
 #endif  
 
 static int32_t  GPS_coord_lead[2];              // Lead filtered gps coordinates
@@ -73,7 +72,7 @@ public:
     }
 
     // setup min and max radio values in CLI
-    int32_t         get_position(int32_t pos, int16_t vel, float lag_in_seconds = 1.0);
+    int32_t         get_position(int32_t pos, int16_t vel, uint16_t lag = 256);   // lag in s << 8
     void            clear() { _last_velocity = 0; }
 
 private:
@@ -81,10 +80,10 @@ private:
 
 };
 
-int32_t LeadFilter::get_position(int32_t pos, int16_t vel, float lag_in_seconds)
+int32_t LeadFilter::get_position(int32_t pos, int16_t vel, uint16_t lag)
 {
-    int16_t accel_contribution = (vel - _last_velocity) * lag_in_seconds * lag_in_seconds;
-    int16_t vel_contribution = vel * lag_in_seconds;
+    int16_t accel_contribution = ((int32_t)(vel - _last_velocity) * lag * lag) >> 16;
+    int16_t vel_contribution = ((int32_t)vel * lag) >> 8;
 
     // store velocity for next iteration
     _last_velocity = vel;
@@ -98,11 +97,12 @@ LeadFilter yLeadFilter;      // Lat  GPS lag filter
 
 #endif
 
+  // the PIDs of the navigation in fixed point: gains << 16, dt in ms
   typedef struct PID_PARAM_ {
-    float kP;
-    float kI;
-    float kD;
-    float Imax;
+    int32_t kP;
+    int32_t kI;     // per s
+    int32_t kD;     // s
+    int32_t Imax;
   } PID_PARAM;
   
   PID_PARAM posholdPID_PARAM;
@@ -110,31 +110,30 @@ LeadFilter yLeadFilter;      // Lat  GPS lag filter
   PID_PARAM navPID_PARAM;
 
   typedef struct PID_ {
-    float   integrator; // integrator value
+    int32_t integrator; // integrator value << 16
     int32_t last_input; // last input for derivative
-    float   lastderivative; // last derivative for low-pass filter
-    float   output;
-    float   derivative;
+    int32_t lastderivative; // last derivative for low-pass filter, per s
   } PID;
   PID posholdPID[2];
   PID poshold_ratePID[2];
   PID navPID[2];
 
   int32_t get_P(int32_t error, struct PID_PARAM_* pid) {
-    return (float)error * pid->kP;
+    return ((int64_t)error * pid->kP) >> 16;
   }
 
-  int32_t get_I(int32_t error, float* dt, struct PID_* pid, struct PID_PARAM_* pid_param) {
-    pid->integrator += ((float)error * pid_param->kI) * *dt;
-    pid->integrator = constrain(pid->integrator,-pid_param->Imax,pid_param->Imax);
-    return pid->integrator;
+  int32_t get_I(int32_t error, uint16_t* dt, struct PID_* pid, struct PID_PARAM_* pid_param) {
+    int32_t imax = pid_param->Imax << 16;
+    pid->integrator += (int64_t)error * pid_param->kI * *dt / 1000;
+    pid->integrator = constrain(pid->integrator,-imax,imax);
+    return pid->integrator >> 16;
   }
     
-  int32_t get_D(int32_t input, float* dt, struct PID_* pid, struct PID_PARAM_* pid_param) { // dt in milliseconds
-    pid->derivative = (input - pid->last_input) / *dt;
+  int32_t get_D(int32_t input, uint16_t* dt, struct PID_* pid, struct PID_PARAM_* pid_param) { // dt in milliseconds
+    int32_t derivative = (int32_t)(input - pid->last_input) * 1000 / *dt;
 
     /// Low pass filter cut frequency for derivative calculation.
-    float filter = 7.9577e-3; // Set to  "1 / ( 2 * PI * f_cut )";
+    // filter = 8ms, "1 / ( 2 * PI * f_cut )";
     // Examples for _filter:
     // f_cut = 10 Hz -> _filter = 15.9155e-3
     // f_cut = 15 Hz -> _filter = 10.6103e-3
@@ -143,13 +142,13 @@ LeadFilter yLeadFilter;      // Lat  GPS lag filter
     // f_cut = 30 Hz -> _filter =  5.3052e-3
 
     // discrete low pass filter, cuts out the
-    // high frequency noise that can drive the controller crazy
-    pid->derivative = pid->lastderivative + (*dt / ( filter + *dt)) * (pid->derivative - pid->lastderivative);
+    // high frequency noise that can drive the controller crazy: dt / (filter + dt) << 16
+    uint32_t k = ((uint32_t)*dt << 16) / (*dt + 8);
+    pid->lastderivative += ((int64_t)(derivative - pid->lastderivative) * k) >> 16;
     // update state
     pid->last_input = input;
-    pid->lastderivative    = pid->derivative;
     // add in derivative component
-    return pid_param->kD * pid->derivative;
+    return ((int64_t)pid_param->kD * pid->lastderivative) >> 16;
   }
 
   void reset_PID(struct PID_* pid) {
@@ -161,17 +160,16 @@ LeadFilter yLeadFilter;      // Lat  GPS lag filter
   #define _X 1
   #define _Y 0
 
-  #define RADX100                    0.000174532925  
   #define CROSSTRACK_GAIN            1
   #define NAV_SPEED_MIN              100    // cm/sec
   #define NAV_SPEED_MAX              300    // cm/sec
   #define NAV_SLOW_NAV               true
   #define NAV_BANK_MAX 3000        //30deg max banking when navigating (just for security and testing)
 
-  static float  dTnav;            // Delta Time in milliseconds for navigation computations, updated with every good GPS read
+  static uint16_t dTnav;          // Delta Time in milliseconds for navigation computations, updated with every good GPS read
   static uint16_t GPS_wp_radius    = GPS_WP_RADIUS;
   static int16_t actual_speed[2] = {0,0};
-  static float GPS_scaleLonDown; // this is used to offset the shrinking longitude as we go towards the poles
+  static int32_t GPS_scaleLonDown; // this is used to offset the shrinking longitude as we go towards the poles, << 16
 
   // The difference between the desired rate of travel and the actual rate of travel
   // updated after GPS read - 5-10hz
@@ -184,27 +182,46 @@ LeadFilter yLeadFilter;      // Lat  GPS lag filter
   ////////////////////////////////////////////////////////////////////////////////
   // Location & Navigation
   ////////////////////////////////////////////////////////////////////////////////
-  // This is the angle from the copter to the "next_WP" location in degrees * 100
-  static int32_t target_bearing;
+  // The leg flown to GPS_WP, from where GPS_set_next_wp() was called or from the waypoint before in a
+  // mission. Its geometry is computed once, a GPS frame then only projects the position on it
+  typedef struct {
+    int32_t  scale;     // GPS_scaleLonDown << 16 at the end of the leg
+    int16_t  u[2];      // unit vector of the leg << 14, [LAT] north, [LON] east
+    int32_t  bearing;   // deg * 100
+    uint32_t length;    // cm
+  } nav_leg_t;
+  static nav_leg_t leg;
+  static void GPS_calc_leg(int32_t* pos1, int32_t* pos2, nav_leg_t* l);
+  static void GPS_calc_leg_error(int32_t* pos);
   ////////////////////////////////////////////////////////////////////////////////
   // Crosstrack
   ////////////////////////////////////////////////////////////////////////////////
-  // deg * 100, The original angle to the next_WP when the next_WP was set
-  // Also used to check when we pass a WP
-  static int32_t original_target_bearing;
-  // The amount of angle correction applied to target_bearing to bring the copter back on its optimum path
-  static int16_t crosstrack_error;
+  // cm the copter is to the left of the leg, the heading correction that brings it back is taken from it
+  static int32_t crosstrack_error;
   ////////////////////////////////////////////////////////////////////////////////
   // The location of the copter in relation to home, updated every GPS read (1deg - 100)
   // static int32_t home_to_copter_bearing; /* unused */
   // distance between plane and home in cm
   // static int32_t home_distance; /* unused */
-  // distance between plane and next_WP in cm
+  // distance left along the leg to next_WP in cm, 0 once the waypoint is passed
   static uint32_t wp_distance;
   
   // used for slow speed wind up when start navigation;
   static uint16_t waypoint_speed_gov;
 
+  #if defined(GPS_NAV)
+    // the mission, read out of the eeprom at arming: each waypoint with the leg ending there, the
+    // first leg from where the mission is started
+    typedef struct {
+      int32_t   pos[2];
+      uint16_t  stay;       // ms held at the waypoint
+      nav_leg_t leg;
+    } mission_leg_t;
+    static mission_leg_t mission[GPS_MISSION_STEPS];
+    static uint32_t missionArrival;     // millis() when the waypoint held was reached
+    static void GPS_mission_next(void);
+  #endif
+
   ////////////////////////////////////////////////////////////////////////////////////
   // moving average filter variables
   //
@@ -264,12 +281,20 @@ static int16_t nav_takeoff_bearing;
      0xB5,0x62,0x06,0x01,0x03,0x00,0xF0,0x00,0x00,0xFA,0x0F,
      0xB5,0x62,0x06,0x01,0x03,0x00,0xF0,0x02,0x00,0xFC,0x13,
      0xB5,0x62,0x06,0x01,0x03,0x00,0xF0,0x04,0x00,0xFE,0x17,
+   #if defined(UBLOX_PVT)
+     0xB5,0x62,0x06,0x01,0x03,0x00,0x01,0x07,0x01,0x13,0x51,                            //set PVT MSG rate
+   #else
      0xB5,0x62,0x06,0x01,0x03,0x00,0x01,0x02,0x01,0x0E,0x47,                            //set POSLLH MSG rate
      0xB5,0x62,0x06,0x01,0x03,0x00,0x01,0x03,0x01,0x0F,0x49,                            //set STATUS MSG rate
      0xB5,0x62,0x06,0x01,0x03,0x00,0x01,0x06,0x01,0x12,0x4F,                            //set SOL MSG rate
      0xB5,0x62,0x06,0x01,0x03,0x00,0x01,0x12,0x01,0x1E,0x67,                            //set VELNED MSG rate
+   #endif
      0xB5,0x62,0x06,0x16,0x08,0x00,0x03,0x07,0x03,0x00,0x51,0x08,0x00,0x00,0x8A,0x41,   //set WAAS to EGNOS
+   #if defined(GPS_10HZ)
+     0xB5, 0x62, 0x06, 0x08, 0x06, 0x00, 0x64, 0x00, 0x01, 0x00, 0x01, 0x00, 0x7A, 0x12 //set rate to 10Hz
+   #else
      0xB5, 0x62, 0x06, 0x08, 0x06, 0x00, 0xC8, 0x00, 0x01, 0x00, 0x01, 0x00, 0xDE, 0x6A //set rate to 5Hz
+   #endif
    };
  #endif
 
@@ -328,7 +353,11 @@ static int16_t nav_takeoff_bearing;
         while(!SerialTXfree(GPS_SERIAL)) delay(80);
       SerialGpsPrint(SBAS_TEST_MODE);
         while(!SerialTXfree(GPS_SERIAL)) delay(80);
-      SerialGpsPrint(MTK_OUTPUT_5HZ);           // 5 Hz update rate
+      #if defined(GPS_10HZ)
+        SerialGpsPrint(MTK_OUTPUT_10HZ);        // 10 Hz update rate
+      #else
+        SerialGpsPrint(MTK_OUTPUT_5HZ);         // 5 Hz update rate
+      #endif
 
       #if defined(NMEA)
         SerialGpsPrint(MTK_SET_NMEA_SENTENCES); // only GGA and RMC sentence
@@ -476,10 +505,8 @@ void GPS_NewData(void) {
 
   #if defined(GPS_SERIAL) || defined(TINY_GPS) || defined(GPS_FROM_OSD)
     #if defined(GPS_SERIAL)
-    uint8_t c = SerialAvailable(GPS_SERIAL);
-    while (c--) {
-    //while (SerialAvailable(GPS_SERIAL)) {
-      if (GPS_newFrame(SerialRead(GPS_SERIAL))) {
+    while (GPS_serialFrame()) {
+      {
     #elif defined(TINY_GPS)
     {
       {
@@ -523,10 +550,10 @@ void GPS_NewData(void) {
           //dTnav calculation
           //Time for calculating x,y speed and navigation pids
           static uint32_t nav_loopTimer;
-          dTnav = (float)(millis() - nav_loopTimer)/ 1000.0;
-          nav_loopTimer = millis();
+          uint32_t now = millis();
           // prevent runup from bad GPS
-          dTnav = min(dTnav, 1.0);  
+          dTnav = constrain(now - nav_loopTimer, 1, 1000);
+          nav_loopTimer = now;
 
           //calculate distance and bearings for gui and other stuff continously - From home to copter
           uint32_t dist;
@@ -543,19 +570,21 @@ void GPS_NewData(void) {
           //calculate the current velocity based on gps coordinates continously to get a valid speed at the moment when we start navigating
           GPS_calc_velocity();        
           
-          if (f.GPS_HOLD_MODE || f.GPS_HOME_MODE){    //ok we are navigating 
+          if (f.GPS_HOLD_MODE || f.GPS_HOME_MODE || f.GPS_MISSION_MODE){    //ok we are navigating 
+            STAGE_BEGIN(STAGE_NAV);
             //do gps nav calculations here, these are common for nav and poshold  
             #if defined(GPS_LEAD_FILTER)
-              GPS_distance_cm_bearing(&GPS_coord_lead[LAT],&GPS_coord_lead[LON],&GPS_WP[LAT],&GPS_WP[LON],&wp_distance,&target_bearing);
-              GPS_calc_location_error(&GPS_WP[LAT],&GPS_WP[LON],&GPS_coord_lead[LAT],&GPS_coord_lead[LON]);
+              GPS_calc_leg_error(GPS_coord_lead);
             #else
-              GPS_distance_cm_bearing(&GPS_coord[LAT],&GPS_coord[LON],&GPS_WP[LAT],&GPS_WP[LON],&wp_distance,&target_bearing);
-              GPS_calc_location_error(&GPS_WP[LAT],&GPS_WP[LON],&GPS_coord[LAT],&GPS_coord[LON]);
+              GPS_calc_leg_error(GPS_coord);
             #endif
             switch (nav_mode) {
               case NAV_MODE_POSHOLD: 
                 //Desired output is in nav_lat and nav_lon where 1deg inclination is 100 
                 GPS_calc_poshold();
+                #if defined(GPS_NAV)
+                  if (f.GPS_MISSION_MODE) GPS_mission_next();
+                #endif
                 break;
               case NAV_MODE_WP:
                 int16_t speed = GPS_calc_desired_speed(NAV_SPEED_MAX, NAV_SLOW_NAV);      //slow navigation 
@@ -571,13 +600,17 @@ void GPS_NewData(void) {
                     magHold = nav_bearing/100;
                   }
                 }
-                // Are we there yet ?(within 2 meters of the destination)
-                if ((wp_distance <= GPS_wp_radius) || check_missed_wp()){         //if yes switch to poshold mode
+                // Are we there yet ?(within 2 meters of the destination along the leg, or past it)
+                if (wp_distance <= GPS_wp_radius) {         //if yes switch to poshold mode
                   nav_mode = NAV_MODE_POSHOLD;
-                  if (NAV_SET_TAKEOFF_HEADING) { magHold = nav_takeoff_bearing; }
+                  #if defined(GPS_NAV)
+                    missionArrival = millis();
+                  #endif
+                  if (NAV_SET_TAKEOFF_HEADING && !f.GPS_MISSION_MODE) { magHold = nav_takeoff_bearing; }
                 } 
                 break;               
             }
+            STAGE_END(STAGE_NAV);
           } //end of gps calcs  
         }
       }
@@ -622,18 +655,18 @@ void GPS_reset_nav(void) {
 //Get the relevant P I D values and set the PID controllers 
 void GPS_set_pids(void) {
   #if defined(GPS_SERIAL)  || defined(GPS_FROM_OSD) || defined(TINY_GPS)
-    posholdPID_PARAM.kP   = (float)conf.pid[PIDPOS].P8/100.0;
-    posholdPID_PARAM.kI   = (float)conf.pid[PIDPOS].I8/100.0;
+    posholdPID_PARAM.kP   = ((int32_t)conf.pid[PIDPOS].P8<<16)/100;
+    posholdPID_PARAM.kI   = ((int32_t)conf.pid[PIDPOS].I8<<16)/100;
     posholdPID_PARAM.Imax = POSHOLD_RATE_IMAX * 100;
     
-    poshold_ratePID_PARAM.kP   = (float)conf.pid[PIDPOSR].P8/10.0;
-    poshold_ratePID_PARAM.kI   = (float)conf.pid[PIDPOSR].I8/100.0;
-    poshold_ratePID_PARAM.kD   = (float)conf.pid[PIDPOSR].D8/1000.0;
+    poshold_ratePID_PARAM.kP   = ((int32_t)conf.pid[PIDPOSR].P8<<16)/10;
+    poshold_ratePID_PARAM.kI   = ((int32_t)conf.pid[PIDPOSR].I8<<16)/100;
+    poshold_ratePID_PARAM.kD   = ((int32_t)conf.pid[PIDPOSR].D8<<16)/1000;
     poshold_ratePID_PARAM.Imax = POSHOLD_RATE_IMAX * 100;
     
-    navPID_PARAM.kP   = (float)conf.pid[PIDNAVR].P8/10.0;
-    navPID_PARAM.kI   = (float)conf.pid[PIDNAVR].I8/100.0;
-    navPID_PARAM.kD   = (float)conf.pid[PIDNAVR].D8/1000.0;
+    navPID_PARAM.kP   = ((int32_t)conf.pid[PIDNAVR].P8<<16)/10;
+    navPID_PARAM.kI   = ((int32_t)conf.pid[PIDNAVR].I8<<16)/100;
+    navPID_PARAM.kD   = ((int32_t)conf.pid[PIDNAVR].D8<<16)/1000;
     navPID_PARAM.Imax = POSHOLD_RATE_IMAX * 100;
   #endif
 
@@ -722,8 +755,7 @@ int32_t wrap_18000(int32_t ang) {
 // It's ok to calculate this once per waypoint setting, since it changes a little within the reach of a multicopter
 //
 void GPS_calc_longitude_scaling(int32_t lat) {
-  float rads       = (abs((float)lat) / 10000000.0) * 0.0174532925;
-  GPS_scaleLonDown = cos(rads);
+  GPS_scaleLonDown = navLonScale(lat);
 }
 
 ////////////////////////////////////////////////////////////////////////////////////
@@ -734,34 +766,98 @@ void GPS_set_next_wp(int32_t* lat, int32_t* lon) {
   GPS_WP[LON] = *lon;
  
   GPS_calc_longitude_scaling(*lat);
-  GPS_distance_cm_bearing(&GPS_coord[LAT],&GPS_coord[LON],&GPS_WP[LAT],&GPS_WP[LON],&wp_distance,&target_bearing);
-
-  nav_bearing = target_bearing;
-  GPS_calc_location_error(&GPS_WP[LAT],&GPS_WP[LON],&GPS_coord[LAT],&GPS_coord[LON]);
-  original_target_bearing = target_bearing;
+  GPS_calc_leg(GPS_coord, GPS_WP, &leg);
+  GPS_calc_leg_error(GPS_coord);
+  nav_bearing = leg.bearing;
   waypoint_speed_gov = NAV_SPEED_MIN;
 }
 
 ////////////////////////////////////////////////////////////////////////////////////
-// Check if we missed the destination somehow
+// Geometry of the leg from pos1 to pos2 (LAT LON), once per leg: the square root and the divisions
+// of the navigation are here, a GPS frame then only needs the products below
+//
+static void GPS_calc_leg(int32_t* pos1, int32_t* pos2, nav_leg_t* l) {
+  int32_t  scale = navLonScale(pos2[LAT]);
+  int32_t  dLat  = pos2[LAT] - pos1[LAT];
+  int32_t  dLon  = ((int64_t)(pos2[LON] - pos1[LON]) * scale + (1 << 15)) >> 16;
+  uint32_t len   = navSqrt((int64_t)dLat * dLat + (int64_t)dLon * dLon);
+
+  l->scale = scale;
+  if (len < 1) {                         // no direction: the waypoint is reached at the first frame
+    l->u[LAT] = NAV_ONE;
+    l->u[LON] = 0;
+  } else {
+    l->u[LAT] = ((int64_t)dLat << 14) / (int32_t)len;
+    l->u[LON] = ((int64_t)dLon << 14) / (int32_t)len;
+  }
+  l->bearing = navBearing(dLat, dLon);
+  l->length  = NAV_CM(len);
+}
+
+////////////////////////////////////////////////////////////////////////////////////
+// Position on the leg, each GPS frame: error[] to GPS_WP, and the projections of it on the leg
+// and on its normal for wp_distance and crosstrack_error
 //
-static bool check_missed_wp(void) {
-  int32_t temp;
-  temp = target_bearing - original_target_bearing;
-  temp = wrap_18000(temp);
-  return (abs(temp) > 10000);   // we passed the waypoint by 100 degrees
+static void GPS_calc_leg_error(int32_t* pos) {
+  int32_t along;
+
+  error[LON] = ((int64_t)(GPS_WP[LON] - pos[LON]) * leg.scale) >> 16;  // X Error
+  error[LAT] = GPS_WP[LAT] - pos[LAT];                                   // Y Error
+  along = ((int64_t)error[LAT] * leg.u[LAT] + (int64_t)error[LON] * leg.u[LON]) >> 14;
+  crosstrack_error = NAV_CM(((int64_t)error[LON] * leg.u[LAT] - (int64_t)error[LAT] * leg.u[LON]) >> 14);
+  wp_distance = along > 0 ? NAV_CM(along) : 0;
 }
 
+#if defined(GPS_NAV)
+////////////////////////////////////////////////////////////////////////////////////
+// Waypoint mission: read at arming, so that recallWP() never runs in flight, up to the waypoint
+// flagged MISSION_FLAG_END or the first one missing. The legs between the waypoints are computed
+// here, only the first one is left to GPS_mission_start()
+//
+void GPS_mission_load(void) {
+  GPS_mission_steps = 0;
+  for (uint8_t n = 1; n <= GPS_MISSION_STEPS && recallWP(n) && mission_step.number == n; n++) {
+    mission_leg_t* m = &mission[GPS_mission_steps];
+    m->pos[LAT] = mission_step.pos[LAT];
+    m->pos[LON] = mission_step.pos[LON];
+    m->stay     = mission_step.stay;
+    if (GPS_mission_steps) GPS_calc_leg(mission[GPS_mission_steps - 1].pos, m->pos, &m->leg);
+    GPS_mission_steps++;
+    if (mission_step.flag == MISSION_FLAG_END) break;
+  }
+}
+
+// flies to the first waypoint, from here: 0 without a mission
+uint8_t GPS_mission_start(void) {
+  if (!GPS_mission_steps) return 0;
+  GPS_mission_step = 0;
+  GPS_set_next_wp(&mission[0].pos[LAT], &mission[0].pos[LON]);
+  nav_mode = NAV_MODE_WP;
+  return 1;
+}
+
+// in poshold at a waypoint: the leg to the next one once its stay is over, the last one is held
+static void GPS_mission_next(void) {
+  if (GPS_mission_step + 1 >= GPS_mission_steps || millis() - missionArrival < mission[GPS_mission_step].stay) return;
+  mission_leg_t* m = &mission[++GPS_mission_step];
+  GPS_WP[LAT] = m->pos[LAT];
+  GPS_WP[LON] = m->pos[LON];
+  leg = m->leg;
+  nav_bearing = leg.bearing;
+  waypoint_speed_gov = NAV_SPEED_MIN;
+  nav_mode = NAV_MODE_WP;
+}
+#endif
+
 ////////////////////////////////////////////////////////////////////////////////////
 // Get distance between two points in cm
 // Get bearing from pos1 to pos2, returns an 1deg = 100 precision
+// The distance is the projection on the bearing, no square root each frame
 void GPS_distance_cm_bearing(int32_t* lat1, int32_t* lon1, int32_t* lat2, int32_t* lon2,uint32_t* dist, int32_t* bearing) {
-  float dLat = *lat2 - *lat1;                                    // difference of latitude in 1/10 000 000 degrees
-  float dLon = (float)(*lon2 - *lon1) * GPS_scaleLonDown;
-  *dist = sqrt(sq(dLat) + sq(dLon)) * 1.113195;
-  
-  *bearing = 9000.0f + atan2(-dLat, dLon) * 5729.57795f;      //Convert the output redians to 100xdeg
-  if (*bearing < 0) *bearing += 36000;
+  int32_t dLat = *lat2 - *lat1;                                  // difference of latitude in 1/10 000 000 degrees
+  int32_t dLon = ((int64_t)(*lon2 - *lon1) * GPS_scaleLonDown + (1 << 15)) >> 16;
+  *bearing = navBearing(dLat, dLon);
+  *dist = NAV_CM(((int64_t)dLat * navCos(*bearing) + (int64_t)dLon * navSin(*bearing)) >> 14);
 }
 
 #if defined(OBSOLATED)
@@ -794,9 +890,11 @@ static void GPS_calc_velocity(void){
   static uint8_t init = 0;
 
   if (init) {
-    float tmp = 1.0/dTnav;
-    actual_speed[_X] = (float)(GPS_coord[LON] - last[LON]) *  GPS_scaleLonDown * tmp;
-    actual_speed[_Y] = (float)(GPS_coord[LAT]  - last[LAT])  * tmp;
+    // 1e-7 degree per s, the moves constrained to 111m per frame to stay in 32 bits
+    int32_t dLon = constrain(((int64_t)(GPS_coord[LON] - last[LON]) * GPS_scaleLonDown) >> 16, -1000000, 1000000);
+    int32_t dLat = constrain(GPS_coord[LAT] - last[LAT], -1000000, 1000000);
+    actual_speed[_X] = dLon * 1000 / (int32_t)dTnav;
+    actual_speed[_Y] = dLat * 1000 / (int32_t)dTnav;
 
 #if !defined(GPS_LEAD_FILTER) 
     actual_speed[_X] = (actual_speed[_X] + speed_old[_X]) / 2;
@@ -819,20 +917,6 @@ static void GPS_calc_velocity(void){
 
 }
 
-////////////////////////////////////////////////////////////////////////////////////
-// Calculate a location error between two gps coordinates
-// Because we are using lat and lon to do our distance errors here's a quick chart:
-//   100  = 1m
-//  1000  = 11m    = 36 feet
-//  1800  = 19.80m = 60 feet
-//  3000  = 33m
-// 10000  = 111m
-//
-static void GPS_calc_location_error( int32_t* target_lat, int32_t* target_lng, int32_t* gps_lat, int32_t* gps_lng ) {
-  error[LON] = (float)(*target_lng - *gps_lng) * GPS_scaleLonDown;  // X Error
-  error[LAT] = *target_lat - *gps_lat; // Y Error
-}
-
 ////////////////////////////////////////////////////////////////////////////////////
 // Calculate nav_lat and nav_lon from the x and y error and the speed
 //
@@ -865,18 +949,20 @@ static void GPS_calc_poshold(void) {
 // Calculate the desired nav_lat and nav_lon for distance flying such as RTH
 //
 static void GPS_calc_nav_rate(uint16_t max_speed) {
-  float trig[2];
+  int32_t correction, s, c, dir[2];
   uint8_t axis;
-  // push us towards the original track
-  GPS_update_crosstrack();
+  // push us towards the leg: 0.01deg per cm off it, up to 30deg
+  correction  = constrain(crosstrack_error * CROSSTRACK_GAIN, -3000, 3000);
+  nav_bearing = wrap_36000(leg.bearing + correction);
 
-  // nav_bearing includes crosstrack
-  float temp = (9000l - nav_bearing) * RADX100;
-  trig[_X] = cos(temp);
-  trig[_Y] = sin(temp);
+  // the leg direction turned by the correction
+  s = navSin(correction);
+  c = navCos(correction);
+  dir[_X] = (leg.u[LON] * c + leg.u[LAT] * s) >> 14;   // east:  sin(nav_bearing)
+  dir[_Y] = (leg.u[LAT] * c - leg.u[LON] * s) >> 14;   // north: cos(nav_bearing)
 
   for (axis=0;axis<2;axis++) {
-    rate_error[axis] = (trig[axis] * max_speed) - actual_speed[axis]; 
+    rate_error[axis] = (dir[axis] * max_speed >> 14) - actual_speed[axis]; 
     rate_error[axis] = constrain(rate_error[axis], -1000, 1000);
     // P + I + D
     nav[axis]      =
@@ -889,21 +975,6 @@ static void GPS_calc_nav_rate(uint16_t max_speed) {
   }
 }
 
-////////////////////////////////////////////////////////////////////////////////////
-// Calculating cross track error, this tries to keep the copter on a direct line 
-// when flying to a waypoint.
-//
-static void GPS_update_crosstrack(void) {
-  if (abs(wrap_18000(target_bearing - original_target_bearing)) < 4500) {  // If we are too far off or too close we don't do track following
-    float temp = (target_bearing - original_target_bearing) * RADX100;
-    crosstrack_error = sin(temp) * (wp_distance * CROSSTRACK_GAIN);  // Meters we are off track line
-    nav_bearing = target_bearing + constrain(crosstrack_error, -3000, 3000);
-    nav_bearing = wrap_36000(nav_bearing);
-  }else{
-    nav_bearing = target_bearing;
-  }
-}
-
 ////////////////////////////////////////////////////////////////////////////////////
 // Determine desired speed when navigating towards a waypoint, also implement slow 
 // speed rampup when starting a navigation
@@ -928,7 +999,7 @@ static uint16_t GPS_calc_desired_speed(uint16_t max_speed, bool _slow) {
   // limit the ramp up of the speed
   // waypoint_speed_gov is reset to 0 at each new WP command
   if(max_speed > waypoint_speed_gov){
-    waypoint_speed_gov += (int)(100.0 * dTnav); // increase at .5/ms
+    waypoint_speed_gov += dTnav / 10;           // increase at 1m/s per s
     max_speed = waypoint_speed_gov;
   }
   return max_speed;
@@ -947,91 +1018,6 @@ int32_t wrap_36000(int32_t ang) {
 // This code is used for parsing NMEA data
 #if defined(GPS_SERIAL)
 
-/* Alex optimization 
-  The latitude or longitude is coded this way in NMEA frames
-  dm.f   coded as degrees + minutes + minute decimal
-  Where:
-    - d can be 1 or more char long. generally: 2 char long for latitude, 3 char long for longitude
-    - m is always 2 char long
-    - f can be 1 or more char long
-  This function converts this format in a unique unsigned long where 1 degree = 10 000 000
-
-  EOS increased the precision here, even if we think that the gps is not precise enough, with 10e5 precision it has 76cm resolution
-  with 10e7 it's around 1 cm now. Increasing it further is irrelevant, since even 1cm resolution is unrealistic, however increased 
-  resolution also increased precision of nav calculations
-*/
-/* This calc adds approc 2km error to the gps coordinates reverted back to the original working one 
-uint32_t GPS_coord_to_degrees(char* s) {
-  char *p = s, *d = s;
-  uint8_t min, deg = 0;
-  uint16_t frac = 0, mult = 10000;
-  
-  while(*p) {                                   // parse the string until its end
-    if (d != s) {frac+=(*p-'0')*mult;mult/=10;} // calculate only fractional part on up to 5 digits  (d != s condition is true when the . is located)
-    if (*p == '.') d=p;                         // locate '.' char in the string
-    p++;
-  }
-  if (p==s) return 0;
-  while (s<d-2) {deg *= 10;deg += *(s++)-'0';}  // convert degrees : all chars before minutes ; for the first iteration, deg = 0
-  min = *(d-1)-'0' + (*(d-2)-'0')*10;           // convert minutes : 2 previous char before '.'
-  return deg * 10000000UL + (min * 100000UL + frac)*10UL / 6;
-}
-*/
-
-#define DIGIT_TO_VAL(_x)        (_x - '0')
-uint32_t GPS_coord_to_degrees(char* s) {
-  char *p, *q;
-  uint8_t deg = 0, min = 0;
-  unsigned int frac_min = 0;
-  uint8_t i;
-
-  // scan for decimal point or end of field
-  for (p = s; isdigit(*p); p++) ;
-  q = s;
-
-  // convert degrees
-  while ((p - q) > 2) {
-    if (deg)
-      deg *= 10;
-    deg += DIGIT_TO_VAL(*q++);
-  }
-  // convert minutes
-  while (p > q) {
-    if (min)
-      min *= 10;
-    min += DIGIT_TO_VAL(*q++);
-  }
-  // convert fractional minutes
-  // expect up to four digits, result is in
-  // ten-thousandths of a minute
-  if (*p == '.') {
-    q = p + 1;
-    for (i = 0; i < 4; i++) {
-      frac_min *= 10;
-      if (isdigit(*q))
-        frac_min += *q++ - '0';
-    }
-  }
-  return deg * 10000000UL + (min * 1000000UL + frac_min*100UL) / 6;
-}
-
-// helper functions 
-uint16_t grab_fields(char* src, uint8_t mult) {  // convert string to uint16
-  uint8_t i;
-  uint16_t tmp = 0;
-
-  for(i=0; src[i]!=0; i++) {
-    if(src[i] == '.') {
-      i++;
-      if(mult==0)   break;
-      else  src[i+mult] = 0;
-    }
-    tmp *= 10;
-    if(src[i] >='0' && src[i] <='9') tmp += src[i]-'0';
-  }
-  return tmp;
-}
-
 uint8_t hex_c(uint8_t n) {    // convert '0'..'9','A'..'F' to 0..15
   n -= '0';
   if(n>9)  n -= 7;
@@ -1039,18 +1025,40 @@ uint8_t hex_c(uint8_t n) {    // convert '0'..'9','A'..'F' to 0..15
   return n;
 } 
 
-bool GPS_newFrame(char c) {
+/* The GPS bytes are parsed by blocks: GPS_serialFrame() copies what the UART received in a chunk
+   (the RX ring interleaves the ports), GPS_parse() walks it and stops after the message of a new fix,
+   returning the bytes it took. The protocols keep their state between two blocks. */
+uint8_t GPS_parse(const uint8_t *data, uint8_t len, uint8_t *fix) {
+  *fix = 0;
   #if defined(NMEA)
-    return GPS_NMEA_newFrame(c);
+    return GPS_NMEA_parse(data, len, fix);
   #endif
   #if defined(UBLOX)
-    return GPS_UBLOX_newFrame(c);
+    return GPS_UBLOX_parse(data, len, fix);
   #endif
   #if defined(MTK_BINARY16) || defined(MTK_BINARY19)
-    return GPS_MTK_newFrame(c);
+    uint8_t n = 0;
+    while (n < len) if (GPS_MTK_newFrame(data[n++])) { *fix = 1; break; }
+    return n;
   #endif
 }
 
+static bool GPS_serialFrame(void) {
+  static uint8_t chunk[GPS_CHUNK];
+  static uint8_t chunkLen = 0, chunkPos = 0;
+  uint8_t fix;
+
+  for (;;) {
+    if (chunkPos == chunkLen) {
+      chunkPos = 0;
+      chunkLen = SerialReadBuf(GPS_SERIAL, chunk, GPS_CHUNK);
+      if (chunkLen == 0) return false;
+    }
+    chunkPos += GPS_parse(chunk + chunkPos, chunkLen - chunkPos, &fix);
+    if (fix) return true;
+  }
+}
+
 #if defined(NMEA)
   /* This is a light implementation of a GPS frame decoding
      This should work with most of modern GPS devices configured to output NMEA frames.
@@ -1062,53 +1070,194 @@ bool GPS_newFrame(char c) {
        - GPS num sat (4 is enough to be +/- reliable)
        - GPS altitude
        - GPS speed
+     The fields are decoded as they come, digits into an integer and its count of fraction digits,
+     following the decoders of the sentence in nmeaSentences (GP, GN, GL... talkers alike). They are
+     kept apart until the checksum is checked, then the values of the sentence are taken.
+
+     The latitude or longitude is coded this way in NMEA frames
+       dm.f   coded as degrees + minutes + minute decimal
+     Up to 5 decimals are kept: degrees * 10 000 000 + minutes * 100 000 * 10/6, around 1cm.
   */
-  #define FRAME_GGA  1
-  #define FRAME_RMC  2
-  
-  bool GPS_NMEA_newFrame(char c) {
-    uint8_t frameOK = 0;
-    static uint8_t param = 0, offset = 0, parity = 0;
-    static char string[15];
-    static uint8_t checksum_param, frame = 0;
-  
-    if (c == '$') {
-      param = 0; offset = 0; parity = 0;
-    } else if (c == ',' || c == '*') {
-      string[offset] = 0;
-      if (param == 0) { //frame identification
-        frame = 0;
-        if (string[0] == 'G' && string[1] == 'P' && string[2] == 'G' && string[3] == 'G' && string[4] == 'A') frame = FRAME_GGA;
-        if (string[0] == 'G' && string[1] == 'P' && string[2] == 'R' && string[3] == 'M' && string[4] == 'C') frame = FRAME_RMC;
-      } else if (frame == FRAME_GGA) {
-        if      (param == 2)                     {GPS_coord[LAT] = GPS_coord_to_degrees(string);}
-        else if (param == 3 && string[0] == 'S') GPS_coord[LAT] = -GPS_coord[LAT];
-        else if (param == 4)                     {GPS_coord[LON] = GPS_coord_to_degrees(string);}
-        else if (param == 5 && string[0] == 'W') GPS_coord[LON] = -GPS_coord[LON];
-        else if (param == 6)                     {f.GPS_FIX = (string[0]  > '0');}
-        else if (param == 7)                     {GPS_numSat = grab_fields(string,0);}
-        else if (param == 9)                     {GPS_altitude = grab_fields(string,0);}  // altitude in meters added by Mis
-      } else if (frame == FRAME_RMC) {
-        if      (param == 7)                     {GPS_speed = ((uint32_t)grab_fields(string,1)*5144L)/1000L;}  //gps speed in cm/s will be used for navigation
-        else if (param == 8)                     {GPS_ground_course = grab_fields(string,1); }                 //ground course deg*10 
+  enum nmea_decoder {
+    NMEA_SKIP = 0,
+    NMEA_LAT,         // ddmm.mmmmm
+    NMEA_LON,         // dddmm.mmmmm
+    NMEA_NS,          // N or S
+    NMEA_EW,          // E or W
+    NMEA_QUALITY,     // GGA fix quality, 0 no fix
+    NMEA_SATS,
+    NMEA_ALT,         // m
+    NMEA_STATUS,      // RMC A valid, V not
+    NMEA_KNOTS,       // ground speed
+    NMEA_COURSE,      // degrees
+    NMEA_FIXTYPE      // GSA 1 no fix, 2 2D, 3 3D
+  };
+  enum nmea_sentence_id {
+    NMEA_GGA = 0,
+    NMEA_RMC,
+    NMEA_GSA,
+    NMEA_VTG,
+    NMEA_SENTENCES,
+    NMEA_NONE = 0xFF
+  };
+  #define NMEA_FIELDS 9         // decoded fields after the address
+
+  struct nmea_sentence {
+    char    id[3];                   // after the 2 characters of the talker
+    uint8_t field[NMEA_FIELDS];      // decoder of fields 1 to 9
+  };
+  const nmea_sentence nmeaSentences[NMEA_SENTENCES] PROGMEM = {
+    // time, lat, N, lon, E, quality, sats, hdop, alt
+    {{'G','G','A'}, {NMEA_SKIP, NMEA_LAT, NMEA_NS, NMEA_LON, NMEA_EW, NMEA_QUALITY, NMEA_SATS, NMEA_SKIP, NMEA_ALT}},
+    // time, status, lat, N, lon, E, knots, course
+    {{'R','M','C'}, {NMEA_SKIP, NMEA_STATUS, NMEA_LAT, NMEA_NS, NMEA_LON, NMEA_EW, NMEA_KNOTS, NMEA_COURSE, NMEA_SKIP}},
+    // mode, fix type
+    {{'G','S','A'}, {NMEA_SKIP, NMEA_FIXTYPE, NMEA_SKIP, NMEA_SKIP, NMEA_SKIP, NMEA_SKIP, NMEA_SKIP, NMEA_SKIP, NMEA_SKIP}},
+    // course, T, magnetic course, M, knots
+    {{'V','T','G'}, {NMEA_COURSE, NMEA_SKIP, NMEA_SKIP, NMEA_SKIP, NMEA_KNOTS, NMEA_SKIP, NMEA_SKIP, NMEA_SKIP, NMEA_SKIP}}
+  };
+
+  enum nmea_state {
+    NMEA_IDLE = 0,      // waiting for $
+    NMEA_FIELD,
+    NMEA_CHECKSUM1,
+    NMEA_CHECKSUM2
+  };
+
+  static struct {
+    uint8_t  state, parity, checksum;
+    uint8_t  field;        // 0 the address
+    uint8_t  sentence;     // nmea_sentence_id
+    uint8_t  decoder;      // of the field
+    uint8_t  letter;       // first character of the field that is not a digit or the point
+    int8_t   decimals;     // digits after the point, -1 before it
+    uint32_t value;        // digits of the field
+  } nmea;
+
+  static struct {          // values of the sentence, taken when its checksum is right
+    int32_t  coord[2];
+    uint8_t  quality, sats, status, fixtype;
+    uint16_t altitude, speed, course;
+  } nmeaData;
+
+  // the field value with that many decimals
+  static uint32_t NMEA_value(uint8_t decimals) {
+    uint32_t v = nmea.value;
+    int8_t d = nmea.decimals < 0 ? 0 : nmea.decimals;
+    while (d < decimals) { v *= 10; d++; }
+    while (d > decimals) { v /= 10; d--; }
+    return v;
+  }
+
+  static void NMEA_field_end(void) {
+    uint32_t v;
+    if (nmea.field == 0) {                       // address: talker then sentence, value has its last 3 characters
+      nmea.sentence = NMEA_NONE;
+      for (uint8_t i = 0; i < NMEA_SENTENCES; i++) {
+        if ((uint8_t)(nmea.value >> 16) == pgm_read_byte(&nmeaSentences[i].id[0])
+         && (uint8_t)(nmea.value >>  8) == pgm_read_byte(&nmeaSentences[i].id[1])
+         && (uint8_t)(nmea.value      ) == pgm_read_byte(&nmeaSentences[i].id[2])) nmea.sentence = i;
       }
-      param++; offset = 0;
-      if (c == '*') checksum_param=1;
-      else parity ^= c;
-    } else if (c == '\r' || c == '\n') {
-      if (checksum_param) { //parity checksum
-        uint8_t checksum = hex_c(string[0]);
-        checksum <<= 4;
-        checksum += hex_c(string[1]);
-        if (checksum == parity) frameOK = 1;
+    } else switch (nmea.decoder) {
+      case NMEA_LAT:
+      case NMEA_LON:
+        v = NMEA_value(5);                         // ddmm.mmmmm * 100 000
+        nmeaData.coord[nmea.decoder == NMEA_LAT ? LAT : LON] = (v / 10000000UL) * 10000000UL + (v % 10000000UL) * 10 / 6;
+        break;
+      case NMEA_NS:      if (nmea.letter == 'S') nmeaData.coord[LAT] = -nmeaData.coord[LAT]; break;
+      case NMEA_EW:      if (nmea.letter == 'W') nmeaData.coord[LON] = -nmeaData.coord[LON]; break;
+      case NMEA_QUALITY: nmeaData.quality  = NMEA_value(0); break;
+      case NMEA_SATS:    nmeaData.sats     = NMEA_value(0); break;
+      case NMEA_ALT:     nmeaData.altitude = NMEA_value(0); break;                    // m
+      case NMEA_STATUS:  nmeaData.status   = nmea.letter; break;
+      case NMEA_KNOTS:   nmeaData.speed    = NMEA_value(2) * 5144 / 10000; break;      // cm/s
+      case NMEA_COURSE:  nmeaData.course   = NMEA_value(1); break;                    // deg*10
+      case NMEA_FIXTYPE: nmeaData.fixtype  = NMEA_value(0); break;
+    }
+    nmea.field++;
+    nmea.decoder = (nmea.sentence == NMEA_NONE || nmea.field > NMEA_FIELDS) ? NMEA_SKIP
+                 : pgm_read_byte(&nmeaSentences[nmea.sentence].field[nmea.field - 1]);
+    nmea.value = 0; nmea.decimals = -1; nmea.letter = 0;
+  }
+
+  // a sentence with the right checksum: its values are taken, true for a GGA
+  static bool NMEA_sentence_end(void) {
+    GPS_Present = 1;
+    switch (nmea.sentence) {
+      case NMEA_GGA:
+        GPS_coord[LAT] = nmeaData.coord[LAT];
+        GPS_coord[LON] = nmeaData.coord[LON];
+        f.GPS_FIX      = nmeaData.quality > 0;
+        GPS_numSat     = nmeaData.sats;
+        GPS_altitude   = nmeaData.altitude;
+        return true;
+      case NMEA_RMC:
+        if (nmeaData.status != 'A') break;
+      case NMEA_VTG:
+        GPS_speed         = nmeaData.speed;        //gps speed in cm/s will be used for navigation
+        GPS_ground_course = nmeaData.course;       //ground course deg*10
+        break;
+      case NMEA_GSA:
+        if (nmeaData.fixtype == 1) f.GPS_FIX = 0;
+        break;
+    }
+    return false;
+  }
+
+  // the state of the sentence is kept in locals over the block, the struct only holds it between two fields
+  uint8_t GPS_NMEA_parse(const uint8_t *data, uint8_t len, uint8_t *fix) {
+    const uint8_t *p = data, *end = data + len;
+    uint8_t  state = nmea.state, parity = nmea.parity, decoder = nmea.decoder, letter = nmea.letter;
+    int8_t   decimals = nmea.decimals;
+    uint32_t value = nmea.value;
+
+    while (p < end) {
+      uint8_t c = *p++;
+      if (c == '$') {
+        state = NMEA_FIELD; parity = 0; nmea.field = 0; nmea.sentence = NMEA_NONE;
+        decoder = NMEA_SKIP; value = 0; decimals = -1; letter = 0;
+        continue;
+      }
+      if (state == NMEA_FIELD) {
+        if (c == ',' || c == '*') {
+          nmea.value = value; nmea.decimals = decimals; nmea.letter = letter; nmea.decoder = decoder;
+          NMEA_field_end();
+          decoder = nmea.decoder; value = 0; decimals = -1; letter = 0;
+          if (c == '*') state = NMEA_CHECKSUM1;
+          else parity ^= c;
+          continue;
+        }
+        parity ^= c;
+        if (decoder != NMEA_SKIP) {
+          if ((uint8_t)(c - '0') <= 9) {
+            if (decimals < 5) {
+              value = value * 10 + (c - '0');
+              if (decimals >= 0) decimals++;
+            }
+          } else if (c == '.') {
+            decimals = 0;
+          } else if (!letter) {
+            letter = c;
+          }
+        } else if (nmea.field == 0) {
+          value = (value << 8) | c;
+        } else if (c == '\r' || c == '\n') {
+          state = NMEA_IDLE;                         // no checksum
+        }
+      } else if (state == NMEA_CHECKSUM1) {
+        nmea.checksum = hex_c(c) << 4;
+        state = NMEA_CHECKSUM2;
+      } else if (state == NMEA_CHECKSUM2) {
+        state = NMEA_IDLE;
+        if ((nmea.checksum | hex_c(c)) == parity && NMEA_sentence_end()) {
+          *fix = 1;
+          break;
+        }
       }
-      checksum_param=0;
-    } else {
-       if (offset < 15) string[offset++] = c;
-       if (!checksum_param) parity ^= c;
     }
-    if (frame) GPS_Present = 1;
-    return frameOK && (frame==FRAME_GGA);
+    nmea.state = state; nmea.parity = parity; nmea.decoder = decoder; nmea.letter = letter;
+    nmea.decimals = decimals; nmea.value = value;
+    return p - data;
   }
 #endif //NMEA
 
@@ -1159,6 +1308,36 @@ bool GPS_newFrame(char c) {
     uint32_t speed_accuracy;
     uint32_t heading_accuracy;
   };
+  struct ubx_nav_pvt {      // u-blox 7 and later, 92 bytes
+    uint32_t time;  // GPS msToW
+    uint16_t year;
+    uint8_t month, day, hour, min, sec;
+    uint8_t valid;
+    uint32_t time_accuracy;
+    int32_t time_nsec;
+    uint8_t fix_type;
+    uint8_t fix_status;
+    uint8_t fix_status2;
+    uint8_t satellites;
+    int32_t longitude;
+    int32_t latitude;
+    int32_t altitude_ellipsoid;
+    int32_t altitude_msl;
+    uint32_t horizontal_accuracy;
+    uint32_t vertical_accuracy;
+    int32_t ned_north;
+    int32_t ned_east;
+    int32_t ned_down;
+    int32_t speed_2d;       // mm/s
+    int32_t heading_2d;     // deg * 100000
+    uint32_t speed_accuracy;
+    uint32_t heading_accuracy;
+    uint16_t position_DOP;
+    uint8_t res[6];
+    int32_t heading_vehicle;
+    int16_t mag_declination;
+    uint16_t mag_accuracy;
+  };
   
   enum ubs_protocol_bytes {
     PREAMBLE1 = 0xb5,
@@ -1171,6 +1350,7 @@ bool GPS_newFrame(char c) {
     MSG_POSLLH = 0x2,
     MSG_STATUS = 0x3,
     MSG_SOL = 0x6,
+    MSG_PVT = 0x7,
     MSG_VELNED = 0x12,
     MSG_CFG_PRT = 0x00,
     MSG_CFG_RATE = 0x08,
@@ -1211,74 +1391,85 @@ bool GPS_newFrame(char c) {
 //    ubx_nav_status status;
     ubx_nav_solution solution;
     ubx_nav_velned velned;
-    uint8_t bytes[];
+    ubx_nav_pvt pvt;
+    uint8_t bytes[sizeof(ubx_nav_pvt)];
    } _buffer;
   
-  void _update_checksum(uint8_t *data, uint8_t len, uint8_t &ck_a, uint8_t &ck_b) {
-    while (len--) {
-      ck_a += *data;
-      ck_b += ck_a;
-      data++;
-    }
-  }
-  
-  bool GPS_UBLOX_newFrame(uint8_t data){
-    bool parsed = false;
-
-    switch(_step) {
-      case 1:
-        if (PREAMBLE2 == data) {
+  // the header and checksum bytes go through the state machine, the payload is taken
+  // as a span of the block: copied up to the size of the buffer and summed in one loop
+  uint8_t GPS_UBLOX_parse(const uint8_t *buf, uint8_t len, uint8_t *fix) {
+    const uint8_t *p = buf, *end = buf + len;
+
+    while (p < end) {
+      if (_step == 6) {                                        // payload
+        uint16_t n = _payload_length - _payload_counter;
+        if (n > (uint16_t)(end - p)) n = end - p;
+        uint8_t a = _ck_a, b = _ck_b;
+        uint8_t *dst = _buffer.bytes + _payload_counter;
+        uint16_t copy = _payload_counter < sizeof(_buffer) ? sizeof(_buffer) - _payload_counter : 0;
+        if (copy > n) copy = n;
+        for (uint16_t i = 0; i < n; i++) {
+          uint8_t d = p[i];
+          if (i < copy) dst[i] = d;
+          b += (a += d);
+        }
+        _ck_a = a; _ck_b = b;
+        p += n;
+        if ((_payload_counter += n) == _payload_length) _step++;
+        continue;
+      }
+      uint8_t data = *p++;
+      switch(_step) {
+        case 1:
+          if (PREAMBLE2 == data) {
+            _step++;
+            break;
+          }
+          _step = 0;
+        case 0:
+          if(PREAMBLE1 == data) _step++;
+          break;
+        case 2:
           _step++;
+          _class = data;
+          _ck_b = _ck_a = data;  // reset the checksum accumulators
           break;
-        }
-        _step = 0;
-      case 0:
-        if(PREAMBLE1 == data) _step++;
-        break;
-      case 2:
-        _step++;
-        _class = data;
-        _ck_b = _ck_a = data;  // reset the checksum accumulators
-        break;
-      case 3:
-        _step++;
-        _ck_b += (_ck_a += data);  // checksum byte
-        _msg_id = data;
-        break;
-      case 4:
-        _step++;
-        _ck_b += (_ck_a += data);  // checksum byte
-        _payload_length = data;  // payload length low byte
+        case 3:
+          _step++;
+          _ck_b += (_ck_a += data);  // checksum byte
+          _msg_id = data;
+          break;
+        case 4:
+          _step++;
+          _ck_b += (_ck_a += data);  // checksum byte
+          _payload_length = data;  // payload length low byte
+          break;
+        case 5:
+          _step++;
+          _ck_b += (_ck_a += data);  // checksum byte
+          _payload_length += (uint16_t)(data<<8);
+          if (_payload_length > 512) {
+            _payload_length = 0;
+            _step = 0;
+          }
+          _payload_counter = 0;  // prepare to receive payload
+          if (_payload_length == 0) _step++;
         break;
-      case 5:
-        _step++;
-        _ck_b += (_ck_a += data);  // checksum byte
-        _payload_length += (uint16_t)(data<<8);
-        if (_payload_length > 512) {
-          _payload_length = 0;
-          _step = 0;
-        }
-        _payload_counter = 0;  // prepare to receive payload
-      break;
-      case 6:
-        _ck_b += (_ck_a += data);  // checksum byte
-        if (_payload_counter < sizeof(_buffer)) {
-          _buffer.bytes[_payload_counter] = data;
-        }
-        if (++_payload_counter == _payload_length)
+        case 7:
           _step++;
+          if (_ck_a != data) _step = 0;  // bad checksum
         break;
-      case 7:
-        _step++;
-        if (_ck_a != data) _step = 0;  // bad checksum
-      break;
-      case 8:
-        _step = 0;
-        if (_ck_b != data)  break;  // bad checksum
-        GPS_Present = 1;
-        if (UBLOX_parse_gps())  { parsed = true; }
-    } //end switch
-    return parsed;
+        case 8:
+          _step = 0;
+          if (_ck_b != data)  break;  // bad checksum
+          GPS_Present = 1;
+          if (UBLOX_parse_gps()) {
+            *fix = 1;
+            return p - buf;
+          }
+      } //end switch
+    }
+    return len;
   }
 
   bool UBLOX_parse_gps(void) {
@@ -1302,6 +1493,19 @@ bool GPS_newFrame(char c) {
       GPS_speed         = _buffer.velned.speed_2d;  // cm/s
       GPS_ground_course = (uint16_t)(_buffer.velned.heading_2d / 10000);  // Heading 2D deg * 100000 rescaled to deg * 10
       break;
+    case MSG_PVT:         // SOL, POSLLH and VELNED in one message
+      _fix_ok = 0;
+      if((_buffer.pvt.fix_status & NAV_STATUS_FIX_VALID) && (_buffer.pvt.fix_type == FIX_3D || _buffer.pvt.fix_type == FIX_2D)) _fix_ok = 1;
+      GPS_numSat = _buffer.pvt.satellites;
+      if(_fix_ok) {
+        GPS_coord[LON] = _buffer.pvt.longitude;
+        GPS_coord[LAT] = _buffer.pvt.latitude;
+        GPS_altitude   = _buffer.pvt.altitude_msl / 1000;         //alt in m
+      }
+      f.GPS_FIX = _fix_ok;
+      GPS_speed         = _buffer.pvt.speed_2d / 10;              // mm/s to cm/s
+      GPS_ground_course = (uint16_t)(_buffer.pvt.heading_2d / 10000);
+      return true;
     default:
       break;
     }
@@ -13,9 +13,20 @@ extern int32_t wrap_18000(int32_t ang);
 void GPS_set_pids(void);
 void GPS_SerialInit(void);
 void GPS_NewData(void);
+#if defined(GPS_SERIAL)
+  uint8_t GPS_parse(const uint8_t *data, uint8_t len, uint8_t *fix);   // bytes taken, *fix 1 after the message of a fix
+#endif
 void GPS_reset_home_position(void);
+void GPS_calc_longitude_scaling(int32_t lat);
+void GPS_distance_cm_bearing(int32_t* lat1, int32_t* lon1, int32_t* lat2, int32_t* lon2,uint32_t* dist, int32_t* bearing);
 void GPS_set_next_wp(int32_t* lat, int32_t* lon);
 void GPS_reset_nav(void);
+#if defined(GPS_NAV)
+  extern uint8_t GPS_mission_steps;     // waypoints of the mission loaded at arming
+  extern uint8_t GPS_mission_step;      // the one flown to or held, from 0
+  void GPS_mission_load(void);
+  uint8_t GPS_mission_start(void);
+#endif
 #if defined(I2C_GPS)
   void GPS_I2C_command(uint8_t command, uint8_t wp);
 #endif
@@ -25,11 +25,11 @@ void computeIMU () {
   //gyro only: the delay to read 2 consecutive values can be reduced to only 0.65ms
   #if defined(NUNCHUCK)
     annexCode();
-    while((uint16_t)(micros()-timeInterleave)<INTERLEAVING_DELAY) ; //interleaving delay between 2 consecutive reads
+    interleaveWait(timeInterleave, INTERLEAVING_DELAY); //interleaving delay between 2 consecutive reads, the loop tasks may run meanwhile
     timeInterleave=micros();
     ACC_getADC();
     getEstimatedAttitude(); // computation time must last less than one interleaving delay
-    while((uint16_t)(micros()-timeInterleave)<INTERLEAVING_DELAY) ; //interleaving delay between 2 consecutive reads
+    interleaveWait(timeInterleave, INTERLEAVING_DELAY); //interleaving delay between 2 consecutive reads
     timeInterleave=micros();
     f.NUNCHUKDATA = 1;
     while(f.NUNCHUKDATA) ACC_getADC(); // For this interleaving reading, we must have a gyro update at this point (less delay)
@@ -41,30 +41,39 @@ void computeIMU () {
       gyroADCprevious[axis] = imu.gyroADC[axis];
     }
   #else
-    #if ACC
-      ACC_getADC();
-      getEstimatedAttitude();
-    #endif
     #if GYRO
       Gyro_getADC();
     #endif
     for (axis = 0; axis < 3; axis++)
       gyroADCp[axis] =  imu.gyroADC[axis];
     timeInterleave=micros();
+    STAGE_BEGIN(STAGE_ANNEX);
     annexCode();
-    if ((uint16_t)(micros()-timeInterleave)>650) {
-       annex650_overrun_count++;
-    } else {
-       while((uint16_t)(micros()-timeInterleave)<650) ; //empirical, interleaving delay between 2 consecutive reads
-    }
+    STAGE_END(STAGE_ANNEX);
+    if ((uint16_t)(micros() - timeInterleave) > 650) annex650_overrun_count++;
+    #if ACC
+      // the accelerometer read and the attitude do not need the second gyro read: they
+      // fill the interleaving delay first (all of it at 100kHz), the loop tasks get the rest
+      ACC_getADC();
+      STAGE_BEGIN(STAGE_ATTITUDE);
+      getEstimatedAttitude();
+      STAGE_END(STAGE_ATTITUDE);
+    #endif
+    STAGE_BEGIN(STAGE_INTERLEAVE);
+    interleaveWait(timeInterleave, 650); //empirical, interleaving delay between 2 consecutive reads, the loop tasks may run meanwhile
+    STAGE_END(STAGE_INTERLEAVE);
     #if GYRO
       Gyro_getADC();
     #endif
     for (axis = 0; axis < 3; axis++) {
-      gyroADCinter[axis] =  imu.gyroADC[axis]+gyroADCp[axis];
-      // empirical, we take a weighted value of the current and the previous values
-      imu.gyroData[axis] = (gyroADCinter[axis]+gyroADCprevious[axis])/3;
-      gyroADCprevious[axis] = gyroADCinter[axis]>>1;
+      #if defined(GYRO_LPF_HZ)
+        imu.gyroData[axis] = imu.gyroADC[axis];  // the low pass of GYRO_Common already smoothed the reads
+      #else
+        gyroADCinter[axis] =  imu.gyroADC[axis]+gyroADCp[axis];
+        // empirical, we take a weighted value of the current and the previous values
+        imu.gyroData[axis] = (gyroADCinter[axis]+gyroADCprevious[axis])/3;
+        gyroADCprevious[axis] = gyroADCinter[axis]>>1;
+      #endif
       if (!ACC) imu.accADC[axis]=0;
     }
   #endif
@@ -181,28 +190,141 @@ void rotateV(struct fp_vector *v,float* delta) {
 static int32_t accLPF32[3]    = {0, 0, 1};
 static float invG; // 1/|G|
 
-static t_fp_vector EstG;
+#if ATTITUDE_ESTIMATOR != 3 || MAG || defined(THROTTLE_ANGLE_CORRECTION)
+  static t_fp_vector EstG;
+#endif
 static t_int32_t_vector EstG32;
 #if MAG
   static t_int32_t_vector EstM32;
   static t_fp_vector EstM;
 #endif
 
+// **************************************************
+// Mahony quaternion filter (ATTITUDE_ESTIMATOR 2 and 3)
+// The attitude is a quaternion turned by the gyro at each update, the
+// accelerometer pulls its gravity direction back with a proportional
+// correction (no integral term: the gyro zero comes from the calibration,
+// as for the complementary filter). The rotation is exact to first order
+// in the gyro angle, where rotateV() only turns the gravity vector with a
+// small angle approximation that drifts at high rates.
+// Axes are those of EstG: X left, Y back, Z up. The gyro turns the body by
+// (gyroADC[PITCH], -gyroADC[ROLL], -gyroADC[YAW]) in them.
+//
+// Mahony, Hamel, Pflimlin: Nonlinear complementary filters on the special orthogonal group, 2008
+// **************************************************
+#if ATTITUDE_ESTIMATOR < 1 || ATTITUDE_ESTIMATOR > 3
+  #error "*** you must set ATTITUDE_ESTIMATOR to one existing implementation"
+#endif
+#ifndef IMU_QUAT_KP
+  #define IMU_QUAT_KP 0.25f // 1/s, accelerometer correction: the 4s time constant of GYR_CMPF_FACTOR at a 6.6ms cycle
+#endif
+
+#if ATTITUDE_ESTIMATOR == 2
+static float q0 = 1.0f, q1 = 0.0f, q2 = 0.0f, q3 = 0.0f;
+
+void quaternionUpdate(uint16_t dt, float scale, uint8_t validAcc) {
+  float dx = imu.gyroADC[PITCH] * scale; // radian
+  float dy = -imu.gyroADC[ROLL] * scale;
+  float dz = -imu.gyroADC[YAW]  * scale;
+  float a0 = q0, a1 = q1, a2 = q2, a3 = q3, n;
+
+  if (validAcc) {
+    // estimated gravity direction, the third row of the rotation matrix
+    float vx = 2.0f * (a1*a3 - a0*a2);
+    float vy = 2.0f * (a0*a1 + a2*a3);
+    float vz = a0*a0 - a1*a1 - a2*a2 + a3*a3;
+    // error = measured x estimated, the acc norm is within 15% of 1G here
+    float k = IMU_QUAT_KP * 1e-6f / ACC_1G * dt;
+    dx += (imu.accSmooth[PITCH] * vz - imu.accSmooth[YAW]   * vy) * k;
+    dy += (imu.accSmooth[YAW]   * vx - imu.accSmooth[ROLL]  * vz) * k;
+    dz += (imu.accSmooth[ROLL]  * vy - imu.accSmooth[PITCH] * vx) * k;
+  }
+  // q += q * (0, d) / 2
+  q0 += 0.5f * (-a1*dx - a2*dy - a3*dz);
+  q1 += 0.5f * ( a0*dx + a2*dz - a3*dy);
+  q2 += 0.5f * ( a0*dy - a1*dz + a3*dx);
+  q3 += 0.5f * ( a0*dz + a1*dy - a2*dx);
+  n = InvSqrt(q0*q0 + q1*q1 + q2*q2 + q3*q3);
+  q0 *= n; q1 *= n; q2 *= n; q3 *= n;
+
+  EstG.V.X = 2.0f * (q1*q3 - q0*q2) * ACC_1G;
+  EstG.V.Y = 2.0f * (q0*q1 + q2*q3) * ACC_1G;
+  EstG.V.Z = (q0*q0 - q1*q1 - q2*q2 + q3*q3) * ACC_1G;
+  for (uint8_t axis = 0; axis < 3; axis++) EstG32.A[axis] = EstG.A[axis];
+}
+#endif
+
+#if ATTITUDE_ESTIMATOR == 3
+// quaternion and gravity direction in Q30, 32x32->64 bit products: no float on the way
+#define Q30              (1L<<30)
+#define GYRO_SCALE_Q40   ((int32_t)(GYRO_SCALE * 1099511627776.0 + 0.5))  // radian/microsecond/LSB, 2^40
+#define IMU_QUAT_KP_Q30  ((int32_t)(IMU_QUAT_KP * 1e-6 * Q30 + 0.5))      // per microsecond
+
+static int32_t qf[4] = {Q30, 0, 0, 0};
+
+void quaternionUpdate(uint16_t dt, uint8_t validAcc) {
+  int32_t gdt = dt * GYRO_SCALE_Q40;             // 16 bit dt * 13 bit scale: fits
+  int32_t d[3], a0 = qf[0], a1 = qf[1], a2 = qf[2], a3 = qf[3], k;
+  int64_t n2;
+
+  d[0] =  ((int64_t)imu.gyroADC[PITCH] * gdt) >> 10;  // Q30 radian
+  d[1] = -(((int64_t)imu.gyroADC[ROLL] * gdt) >> 10);
+  d[2] = -(((int64_t)imu.gyroADC[YAW]  * gdt) >> 10);
+
+  if (validAcc) {
+    int32_t vx = ((int64_t)a1*a3 - (int64_t)a0*a2) >> 29;
+    int32_t vy = ((int64_t)a0*a1 + (int64_t)a2*a3) >> 29;
+    int32_t vz = ((int64_t)a0*a0 - (int64_t)a1*a1 - (int64_t)a2*a2 + (int64_t)a3*a3) >> 30;
+    int32_t kdt = IMU_QUAT_KP_Q30 * dt;
+    // measured x estimated, in Q30 of 1G, then times Kp.dt
+    d[0] += ((((int64_t)imu.accSmooth[PITCH] * vz - (int64_t)imu.accSmooth[YAW]   * vy) / ACC_1G) * kdt) >> 30;
+    d[1] += ((((int64_t)imu.accSmooth[YAW]   * vx - (int64_t)imu.accSmooth[ROLL]  * vz) / ACC_1G) * kdt) >> 30;
+    d[2] += ((((int64_t)imu.accSmooth[ROLL]  * vy - (int64_t)imu.accSmooth[PITCH] * vx) / ACC_1G) * kdt) >> 30;
+  }
+  // q += q * (0, d) / 2
+  qf[0] += (-(int64_t)a1*d[0] - (int64_t)a2*d[1] - (int64_t)a3*d[2]) >> 31;
+  qf[1] += ( (int64_t)a0*d[0] + (int64_t)a2*d[2] - (int64_t)a3*d[1]) >> 31;
+  qf[2] += ( (int64_t)a0*d[1] - (int64_t)a1*d[2] + (int64_t)a3*d[0]) >> 31;
+  qf[3] += ( (int64_t)a0*d[2] + (int64_t)a1*d[1] - (int64_t)a2*d[0]) >> 31;
+  // |q| stays close to 1: one Newton step of 1/sqrt from 1, q *= (3 - |q|^2) / 2
+  n2 = ((int64_t)qf[0]*qf[0] + (int64_t)qf[1]*qf[1] + (int64_t)qf[2]*qf[2] + (int64_t)qf[3]*qf[3]) >> 30;
+  k = (3 * (int64_t)Q30 - n2) >> 1;
+  for (uint8_t i = 0; i < 4; i++) qf[i] = ((int64_t)qf[i] * k) >> 30;
+
+  EstG32.V.X = ((((int64_t)qf[1]*qf[3] - (int64_t)qf[0]*qf[2]) >> 29) * ACC_1G) >> 30;
+  EstG32.V.Y = ((((int64_t)qf[0]*qf[1] + (int64_t)qf[2]*qf[3]) >> 29) * ACC_1G) >> 30;
+  EstG32.V.Z = ((((int64_t)qf[0]*qf[0] - (int64_t)qf[1]*qf[1] - (int64_t)qf[2]*qf[2] + (int64_t)qf[3]*qf[3]) >> 30) * ACC_1G) >> 30;
+  #if MAG || defined(THROTTLE_ANGLE_CORRECTION)
+    for (uint8_t axis = 0; axis < 3; axis++) EstG.A[axis] = EstG32.A[axis];
+  #endif
+}
+#endif
+
 void getEstimatedAttitude(){
   uint8_t axis;
   int32_t accMag = 0;
-  float scale, deltaGyroAngle[3];
   uint8_t validAcc;
   static uint16_t previousT;
   uint16_t currentT = micros();
+  uint16_t dt = currentT - previousT; // wraps like a 16 bit int
+  #if ATTITUDE_ESTIMATOR != 3 || MAG
+    float scale;
+  #endif
+  #if ATTITUDE_ESTIMATOR == 1 || MAG
+    float deltaGyroAngle[3];
+  #endif
 
 //  Serial.println("getEstimatedAttitude");
-  scale = (currentT - previousT) * GYRO_SCALE; // GYRO_SCALE unit: radian/microsecond
   previousT = currentT;
+  #if ATTITUDE_ESTIMATOR != 3 || MAG
+    scale = dt * GYRO_SCALE; // GYRO_SCALE unit: radian/microsecond
+  #endif
 
   // Initialization
   for (axis = 0; axis < 3; axis++) {
-    deltaGyroAngle[axis] = imu.gyroADC[axis]  * scale; // radian
+    #if ATTITUDE_ESTIMATOR == 1 || MAG
+      deltaGyroAngle[axis] = imu.gyroADC[axis]  * scale; // radian
+    #endif
 
     accLPF32[axis]    -= accLPF32[axis]>>ACC_LPF_FACTOR;
     accLPF32[axis]    += imu.accADC[axis];
@@ -211,7 +333,9 @@ void getEstimatedAttitude(){
     accMag += (int32_t)imu.accSmooth[axis]*imu.accSmooth[axis] ;
   }
  
-  rotateV(&EstG.V,deltaGyroAngle);
+  #if ATTITUDE_ESTIMATOR == 1
+    rotateV(&EstG.V,deltaGyroAngle);
+  #endif
   #if MAG
     rotateV(&EstM.V,deltaGyroAngle);
   #endif
@@ -227,10 +351,17 @@ void getEstimatedAttitude(){
   // Apply complimentary filter (Gyro drift correction)
   // If accel magnitude >1.15G or <0.85G and ACC vector outside of the limit range => we neutralize the effect of accelerometers in the angle estimation.
   // To do that, we just skip filter, as EstV already rotated by Gyro
+  #if ATTITUDE_ESTIMATOR == 2
+    quaternionUpdate(dt, scale, validAcc);
+  #elif ATTITUDE_ESTIMATOR == 3
+    quaternionUpdate(dt, validAcc);
+  #endif
   for (axis = 0; axis < 3; axis++) {
-    if ( validAcc )
-      EstG.A[axis] = (EstG.A[axis] * GYR_CMPF_FACTOR + imu.accSmooth[axis]) * INV_GYR_CMPF_FACTOR;
-    EstG32.A[axis] = EstG.A[axis]; //int32_t cross calculation is a little bit faster than float	
+    #if ATTITUDE_ESTIMATOR == 1
+      if ( validAcc )
+        EstG.A[axis] = (EstG.A[axis] * GYR_CMPF_FACTOR + imu.accSmooth[axis]) * INV_GYR_CMPF_FACTOR;
+      EstG32.A[axis] = EstG.A[axis]; //int32_t cross calculation is a little bit faster than float	
+    #endif
     #if MAG
       EstM.A[axis] = (EstM.A[axis] * GYR_CMPFM_FACTOR  + imu.magADC[axis]) * INV_GYR_CMPFM_FACTOR;
       EstM32.A[axis] = EstM.A[axis];
@@ -274,9 +405,93 @@ void getEstimatedAttitude(){
   }
 
 #if BARO
+#if defined(ALT_KALMAN)
+/* ALT_KALMAN: the baro altitude is the ln() of the pressure ratio to the ground from baroLnTab, times the
+   temperature. The Kalman filter predicts altitude and speed with the vertical acceleration less its bias and
+   corrects the three with the baro altitude error, with the gains of its steady state for UPDATE_INTERVAL
+   (found once, in float). The states run in 1/256 cm, cm/s and cm/s2. */
+#define ALT_SHIFT     8
+#define BARO_LN_FIRST 224       // pressure ratio of the first entry of baroLnTab, in 1/256
+#define BARO_LN_STEPS 40
+#define ACC_CMSS      ((int32_t)(980.665f * (1 << ALT_SHIFT) / ACC_1G))  // one acc unit in 1/256 cm/s2
+
+// ln(ground pressure / pressure) * 2^24, pressure / ground pressure from 224/256 (1100m up) to 264/256 by 1/256
+static const int32_t baroLnTab[BARO_LN_STEPS + 1] = {
+   2240285,  2165553,  2091153,  2017082,  1943335,  1869912,  1796809,  1724022,
+   1651550,  1579390,  1507539,  1435994,  1364753,  1293814,  1223173,  1152828,
+   1082777,  1013017,   943546,   874361,   805461,   736842,   668503,   600442,
+    532655,   465141,   397897,   330922,   264214,   197769,   131587,    65664,
+         0,   -65408,  -130563,  -195465,  -260117,  -324521,  -388679,  -452592,
+   -516263 };
+
+// altitude in cm of the last pressure read over the ground (2cm at most from the log(), between two entries)
+static int32_t baroAltitude(int32_t groundSum) {
+  if (groundSum <= 0) return 0;                 // no baro read yet
+  int32_t r = ((int64_t)baroPressure * (BARO_TAB_SIZE - 1) << 24) / groundSum;  // pressure ratio, 1/2^24
+  int32_t i = (r >> 16) - BARO_LN_FIRST, frac = r & 0xffff;
+  if (i < 0) {                                  // out of the table: on the line of the end entries
+    frac += i * 65536;
+    i = 0;
+  } else if (i >= BARO_LN_STEPS) {
+    frac += (i - BARO_LN_STEPS + 1) * 65536;
+    i = BARO_LN_STEPS - 1;
+  }
+  int32_t ln = baroLnTab[i] + (((int64_t)(baroLnTab[i + 1] - baroLnTab[i]) * frac) >> 16);
+  return ((int64_t)ln * ((baroTemperature + 27315) * 7494L >> 8)) >> 24;   // (T + 273.15) * 29.27 cm
+}
+
+static int32_t altGain[3];      // altitude, speed and bias gains of the baro error, 1/65536
+
+// the steady state gains for updates dt s apart: the Riccati equation iterated until they settle
+static void altKalmanGains(float dt) {
+  // x = F x with F = [1 dt -dt2/2; 0 1 -dt; 0 0 1], the acceleration noise through G = [dt2/2 dt 0]
+  float f[3][3] = { {1, dt, -dt * dt / 2}, {0, 1, -dt}, {0, 0, 1} };
+  float g[3] = { dt * dt / 2, dt, 0 };
+  float p[3][3] = { {0} }, fp[3][3], k[3];
+  float qa = sq((float)ALT_KALMAN_ACC_NOISE), qb = sq((float)ALT_KALMAN_BIAS_NOISE) * dt;
+  float r = sq((float)ALT_KALMAN_BARO_NOISE);
+  uint8_t i, j, n;
+
+  p[0][0] = r; p[1][1] = sq(100.0f); p[2][2] = sq(50.0f);
+  for (n = 0; n < 200; n++) {
+    for (i = 0; i < 3; i++)
+      for (j = 0; j < 3; j++)
+        fp[i][j] = f[i][0] * p[0][j] + f[i][1] * p[1][j] + f[i][2] * p[2][j];
+    for (i = 0; i < 3; i++)
+      for (j = 0; j < 3; j++)
+        p[i][j] = fp[i][0] * f[j][0] + fp[i][1] * f[j][1] + fp[i][2] * f[j][2] + g[i] * g[j] * qa;
+    p[2][2] += qb;
+    for (i = 0; i < 3; i++) k[i] = p[i][0] / (p[0][0] + r);
+    for (i = 0; i < 3; i++)
+      for (j = 0; j < 3; j++)
+        fp[i][j] = p[i][j] - k[i] * p[0][j];
+    memcpy(p, fp, sizeof(p));
+  }
+  for (i = 0; i < 3; i++) altGain[i] = k[i] * 65536;
+}
+#endif
+
+// projection of ACC vector to global Z, with 1G subtructed, less its average while disarmed
+static int16_t getAccZ() {
+  // Math: accZ = A * G / |G| - 1G
+  int16_t accZ = (imu.accSmooth[ROLL] * EstG32.V.X + imu.accSmooth[PITCH] * EstG32.V.Y + imu.accSmooth[YAW] * EstG32.V.Z) * invG;
+
+  static int16_t accZoffset = 0;
+  if (!f.ARMED) {
+    accZoffset -= accZoffset>>3;
+    accZoffset += accZ;
+  }  
+  return accZ - (accZoffset>>3);
+}
+
 uint8_t getEstimatedAltitude(){
-  static int32_t baroGroundPressure;
-  static float vel = 0.0f;
+  #if defined(ALT_KALMAN)
+    static int32_t baroGroundSum, h, v, b;   // h, v, b in 1/256 cm, cm/s, cm/s2
+    int32_t a, e, dt;
+  #else
+    static int32_t baroGroundPressure;
+    static float vel = 0.0f;
+  #endif
   int16_t vel_tmp;
   static uint16_t previousT;
   uint16_t currentT = micros();
@@ -286,17 +501,38 @@ uint8_t getEstimatedAltitude(){
   if (dTime < UPDATE_INTERVAL) return 0;
   previousT = currentT;
 
-  if(calibratingB > 0) {
-    baroGroundPressure = baroPressureSum/(BARO_TAB_SIZE - 1);
-    calibratingB--;
-  }
+  #if defined(ALT_KALMAN)
+    if(calibratingB > 0) {
+      baroGroundSum = baroPressureSum;
+      calibratingB--;
+      if (!altGain[0]) altKalmanGains(UPDATE_INTERVAL * 1e-6f);
+      h = v = b = 0;
+    }
+    BaroAlt = baroAltitude(baroGroundSum);
+
+    // predict with the acceleration less its bias, correct with the baro altitude error
+    dt = ((uint32_t)dTime << 16) / 1000000;   // s, 1/65536
+    a = getAccZ() * ACC_CMSS - b;
+    h += ((int64_t)v * dt + ((((int64_t)a * dt) >> 16) * dt >> 1)) >> 16;
+    v += ((int64_t)a * dt) >> 16;
+    e = (BaroAlt << ALT_SHIFT) - h;
+    h += ((int64_t)altGain[0] * e) >> 16;
+    v += ((int64_t)altGain[1] * e) >> 16;
+    b += ((int64_t)altGain[2] * e) >> 16;
+    alt.EstAlt = (h + (1 << (ALT_SHIFT - 1))) >> ALT_SHIFT;
+  #else
+    if(calibratingB > 0) {
+      baroGroundPressure = baroPressureSum/(BARO_TAB_SIZE - 1);
+      calibratingB--;
+    }
 
-  // pressure relative to ground pressure with temperature compensation (fast!)
-  // baroGroundPressure is not supposed to be 0 here
-  // see: https://code.google.com/p/ardupilot-mega/source/browse/libraries/AP_Baro/AP_Baro.cpp
-  BaroAlt = log( baroGroundPressure * (BARO_TAB_SIZE - 1)/ (float)baroPressureSum ) * (baroTemperature+27315) * 29.271267f; // in cemtimeter 
+    // pressure relative to ground pressure with temperature compensation (fast!)
+    // baroGroundPressure is not supposed to be 0 here
+    // see: https://code.google.com/p/ardupilot-mega/source/browse/libraries/AP_Baro/AP_Baro.cpp
+    BaroAlt = log( baroGroundPressure * (BARO_TAB_SIZE - 1)/ (float)baroPressureSum ) * (baroTemperature+27315) * 29.271267f; // in cemtimeter 
 
-  alt.EstAlt = (alt.EstAlt * 6 + BaroAlt * 2) >> 3; // additional LPF to reduce baro noise (faster by 30 µs)
+    alt.EstAlt = (alt.EstAlt * 6 + BaroAlt * 2) >> 3; // additional LPF to reduce baro noise (faster by 30 µs)
+  #endif
 
   #if (defined(VARIOMETER) && (VARIOMETER != 2)) || !defined(SUPPRESS_BARO_ALTHOLD)
     //P
@@ -309,34 +545,29 @@ uint8_t getEstimatedAltitude(){
     errorAltitudeI = constrain(errorAltitudeI,-30000,30000);
     BaroPID += errorAltitudeI>>9; //I in range +/-60
  
-    // projection of ACC vector to global Z, with 1G subtructed
-    // Math: accZ = A * G / |G| - 1G
-    int16_t accZ = (imu.accSmooth[ROLL] * EstG32.V.X + imu.accSmooth[PITCH] * EstG32.V.Y + imu.accSmooth[YAW] * EstG32.V.Z) * invG;
-
-    static int16_t accZoffset = 0;
-    if (!f.ARMED) {
-      accZoffset -= accZoffset>>3;
-      accZoffset += accZ;
-    }  
-    accZ -= accZoffset>>3;
-    applyDeadband(accZ, ACC_Z_DEADBAND);
-
-    static int32_t lastBaroAlt;
-    int16_t baroVel = (alt.EstAlt - lastBaroAlt) * 1000000.0f / dTime;
-    lastBaroAlt = alt.EstAlt;
-
-    baroVel = constrain(baroVel, -300, 300); // constrain baro velocity +/- 300cm/s
-    applyDeadband(baroVel, 10); // to reduce noise near zero
-
-    // Integrator - velocity, cm/sec
-    vel += accZ * ACC_VelScale * dTime;
-
-    // apply Complimentary Filter to keep the calculated velocity based on baro velocity (i.e. near real velocity). 
-    // By using CF it's possible to correct the drift of integrated accZ (velocity) without loosing the phase, i.e without delay
-    vel = vel * 0.985f + baroVel * 0.015f;
+    #if defined(ALT_KALMAN)
+      vel_tmp = constrain(v >> ALT_SHIFT, -32000, 32000);
+    #else
+      int16_t accZ = getAccZ();
+      applyDeadband(accZ, ACC_Z_DEADBAND);
+
+      static int32_t lastBaroAlt;
+      int16_t baroVel = (alt.EstAlt - lastBaroAlt) * 1000000.0f / dTime;
+      lastBaroAlt = alt.EstAlt;
+
+      baroVel = constrain(baroVel, -300, 300); // constrain baro velocity +/- 300cm/s
+      applyDeadband(baroVel, 10); // to reduce noise near zero
+
+      // Integrator - velocity, cm/sec
+      vel += accZ * ACC_VelScale * dTime;
+
+      // apply Complimentary Filter to keep the calculated velocity based on baro velocity (i.e. near real velocity). 
+      // By using CF it's possible to correct the drift of integrated accZ (velocity) without loosing the phase, i.e without delay
+      vel = vel * 0.985f + baroVel * 0.015f;
+      vel_tmp = vel;
+    #endif
 
     //D
-    vel_tmp = vel;
     applyDeadband(vel_tmp, 5);
     alt.vario = vel_tmp;
     BaroPID -= constrain(conf.pid[PIDALT].D8 * vel_tmp >>4, -150, 150);
@@ -1792,10 +1792,13 @@ void output_fails() {
   LCDprintChar(line2);
 }
 void output_annex() {
-  //                   0123456789
-  strcpy_P(line2,PSTR("annex --"));
+  //                   0123456789012345
+  strcpy_P(line2,PSTR("annex -- rcl ---"));
   line2[6] = digit10(annex650_overrun_count);
   line2[7] = digit1(annex650_overrun_count);
+  line2[13] = digit100(interleaveReclaimed);
+  line2[14] = digit10(interleaveReclaimed);
+  line2[15] = digit1(interleaveReclaimed);
   LCDprintChar(line2);
 }
 static char checkboxitemNames[][4] = {
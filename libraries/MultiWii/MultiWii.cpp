@@ -29,6 +29,10 @@ March  2013     V2.2
 #include "Sensors.h"
 #include "Serial.h"
 #include "GPS.h"
+#include "NavMath.h"
+#if defined(CHIPKIT)
+  #include "Store.h"
+#endif
 
 
 /*********** RC alias *****************/
@@ -72,6 +76,9 @@ const char boxnames[] PROGMEM = // names for dynamic generation of config GUI
   #if GPS
     "GPS HOME;"
     "GPS HOLD;"
+    #if defined(GPS_NAV)
+      "MISSION;"
+    #endif
   #endif
   #if defined(FIXEDWING) || defined(HELICOPTER)
     "PASSTHRU;"
@@ -123,6 +130,9 @@ const uint8_t boxids[] PROGMEM = {// permanent IDs associated to boxes. This way
   #if GPS
     10, //"GPS HOME;"
     11, //"GPS HOLD;"
+    #if defined(GPS_NAV)
+      20, //"MISSION;"
+    #endif
   #endif
   #if defined(FIXEDWING) || defined(HELICOPTER)
     12, //"PASSTHRU;"
@@ -199,6 +209,7 @@ flags_struct_t f;
 
 int16_t  i2c_errors_count = 0;
 int16_t  annex650_overrun_count = 0;
+uint16_t interleaveReclaimed = 0;     // us of the last cycle interleaving delays spent on the loop tasks instead of waiting
 
 
 
@@ -323,6 +334,11 @@ conf_t conf;
   int16_t  nav_rated[2];    //Adding a rate controller to the navigation to make it smoother
 
   uint8_t nav_mode = NAV_MODE_NONE; // Navigation mode
+  #if defined(GPS_NAV)
+    mission_step_struct mission_step;
+    uint8_t GPS_mission_steps;
+    uint8_t GPS_mission_step;
+  #endif
 
   uint8_t alarmArray[16];           // array
  
@@ -490,11 +506,13 @@ void annexCode() { // this code is excetuted at each loop and won't interfere wi
   }
 
   #if !(defined(SPEKTRUM) && defined(PROMINI))  //Only one serial port on ProMini.  Skip serial com if Spektrum Sat in use. Note: Spek code will auto-call serialCom if GUI data detected on serial0.
+    STAGE_BEGIN(STAGE_SERIAL);
     #if defined(GPS_PROMINI)
       if(GPS_Enable == 0) {serialCom();}
     #else
       serialCom();
     #endif
+    STAGE_END(STAGE_SERIAL);
   #endif
 
   #if defined(POWERMETER)
@@ -585,6 +603,9 @@ void setup () {
   STABLEPIN_PINMODE;
   POWERPIN_OFF;
   initOutput();
+  #if defined(CHIPKIT)
+    storeInit();                                // index of the setting records in flash
+  #endif
   readGlobalSet();
   #ifndef NO_FLASH_CHECK
     #if defined(MEGA)
@@ -637,6 +658,12 @@ void setup () {
   #if defined(I2C_GPS) || defined(GPS_SERIAL) || defined(GPS_FROM_OSD)
     GPS_set_pids();
   #endif
+  #if defined(LOOP_PROFILER)
+    profilerReset();
+  #endif
+  #if defined(BLACKBOX)
+    blackboxInit();
+  #endif
   previousTime = micros();
   #if defined(GIMBAL)
    calibratingA = 512;
@@ -732,6 +759,9 @@ void go_arm() {
           powerValueMaxMAH = 0;
         #endif
       #endif
+      #if defined(GPS_NAV)
+        GPS_mission_load();   // the waypoints are not read in flight
+      #endif
       #ifdef LOG_PERMANENT
         plog.arm++;           // #arm events
         plog.running = 1;       // toggle on arm & disarm to monitor for clean shutdown vs. powercut
@@ -759,6 +789,98 @@ void go_disarm() {
   }
 }
 
+// ******** Loop tasks *********
+// the tasks of the loops without a new RC frame, one of them per loop. They are
+// run in the gap between the two gyro reads of computeIMU() when the longest
+// recent run of the next one fits in what is left of it, so that the gap is
+// not spent waiting, and after computeIMU() otherwise.
+static uint8_t  taskOrder = 0;  // never call all functions in the same loop, to avoid high delay spikes
+static uint8_t  taskPending = 0;
+static uint16_t taskCost[5];    // us, longest recent run starting at each taskOrder
+
+static void runTask() {
+  uint8_t order, c;
+  uint16_t start, t;
+
+  taskPending = 0;
+  order = taskOrder;
+  start = micros();
+  switch (taskOrder) {
+    case 0:
+      taskOrder++;
+      #if MAG
+        STAGE_BEGIN(STAGE_MAG);
+        c = Mag_getADC();
+        STAGE_END(STAGE_MAG);
+        if (c) break; // max 350 µs (HMC5883) // only break when we actually did something
+      #endif
+    case 1:
+      taskOrder++;
+      #if BARO
+        STAGE_BEGIN(STAGE_BARO);
+        c = Baro_update();
+        STAGE_END(STAGE_BARO);
+        if (c != 0) break;
+      #endif
+    case 2:
+      taskOrder++;
+      #if BARO
+        STAGE_BEGIN(STAGE_ALT);
+        c = getEstimatedAltitude();
+        STAGE_END(STAGE_ALT);
+        if (c != 0) break;
+      #endif    
+    case 3:
+      taskOrder++;
+      #if GPS
+        STAGE_BEGIN(STAGE_GPS);
+        if(GPS_Enable) GPS_NewData();
+        STAGE_END(STAGE_GPS);
+        break;
+      #endif
+    case 4:
+      taskOrder++;
+      #if SONAR
+        Sonar_update(); //debug[2] = sonarAlt;
+      #endif
+      #ifdef LANDING_LIGHTS_DDR
+        auto_switch_landing_lights();
+      #endif
+      #ifdef VARIOMETER
+        if (f.VARIO_MODE) vario_signaling();
+      #endif
+      break;
+  }
+  if(taskOrder>4) taskOrder-=5;
+  t = (uint16_t)micros() - start;
+  if (t > taskCost[order]) taskCost[order] = t;
+  else taskCost[order] -= (taskCost[order] - t) >> 6;  // slow decay: a task that sometimes lasts long stays out of the gap
+}
+
+// wait until spacing us after start, running the pending task meanwhile if it fits
+// return 1 when the gap was already over before the end of the wait
+uint8_t interleaveWait(uint32_t start, uint16_t spacing) {
+  uint16_t elapsed = micros() - start;
+
+  if (taskPending && elapsed < spacing && taskCost[taskOrder] <= spacing - elapsed) {
+    runTask();
+    uint16_t now = micros() - start;
+    interleaveReclaimed += min(now, spacing) - elapsed;
+    elapsed = now;
+  }
+  #if defined(BLACKBOX)
+    if (elapsed < spacing && blackboxPending()) {
+      blackboxFlush(start, spacing);
+      uint16_t now = micros() - start;
+      interleaveReclaimed += min(now, spacing) - elapsed;
+      elapsed = now;
+    }
+  #endif
+  if (elapsed > spacing) return 1;
+  while((uint16_t)(micros()-start)<spacing) ;
+  return 0;
+}
+
 // ******** Main Loop *********
 #if defined(CHIPKIT) //EDH
 void MultiWii_loop () {
@@ -799,9 +921,19 @@ void loop () {
   #if defined(OPENLRSv2MULTI) 
     Read_OpenLRS_RC();
   #endif 
+  #if defined(RC_FILTER)
+    STAGE_BEGIN(STAGE_COMPUTERC);
+    computeRC();     // every loop: the frames of the receiver in, rcData filtered out
+    STAGE_END(STAGE_COMPUTERC);
+  #endif
   if (currentTime > rcTime ) { // 50Hz
     rcTime = currentTime + 20000;
-    computeRC();
+    STAGE_BEGIN(STAGE_RC);
+    #if !defined(RC_FILTER)
+      STAGE_BEGIN(STAGE_COMPUTERC);
+      computeRC();
+      STAGE_END(STAGE_COMPUTERC);
+    #endif
     // Failsafe routine - added by MIS
     #if defined(FAILSAFE)
       if ( failsafeCnt > (5*FAILSAFE_DELAY) && f.ARMED) {                  // Stabilize, and set Throttle to specified level
@@ -1050,6 +1182,7 @@ void loop () {
           if (!f.GPS_HOME_MODE)  {
             f.GPS_HOME_MODE = 1;
             f.GPS_HOLD_MODE = 0;
+            f.GPS_MISSION_MODE = 0;
             GPSNavReset = 0;
             #if defined(I2C_GPS)
               GPS_I2C_command(I2C_GPS_COMMAND_START_NAV,0);        //waypoint zero
@@ -1058,8 +1191,19 @@ void loop () {
               nav_mode    = NAV_MODE_WP;
             #endif
           }
+        #if defined(GPS_NAV)
+        } else if (rcOptions[BOXGPSNAV] && GPS_mission_steps) {  // GPS_HOME first, then the mission
+          f.GPS_HOME_MODE = 0;
+          if (!f.GPS_MISSION_MODE) {
+            f.GPS_MISSION_MODE = 1;
+            f.GPS_HOLD_MODE = 0;
+            GPSNavReset = 0;
+            GPS_mission_start();
+          }
+        #endif
         } else {
           f.GPS_HOME_MODE = 0;
+          f.GPS_MISSION_MODE = 0;
           if (rcOptions[BOXGPSHOLD] && abs(rcCommand[ROLL])< AP_MODE && abs(rcCommand[PITCH]) < AP_MODE) {
             if (!f.GPS_HOLD_MODE) {
               f.GPS_HOLD_MODE = 1;
@@ -1085,6 +1229,7 @@ void loop () {
       } else {
         f.GPS_HOME_MODE = 0;
         f.GPS_HOLD_MODE = 0;
+        f.GPS_MISSION_MODE = 0;
         #if !defined(I2C_GPS)
           nav_mode = NAV_MODE_NONE;
         #endif
@@ -1095,52 +1240,22 @@ void loop () {
       if (rcOptions[BOXPASSTHRU]) {f.PASSTHRU_MODE = 1;}
       else {f.PASSTHRU_MODE = 0;}
     #endif
+    STAGE_END(STAGE_RC);
  
   } else { // not in rc loop
-    static uint8_t taskOrder=0; // never call all functions in the same loop, to avoid high delay spikes
-    if(taskOrder>4) taskOrder-=5;
-    switch (taskOrder) {
-      case 0:
-        taskOrder++;
-        #if MAG
-          if (Mag_getADC()) break; // max 350 µs (HMC5883) // only break when we actually did something
-        #endif
-      case 1:
-        taskOrder++;
-        #if BARO
-          if (Baro_update() != 0 ) break;
-        #endif
-      case 2:
-        taskOrder++;
-        #if BARO
-          if (getEstimatedAltitude() !=0) break;
-        #endif    
-      case 3:
-        taskOrder++;
-        #if GPS
-          if(GPS_Enable) GPS_NewData();
-          break;
-        #endif
-      case 4:
-        taskOrder++;
-        #if SONAR
-          Sonar_update(); //debug[2] = sonarAlt;
-        #endif
-        #ifdef LANDING_LIGHTS_DDR
-          auto_switch_landing_lights();
-        #endif
-        #ifdef VARIOMETER
-          if (f.VARIO_MODE) vario_signaling();
-        #endif
-        break;
-    }
+    taskPending = 1;  // run in the interleaving delay of computeIMU() if it fits there, after it otherwise
   }
  
+  interleaveReclaimed = 0;
+  STAGE_BEGIN(STAGE_IMU);
   computeIMU();
+  STAGE_END(STAGE_IMU);
+  if (taskPending) runTask();
   // Measure loop rate just afer reading the sensors
   currentTime = micros();
   cycleTime = currentTime - previousTime;
   previousTime = currentTime;
+  STAGE_RECORD(STAGE_CYCLE, cycleTime);
 
   //***********************************
   //**** Experimental FlightModes *****
@@ -1154,6 +1269,7 @@ void loop () {
         f.BARO_MODE=0;
         f.GPS_HOME_MODE=0;
         f.GPS_HOLD_MODE=0;
+        f.GPS_MISSION_MODE=0;
       }
     }
   #endif
@@ -1211,17 +1327,17 @@ void loop () {
   #endif
   
   #if GPS
-    if ( (f.GPS_HOME_MODE || f.GPS_HOLD_MODE) && f.GPS_FIX_HOME ) {
-      float sin_yaw_y = sin(att.heading*0.0174532925f);
-      float cos_yaw_x = cos(att.heading*0.0174532925f);
+    if ( (f.GPS_HOME_MODE || f.GPS_HOLD_MODE || f.GPS_MISSION_MODE) && f.GPS_FIX_HOME ) {
+      int32_t sin_yaw_y = navSin(att.heading*100);    // << 14
+      int32_t cos_yaw_x = navCos(att.heading*100);
       #if defined(NAV_SLEW_RATE)     
         nav_rated[LON]   += constrain(wrap_18000(nav[LON]-nav_rated[LON]),-NAV_SLEW_RATE,NAV_SLEW_RATE);
         nav_rated[LAT]   += constrain(wrap_18000(nav[LAT]-nav_rated[LAT]),-NAV_SLEW_RATE,NAV_SLEW_RATE);
-        GPS_angle[ROLL]   = (nav_rated[LON]*cos_yaw_x - nav_rated[LAT]*sin_yaw_y) /10;
-        GPS_angle[PITCH]  = (nav_rated[LON]*sin_yaw_y + nav_rated[LAT]*cos_yaw_x) /10;
+        GPS_angle[ROLL]   = (nav_rated[LON]*cos_yaw_x - nav_rated[LAT]*sin_yaw_y) / (NAV_ONE*10);
+        GPS_angle[PITCH]  = (nav_rated[LON]*sin_yaw_y + nav_rated[LAT]*cos_yaw_x) / (NAV_ONE*10);
       #else 
-        GPS_angle[ROLL]   = (nav[LON]*cos_yaw_x - nav[LAT]*sin_yaw_y) /10;
-        GPS_angle[PITCH]  = (nav[LON]*sin_yaw_y + nav[LAT]*cos_yaw_x) /10;
+        GPS_angle[ROLL]   = (nav[LON]*cos_yaw_x - nav[LAT]*sin_yaw_y) / (NAV_ONE*10);
+        GPS_angle[PITCH]  = (nav[LON]*sin_yaw_y + nav[LAT]*cos_yaw_x) / (NAV_ONE*10);
       #endif
     } else {
       GPS_angle[ROLL]  = 0;
@@ -1230,6 +1346,7 @@ void loop () {
   #endif
 
   //**** PITCH & ROLL & YAW PID ****
+  STAGE_BEGIN(STAGE_PID);
 #if PID_CONTROLLER == 1 // evolved oldschool
   if ( f.HORIZON_MODE ) prop = min(max(abs(rcCommand[PITCH]),abs(rcCommand[ROLL])),512);
 
@@ -1271,6 +1388,7 @@ void loop () {
     DTerm = ((int32_t)DTerm*dynD8[axis])>>5;        // 32 bits is needed for calculation
 
     axisPID[axis] =  PTerm + ITerm - DTerm;
+    BLACKBOX_PID(axis, PTerm, ITerm, -DTerm);
   }
 
   //YAW
@@ -1292,6 +1410,7 @@ void loop () {
   ITerm = constrain((int16_t)(errorGyroI_YAW>>13),-GYRO_I_MAX,+GYRO_I_MAX);
   
   axisPID[YAW] =  PTerm + ITerm;
+  BLACKBOX_PID(YAW, PTerm, ITerm, 0);
 #elif PID_CONTROLLER == 2 // alexK
   #define GYRO_I_MAX 256
   #define ACC_I_MAX 256
@@ -1354,12 +1473,24 @@ void loop () {
 
     //-----calculate total PID output
     axisPID[axis] =  PTerm + ITerm + DTerm;
+    BLACKBOX_PID(axis, PTerm, ITerm, DTerm);
   }
 #else
   #error "*** you must set PID_CONTROLLER to one existing implementation"
 #endif
+  STAGE_END(STAGE_PID);
+  STAGE_BEGIN(STAGE_MIX);
   mixTable();
+  STAGE_END(STAGE_MIX);
+  STAGE_BEGIN(STAGE_WRITE);
   // do not update servos during unarmed calibration of sensors which are sensitive to vibration
   if ( (f.ARMED) || ((!calibratingG) && (!calibratingA)) ) writeServos();
   writeMotors();
+  STAGE_END(STAGE_WRITE);
+  #if defined(BLACKBOX)
+    STAGE_BEGIN(STAGE_BLACKBOX);
+    blackboxLog();
+    if (blackboxPending() > BLACKBOX_RING / 4 || !f.ARMED) blackboxFlush(micros(), BLACKBOX_FLUSH_US);
+    STAGE_END(STAGE_BLACKBOX);
+  #endif
 }
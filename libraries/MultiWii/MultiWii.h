@@ -60,6 +60,7 @@ extern int16_t debug[4];
 extern conf_t conf;
 
 extern int16_t  annex650_overrun_count;
+extern uint16_t interleaveReclaimed;
 extern flags_struct_t f;
 extern uint16_t intPowerTrigger1;
 
@@ -143,6 +144,9 @@ extern int16_t lookupThrottleRC[11];
   #define NAV_MODE_POSHOLD       1
   #define NAV_MODE_WP            2
   extern uint8_t nav_mode; // Navigation mode
+  #if defined(GPS_NAV)
+    extern mission_step_struct mission_step;  // the waypoint of recallWP() and storeWP()
+  #endif
   extern int16_t  nav[2];
   extern int16_t  nav_rated[2];    //Adding a rate controller to the navigation to make it smoother
 
@@ -193,9 +197,40 @@ extern int16_t lookupThrottleRC[11];
 #endif
 
 void annexCode();
+uint8_t interleaveWait(uint32_t start, uint16_t spacing);
 #if defined(CHIPKIT) //EDH
   void MultiWii_setup();
   void MultiWii_loop ();
 #endif
 
+// main loop stage timing: recorded by the profiler with LOOP_PROFILER (read with MSP_PROFILER),
+// and by the SITL build in target and host time
+#if defined(SITL)
+  #include "SITL/sitl.h"
+  #define SITL_STAGE_BEGIN(s) sitl_stage_begin(s);
+  #define SITL_STAGE_END(s)   sitl_stage_end(s);
+#else
+  #define SITL_STAGE_BEGIN(s)
+  #define SITL_STAGE_END(s)
+#endif
+#if defined(LOOP_PROFILER)
+  #include "Profiler.h"
+  #define PROFILER_BEGIN(s) profilerBegin(s);
+  #define PROFILER_END(s)   profilerEnd(s);
+  #define STAGE_RECORD(s, us) profilerRecord(s, us)
+#else
+  #define PROFILER_BEGIN(s)
+  #define PROFILER_END(s)
+  #define STAGE_RECORD(s, us)
+#endif
+#define STAGE_BEGIN(s) {SITL_STAGE_BEGIN(s) PROFILER_BEGIN(s)}
+#define STAGE_END(s)   {PROFILER_END(s) SITL_STAGE_END(s)}
+
+#if defined(BLACKBOX)
+  #include "Blackbox.h"
+  #define BLACKBOX_PID(axis, p, i, d) {blackboxPID[axis][0] = p; blackboxPID[axis][1] = i; blackboxPID[axis][2] = d;}
+#else
+  #define BLACKBOX_PID(axis, p, i, d)
+#endif
+
 #endif /* MULTIWII_H_ */
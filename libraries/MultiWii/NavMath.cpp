@@ -0,0 +1,124 @@
+#if defined(ARDUINO) && ARDUINO >= 100
+#include "Arduino.h"
+#else
+#include "WProgram.h"
+#endif
+
+#include "config.h"
+#include "def.h"
+#include "types.h"
+#include "NavMath.h"
+
+#if GPS
+
+// sin of 0 to 90 degrees by half degree, << 16 (1.0 as 65535)
+const uint16_t navSinTable[181] PROGMEM = {
+      0,   572,  1144,  1716,  2287,  2859,  3430,  4001,  4572,  5142,
+   5712,  6281,  6850,  7419,  7987,  8554,  9121,  9687, 10252, 10817,
+  11380, 11943, 12505, 13066, 13626, 14185, 14742, 15299, 15855, 16409,
+  16962, 17514, 18064, 18613, 19161, 19707, 20252, 20795, 21336, 21876,
+  22415, 22951, 23486, 24019, 24550, 25080, 25607, 26132, 26656, 27177,
+  27697, 28214, 28729, 29242, 29753, 30261, 30767, 31271, 31772, 32271,
+  32768, 33262, 33754, 34242, 34729, 35212, 35693, 36172, 36647, 37120,
+  37590, 38057, 38521, 38982, 39441, 39896, 40348, 40797, 41243, 41686,
+  42126, 42562, 42995, 43425, 43852, 44275, 44695, 45112, 45525, 45935,
+  46341, 46744, 47143, 47538, 47930, 48318, 48703, 49084, 49461, 49834,
+  50203, 50569, 50931, 51289, 51643, 51993, 52339, 52682, 53020, 53354,
+  53684, 54010, 54332, 54650, 54963, 55273, 55578, 55879, 56175, 56468,
+  56756, 57040, 57319, 57594, 57865, 58131, 58393, 58650, 58903, 59152,
+  59396, 59635, 59870, 60100, 60326, 60547, 60764, 60976, 61183, 61386,
+  61584, 61777, 61966, 62149, 62328, 62503, 62672, 62837, 62997, 63152,
+  63303, 63449, 63589, 63725, 63856, 63983, 64104, 64220, 64332, 64439,
+  64540, 64637, 64729, 64816, 64898, 64975, 65048, 65115, 65177, 65234,
+  65287, 65334, 65376, 65414, 65446, 65474, 65496, 65514, 65526, 65534,
+  65535
+};
+
+// atan of 0 to 1 by 1/64, deg*100
+const uint16_t navAtanTable[65] PROGMEM = {
+      0,    90,   179,   268,   358,   447,   536,   624,   713,   800,
+    888,   975,  1062,  1148,  1234,  1319,  1404,  1488,  1571,  1653,
+   1735,  1817,  1897,  1977,  2056,  2134,  2211,  2287,  2363,  2438,
+   2511,  2584,  2657,  2728,  2798,  2867,  2936,  3003,  3070,  3136,
+   3201,  3264,  3327,  3390,  3451,  3511,  3571,  3629,  3687,  3744,
+   3800,  3855,  3909,  3963,  4016,  4067,  4119,  4169,  4218,  4267,
+   4315,  4363,  4409,  4455,  4500
+};
+
+// sin of 0 to 90 degrees, a in 1/unit of a half degree, << 16: interpolated between the half degrees
+// of the table, 2.5e-5 at most
+static int32_t navSinQuarter(uint32_t a, uint16_t unit) {
+  uint16_t i  = a / unit;
+  uint16_t fr = a % unit;
+  int32_t  s  = pgm_read_word(&navSinTable[i]);
+  if (fr) s += (((int32_t)pgm_read_word(&navSinTable[i + 1]) - s) * fr + unit / 2) / unit;
+  return s;
+}
+
+int16_t navSin(int32_t angle) {
+  int32_t s;
+  angle %= 36000;
+  if (angle < 0) angle += 36000;
+  if      (angle <  9000) s =  navSinQuarter(angle, 50);
+  else if (angle < 18000) s =  navSinQuarter(18000 - angle, 50);
+  else if (angle < 27000) s = -navSinQuarter(angle - 18000, 50);
+  else                    s = -navSinQuarter(36000 - angle, 50);
+  return (s + 2) >> 2;
+}
+
+int16_t navCos(int32_t angle) {
+  return navSin(angle + 9000);
+}
+
+// the octant of (x, y) brings the ratio of the smaller to the larger side in 0..1, << 14 for
+// the table: 0.02deg at most
+int32_t navAtan2(int32_t y, int32_t x) {
+  uint32_t ax = abs(x), ay = abs(y);
+  uint32_t mn = min(ax, ay), mx = max(ax, ay);
+  int32_t  a;
+
+  if (mx == 0) return 0;
+  while (mx >= (1UL << 17)) { mx >>= 1; mn >>= 1; }      // mn << 14 in 32 bits
+  uint16_t r  = (mn << 14) / mx;
+  uint8_t  i  = r >> 8;
+  uint8_t  fr = r & 0xFF;
+  a = pgm_read_word(&navAtanTable[i]);
+  if (fr) a += (((int32_t)pgm_read_word(&navAtanTable[i + 1]) - a) * fr) >> 8;
+  if (ay > ax) a = 9000 - a;
+  if (x < 0)   a = 18000 - a;
+  return y < 0 ? -a : a;
+}
+
+int32_t navBearing(int32_t dLat, int32_t dLon) {
+  int32_t b = navAtan2(dLon, dLat);
+  return b < 0 ? b + 36000 : b;
+}
+
+// one bit of the root per step, from the top; in 32 bits up to 730m in 1e-7 degree
+uint32_t navSqrt(uint64_t v) {
+  if (v >> 32) {
+    uint64_t bit = 1ULL << 62, r = 0;
+    while (bit > v) bit >>= 2;
+    while (bit) {
+      if (v >= r + bit) { v -= r + bit; r = (r >> 1) + bit; }
+      else r >>= 1;
+      bit >>= 2;
+    }
+    return r;
+  }
+  uint32_t w = v, bit = 1UL << 30, r = 0;
+  while (bit > w) bit >>= 2;
+  while (bit) {
+    if (w >= r + bit) { w -= r + bit; r = (r >> 1) + bit; }
+    else r >>= 1;
+    bit >>= 2;
+  }
+  return r;
+}
+
+// cos(lat) as sin(90 - lat), lat brought to deg*10000
+int32_t navLonScale(int32_t lat) {
+  return navSinQuarter(900000 - (abs(lat) + 500) / 1000, 5000);
+}
+
+#endif // GPS
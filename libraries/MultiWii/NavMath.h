@@ -0,0 +1,17 @@
+#ifndef NAVMATH_H_
+#define NAVMATH_H_
+
+// Fixed point trigonometry of the GPS navigation: angles in deg*100, sin and cos << 14,
+// coordinates in 1e-7 degree as GPS_coord
+
+#define NAV_ONE   16384                       // 1.0 of navSin(), navCos() and the unit vectors of the legs
+#define NAV_CM(d) (((int64_t)(d) * 72954) >> 16)  // 1e-7 degree of latitude to cm: 1.113195
+
+int16_t  navSin(int32_t angle);               // angle deg*100, any turn
+int16_t  navCos(int32_t angle);
+int32_t  navAtan2(int32_t y, int32_t x);      // deg*100, -18000 to 18000
+int32_t  navBearing(int32_t dLat, int32_t dLon);  // deg*100 from north towards east, 0 to 35999
+uint32_t navSqrt(uint64_t v);
+int32_t  navLonScale(int32_t lat);            // cos(lat) << 16: 1e-7 degree of longitude to ones of latitude
+
+#endif /* NAVMATH_H_ */
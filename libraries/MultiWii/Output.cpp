@@ -1079,6 +1079,136 @@ int16_t get_middle(uint8_t nr) {
 
 // int8_t servodir(uint8_t n, uint8_t b) { return ((conf.servoConf[n].rate & b) ? -1 : 1) ; }
 
+#if defined(MOTOR_MIXER)
+/****************             motor mixer matrix of the frame             ******************/
+// the weights of roll, pitch and yaw for each motor, rounded to 1/MIX_ONE: 1/2 and 7/8 are exact,
+// 4/3 is 341/256, 2/3 171/256 and 7/10 179/256 (at most 1/768 off, 0.65 at a PID of 500).
+// conf.mixer starts from this table and can be loaded with MSP_SET_MIXER.
+#define MIXW(x) ((int16_t)((x)*MIX_ONE + ((x) < 0 ? -0.5 : 0.5)))
+#define MIX(X,Y,Z) { MIXW(X), MIXW(Y), MIXW(Z) }
+
+static const mix_rule_ mixerDefault[NUMBER_MOTOR] = {
+  #if defined( BI )
+    MIX(+1, 0, 0), //LEFT
+    MIX(-1, 0, 0), //RIGHT
+  #elif defined( TRI )
+    MIX( 0,+4/3.0, 0), //REAR
+    MIX(-1,-2/3.0, 0), //RIGHT
+    MIX(+1,-2/3.0, 0), //LEFT
+  #elif defined( QUADP )
+    MIX( 0,+1,-1), //REAR
+    MIX(-1, 0,+1), //RIGHT
+    MIX(+1, 0,+1), //LEFT
+    MIX( 0,-1,-1), //FRONT
+  #elif defined( QUADX )
+    MIX(-1,+1,-1), //REAR_R
+    MIX(-1,-1,+1), //FRONT_R
+    MIX(+1,+1,+1), //REAR_L
+    MIX(+1,-1,-1), //FRONT_L
+  #elif defined( Y4 )
+    MIX(+0,+1,-1), //REAR_1 CW
+    MIX(-1,-1, 0), //FRONT_R CCW
+    MIX(+0,+1,+1), //REAR_2 CCW
+    MIX(+1,-1, 0), //FRONT_L CW
+  #elif defined( Y6 )
+    MIX(+0,+4/3.0,+1), //REAR
+    MIX(-1,-2/3.0,-1), //RIGHT
+    MIX(+1,-2/3.0,-1), //LEFT
+    MIX(+0,+4/3.0,-1), //UNDER_REAR
+    MIX(-1,-2/3.0,+1), //UNDER_RIGHT
+    MIX(+1,-2/3.0,+1), //UNDER_LEFT
+  #elif defined( HEX6 )
+    MIX(-7/8.0,+1/2.0,+1), //REAR_R
+    MIX(-7/8.0,-1/2.0,-1), //FRONT_R
+    MIX(+7/8.0,+1/2.0,+1), //REAR_L
+    MIX(+7/8.0,-1/2.0,-1), //FRONT_L
+    MIX(+0    ,-1    ,+1), //FRONT
+    MIX(+0    ,+1    ,-1), //REAR
+  #elif defined( HEX6X )
+    MIX(-1/2.0,+7/8.0,+1), //REAR_R
+    MIX(-1/2.0,-7/8.0,+1), //FRONT_R
+    MIX(+1/2.0,+7/8.0,-1), //REAR_L
+    MIX(+1/2.0,-7/8.0,-1), //FRONT_L
+    MIX(-1    ,+0    ,-1), //RIGHT
+    MIX(+1    ,+0    ,+1), //LEFT
+  #elif defined( HEX6H )
+    MIX(-1,+1,-1), //REAR_R
+    MIX(-1,-1,+1), //FRONT_R
+    MIX(+1,+1,+1), //REAR_L
+    MIX(+1,-1,-1), //FRONT_L
+    MIX( 0, 0, 0), //RIGHT
+    MIX( 0, 0, 0), //LEFT
+  #elif defined( OCTOX8 )
+    MIX(-1,+1,-1), //REAR_R
+    MIX(-1,-1,+1), //FRONT_R
+    MIX(+1,+1,+1), //REAR_L
+    MIX(+1,-1,-1), //FRONT_L
+    MIX(-1,+1,+1), //UNDER_REAR_R
+    MIX(-1,-1,-1), //UNDER_FRONT_R
+    MIX(+1,+1,-1), //UNDER_REAR_L
+    MIX(+1,-1,+1), //UNDER_FRONT_L
+  #elif defined( OCTOFLATP )
+    MIX(+7/10.0,-7/10.0,+1), //FRONT_L
+    MIX(-7/10.0,-7/10.0,+1), //FRONT_R
+    MIX(-7/10.0,+7/10.0,+1), //REAR_R
+    MIX(+7/10.0,+7/10.0,+1), //REAR_L
+    MIX(+0     ,-1     ,-1), //FRONT
+    MIX(-1     ,+0     ,-1), //RIGHT
+    MIX(+0     ,+1     ,-1), //REAR
+    MIX(+1     ,+0     ,-1), //LEFT
+  #elif defined( OCTOFLATX )
+    MIX(+1    ,-1/2.0,+1), //MIDFRONT_L
+    MIX(-1/2.0,-1    ,+1), //FRONT_R
+    MIX(-1    ,+1/2.0,+1), //MIDREAR_R
+    MIX(+1/2.0,+1    ,+1), //REAR_L
+    MIX(+1/2.0,-1    ,-1), //FRONT_L
+    MIX(-1    ,-1/2.0,-1), //MIDFRONT_R
+    MIX(-1/2.0,+1    ,-1), //REAR_R
+    MIX(+1    ,+1/2.0,-1), //MIDREAR_L
+  #elif defined( VTAIL4 )
+    MIX(+0,+1,+1), //REAR_R
+    MIX(-1,-1,+0), //FRONT_R
+    MIX(+0,+1,-1), //REAR_L
+    MIX(+1,-1,-0), //FRONT_L
+  #elif defined( DUALCOPTER )
+    MIX( 0, 0,-1), //Pin D9
+    MIX( 0, 0,+1), //Pin D10
+  #endif
+};
+
+static uint8_t mixerIsDefault;
+
+// motor[i] = throttle + (roll*R + pitch*P + yaw*Y) / MIX_ONE, rounded, for the motors 0..N-1,
+// unrolled by the compiler. run() takes the weights of conf.mixer. fixed() takes the built-in
+// table, whose weights are then constants: split in integer and fractional parts of MIX_ONE,
+// the +-1 weights become adds and the fraction of the usual frames vanishes, as with PIDMIX.
+template <uint8_t N> struct MixKernel {
+  static inline __attribute__ ((always_inline)) void run(const mix_rule_ *m, int16_t thr, int16_t r, int16_t p, int16_t y) {
+    MixKernel<N-1>::run(m, thr, r, p, y);
+    motor[N-1] = thr + (((int32_t)r*m[N-1].roll + (int32_t)p*m[N-1].pitch + (int32_t)y*m[N-1].yaw + MIX_ONE/2) >> MIX_SHIFT);
+  }
+  static inline __attribute__ ((always_inline)) void fixed(const mix_rule_ *m, int16_t thr, int16_t r, int16_t p, int16_t y) {
+    MixKernel<N-1>::fixed(m, thr, r, p, y);
+    const mix_rule_ &w = m[N-1];
+    motor[N-1] = thr + r*(w.roll/MIX_ONE) + p*(w.pitch/MIX_ONE) + y*(w.yaw/MIX_ONE)
+               + (((int32_t)r*(w.roll%MIX_ONE) + (int32_t)p*(w.pitch%MIX_ONE) + (int32_t)y*(w.yaw%MIX_ONE) + MIX_ONE/2) >> MIX_SHIFT);
+  }
+};
+template <> struct MixKernel<0> {
+  static inline __attribute__ ((always_inline)) void run(const mix_rule_ *m, int16_t thr, int16_t r, int16_t p, int16_t y) {}
+  static inline __attribute__ ((always_inline)) void fixed(const mix_rule_ *m, int16_t thr, int16_t r, int16_t p, int16_t y) {}
+};
+
+void loadDefaultMixer() {
+  memcpy(conf.mixer, mixerDefault, sizeof(mixerDefault));
+}
+
+// to be called each time conf.mixer changes: selects the kernel of the built-in table when it is the same
+void checkMixer() {
+  mixerIsDefault = memcmp(conf.mixer, mixerDefault, sizeof(mixerDefault)) == 0;
+}
+#endif
+
 void mixTable() {
   int16_t maxMotor;
   uint8_t i;
@@ -1089,93 +1219,19 @@ void mixTable() {
   #define SERVODIR(n,b) ((conf.servoConf[n].rate & b) ? -1 : 1)
 
   /****************                   main Mix Table                ******************/
+  #if defined( MOTOR_MIXER )
+    if (mixerIsDefault)
+      MixKernel<NUMBER_MOTOR>::fixed(mixerDefault, rcCommand[THROTTLE], axisPID[ROLL], axisPID[PITCH], YAW_DIRECTION * axisPID[YAW]);
+    else
+      MixKernel<NUMBER_MOTOR>::run(conf.mixer, rcCommand[THROTTLE], axisPID[ROLL], axisPID[PITCH], YAW_DIRECTION * axisPID[YAW]);
+  #endif
   #if defined( MY_PRIVATE_MIXING )
     #include MY_PRIVATE_MIXING
   #elif defined( BI )
-    motor[0] = PIDMIX(+1, 0, 0); //LEFT
-    motor[1] = PIDMIX(-1, 0, 0); //RIGHT
     servo[4] = (SERVODIR(4,2) * axisPID[YAW]) + (SERVODIR(4,1) * axisPID[PITCH]) + get_middle(4); //LEFT
     servo[5] = (SERVODIR(5,2) * axisPID[YAW]) + (SERVODIR(5,1) * axisPID[PITCH]) + get_middle(5); //RIGHT
   #elif defined( TRI )
-    motor[0] = PIDMIX( 0,+4/3, 0); //REAR
-    motor[1] = PIDMIX(-1,-2/3, 0); //RIGHT
-    motor[2] = PIDMIX(+1,-2/3, 0); //LEFT
     servo[5] = (SERVODIR(5, 1) * axisPID[YAW]) + get_middle(5); //REAR
-  #elif defined( QUADP )
-    motor[0] = PIDMIX( 0,+1,-1); //REAR
-    motor[1] = PIDMIX(-1, 0,+1); //RIGHT
-    motor[2] = PIDMIX(+1, 0,+1); //LEFT
-    motor[3] = PIDMIX( 0,-1,-1); //FRONT
-  #elif defined( QUADX )
-    motor[0] = PIDMIX(-1,+1,-1); //REAR_R
-    motor[1] = PIDMIX(-1,-1,+1); //FRONT_R
-    motor[2] = PIDMIX(+1,+1,+1); //REAR_L
-    motor[3] = PIDMIX(+1,-1,-1); //FRONT_L
-  #elif defined( Y4 )
-    motor[0] = PIDMIX(+0,+1,-1);   //REAR_1 CW
-    motor[1] = PIDMIX(-1,-1, 0); //FRONT_R CCW
-    motor[2] = PIDMIX(+0,+1,+1);   //REAR_2 CCW
-    motor[3] = PIDMIX(+1,-1, 0); //FRONT_L CW
-  #elif defined( Y6 )
-    motor[0] = PIDMIX(+0,+4/3,+1); //REAR
-    motor[1] = PIDMIX(-1,-2/3,-1); //RIGHT
-    motor[2] = PIDMIX(+1,-2/3,-1); //LEFT
-    motor[3] = PIDMIX(+0,+4/3,-1); //UNDER_REAR
-    motor[4] = PIDMIX(-1,-2/3,+1); //UNDER_RIGHT
-    motor[5] = PIDMIX(+1,-2/3,+1); //UNDER_LEFT
-  #elif defined( HEX6 )
-    motor[0] = PIDMIX(-7/8,+1/2,+1); //REAR_R
-    motor[1] = PIDMIX(-7/8,-1/2,-1); //FRONT_R
-    motor[2] = PIDMIX(+7/8,+1/2,+1); //REAR_L
-    motor[3] = PIDMIX(+7/8,-1/2,-1); //FRONT_L
-    motor[4] = PIDMIX(+0  ,-1  ,+1); //FRONT
-    motor[5] = PIDMIX(+0  ,+1  ,-1); //REAR
-  #elif defined( HEX6X )
-    motor[0] = PIDMIX(-1/2,+7/8,+1); //REAR_R
-    motor[1] = PIDMIX(-1/2,-7/8,+1); //FRONT_R
-    motor[2] = PIDMIX(+1/2,+7/8,-1); //REAR_L
-    motor[3] = PIDMIX(+1/2,-7/8,-1); //FRONT_L
-    motor[4] = PIDMIX(-1  ,+0  ,-1); //RIGHT
-    motor[5] = PIDMIX(+1  ,+0  ,+1); //LEFT
-  #elif defined( HEX6H )
-    motor[0] = PIDMIX(-1,+1,-1); //REAR_R
-    motor[1] = PIDMIX(-1,-1,+1); //FRONT_R
-    motor[2] = PIDMIX(+ 1,+1,+1); //REAR_L
-    motor[3] = PIDMIX(+ 1,-1,-1); //FRONT_L
-    motor[4] = PIDMIX(0 ,0 ,0); //RIGHT
-    motor[5] = PIDMIX(0 ,0 ,0); //LEFT
-  #elif defined( OCTOX8 )
-    motor[0] = PIDMIX(-1,+1,-1); //REAR_R
-    motor[1] = PIDMIX(-1,-1,+1); //FRONT_R
-    motor[2] = PIDMIX(+1,+1,+1); //REAR_L
-    motor[3] = PIDMIX(+1,-1,-1); //FRONT_L
-    motor[4] = PIDMIX(-1,+1,+1); //UNDER_REAR_R
-    motor[5] = PIDMIX(-1,-1,-1); //UNDER_FRONT_R
-    motor[6] = PIDMIX(+1,+1,-1); //UNDER_REAR_L
-    motor[7] = PIDMIX(+1,-1,+1); //UNDER_FRONT_L
-  #elif defined( OCTOFLATP )
-    motor[0] = PIDMIX(+7/10,-7/10,+1); //FRONT_L
-    motor[1] = PIDMIX(-7/10,-7/10,+1); //FRONT_R
-    motor[2] = PIDMIX(-7/10,+7/10,+1); //REAR_R
-    motor[3] = PIDMIX(+7/10,+7/10,+1); //REAR_L
-    motor[4] = PIDMIX(+0   ,-1   ,-1); //FRONT
-    motor[5] = PIDMIX(-1   ,+0   ,-1); //RIGHT
-    motor[6] = PIDMIX(+0   ,+1   ,-1); //REAR
-    motor[7] = PIDMIX(+1   ,+0   ,-1); //LEFT
-  #elif defined( OCTOFLATX )
-    motor[0] = PIDMIX(+1  ,-1/2,+1); //MIDFRONT_L
-    motor[1] = PIDMIX(-1/2,-1  ,+1); //FRONT_R
-    motor[2] = PIDMIX(-1  ,+1/2,+1); //MIDREAR_R
-    motor[3] = PIDMIX(+1/2,+1  ,+1); //REAR_L
-    motor[4] = PIDMIX(+1/2,-1  ,-1); //FRONT_L
-    motor[5] = PIDMIX(-1  ,-1/2,-1); //MIDFRONT_R
-    motor[6] = PIDMIX(-1/2,+1  ,-1); //REAR_R
-    motor[7] = PIDMIX(+1  ,+1/2,-1); //MIDREAR_L
-  #elif defined( VTAIL4 )
-    motor[0] = PIDMIX(+0,+1, +1); //REAR_R
-    motor[1] = PIDMIX(-1, -1, +0); //FRONT_R
-    motor[2] = PIDMIX(+0,+1, -1); //REAR_L
-    motor[3] = PIDMIX(+1, -1, -0); //FRONT_L
   #elif defined( FLYING_WING )
     /*****************************             FLYING WING                **************************************/
     if (!f.ARMED) {
@@ -1280,8 +1336,6 @@ void mixTable() {
       servo[i] =  axisPID[5-i] * SERVODIR(i,1);    // mix and setup direction
       servo[i] += get_middle(i);
     }
-    motor[0] = PIDMIX(0,0,-1);                                 //  Pin D9
-    motor[1] = PIDMIX(0,0,+1);                                 //  Pin D10
 
   #elif defined( HELICOPTER )
     /*****************************               HELICOPTERS               **************************************/
@@ -1387,7 +1441,7 @@ void mixTable() {
       servo[i]  = ((int32_t)conf.servoConf[i].rate * att.angle[1-i]) /50L;
       servo[i] += get_middle(i);
     }
-  #else
+  #elif !defined( MOTOR_MIXER )
     #error "missing coptertype mixtable entry. Either you forgot to define a copter type or the mixing table is lacking neccessary code"
   #endif // MY_PRIVATE_MIXING
 
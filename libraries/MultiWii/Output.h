@@ -7,5 +7,7 @@ void initOutput();
 void mixTable();
 void writeServos();
 void writeMotors();
+void loadDefaultMixer();
+void checkMixer();
 
 #endif /* OUTPUT_H_ */
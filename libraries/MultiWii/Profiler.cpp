@@ -0,0 +1,49 @@
+#if defined(ARDUINO) && ARDUINO >= 100
+#include "Arduino.h"
+#else
+#include "WProgram.h"
+#endif
+
+#include "config.h"
+#include "def.h"
+#include "types.h"
+#include "MultiWii.h"
+
+#if defined(LOOP_PROFILER)
+
+profiler_stage_t profiler[STAGE_ITEMS];
+static uint16_t profilerStart[STAGE_ITEMS];
+
+void profilerReset() {
+  memset(profiler, 0, sizeof(profiler));
+  for (uint8_t s = 0; s < STAGE_ITEMS; s++) profiler[s].min = 0xFFFF;
+}
+
+void profilerBegin(uint8_t s) {
+  profilerStart[s] = micros();
+}
+
+void profilerEnd(uint8_t s) {
+  profilerRecord(s, (uint16_t)micros() - profilerStart[s]);
+}
+
+void profilerRecord(uint8_t s, uint16_t us) {
+  profiler_stage_t *p = &profiler[s];
+  uint8_t bin = 0, i;
+
+  if (us < p->min) p->min = us;
+  if (us > p->max) p->max = us;
+  if (p->sum > 0xFFFFFFFF - us) {
+    p->sum >>= 1;
+    p->count >>= 1;
+  }
+  p->sum += us;
+  p->count++;
+
+  for (uint16_t t = us >> 6; t && bin < PROFILER_BINS - 1; t >>= 1) bin++;
+  if (p->bins[bin] == 0xFFFF)
+    for (i = 0; i < PROFILER_BINS; i++) p->bins[i] >>= 1;
+  p->bins[bin]++;
+}
+
+#endif
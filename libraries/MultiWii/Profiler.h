@@ -0,0 +1,20 @@
+#ifndef PROFILER_H_
+#define PROFILER_H_
+
+#define PROFILER_BINS 8   // bin 0: < 64us, bin n: 32us<<n to 64us<<n, bin 7: 4096us and more
+
+typedef struct {
+  uint32_t count;
+  uint32_t sum;                 // us, halved with count before it overflows: the average stays right
+  uint16_t min, max;            // us
+  uint16_t bins[PROFILER_BINS]; // halved all together when one is full: the shape stays right
+} profiler_stage_t;
+
+extern profiler_stage_t profiler[STAGE_ITEMS];
+
+void profilerBegin(uint8_t s);
+void profilerEnd(uint8_t s);
+void profilerRecord(uint8_t s, uint16_t us);
+void profilerReset();
+
+#endif /* PROFILER_H_ */
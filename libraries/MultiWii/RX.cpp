@@ -3,9 +3,11 @@
 #else
 #include "WProgram.h"
 #include <sys/attribs.h> //EDH used for __ISR
+#if !defined(SITL)
 #define cli()  asm volatile("di") //turn intrupts off
 #define sei()  asm volatile("ei") //turn intrupts on
 #endif
+#endif
 
 #include "config.h"
 #include "def.h"
@@ -45,6 +47,15 @@
 
 #define FAILSAFE_DETECT_TRESHOLD  985
 
+#if defined(RC_FILTER)
+  // the whole frames of the receiver, counted and timed where they are read, for computeRC
+  static volatile uint8_t rcFrames;
+  static volatile uint16_t rcFrameTime;   // micros(), 16 bits as in the pulse interrupts
+  #define RC_FRAME(time) do { rcFrameTime = (time); rcFrames++; } while (0)
+#else
+  #define RC_FRAME(time) do { } while (0)
+#endif
+
 void rxInt(void);
 
 /**************************************************************************************/
@@ -120,20 +131,45 @@ void configureReceiver() {
 /**************************************************************************************/
 #if defined(STANDARD_RX)
 
+#if defined(RC_FILTER)
+  // a PWM frame is whole once the four sticks have a new pulse and none is high: with the channels one
+  // after the other, the frame then ends on the last stick of the receiver, whatever the first pulse seen
+  #define RC_FRAME_PULSES ((1<<ROLLPIN) | (1<<PITCHPIN) | (1<<YAWPIN) | (1<<THROTTLEPIN))
+  static uint8_t rcFramePulses, rcFrameHigh;
+  #define RC_FRAME_RISE(rc_value_pos)  rcFrameHigh |= 1<<(rc_value_pos)
+  #define RC_FRAME_FALL(rc_value_pos)  rcFrameHigh &= ~(1<<(rc_value_pos))
+  #define RC_FRAME_PULSE(rc_value_pos) rcFramePulses |= 1<<(rc_value_pos)
+  #define RC_FRAME_CHECK(time)                                                                          \
+    if ((rcFramePulses & RC_FRAME_PULSES) == RC_FRAME_PULSES && !(rcFrameHigh & RC_FRAME_PULSES)) {     \
+      rcFramePulses = 0;                                                                                \
+      RC_FRAME(time);                                                                                   \
+    }
+#else
+  #define RC_FRAME_RISE(rc_value_pos)
+  #define RC_FRAME_FALL(rc_value_pos)
+  #define RC_FRAME_PULSE(rc_value_pos)
+  #define RC_FRAME_CHECK(time)
+#endif
+
 #if defined(FAILSAFE) && !defined(PROMICRO)
    // predefined PC pin block (thanks to lianj)  - Version with failsafe
   #define RX_PIN_CHECK(pin_pos, rc_value_pos)                        \
     if (mask & PCInt_RX_Pins[pin_pos]) {                             \
       if (!(pin & PCInt_RX_Pins[pin_pos])) {                         \
         dTime = cTime-edgeTime[pin_pos];                             \
+        RC_FRAME_FALL(rc_value_pos);                                 \
         if (900<dTime && dTime<2200) {                               \
           rcValue[rc_value_pos] = dTime;                             \
+          RC_FRAME_PULSE(rc_value_pos);                              \
           if((rc_value_pos==THROTTLEPIN || rc_value_pos==YAWPIN ||   \
               rc_value_pos==PITCHPIN || rc_value_pos==ROLLPIN)       \
               && dTime>FAILSAFE_DETECT_TRESHOLD)                     \
                 GoodPulses |= (1<<rc_value_pos);                     \
         }                                                            \
-      } else edgeTime[pin_pos] = cTime;                              \
+      } else {                                                       \
+        edgeTime[pin_pos] = cTime;                                   \
+        RC_FRAME_RISE(rc_value_pos);                                 \
+      }                                                              \
     }
 #else
    // predefined PC pin block (thanks to lianj)  - Version without failsafe
@@ -141,10 +177,15 @@ void configureReceiver() {
     if (mask & PCInt_RX_Pins[pin_pos]) {                             \
       if (!(pin & PCInt_RX_Pins[pin_pos])) {                         \
         dTime = cTime-edgeTime[pin_pos];                             \
+        RC_FRAME_FALL(rc_value_pos);                                 \
         if (900<dTime && dTime<2200) {                               \
           rcValue[rc_value_pos] = dTime;                             \
+          RC_FRAME_PULSE(rc_value_pos);                              \
         }                                                            \
-      } else edgeTime[pin_pos] = cTime;                              \
+      } else {                                                       \
+        edgeTime[pin_pos] = cTime;                                   \
+        RC_FRAME_RISE(rc_value_pos);                                 \
+      }                                                              \
     }
 #endif
 
@@ -197,6 +238,7 @@ void configureReceiver() {
     #if (PCINT_PIN_COUNT > 7)
       RX_PIN_CHECK(7,3);
     #endif
+    RC_FRAME_CHECK(cTime);
     
     #if defined(FAILSAFE) && !defined(PROMICRO)
       if (GoodPulses==(1<<THROTTLEPIN)+(1<<YAWPIN)+(1<<ROLLPIN)+(1<<PITCHPIN)) {  // If all main four chanells have good pulses, clear FailSafe counter
@@ -251,15 +293,21 @@ void configureReceiver() {
       now = micros();  
       if(!(PINE & (1<<6))){
         diff = now - last;
+        RC_FRAME_FALL(3);
         if(900<diff && diff<2200){
           rcValue[3] = diff;
+          RC_FRAME_PULSE(3);
           #if defined(FAILSAFE)
            if(diff>FAILSAFE_DETECT_TRESHOLD) {        // if Throttle value is higher than FAILSAFE_DETECT_TRESHOLD
              if(failsafeCnt > 20) failsafeCnt -= 20; else failsafeCnt = 0;   // If pulse present on THROTTLE pin (independent from ardu version), clear FailSafe counter  - added by MIS
            }
           #endif 
         }
-      }else last = now; 
+      }else {
+        last = now; 
+        RC_FRAME_RISE(3);
+      }
+      RC_FRAME_CHECK(now);
     }
     // Aux 2
     #if defined(RCAUX2PINRXO)
@@ -304,8 +352,10 @@ void configureReceiver() {
     sei();
     diff = now - last;
     last = now;
-    if(diff>3000) chan = 0;
-    else {
+    if(diff>3000) {
+      if (chan >= 4) RC_FRAME(now);   // the sync ends a frame of at least the four sticks
+      chan = 0;
+    } else {
       if(900<diff && diff<2200 && chan<RC_CHANS ) {   //Only if the signal is between these values it is valid, otherwise the failsafe counter should move up
         rcValue[chan] = diff;
         #if defined(FAILSAFE)
@@ -355,6 +405,7 @@ void  readSBus(){
       // now the two Digital-Channels
       if ((sbus[23]) & 0x0001)       rcValue[16] = 2000; else rcValue[16] = 1000;
       if ((sbus[23] >> 1) & 0x0001)  rcValue[17] = 2000; else rcValue[17] = 1000;
+      RC_FRAME(micros());
 
       // Failsafe: there is one Bit in the SBUS-protocol (Byte 25, Bit 4) whitch is the failsafe-indicator-bit
       #if defined(FAILSAFE)
@@ -396,6 +447,7 @@ void readSpektrum(void) {
         if (spekChannel < RC_CHANS) rcValue[spekChannel] = 988 + ((((uint16_t)(bh & SPEK_CHAN_MASK) << 8) + bl) SPEK_DATA_SHIFT);
       }
       spekFrameFlags = 0x00;
+      RC_FRAME(micros());
       #if defined(FAILSAFE)
         if(failsafeCnt > 20) failsafeCnt -= 20; else failsafeCnt = 0;   // Valid frame, clear FailSafe counter
       #endif
@@ -433,6 +485,117 @@ uint16_t readRawRC(uint8_t chan) {
 /**************************************************************************************/
 /***************          compute and Filter the RX data           ********************/
 /**************************************************************************************/
+#if defined(RC_FILTER)
+/* RC_FILTER: computeRC runs every loop. A new frame (rcFrames moved) is read with the time the
+   RX layer saw it, then each channel of rcData follows it through its filter: the PT1 for the time
+   since the last loop, the biquad with coefficients for the average loop time (computed again when
+   it drifts by 1/8), the ramp of INTERP over the average frame interval from the time of the frame.
+   The channels run in 1/16us. */
+#define RC_SHIFT        4
+#define RC_BIQUAD_SHIFT 24
+
+static const uint8_t rcFilterType[] = RC_FILTER;
+
+typedef struct {
+  int32_t x1, x2, y1, y2;
+} rc_biquad_t;
+
+// the Butterworth low pass at RC_FILTER_HZ for a loop of dt us, in 1/2^RC_BIQUAD_SHIFT
+static void rcBiquadCoefficients(int32_t *c, uint16_t dt) {
+  float w = 2 * PI * RC_FILTER_HZ * dt * 1e-6f, cs = cos(w), alpha = sin(w) * 0.7071068f;   // Q = 1/sqrt(2)
+  float scale = (1L << RC_BIQUAD_SHIFT) / (1 + alpha);
+  c[0] = (1 - cs) / 2 * scale;  // b0 = b2, b1 = 2 b0
+  c[1] = -2 * cs * scale;       // a1
+  c[2] = (1 - alpha) * scale;   // a2
+}
+
+void computeRC() {
+  static uint8_t frames, started, ramped;
+  static uint16_t frameTime, frameInterval = 20000, loopTime, loopAvg, coefLoop;
+  static int32_t from[RC_CHANS], to[RC_CHANS], out[RC_CHANS], coef[3];
+  static rc_biquad_t biquad[RC_CHANS];
+  static uint16_t serialTime;
+  uint16_t now, dt, age;
+  int32_t k, ramp;
+  uint8_t chan, serialTick;
+
+  #if defined(SBUS)
+    readSBus();
+  #endif
+  now = micros();
+  if (frames != rcFrames) {                                  // a new frame
+    uint16_t t = rcFrameTime;
+    frames = rcFrames;
+    if (started && (uint16_t)(t - frameTime) < 50000)        // not after a loss of the receiver
+      frameInterval += ((int16_t)(t - frameTime - frameInterval)) >> 2;
+    frameTime = t;
+    ramped = 0;
+    for (chan = 0; chan < RC_CHANS; chan++) {
+      uint16_t rcval = readRawRC(chan);
+      #if defined(FAILSAFE)
+        if (rcval <= FAILSAFE_DETECT_TRESHOLD && chan <= 3 && f.ARMED) continue;  // keep the controls of the last good frame
+      #endif
+      from[chan] = out[chan];
+      to[chan] = (int32_t)rcval << RC_SHIFT;
+      if (!started) {
+        from[chan] = out[chan] = to[chan];
+        biquad[chan].x1 = biquad[chan].x2 = biquad[chan].y1 = biquad[chan].y2 = to[chan];
+      }
+    }
+    if (!started) {
+      loopTime = now;
+      loopAvg = coefLoop = 3000;
+      rcBiquadCoefficients(coef, coefLoop);
+    }
+    started = 1;
+  }
+  if (!started) return;
+
+  dt = now - loopTime;
+  loopTime = now;
+  loopAvg += ((int16_t)(dt - loopAvg)) >> 4;
+  if (loopAvg > coefLoop + (coefLoop >> 3) || loopAvg < coefLoop - (coefLoop >> 3)) {
+    coefLoop = loopAvg;
+    rcBiquadCoefficients(coef, coefLoop);
+  }
+  k = ((int32_t)dt << 15) / (dt + (uint16_t)(1000000 / (2 * PI * RC_FILTER_HZ)));   // PT1 gain, 1/32768
+  age = now - frameTime;
+  if (age >= frameInterval) ramped = 1;                     // and stays there until the next frame, age may wrap
+  ramp = ramped ? 1L << 15 : ((int32_t)age << 15) / frameInterval;   // INTERP, 1/32768
+
+  serialTick = (uint16_t)(now - serialTime) >= 20000;        // MSP_SET_RAW_RC holds the sticks for rcSerialCount 50Hz ticks
+  if (serialTick) serialTime = now;
+  for (chan = 0; chan < RC_CHANS; chan++) {
+    switch (chan < sizeof(rcFilterType) ? rcFilterType[chan] : RC_FILTER_NONE) {
+      case RC_FILTER_PT1:
+        out[chan] += ((to[chan] - out[chan]) * k) >> 15;
+        break;
+      case RC_FILTER_BIQUAD: {
+        rc_biquad_t *b = &biquad[chan];
+        int32_t y = ((int64_t)coef[0] * (to[chan] + 2 * b->x1 + b->x2) - (int64_t)coef[1] * b->y1
+                     - (int64_t)coef[2] * b->y2) >> RC_BIQUAD_SHIFT;
+        b->x2 = b->x1; b->x1 = to[chan];
+        b->y2 = b->y1; b->y1 = y;
+        out[chan] = y;
+        break;
+      }
+      case RC_FILTER_INTERP:
+        out[chan] = from[chan] + (((to[chan] - from[chan]) * ramp) >> 15);
+        break;
+      default:
+        out[chan] = to[chan];
+    }
+    rcData[chan] = (out[chan] + (1 << (RC_SHIFT - 1))) >> RC_SHIFT;
+    if (chan < 8 && rcSerialCount > 0) { // rcData comes from MSP and overrides RX Data until rcSerialCount reaches 0
+      if (serialTick) rcSerialCount--;
+      #if defined(FAILSAFE)
+        failsafeCnt = 0;
+      #endif
+      if (rcSerial[chan] > 900) rcData[chan] = rcSerial[chan];
+    }
+  }
+}
+#else
 void computeRC() {
   static uint16_t rcData4Values[RC_CHANS][4], rcDataMean[RC_CHANS];
   static uint8_t rc4ValuesIndex = 0;
@@ -471,6 +634,7 @@ void computeRC() {
   
 //  Serial.println(" End computeRC");
 }
+#endif
 
 
 /**************************************************************************************/
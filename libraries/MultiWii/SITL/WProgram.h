@@ -0,0 +1,183 @@
+/*
+  WProgram.h - MPIDE 0023 core API for the SITL build of MultiWii
+
+  Stands in for the chipKIT MAX32 core when the MultiWii sources are compiled
+  on a PC with -DSITL -ISITL. Time is the simulated target time of sitl.h,
+  the serial ports and the PIC32 registers used by the CHIPKIT code are
+  emulated in sitl_hal.cpp.
+*/
+
+#ifndef WProgram_h
+#define WProgram_h
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+
+#include "sitl.h"
+
+#define F_CPU 80000000L
+#define _BOARD_MEGA_          // the MAX32: Serial, Serial1, Serial2 and Serial3
+
+#define HIGH 0x1
+#define LOW  0x0
+#define INPUT  0x0
+#define OUTPUT 0x1
+
+#define PI         3.1415926535897932384626433832795
+#define HALF_PI    1.5707963267948966192313216916398
+#define TWO_PI     6.283185307179586476925286766559
+#define DEG_TO_RAD 0.017453292519943295769236907684886
+#define RAD_TO_DEG 57.295779513082320876798154814105
+
+#define DEC 10
+#define HEX 16
+#define OCT 8
+#define BIN 2
+
+#define min(a,b) ((a)<(b)?(a):(b))
+#define max(a,b) ((a)>(b)?(a):(b))
+#define abs(x) ((x)>0?(x):-(x))
+#define constrain(amt,low,high) ((amt)<(low)?(low):((amt)>(high)?(high):(amt)))
+#define radians(deg) ((deg)*DEG_TO_RAD)
+#define degrees(rad) ((rad)*RAD_TO_DEG)
+#define sq(x) ((x)*(x))
+#define lowByte(w) ((uint8_t) ((w) & 0xff))
+#define highByte(w) ((uint8_t) ((w) >> 8))
+#define clockCyclesPerMicrosecond() (F_CPU / 1000000L)
+
+typedef uint8_t byte;
+typedef uint8_t boolean;
+
+// no program memory on the PIC32, nor here
+#define PROGMEM
+#define PSTR(s) (s)
+typedef char prog_char;
+typedef unsigned char prog_uchar;
+typedef uint8_t prog_uint8_t;
+typedef uint16_t prog_uint16_t;
+#define pgm_read_byte(p) (*(const uint8_t *)(p))
+#define pgm_read_word(p) (*(const uint16_t *)(p))
+
+// the NVM pages of the core for Deeprom.cpp, Board_Defs.h of the MAX32
+#define _EEPROM_PAGE_SIZE  1024   // words
+#define _EEPROM_PAGE_COUNT 4
+
+// a single execution context: interrupts are delivered between loops by sitl.h
+#define cli()
+#define sei()
+
+unsigned long millis(void);
+unsigned long micros(void);
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t val);
+int digitalRead(uint8_t pin);
+int analogRead(uint8_t pin);
+void analogWrite(uint8_t pin, int val);
+
+class Print {
+  public:
+    virtual void write(uint8_t c) = 0;
+    virtual void write(const char *str);
+    virtual void write(const uint8_t *buffer, size_t size);
+
+    void print(const char *s);
+    void print(char c);
+    void print(unsigned char b, int base = DEC);
+    void print(int n, int base = DEC);
+    void print(unsigned int n, int base = DEC);
+    void print(long n, int base = DEC);
+    void print(unsigned long n, int base = DEC);
+    void print(double n, int digits = 2);
+
+    void println(void);
+    void println(const char *s);
+    void println(char c);
+    void println(unsigned char b, int base = DEC);
+    void println(int n, int base = DEC);
+    void println(unsigned int n, int base = DEC);
+    void println(long n, int base = DEC);
+    void println(unsigned long n, int base = DEC);
+    void println(double n, int digits = 2);
+
+  private:
+    void printNumber(unsigned long n, uint8_t base);
+};
+
+class HardwareSerial : public Print {
+  public:
+    HardwareSerial(uint8_t port);
+    void begin(unsigned long baud);
+    void end(void);
+    int available(void);
+    int peek(void);
+    int read(void);
+    void flush(void);
+    virtual void write(uint8_t c);
+    using Print::write;
+
+  private:
+    uint8_t port;
+};
+
+extern HardwareSerial Serial;
+extern HardwareSerial Serial1;
+extern HardwareSerial Serial2;
+extern HardwareSerial Serial3;
+
+// PIC32 registers written by the CHIPKIT code
+extern volatile uint32_t T2CON, TMR2, PR2;
+extern volatile uint32_t OC1CON, OC1R, OC1RS;
+extern volatile uint32_t OC2CON, OC2R, OC2RS;
+extern volatile uint32_t OC3CON, OC3R, OC3RS;
+extern volatile uint32_t OC4CON, OC4R, OC4RS;
+extern volatile uint32_t OC5CON, OC5R, OC5RS;
+extern volatile uint32_t CNEN, IFS1CLR;
+extern volatile uint32_t PORTC, PORTD;
+
+// interrupt controller: IFS0..2, IEC0..2 and IPC0..15 as p32_regset, see p32_defs.h
+extern volatile uint32_t sitl_ifs[3][4], sitl_iec[3][4], sitl_ipc[16][4];
+#define IFS0 (sitl_ifs[0][0])
+#define IEC0 (sitl_iec[0][0])
+#define IPC0 (sitl_ipc[0][0])
+#define _DMA0_IRQ 36
+
+// UART transmit registers and interrupt sources
+extern volatile uint32_t U1TXREG, U2TXREG, U3TXREG, U4TXREG;
+#define _UART1_TX_IRQ 28
+#define _UART2_TX_IRQ 42
+#define _UART3_TX_IRQ 33
+#define _UART4_TX_IRQ 68
+
+// DMA: the controller and channels 0 to 7, 12 p32_regset each from DCH0CON
+extern volatile uint32_t DMACONSET;
+extern volatile uint32_t sitl_dch[8][48];
+#define DCH0CON (sitl_dch[0][0])
+#define _DMACON_ON_MASK             0x00008000
+#define _DCH0CON_CHEN_MASK          0x00000080
+#define _DCH0ECON_CHSIRQ_POSITION   8
+#define _DCH0ECON_SIRQEN_MASK       0x00000010
+#define _DCH0ECON_CFORCE_MASK       0x00000080
+#define _DCH0INT_CHBCIF_MASK        0x00000008
+#define _DCH0INT_CHBCIE_MASK        0x00080000
+
+// I2C1: the master of the sensor bus for the queue of Sensors.cpp, see sitl_sensors.cpp
+extern volatile uint32_t sitl_i2c1con[4];
+#define I2C1CON    (sitl_i2c1con[0])
+#define I2C1CONCLR (sitl_i2c1con[1])
+#define I2C1CONSET (sitl_i2c1con[2])
+extern volatile uint32_t I2C1STAT, I2C1TRN, I2C1RCV;
+#define _I2C1_MASTER_IRQ        31
+#define _I2C1CON_SEN_MASK       0x00000001
+#define _I2C1CON_RSEN_MASK      0x00000002
+#define _I2C1CON_PEN_MASK       0x00000004
+#define _I2C1CON_RCEN_MASK      0x00000008
+#define _I2C1CON_ACKEN_MASK     0x00000010
+#define _I2C1CON_ACKDT_MASK     0x00000020
+#define _I2C1STAT_ACKSTAT_MASK  0x00008000
+
+#endif
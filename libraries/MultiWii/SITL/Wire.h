@@ -0,0 +1,46 @@
+/*
+  Wire.h - MPIDE 0023 Wire (I2C master) API for the SITL build of MultiWii
+
+  Same behaviour as the chipKIT library: send() only queues bytes after a
+  beginTransmission(), the transfer goes on the bus at endTransmission().
+  The devices on the simulated bus are in sitl_sensors.cpp.
+*/
+
+#ifndef TwoWire_h
+#define TwoWire_h
+
+#include <stdint.h>
+
+#define BUFFER_LENGTH 32
+
+class TwoWire {
+  public:
+    TwoWire();
+    void begin();
+    void beginTransmission(uint8_t address);
+    void beginTransmission(int address);
+    uint8_t endTransmission(void);
+    uint8_t requestFrom(uint8_t address, uint8_t quantity);
+    uint8_t requestFrom(int address, int quantity);
+    void send(uint8_t data);
+    void send(uint8_t *data, uint8_t quantity);
+    void send(char *data);
+    void send(int data);
+    uint8_t available(void);
+    uint8_t receive(void);
+
+  private:
+    uint8_t rxBuffer[BUFFER_LENGTH];
+    uint8_t rxBufferIndex;
+    uint8_t rxBufferLength;
+
+    uint8_t txAddress;
+    uint8_t txBuffer[BUFFER_LENGTH];
+    uint8_t txBufferLength;
+
+    uint8_t transmitting;
+};
+
+extern TwoWire Wire;
+
+#endif
@@ -0,0 +1,21 @@
+/*
+  p32_defs.h - PIC32 register set of the chipKIT core, for the SITL build of MultiWii
+
+  Most PIC32 registers are followed by their CLR, SET and INV registers.
+  The stand-ins of WProgram.h are laid out the same way; sitl_hal.cpp
+  applies the CLR and SET writes when it looks at them.
+*/
+
+#ifndef _P32_DEFS_H
+#define _P32_DEFS_H
+
+#include <stdint.h>
+
+typedef struct {
+  volatile uint32_t reg;
+  volatile uint32_t clr;
+  volatile uint32_t set;
+  volatile uint32_t inv;
+} p32_regset;
+
+#endif
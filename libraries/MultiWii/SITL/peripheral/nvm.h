@@ -0,0 +1,14 @@
+/*
+  peripheral/nvm.h - PIC32 flash programming for the SITL build of MultiWii
+
+  The flash of the program is host RAM here: a word write can only clear
+  bits and costs the time of the PIC32, a page erase sets its 4kB to 0xFF.
+*/
+
+#ifndef _PERIPHERAL_NVM_H
+#define _PERIPHERAL_NVM_H
+
+unsigned int NVMWriteWord(void *address, unsigned int data);
+unsigned int NVMErasePage(void *address);
+
+#endif
@@ -0,0 +1,116 @@
+/*
+  sitl.h - software in the loop simulation of the MultiWii flight loop
+
+  The MultiWii sources are compiled for the PC with the CHIPKIT options of
+  config.h, against the MAX32 stand-ins of this folder (WProgram.h, Wire.h,
+  sys/attribs.h, sys/kmem.h, p32_defs.h, peripheral/nvm.h). Everything the
+  board would do in hardware is done here:
+
+  - sitl_hal.cpp:     the target clock, the UARTs, the PIC32 registers, the
+                      DMA channels of the UARTs, the NVM pages of Store.cpp and
+                      Blackbox.cpp, with power losses, and the main loop
+                      stage timing
+  - sitl_sensors.cpp: the I2C bus with a MPU6050 and a MS5611, through Wire
+                      or the I2C1 master of the transaction queue, the NMEA
+                      or NAV-PVT GPS, the motor vibration on the gyro
+  - sitl_model.cpp:   the rigid body quad seen by the sensors and driven by
+                      the motor outputs, the RC receiver pulses
+  - sitl_main.cpp:    the flight scenario and the report
+
+  Target time only moves when the firmware spends it: the host time of the
+  firmware code scaled by sitl_cpu_scale, bus and UART transfers, delays.
+  Pending events (model steps, RC edges, GPS bytes) are run whenever the
+  firmware looks at the clock or at a peripheral, in time order, so that
+  the firmware sees them as the interrupts and sensors of the board would.
+*/
+
+#ifndef SITL_H_
+#define SITL_H_
+
+#include <stdint.h>
+#include <setjmp.h>
+
+/*************** target clock ***************/
+extern double sitl_cpu_scale;    // target ns charged per host ns of firmware code, 0: only sitl_call_ns
+extern uint32_t sitl_call_ns;    // target ns charged per clock read (the micros() call itself)
+
+uint64_t sitl_now_ns(void);
+void sitl_advance_ns(uint64_t ns);  // the firmware waits for ns (delay, bus or UART transfer)
+void sitl_sync(void);               // charge the firmware time and run the events due
+void sitl_sim_enter(void);          // the simulator works from here: time is not charged
+void sitl_sim_leave(void);
+void sitl_interrupt(uint64_t at_ns, void (*handler)(void));  // run an interrupt handler at the time of its event
+void sitl_sfr_apply(volatile uint32_t *r);                    // apply the CLR and SET writes of a register
+void sitl_dma_event(uint8_t irq, uint64_t at_ns);             // an interrupt flag raised: the DMA channels 4 to 7 it starts
+
+/*************** main loop stage timing ***************/
+struct sitl_stage_stat_t {
+  uint32_t count;
+  uint64_t target_ns;   // total target time, as the board would spend it
+  uint64_t host_ns;     // total host time of the firmware code alone
+  uint64_t max_ns;      // longest target time
+};
+extern sitl_stage_stat_t sitl_stage_stat[];
+
+void sitl_stage_begin(uint8_t s);
+void sitl_stage_end(uint8_t s);
+
+/*************** serial ports ***************/
+#define SITL_UART_COUNT 4
+extern uint8_t sitl_uart_echo;    // copy what the firmware sends on Serial to stdout
+
+void sitl_uart_inject(uint8_t port, const uint8_t *data, uint16_t len, uint64_t at_ns);
+uint16_t sitl_uart_take(uint8_t port, uint8_t *buf, uint16_t size);
+uint32_t sitl_uart_baud(uint8_t port);
+
+/*************** program flash ***************/
+extern uint32_t sitl_nvm_words, sitl_nvm_erases;  // NVMWriteWord() and NVMErasePage() calls
+extern uint32_t sitl_eeprom_erases[];             // erases of each NVM page of Deeprom.cpp
+extern uint32_t sitl_nvm_cut;                     // NVM operations until a power loss cuts one, 0: none
+extern jmp_buf sitl_power_loss;                   // where the cut returns, set by the caller with setjmp
+
+/*************** I2C bus ***************/
+struct sitl_i2c_device_t {
+  uint8_t address;                                    // 7 bit address
+  void (*write)(const uint8_t *data, uint8_t len);    // one transfer from the master
+  void (*read)(uint8_t *data, uint8_t len);           // one transfer to the master
+};
+
+void sitl_i2c_attach(const sitl_i2c_device_t *device);
+uint8_t sitl_i2c_write(uint8_t address, const uint8_t *data, uint8_t len);  // 0: ACK, 2: address NACK
+uint8_t sitl_i2c_read(uint8_t address, uint8_t *data, uint8_t len);         // bytes read
+
+// Wire as the interrupt driven Wire of the core: begin() enables the I2C1 master interrupt, a
+// transfer started while it is masked never ends (counted, and failed instead of hanging)
+extern uint32_t sitl_wire_transfers, sitl_wire_after_queue, sitl_wire_stuck;
+
+extern double sitl_vibration_dps;    // -v: amplitude of the motor vibration on the gyro, 0: none
+double sitl_vibration_hz(void);     // its frequency for the motor commands of the model, average of the 4
+
+void sitl_sensors_init(uint32_t seed);
+void sitl_sensors_run(uint64_t now_ns);
+void sitl_gps_coord(double north, double east, int32_t *lat, int32_t *lon);    // m from home to GPS_coord units
+void sitl_gps_meters(int32_t lat, int32_t lon, double *north, double *east);  // and back
+uint16_t sitl_gps_epoch(uint8_t *buf, uint16_t size, uint64_t at_ns);     // the messages of the fix at that time
+
+/*************** vehicle model and receiver ***************/
+struct sitl_state_t {
+  double pos[3];        // m, north east down from home
+  double vel[3];        // m/s, north east down
+  double q[4];          // attitude quaternion w x y z, body (front right down) to earth
+  double rate[3];       // rad/s, body p q r
+  double force[3];      // m/s^2, specific force in body axes as an accelerometer sees it
+  double motor[4];      // us, motor commands seen through the ESC lag
+  double thrust;        // N, total thrust
+  double wind[3];       // m/s, north east down, the air the drag is against
+};
+extern sitl_state_t sitl_state;
+
+void sitl_model_init(void);
+void sitl_model_run(uint64_t now_ns);
+void sitl_euler(double angle[3]);     // roll, pitch, yaw in rad (front right down)
+
+void sitl_rc_set(uint8_t chan, uint16_t us); // chan in the RX order: THROTTLE ROLL PITCH YAW AUX1..AUX4
+void sitl_rc_run(uint64_t now_ns);
+
+#endif
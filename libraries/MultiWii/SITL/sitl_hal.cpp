@@ -0,0 +1,480 @@
+/*
+  sitl_hal.cpp - target clock, UARTs, registers and NVM of the simulated MAX32
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "WProgram.h"
+#include "p32_defs.h"
+#include "sys/attribs.h"
+#include "sys/kmem.h"
+#include "../config.h"
+#include "../def.h"
+#include "../types.h"
+
+/*************** target clock ***************/
+double sitl_cpu_scale = 30;   // a 80MHz PIC32 without FPU against a PC, see ReadMe.txt
+uint32_t sitl_call_ns = 250;  // core timer read and 64 bit arithmetic of micros()
+
+static uint64_t now_ns;       // target time
+static uint64_t host_mark;    // host time already charged
+static uint64_t host_total;   // host time of the firmware code
+static uint8_t sim_depth;     // > 0 while the simulator works
+static uint8_t in_events;     // the events run from sitl_sync() must not run themselves
+static uint64_t frozen_ns;    // time seen by an interrupt handler, 0: none
+
+static uint64_t host_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec*1000000000ULL + ts.tv_nsec;
+}
+
+// the firmware never runs long without looking at the clock or a peripheral:
+// a longer host time is the host scheduling something else, not charged
+#define HOST_SLICE_NS 100000
+
+static void charge(void) {
+  uint64_t h = host_ns(), d = h - host_mark;
+  if (sim_depth == 0 && host_mark != 0 && d < HOST_SLICE_NS) {
+    now_ns += (uint64_t)(d * sitl_cpu_scale);
+    host_total += d;
+  }
+  host_mark = h;
+}
+
+void sitl_sim_enter(void) {
+  if (sim_depth == 0) charge();
+  sim_depth++;
+}
+
+void sitl_sim_leave(void) {
+  if (--sim_depth == 0) host_mark = host_ns();
+}
+
+static void dma_run(void);
+
+static void run_events(void) {
+  if (in_events) return;
+  in_events = 1;
+  sitl_sim_enter();
+  sitl_model_run(now_ns);
+  sitl_rc_run(now_ns);
+  sitl_sensors_run(now_ns);
+  dma_run();
+  sitl_sim_leave();
+  in_events = 0;
+}
+
+uint64_t sitl_now_ns(void) {
+  return frozen_ns ? frozen_ns : now_ns;
+}
+
+void sitl_sync(void) {
+  if (frozen_ns) return;
+  charge();
+  run_events();
+}
+
+void sitl_advance_ns(uint64_t ns) {
+  if (frozen_ns) return;      // busy waits are not done inside interrupt handlers
+  charge();
+  now_ns += ns;
+  run_events();
+}
+
+// an interrupt handler runs at the time of its event: its own cost is charged to the code it interrupts
+void sitl_interrupt(uint64_t at_ns, void (*handler)(void)) {
+  uint64_t h = host_ns();
+  frozen_ns = at_ns;
+  handler();
+  frozen_ns = 0;
+  h = host_ns() - h;
+  now_ns += (uint64_t)(h * sitl_cpu_scale);
+  host_total += h;
+}
+
+unsigned long micros(void) {
+  if (!frozen_ns) sitl_advance_ns(sitl_call_ns);
+  return (unsigned long)(uint32_t)(sitl_now_ns() / 1000);
+}
+
+unsigned long millis(void) {
+  if (!frozen_ns) sitl_advance_ns(sitl_call_ns);
+  return (unsigned long)(uint32_t)(sitl_now_ns() / 1000000);
+}
+
+void delay(unsigned long ms) {
+  sitl_advance_ns((uint64_t)ms * 1000000);
+}
+
+void delayMicroseconds(unsigned int us) {
+  sitl_advance_ns((uint64_t)us * 1000);
+}
+
+void pinMode(uint8_t pin, uint8_t mode) {}
+void digitalWrite(uint8_t pin, uint8_t val) {}
+int digitalRead(uint8_t pin) { return LOW; }
+int analogRead(uint8_t pin) { return 0; }
+void analogWrite(uint8_t pin, int val) {}
+
+/*************** main loop stage timing ***************/
+sitl_stage_stat_t sitl_stage_stat[STAGE_ITEMS];
+static uint64_t stage_target[STAGE_ITEMS];
+static uint64_t stage_host[STAGE_ITEMS];
+
+void sitl_stage_begin(uint8_t s) {
+  sitl_sim_enter();
+  stage_target[s] = now_ns;
+  stage_host[s] = host_total;
+  sitl_sim_leave();
+}
+
+void sitl_stage_end(uint8_t s) {
+  sitl_sim_enter();
+  sitl_stage_stat_t *st = &sitl_stage_stat[s];
+  uint64_t t = now_ns - stage_target[s];
+  st->count++;
+  st->target_ns += t;
+  st->host_ns += host_total - stage_host[s];
+  if (t > st->max_ns) st->max_ns = t;
+  sitl_sim_leave();
+}
+
+/*************** serial ports ***************/
+#define UART_FIFO  8      // PIC32 UART transmit FIFO
+#define UART_RX    128    // HardwareSerial receive buffer
+#define UART_IN    4096   // bytes on their way to the board
+#define UART_OUT   8192   // bytes sent by the board, not taken yet
+
+struct uart_t {
+  uint32_t baud;
+  uint64_t tx_done_ns;                // end of transmission of the last byte written
+  uint8_t rx[UART_RX];
+  uint16_t rx_head, rx_tail;
+  uint8_t in[UART_IN];                // injected bytes and their arrival times
+  uint64_t in_ns[UART_IN];
+  uint16_t in_head, in_tail;
+  uint8_t out[UART_OUT];
+  uint16_t out_head, out_tail;
+  uint32_t rx_dropped;
+};
+
+static uart_t uart[SITL_UART_COUNT];
+uint8_t sitl_uart_echo = 0;
+
+static uint64_t byte_ns(uart_t *u) {
+  return u->baud ? 10000000000ULL / u->baud : 0;   // start, 8 data and stop bits
+}
+
+// bytes arrived by now land in the receive buffer, or are lost when it is full
+static void uart_receive(uart_t *u) {
+  while (u->in_tail != u->in_head && u->in_ns[u->in_tail] <= sitl_now_ns()) {
+    uint16_t next = (u->rx_head + 1) % UART_RX;
+    if (next != u->rx_tail) {
+      u->rx[u->rx_head] = u->in[u->in_tail];
+      u->rx_head = next;
+    } else u->rx_dropped++;
+    u->in_tail = (u->in_tail + 1) % UART_IN;
+  }
+}
+
+void sitl_uart_inject(uint8_t port, const uint8_t *data, uint16_t len, uint64_t at_ns) {
+  uart_t *u = &uart[port];
+  uint64_t t = at_ns;
+  if (u->in_tail != u->in_head) {
+    uint64_t last = u->in_ns[(u->in_head + UART_IN - 1) % UART_IN];
+    if (last > t) t = last;
+  }
+  while (len--) {
+    uint16_t next = (u->in_head + 1) % UART_IN;
+    if (next == u->in_tail) break;
+    t += byte_ns(u);
+    u->in[u->in_head] = *data++;
+    u->in_ns[u->in_head] = t;
+    u->in_head = next;
+  }
+}
+
+uint16_t sitl_uart_take(uint8_t port, uint8_t *buf, uint16_t size) {
+  uart_t *u = &uart[port];
+  uint16_t n = 0;
+  while (n < size && u->out_tail != u->out_head) {
+    buf[n++] = u->out[u->out_tail];
+    u->out_tail = (u->out_tail + 1) % UART_OUT;
+  }
+  return n;
+}
+
+uint32_t sitl_uart_baud(uint8_t port) {
+  return uart[port].baud;
+}
+
+HardwareSerial Serial(0);
+HardwareSerial Serial1(1);
+HardwareSerial Serial2(2);
+HardwareSerial Serial3(3);
+
+HardwareSerial::HardwareSerial(uint8_t port) : port(port) {}
+
+void HardwareSerial::begin(unsigned long baud) {
+  uart[port].baud = baud;
+  uart[port].rx_head = uart[port].rx_tail = 0;
+}
+
+void HardwareSerial::end(void) {
+  uart[port].baud = 0;
+}
+
+int HardwareSerial::available(void) {
+  uart_t *u = &uart[port];
+  sitl_sync();
+  uart_receive(u);
+  return (u->rx_head + UART_RX - u->rx_tail) % UART_RX;
+}
+
+int HardwareSerial::peek(void) {
+  uart_t *u = &uart[port];
+  if (!available()) return -1;
+  return u->rx[u->rx_tail];
+}
+
+int HardwareSerial::read(void) {
+  uart_t *u = &uart[port];
+  if (!available()) return -1;
+  uint8_t c = u->rx[u->rx_tail];
+  u->rx_tail = (u->rx_tail + 1) % UART_RX;
+  return c;
+}
+
+void HardwareSerial::flush(void) {
+  uart[port].rx_head = uart[port].rx_tail = 0;
+}
+
+// c enters the transmit FIFO at at_ns, which has room by then: it is sent after the bytes before it
+static void uart_send(uint8_t port, uint8_t c, uint64_t at_ns) {
+  uart_t *u = &uart[port];
+  if (u->tx_done_ns < at_ns) u->tx_done_ns = at_ns;
+  u->tx_done_ns += byte_ns(u);
+  uint16_t next = (u->out_head + 1) % UART_OUT;
+  if (next != u->out_tail) {
+    u->out[u->out_head] = c;
+    u->out_head = next;
+  }
+  if (port == 0 && sitl_uart_echo) putchar(c);
+}
+
+// when the transmit FIFO has room for one more byte
+static uint64_t uart_room_ns(uart_t *u) {
+  uint64_t fifo = UART_FIFO * byte_ns(u);
+  return u->tx_done_ns > fifo ? u->tx_done_ns - fifo : 0;
+}
+
+// blocks while the transmit FIFO is full, as the chipKIT core does
+void HardwareSerial::write(uint8_t c) {
+  sitl_sync();
+  uint64_t now = sitl_now_ns(), room = uart_room_ns(&uart[port]);
+  if (room > now) sitl_advance_ns(room - now);
+  uart_send(port, c, now);
+}
+
+/*************** Print ***************/
+void Print::write(const char *str) {
+  while (*str) write((uint8_t)*str++);
+}
+
+void Print::write(const uint8_t *buffer, size_t size) {
+  while (size--) write(*buffer++);
+}
+
+void Print::printNumber(unsigned long n, uint8_t base) {
+  char buf[8 * sizeof(long) + 1];
+  char *str = &buf[sizeof(buf) - 1];
+  *str = '\0';
+  if (base < 2) base = 10;
+  do {
+    unsigned long m = n;
+    n /= base;
+    char c = m - base * n;
+    *--str = c < 10 ? c + '0' : c + 'A' - 10;
+  } while (n);
+  write(str);
+}
+
+void Print::print(const char *s) { write(s); }
+void Print::print(char c) { write((uint8_t)c); }
+void Print::print(unsigned char b, int base) { printNumber(b, base); }
+void Print::print(unsigned int n, int base) { printNumber(n, base); }
+void Print::print(unsigned long n, int base) { printNumber(n, base); }
+void Print::print(int n, int base) { print((long)n, base); }
+
+void Print::print(long n, int base) {
+  if (base == 10 && n < 0) {
+    write((uint8_t)'-');
+    n = -n;
+  }
+  printNumber(n, base);
+}
+
+void Print::print(double n, int digits) {
+  char buf[32];
+  snprintf(buf, sizeof(buf), "%.*f", digits, n);
+  write(buf);
+}
+
+void Print::println(void) { print('\r'); print('\n'); }
+void Print::println(const char *s) { print(s); println(); }
+void Print::println(char c) { print(c); println(); }
+void Print::println(unsigned char b, int base) { print(b, base); println(); }
+void Print::println(int n, int base) { print(n, base); println(); }
+void Print::println(unsigned int n, int base) { print(n, base); println(); }
+void Print::println(long n, int base) { print(n, base); println(); }
+void Print::println(unsigned long n, int base) { print(n, base); println(); }
+void Print::println(double n, int digits) { print(n, digits); println(); }
+
+/*************** PIC32 registers ***************/
+volatile uint32_t T2CON, TMR2, PR2;
+volatile uint32_t OC1CON, OC1R, OC1RS;
+volatile uint32_t OC2CON, OC2R, OC2RS;
+volatile uint32_t OC3CON, OC3R, OC3RS;
+volatile uint32_t OC4CON, OC4R, OC4RS;
+volatile uint32_t OC5CON, OC5R, OC5RS;
+volatile uint32_t CNEN, IFS1CLR;
+volatile uint32_t PORTC, PORTD;
+volatile uint32_t sitl_ifs[3][4], sitl_iec[3][4], sitl_ipc[16][4];
+volatile uint32_t U1TXREG, U2TXREG, U3TXREG, U4TXREG;
+
+// the CLR and SET registers written since the last look
+void sitl_sfr_apply(volatile uint32_t *r) {
+  r[0] = (r[0] & ~r[1]) | r[2];
+  r[1] = r[2] = 0;
+}
+
+/*************** DMA ***************/
+// channels 0 to 3 moving bytes to a UART transmit register, one each time
+// the UART raises its transmit interrupt (its FIFO has room), and channels 4
+// to 7 moving one cell each time the peripheral of sitl_dma_event() raises
+// their start interrupt. At the end of a block the channel stops and raises
+// its own interrupt.
+volatile uint32_t DMACONSET;
+volatile uint32_t sitl_dch[8][48];
+uint8_t sitl_pa_base;
+
+enum { DCH_CON = 0, DCH_ECON = 4, DCH_INT = 8, DCH_SSA = 12, DCH_DSA = 16, DCH_SSIZ = 20, DCH_SPTR = 28 };
+
+// the handlers of Serial.cpp, missing in a -DCHIPKIT_BLOCKING_TX build
+extern "C" {
+  void SerialTX0_Handler(void) __attribute__ ((weak));
+  void SerialTX1_Handler(void) __attribute__ ((weak));
+  void SerialTX2_Handler(void) __attribute__ ((weak));
+  void SerialTX3_Handler(void) __attribute__ ((weak));
+  void I2CQueue_Handler(void) __attribute__ ((weak));   // channel 4, Sensors.cpp
+}
+
+static uint64_t dma_start_ns[4];    // when the channel was seen enabled, 0: off
+
+static void dma_run(void) {
+  // the UARTs of Serial to Serial3 on the MAX32
+  static volatile uint32_t *const txreg[SITL_UART_COUNT] = { &U1TXREG, &U4TXREG, &U3TXREG, &U2TXREG };
+  static const uint8_t txirq[SITL_UART_COUNT] = { _UART1_TX_IRQ, _UART4_TX_IRQ, _UART3_TX_IRQ, _UART2_TX_IRQ };
+  static void (*const handler[4])(void) = { SerialTX0_Handler, SerialTX1_Handler, SerialTX2_Handler, SerialTX3_Handler };
+
+  for (uint8_t c = 0; c < 4; c++) {
+    volatile uint32_t *d = sitl_dch[c];
+    uint8_t irq = _DMA0_IRQ + c;
+    uint32_t bit = 1UL << (irq & 31);
+    for (;;) {
+      sitl_sfr_apply(d + DCH_CON);
+      sitl_sfr_apply(d + DCH_ECON);
+      sitl_sfr_apply(d + DCH_INT);
+      if (!(d[DCH_CON] & _DCH0CON_CHEN_MASK)) {
+        dma_start_ns[c] = 0;
+        break;
+      }
+      if (!dma_start_ns[c]) dma_start_ns[c] = now_ns;
+      uint8_t p = 0;
+      while (p < SITL_UART_COUNT && d[DCH_DSA] != KVA_TO_PA(txreg[p])) p++;
+      if (p == SITL_UART_COUNT || !uart[p].baud || !(d[DCH_ECON] & _DCH0ECON_SIRQEN_MASK) ||
+          (d[DCH_ECON] >> _DCH0ECON_CHSIRQ_POSITION & 0xFF) != txirq[p]) break;  // never started
+      uint64_t at = uart_room_ns(&uart[p]);
+      if (at < dma_start_ns[c]) at = dma_start_ns[c];
+      if (at > now_ns) break;
+      uart_send(p, ((const uint8_t *)PA_TO_KVA1(d[DCH_SSA]))[d[DCH_SPTR]], at);
+      if (++d[DCH_SPTR] < d[DCH_SSIZ]) continue;
+      d[DCH_SPTR] = 0;
+      d[DCH_CON] &= ~_DCH0CON_CHEN_MASK;
+      d[DCH_INT] |= _DCH0INT_CHBCIF_MASK;
+      sitl_ifs[irq >> 5][0] |= bit;
+      sitl_sfr_apply(sitl_iec[irq >> 5]);
+      if ((d[DCH_INT] & _DCH0INT_CHBCIE_MASK) && (sitl_iec[irq >> 5][0] & bit) && handler[c]) {
+        sitl_interrupt(at, handler[c]);
+        sitl_sfr_apply(sitl_ifs[irq >> 5]);
+        dma_start_ns[c] = at;   // a block started by the handler
+      }
+    }
+  }
+}
+
+void sitl_dma_event(uint8_t irq, uint64_t at_ns) {
+  static void (*const handler[4])(void) = { I2CQueue_Handler, 0, 0, 0 };
+
+  for (uint8_t c = 4; c < 8; c++) {
+    volatile uint32_t *d = sitl_dch[c];
+    uint8_t dirq = _DMA0_IRQ + c;
+    uint32_t bit = 1UL << (dirq & 31);
+    sitl_sfr_apply(d + DCH_CON);
+    sitl_sfr_apply(d + DCH_ECON);
+    sitl_sfr_apply(d + DCH_INT);
+    if (!(d[DCH_CON] & _DCH0CON_CHEN_MASK) || !(d[DCH_ECON] & _DCH0ECON_SIRQEN_MASK) ||
+        (d[DCH_ECON] >> _DCH0ECON_CHSIRQ_POSITION & 0xFF) != irq) continue;
+    ((uint8_t *)PA_TO_KVA1(d[DCH_DSA]))[0] = ((const uint8_t *)PA_TO_KVA1(d[DCH_SSA]))[0];  // one byte cells
+    d[DCH_CON] &= ~_DCH0CON_CHEN_MASK;
+    d[DCH_INT] |= _DCH0INT_CHBCIF_MASK;
+    sitl_ifs[dirq >> 5][0] |= bit;
+    sitl_sfr_apply(sitl_iec[dirq >> 5]);
+    if ((d[DCH_INT] & _DCH0INT_CHBCIE_MASK) && (sitl_iec[dirq >> 5][0] & bit) && handler[c - 4]) {
+      sitl_interrupt(at_ns, handler[c - 4]);
+      sitl_sfr_apply(sitl_ifs[dirq >> 5]);
+    }
+  }
+}
+
+/*************** program flash ***************/
+// the NVM pages of Deeprom.cpp, for Store.cpp, erased when the board is new, and the pages of Blackbox.cpp:
+// word write 20us and page erase 20ms of the PIC32MX, typical
+unsigned int eedata_addr[_EEPROM_PAGE_COUNT][1024] __attribute__ ((aligned(4096)));
+static struct eeprom_erased {
+  eeprom_erased() { memset(eedata_addr, 0xFF, sizeof(eedata_addr)); }
+} eeprom_erased;
+
+uint32_t sitl_nvm_words, sitl_nvm_erases, sitl_eeprom_erases[_EEPROM_PAGE_COUNT];
+uint32_t sitl_nvm_cut;
+jmp_buf sitl_power_loss;
+
+// the operation the power loss cuts leaves a random part of its bits done
+static void nvm_cut(void) {
+  if (!sitl_nvm_cut || --sitl_nvm_cut) return;
+  longjmp(sitl_power_loss, 1);
+}
+
+extern "C" unsigned int NVMWriteWord(void *address, unsigned int data) {
+  sitl_nvm_words++;
+  sitl_advance_ns(20000);
+  if (sitl_nvm_cut == 1) *(volatile uint32_t *)address &= data | ((uint32_t)rand() << 16 ^ rand());
+  nvm_cut();
+  *(volatile uint32_t *)address &= data;
+  return 0;
+}
+
+extern "C" unsigned int NVMErasePage(void *address) {
+  uint32_t *w = (uint32_t *)address;
+  uintptr_t page = ((uintptr_t)address - (uintptr_t)eedata_addr) / 4096;
+  sitl_nvm_erases++;
+  if (page < _EEPROM_PAGE_COUNT) sitl_eeprom_erases[page]++;
+  sitl_advance_ns(20000000);
+  if (sitl_nvm_cut == 1) for (uint16_t i = 0; i < 1024; i++) w[i] |= rand() & 1 ? (uint32_t)rand() << 16 ^ rand() : 0;
+  nvm_cut();
+  memset(address, 0xFF, 4096);
+  return 0;
+}
@@ -0,0 +1,1221 @@
+/*
+  sitl_main.cpp - flight scenario and report of the MultiWii SITL build
+
+  usage: sitl [-t seconds] [-s seed] [-c cpu_scale] [-l log.csv] [-e] [-a] [-m] [-g mode] [-b log.bbl] [-f writes] [-k] [-x] [-n test] [-v dps] [-z]
+
+  Boots the firmware with MultiWii_setup(), then calls MultiWii_loop() as
+  the MPIDE core would, while a pilot flies the model through the RC:
+  gyro calibration on the ground, arming with the yaw stick, climb to 2m in
+  ANGLE mode (AUX1 high) with the pilot holding the altitude on the
+  throttle, a roll doublet, a pitch doublet, hover (-a: 8s of full stick
+  reversals with a yaw spin instead of the doublets). At the end it prints the
+  loop cycle time, the cost of each stage of the loop, the cost of mixTable()
+  and how well the attitude follows the sticks. -m loads a mixer matrix over
+  MSP before arming, so that the flight runs the generic mixer kernel. -g
+  adds a configurator on Serial from arming: MSP_SET_RAW_RC with the sticks
+  and six telemetry requests per round, the next round sent once the
+  replies are in, as one frame per command (1), one MSP_MULTI frame (2) or
+  one v2 frame per command (3); it reports the commands answered per second.
+  -b, with a BLACKBOX build, lands and disarms after the report, then
+  downloads the flight recorder log over MSP into the file, to be decoded
+  by tools/blackbox_decode.py. -f does not fly: it writes setting records
+  to the flash store of Store.cpp with power losses cutting one write in
+  four, boots again after each and checks every record. -k does not fly
+  either: it checks the fixed point navigation math of NavMath.cpp against
+  the float formulas it replaced, -x the mixer matrix of the frame against
+  the PIDMIX chain of mixTable() it replaced. -n flies the GPS
+  with a gusting wind: GPS HOLD (1) or a waypoint mission loaded over
+  MSP_SET_WP (2, GPS_NAV build), and reports the cost of the navigation of
+  each GPS frame and how close the quad stays to the hold point or the legs.
+  -v shakes the gyro with the motor vibration; the report gives the delay
+  and noise of the gyro data, and the cost of the gyro filters. -z holds
+  the altitude in BARO mode from 8s with the throttle stick left alone.
+  The report ends with the cost of GPS_parse() per byte and per fix.
+*/
+
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "WProgram.h"
+#include "../config.h"
+#include "../def.h"
+#include "../types.h"
+#include "../MultiWii.h"
+#include "../Output.h"
+#include "../Store.h"
+#include "../Serial.h"
+#include "../GPS.h"
+#include "../NavMath.h"
+#include "../Sensors.h"
+
+#define RC_THROTTLE 0
+#define RC_ROLL     1
+#define RC_PITCH    2
+#define RC_YAW      3
+#define RC_AUX1     4
+#define RC_AUX2     5
+#define RC_AUX3     6
+#define RC_AUX4     7
+
+#define CYCLE_BINS  20      // 500us each
+#define HOVER_ALT   2.0     // m
+#define NAV_START   9.0     // s, GPS HOLD or MISSION switched on (-n)
+#define NAV_WIND    11.0    // s, the wind rises
+#define ALT_START   8.0     // s, BARO mode switched on (-z)
+
+#define MSP_MIXER_MATRIX     121
+#define MSP_STATUS           101
+#define MSP_RAW_IMU          102
+#define MSP_MOTOR            104
+#define MSP_RC               105
+#define MSP_ATTITUDE         108
+#define MSP_ALTITUDE         109
+#define MSP_BLACKBOX         122
+#define MSP_BLACKBOX_READ    123
+#define MSP_PROFILER         125
+#define MSP_MULTI            126
+#define MSP_WP               118
+#define MSP_SET_RAW_RC       200
+#define MSP_SET_WP           209
+#define MSP_SET_MIXER_MATRIX 213
+#define MIXTABLE_CALLS       1000000
+#define GYRO_FILTER_CALLS    1000000
+#define GPS_PARSE_EPOCHS     64
+#define GPS_PARSE_ROUNDS     2000
+
+static const char *stage_name[STAGE_ITEMS] = {
+  "rc", "  computeRC", "mag", "baro", "altitude", "gps", "  nav", "imu", "  attitude", "  annex", "    serial",
+  "  interleave", "pid", "mix", "write", "blackbox", "cycle" };
+// the stages not nested in another one: with RC_FILTER computeRC runs every loop, out of the rc block
+#if defined(RC_FILTER)
+static const uint8_t stage_top[STAGE_ITEMS] = { 1, 1, 1, 1, 1, 1, 0, 1, 0, 0, 0, 0, 1, 1, 1, 1, 0 };
+#else
+static const uint8_t stage_top[STAGE_ITEMS] = { 1, 0, 1, 1, 1, 1, 0, 1, 0, 0, 0, 0, 1, 1, 1, 1, 0 };
+#endif
+
+struct error_t {
+  double sum2;
+  double max;
+  uint32_t count;
+};
+
+static void error_add(error_t *e, double err) {
+  e->sum2 += err * err;
+  if (fabs(err) > e->max) e->max = fabs(err);
+  e->count++;
+}
+
+static double error_rms(const error_t *e) {
+  return e->count ? sqrt(e->sum2 / e->count) : 0;
+}
+
+// a stick step of roll or pitch, until rcData is halfway and the motors answer
+#define STEP_MOTORS 50      // change of the motor mix of the axis taken as the answer
+
+struct step_t {
+  double t;                 // s, when the pilot moved the stick
+  uint16_t mid;             // halfway from the stick before to the stick after
+  int8_t dir;
+  int32_t mix;              // motor mix of the axis at the step
+  uint8_t rc_done, motor_done;
+};
+
+struct lag_t {
+  double sum, max;
+  uint32_t count, missed;
+};
+
+static void lag_add(lag_t *l, double ms) {
+  l->sum += ms;
+  if (ms > l->max) l->max = ms;
+  l->count++;
+}
+
+// the quad X mix of an axis from motor[]: axisPID of ROLL or PITCH times 4
+static int32_t axis_mix(uint8_t axis) {
+  return axis == ROLL ? motor[2] + motor[3] - motor[0] - motor[1] : motor[0] + motor[2] - motor[1] - motor[3];
+}
+
+static void step_check(step_t *s, lag_t *rc_lag, lag_t *motor_lag, uint8_t axis, double t) {
+  if (s->t < 0) return;
+  if (!s->rc_done && (rcData[axis] - s->mid) * s->dir >= 0) {
+    s->rc_done = 1;
+    lag_add(rc_lag, (t - s->t) * 1e3);
+  }
+  if (!s->motor_done && (axis_mix(axis) - s->mix) * s->dir >= STEP_MOTORS) {
+    s->motor_done = 1;
+    lag_add(motor_lag, (t - s->t) * 1e3);
+  }
+}
+
+static void step_start(step_t *s, lag_t *rc_lag, lag_t *motor_lag, uint8_t axis, double t, uint16_t from, uint16_t to) {
+  if (s->t >= 0) {          // the step before never got there
+    rc_lag->missed += !s->rc_done;
+    motor_lag->missed += !s->motor_done;
+  }
+  s->t = t;
+  s->mid = (from + to) / 2;
+  s->dir = to > from ? 1 : -1;
+  s->mix = axis_mix(axis);
+  s->rc_done = s->motor_done = 0;
+}
+
+// imu.gyroData of roll and pitch against the true body rates at the end of each loop: the delay is the
+// shift of the rates that best fits the gyro data (least squares gain), the noise what is left of the fit
+#define GYRO_TRACE    65536
+#define GYRO_DELAY_MS 30.0
+
+struct gyro_trace_t {
+  double t;
+  double rate[2];     // deg/s, p and q
+  double data[2];     // imu.gyroData
+};
+static gyro_trace_t *gyro_trace;
+static uint32_t gyro_traced;
+
+static void gyro_trace_add(double t) {
+  if (!gyro_trace) gyro_trace = (gyro_trace_t *)malloc(GYRO_TRACE * sizeof(gyro_trace_t));
+  if (gyro_traced == GYRO_TRACE) return;
+  gyro_trace_t *g = &gyro_trace[gyro_traced++];
+  g->t = t;
+  for (uint8_t axis = 0; axis < 2; axis++) {
+    g->rate[axis] = degrees(sitl_state.rate[axis]);
+    g->data[axis] = imu.gyroData[axis];
+  }
+}
+
+// residual rms in deg/s of the fit of the gyro data on the rates delay s before, for both axes
+static double gyro_fit(double delay) {
+  double residual = 0;
+  for (uint8_t axis = 0; axis < 2; axis++) {
+    double xy = 0, xx = 0, yy = 0;
+    uint32_t j = 0, n = 0;
+    for (uint32_t i = 0; i < gyro_traced; i++) {
+      double t = gyro_trace[i].t - delay;
+      if (t < gyro_trace[0].t) continue;
+      while (gyro_trace[j + 1].t < t) j++;
+      double u = (t - gyro_trace[j].t) / (gyro_trace[j + 1].t - gyro_trace[j].t);
+      double x = gyro_trace[j].rate[axis] + u * (gyro_trace[j + 1].rate[axis] - gyro_trace[j].rate[axis]);
+      double y = gyro_trace[i].data[axis];
+      xy += x * y; xx += x * x; yy += y * y;
+      n++;
+    }
+    residual += (yy - xy * xy / xx) / n / sq(xy / xx);
+  }
+  return sqrt(residual / 2);
+}
+
+static void gyro_report(void) {
+  double best = 0, noise = 1e30;
+  if (gyro_traced < 100) return;
+  for (double d = 0; d <= GYRO_DELAY_MS; d += 0.1) {
+    double r = gyro_fit(d * 1e-3);
+    if (r < noise) { noise = r; best = d; }
+  }
+  printf("\ngyro data at the end of the loop against the body rates, from arming: delay %.1fms, noise %.2f deg/s rms",
+         best, noise);
+  if (sitl_vibration_dps) printf(",\n  motor vibration %.0f deg/s at %.0fHz", sitl_vibration_dps, sitl_vibration_hz());
+  printf("\n");
+}
+
+// alt.EstAlt less the true altitude from 1s after the baro calibration of the boot (calibratingB), which ends
+// in the climb: the ground of the baro is off by what was climbed, the error is taken about its average
+static float *alt_trace;
+static uint32_t alt_traced;
+
+static void alt_trace_add(double err) {
+  if (!alt_trace) alt_trace = (float *)malloc(GYRO_TRACE * sizeof(float));
+  if (alt_traced < GYRO_TRACE) alt_trace[alt_traced++] = err;
+}
+
+static error_t alt_trace_error(double *offset) {
+  error_t e = { 0 };
+  double sum = 0;
+  for (uint32_t i = 0; i < alt_traced; i++) sum += alt_trace[i];
+  *offset = alt_traced ? sum / alt_traced : 0;
+  for (uint32_t i = 0; i < alt_traced; i++) error_add(&e, alt_trace[i] - *offset);
+  return e;
+}
+
+#if defined(GYRO_FILTER)
+// host time of Gyro_filter() alone on a sample, samples 1.4ms apart
+static double gyro_filter_ns(void) {
+  struct timespec a, b;
+  uint16_t now = micros();
+  clock_gettime(CLOCK_MONOTONIC, &a);
+  for (uint32_t i = 0; i < GYRO_FILTER_CALLS; i++) {
+    for (uint8_t axis = 0; axis < 3; axis++) imu.gyroADC[axis] = (int16_t)(i * (axis + 5)) >> 6;
+    now += 1400;
+    Gyro_filter(now);
+  }
+  clock_gettime(CLOCK_MONOTONIC, &b);
+  return ((b.tv_sec - a.tv_sec) * 1e9 + (b.tv_nsec - a.tv_nsec)) / GYRO_FILTER_CALLS;
+}
+#endif
+
+// host time of GPS_parse() alone on the fixes of the simulated receiver, in blocks of GPS_CHUNK bytes
+static double gps_parse_ns(uint32_t *bytes, uint32_t *fixes) {
+  static uint8_t epochs[GPS_PARSE_EPOCHS * 512];
+  uint32_t len = 0;
+  for (uint8_t i = 0; i < GPS_PARSE_EPOCHS; i++)
+    len += sitl_gps_epoch(epochs + len, sizeof(epochs) - len, (uint64_t)i * 100000000ULL);
+  int32_t coord[2] = { GPS_coord[LAT], GPS_coord[LON] };
+  uint8_t sats = GPS_numSat, fix = f.GPS_FIX;
+  uint16_t altitude = GPS_altitude, speed = GPS_speed, course = GPS_ground_course;
+  struct timespec a, b;
+  *fixes = 0;
+  clock_gettime(CLOCK_MONOTONIC, &a);
+  for (uint32_t r = 0; r < GPS_PARSE_ROUNDS; r++) {
+    for (uint32_t n = 0; n < len; ) {
+      uint8_t block = len - n < GPS_CHUNK ? len - n : GPS_CHUNK, frame;
+      n += GPS_parse(epochs + n, block, &frame);
+      *fixes += frame;
+    }
+  }
+  clock_gettime(CLOCK_MONOTONIC, &b);
+  GPS_coord[LAT] = coord[0]; GPS_coord[LON] = coord[1];
+  GPS_numSat = sats; f.GPS_FIX = fix;
+  GPS_altitude = altitude; GPS_speed = speed; GPS_ground_course = course;
+  *bytes = len * GPS_PARSE_ROUNDS;
+  return (b.tv_sec - a.tv_sec) * 1e9 + (b.tv_nsec - a.tv_nsec);
+}
+
+static uint8_t aggressive, custom_mixer, gui_mode, landed, nav_test, alt_test;
+static uint16_t sticks[8];              // what the pilot holds, in the order of rcData
+static uint16_t alt_throttle;           // -z: the throttle stick left where it was at ALT_START
+
+// the pilot: sticks as a function of the time since boot, throttle holding the altitude
+static void pilot(double t) {
+  uint16_t roll = 1500, pitch = 1500, yaw = 1500, throttle = 1000, aux2 = 1000, aux3 = 1000, aux4 = 1000;
+
+  if (t >= 4 && t < 5.5) yaw = 2000;                            // arm: throttle low, yaw right
+  if (landed) {                                                 // disarm: throttle low, yaw left
+    throttle = 1000;
+    yaw = 1000;
+  } else if (t >= 6) {
+    double h = -sitl_state.pos[2], climb = -sitl_state.vel[2];
+    throttle = constrain(1500 + 150 * (HOVER_ALT - h) - 150 * climb, 1100, 1900);
+    if (alt_test && t >= ALT_START) {                           // hands off the throttle, BARO holds (AUX4 high)
+      if (!alt_throttle) alt_throttle = throttle;
+      throttle = alt_throttle;
+      aux4 = 2000;
+    }
+  }
+  if (nav_test) {                                               // hands off the sticks, the GPS flies
+    if (t >= NAV_START) (nav_test == 1 ? aux2 : aux3) = 2000;   // GPS HOLD or MISSION
+  } else if (!aggressive) {
+    if (t >= 10 && t < 11) roll = 1600;                         // roll doublet
+    if (t >= 11 && t < 12) roll = 1400;
+    if (t >= 14 && t < 15) pitch = 1600;                        // pitch doublet
+    if (t >= 15 && t < 16) pitch = 1400;
+  } else if (t >= 10 && t < 18) {
+    roll = fmod(t, 0.8) < 0.4 ? 1900 : 1100;                    // full stick reversals, 1.25Hz and 0.9Hz
+    pitch = fmod(t, 1.1) < 0.55 ? 1100 : 1900;
+    if (t >= 12 && t < 16) yaw = 1950;                          // while turning on itself
+  }
+
+  sitl_rc_set(RC_THROTTLE, throttle);
+  sitl_rc_set(RC_ROLL, roll);
+  sitl_rc_set(RC_PITCH, pitch);
+  sitl_rc_set(RC_YAW, yaw);
+  sitl_rc_set(RC_AUX1, 2000);                                   // ANGLE mode
+  sitl_rc_set(RC_AUX2, aux2);
+  sitl_rc_set(RC_AUX3, aux3);
+  sitl_rc_set(RC_AUX4, aux4);
+  sticks[ROLL] = roll; sticks[PITCH] = pitch; sticks[YAW] = yaw; sticks[THROTTLE] = throttle;
+  sticks[AUX1] = 2000; sticks[AUX2] = aux2; sticks[AUX3] = aux3; sticks[AUX4] = aux4;
+}
+
+// with -n, from NAV_WIND: 2.5m/s from the south west, gusting by up to 1.5m/s
+static void weather(double t) {
+  if (!nav_test || t < NAV_WIND) return;
+  double gust = sin(2 * M_PI * 0.2 * t) + 0.5 * sin(2 * M_PI * 0.53 * t + 1);
+  sitl_state.wind[0] = (2.5 + gust) * M_SQRT1_2;
+  sitl_state.wind[1] = (2.5 + gust) * M_SQRT1_2;
+}
+
+/*************** configurator ***************/
+// a ground station on Serial: a round is MSP_SET_RAW_RC and the telemetry below, the next
+// round leaves once every reply of the previous one is in (or after 100ms)
+static const uint8_t gui_telemetry[] = { MSP_STATUS, MSP_RAW_IMU, MSP_ATTITUDE, MSP_ALTITUDE, MSP_MOTOR, MSP_RC };
+#define GUI_COMMANDS (1 + sizeof(gui_telemetry))
+#define GUI_TIMEOUT_NS 100000000ULL
+
+static struct {
+  uint32_t rounds, answered, timeouts, bad;
+  uint64_t sent_ns, rtt_sum_ns, rtt_max_ns, first_ns, last_ns, bytes;
+  uint8_t waiting;                      // replies the round still waits for
+  uint8_t state, v2, sum, hdr[5], n;    // reply parser
+  uint16_t cmd, size, got;
+  uint8_t payload[256];
+} gui;
+
+static uint8_t crc8_dvb_s2(uint8_t crc, uint8_t a) {
+  crc ^= a;
+  for (uint8_t i = 0; i < 8; i++) crc = (crc & 0x80) ? (crc << 1) ^ 0xD5 : crc << 1;
+  return crc;
+}
+
+static uint8_t gui_frame(uint8_t *f, uint8_t v2, uint8_t cmd, const uint8_t *data, uint8_t len) {
+  uint8_t n = 0, sum = 0;
+  f[n++] = '$'; f[n++] = v2 ? 'X' : 'M'; f[n++] = '<';
+  if (v2) {
+    uint8_t h[5] = { 0, cmd, 0, len, 0 };
+    for (uint8_t i = 0; i < 5; i++) { f[n++] = h[i]; sum = crc8_dvb_s2(sum, h[i]); }
+    for (uint8_t i = 0; i < len; i++) { f[n++] = data[i]; sum = crc8_dvb_s2(sum, data[i]); }
+  } else {
+    f[n++] = len; f[n++] = cmd; sum = len ^ cmd;
+    for (uint8_t i = 0; i < len; i++) { f[n++] = data[i]; sum ^= data[i]; }
+  }
+  f[n++] = sum;
+  return n;
+}
+
+static void gui_send(uint64_t now) {
+  uint8_t rc[16], buf[256], multi[64], n = 0, m = 0;
+  for (uint8_t i = 0; i < 8; i++) { rc[2 * i] = sticks[i]; rc[2 * i + 1] = sticks[i] >> 8; }
+  if (gui_mode == 2) {                  // one frame: each command, the size of its payload, its payload
+    multi[m++] = MSP_SET_RAW_RC;
+    multi[m++] = sizeof(rc);
+    memcpy(multi + m, rc, sizeof(rc)); m += sizeof(rc);
+    for (uint8_t i = 0; i < sizeof(gui_telemetry); i++) { multi[m++] = gui_telemetry[i]; multi[m++] = 0; }
+    n = gui_frame(buf, 0, MSP_MULTI, multi, m);
+    gui.waiting = 1;
+  } else {
+    uint8_t v2 = gui_mode == 3;
+    n = gui_frame(buf, v2, MSP_SET_RAW_RC, rc, sizeof(rc));
+    for (uint8_t i = 0; i < sizeof(gui_telemetry); i++) n += gui_frame(buf + n, v2, gui_telemetry[i], 0, 0);
+    gui.waiting = GUI_COMMANDS;
+  }
+  sitl_uart_inject(0, buf, n, now);
+  gui.sent_ns = now;
+  gui.rounds++;
+}
+
+static void gui_reply(uint64_t now) {
+  uint8_t count = 1;
+  if (gui.cmd == MSP_MULTI) {           // the commands inside: command, size, reply
+    count = 0;
+    for (uint16_t i = 0; i + 2 <= gui.got && i + 2u <= sizeof(gui.payload); i += 2 + gui.payload[i + 1]) count++;
+  }
+  gui.answered += count;
+  if (gui.waiting > 1) { gui.waiting--; return; }
+  uint64_t rtt = now - gui.sent_ns;
+  gui.rtt_sum_ns += rtt;
+  if (rtt > gui.rtt_max_ns) gui.rtt_max_ns = rtt;
+  gui.waiting = 0;
+}
+
+static void gui_run(uint64_t now) {
+  uint8_t buf[256];
+  uint16_t k;
+  if (!gui.first_ns) gui.first_ns = now;
+  gui.last_ns = now;
+  while ((k = sitl_uart_take(0, buf, sizeof(buf)))) {
+    gui.bytes += k;
+    for (uint16_t i = 0; i < k; i++) {
+      uint8_t c = buf[i];
+      switch (gui.state) {
+        case 0: gui.state = c == '$'; break;
+        case 1: gui.state = c == 'M' ? 2 : c == 'X' ? 3 : 0; gui.v2 = c == 'X'; break;
+        case 2: case 3: gui.state = c == '>' ? (gui.v2 ? 5 : 4) : 0; gui.n = 0; gui.sum = 0; gui.got = 0; break;
+        case 4:                         // v1 size and command
+          gui.hdr[gui.n++] = c; gui.sum ^= c;
+          if (gui.n == 2) { gui.size = gui.hdr[0]; gui.cmd = gui.hdr[1]; gui.state = gui.size ? 6 : 7; }
+          break;
+        case 5:                         // v2 flag, command, size
+          gui.hdr[gui.n++] = c; gui.sum = crc8_dvb_s2(gui.sum, c);
+          if (gui.n == 5) { gui.cmd = gui.hdr[1] | gui.hdr[2] << 8; gui.size = gui.hdr[3] | gui.hdr[4] << 8; gui.state = gui.size ? 6 : 7; }
+          break;
+        case 6:
+          gui.sum = gui.v2 ? crc8_dvb_s2(gui.sum, c) : gui.sum ^ c;
+          if (gui.got < sizeof(gui.payload)) gui.payload[gui.got] = c;
+          if (++gui.got == gui.size) gui.state = 7;
+          break;
+        case 7:
+          if (c == gui.sum) gui_reply(now); else gui.bad++;
+          gui.state = 0;
+          break;
+      }
+    }
+  }
+  if (gui.waiting && now - gui.sent_ns > GUI_TIMEOUT_NS) { gui.timeouts++; gui.waiting = 0; }
+  if (!gui.waiting) gui_send(now);
+}
+
+static uint64_t boot_ns;
+
+static void fly_loop(void) {
+  MultiWii_loop();
+  sitl_sim_enter();
+  pilot((sitl_now_ns() - boot_ns) * 1e-9);
+  sitl_sim_leave();
+}
+
+// one MSP request on Serial, the firmware flies until the reply is complete: reply size, -1 on no reply
+static int msp_exchange(uint8_t cmd, const uint8_t *data, uint8_t len, uint8_t *reply) {
+  uint8_t frame[64], n = 0, cs = len ^ cmd, buf[256], state = 0, size = 0, got = 0, sum = 0;
+
+  sitl_sim_enter();
+  while (sitl_uart_take(0, buf, sizeof(buf)));         // what was sent before is not the reply
+  frame[n++] = '$'; frame[n++] = 'M'; frame[n++] = '<'; frame[n++] = len; frame[n++] = cmd;
+  for (uint8_t i = 0; i < len; i++) { frame[n++] = data[i]; cs ^= data[i]; }
+  frame[n++] = cs;
+  sitl_uart_inject(0, frame, n, sitl_now_ns());
+  sitl_sim_leave();
+
+  for (uint16_t loops = 0; loops < 500; loops++) {
+    fly_loop();
+    sitl_sim_enter();
+    uint16_t k = sitl_uart_take(0, buf, sizeof(buf));
+    sitl_sim_leave();
+    for (uint16_t i = 0; i < k; i++) {
+      uint8_t c = buf[i];
+      switch (state) {
+        case 0: state = c == '$'; break;
+        case 1: state = c == 'M' ? 2 : 0; break;
+        case 2: state = c == '>' ? 3 : 0; break;
+        case 3: size = c; sum = c; got = 0; state = 4; break;
+        case 4: sum ^= c; state = c == cmd ? (size ? 5 : 6) : 0; break;
+        case 5: reply[got++] = c; sum ^= c; if (got == size) state = 6; break;
+        case 6: return c == sum ? size : -1;
+      }
+    }
+  }
+  return -1;
+}
+
+// the built-in matrix with 3/4 of its yaw weights, read and written back over MSP
+static void load_mixer(void) {
+  int16_t m[3 * NUMBER_MOTOR], r[3 * NUMBER_MOTOR];  // little endian, as the x86 host
+  if (msp_exchange(MSP_MIXER_MATRIX, 0, 0, (uint8_t *)m) != sizeof(m)) { printf("MSP_MIXER_MATRIX: no reply\n"); return; }
+  for (uint8_t i = 0; i < NUMBER_MOTOR; i++) m[3 * i + 2] = m[3 * i + 2] * 3 / 4;
+  if (msp_exchange(MSP_SET_MIXER_MATRIX, (uint8_t *)m, sizeof(m), 0) != 0) { printf("MSP_SET_MIXER_MATRIX: no reply\n"); return; }
+  if (msp_exchange(MSP_MIXER_MATRIX, 0, 0, (uint8_t *)r) != sizeof(r) || memcmp(m, r, sizeof(m)))
+    printf("MSP_MIXER_MATRIX: the matrix read back is not the one loaded\n");
+}
+
+static uint32_t le32(const uint8_t *p) {
+  return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+/*************** GPS navigation ***************/
+#if defined(GPS_NAV)
+static uint8_t *put32(uint8_t *p, uint32_t v) {
+  for (uint8_t i = 0; i < 4; i++) *p++ = v >> (8 * i);
+  return p;
+}
+
+// -n 2: a 25m square from home, 3s held at its second corner, back over home
+#define MISSION_STEPS 4
+static const double mission_ne[MISSION_STEPS][2] = { { 25, 0 }, { 25, 25 }, { 0, 25 }, { 0, 0 } };
+static const uint16_t mission_stay[MISSION_STEPS] = { 0, 3000, 0, 0 };
+
+// the waypoints written with MSP_SET_WP before arming, read back with MSP_WP
+static void load_mission(void) {
+  for (uint8_t i = 0; i < MISSION_STEPS; i++) {
+    uint8_t wp[18], r[32], *p = wp;
+    int32_t lat, lon;
+    sitl_gps_coord(mission_ne[i][0], mission_ne[i][1], &lat, &lon);
+    *p++ = i + 1;
+    p = put32(p, lat);
+    p = put32(p, lon);
+    p = put32(p, HOVER_ALT * 100);
+    *p++ = 0; *p++ = 0;                                         // heading
+    *p++ = mission_stay[i]; *p++ = mission_stay[i] >> 8;
+    *p++ = i == MISSION_STEPS - 1 ? MISSION_FLAG_END : 0;
+    if (msp_exchange(MSP_SET_WP, wp, sizeof(wp), 0) != 0) { printf("MSP_SET_WP: no reply\n"); return; }
+    if (msp_exchange(MSP_WP, wp, 1, r) != sizeof(wp) || memcmp(wp, r, sizeof(wp)))
+      printf("MSP_WP %u: not the waypoint written\n", i + 1);
+  }
+}
+
+// distance from p to the line through a and b, m
+static double crosstrack(const double *p, const double *a, const double *b) {
+  double dn = b[0] - a[0], de = b[1] - a[1], len = sqrt(dn * dn + de * de);
+  if (len < 0.01) return sqrt(sq(p[0] - b[0]) + sq(p[1] - b[1]));
+  return fabs((p[0] - a[0]) * de - (p[1] - a[1]) * dn) / len;
+}
+#endif
+
+// land, disarm, wait for the ring to reach the flash and download the flight recorder log
+static void blackbox_download(const char *name) {
+  uint8_t r[256];
+  FILE *out = fopen(name, "wb");
+  if (!out) { perror(name); return; }
+  landed = 1;
+  uint32_t last = 0xFFFFFFFF;
+  for (uint32_t loops = 0; loops < 100000; loops++) {    // until disarmed and nothing more is written
+    fly_loop();
+    if (f.ARMED || msp_exchange(MSP_BLACKBOX, 0, 0, r) != 27 || (r[0] & 1)) continue;
+    if (le32(r + 5) == last) break;
+    last = le32(r + 5);
+  }
+  if (msp_exchange(MSP_BLACKBOX, 0, 0, r) != 27) { printf("MSP_BLACKBOX: no reply\n"); fclose(out); return; }
+  uint32_t size = le32(r + 1), used = le32(r + 5), frames = le32(r + 9), dropped = le32(r + 13);
+  printf("\nMSP_BLACKBOX: state %u, %u of %u bytes used, last flight %u frames, %u dropped,\n"
+         "  ring max %u of %u bytes, log max %uus, flush max %uus, flash word %uus\n", r[0], used, size, frames, dropped,
+         r[17] | r[18] << 8, r[19] | r[20] << 8, r[21] | r[22] << 8, r[23] | r[24] << 8, r[25] | r[26] << 8);
+  uint32_t address = 0;
+  while (address < used) {
+    uint8_t a[4] = { (uint8_t)address, (uint8_t)(address >> 8), (uint8_t)(address >> 16), (uint8_t)(address >> 24) };
+    int n = msp_exchange(MSP_BLACKBOX_READ, a, 4, r);
+    if (n <= 4 || le32(r) != address) { printf("MSP_BLACKBOX_READ %u: no reply\n", address); break; }
+    fwrite(r + 4, 1, n - 4, out);
+    address += n - 4;
+  }
+  fclose(out);
+  printf("%u bytes written to %s\n", address, name);
+}
+
+/*************** flash store ***************/
+// random setting records, with the sizes of the structs, written with power losses: after a loss the
+// board boots again, the record cut must read as before or after the write and the others as before.
+// 200 waypoints fill most of the store
+#define STORE_TEST_KEYS (STORE_WP + 200)
+
+static int store_test(uint32_t writes, uint32_t seed) {
+  static uint16_t sizes[STORE_TEST_KEYS];
+  static uint8_t value[STORE_TEST_KEYS][512], next[512], got[512], known[STORE_TEST_KEYS];
+  uint32_t cuts = 0, after = 0, errors = 0, refused = 0, boots = 0, done = 0, words = sitl_nvm_words;
+  uint64_t ns = 0, ns_max = 0;
+
+  for (uint16_t j = 0; j < STORE_TEST_KEYS; j++) {
+    sizes[j] = j == STORE_GLOBAL ? sizeof(global_conf) : j < STORE_PLOG ? sizeof(conf) : j == STORE_PLOG ? 24 : sizeof(mission_step_struct);
+  }
+  srand(seed);
+  storeInit();
+  for (uint32_t w = 0; w < writes; w++) {
+    uint16_t k = rand() % 2 ? rand() % STORE_WP : rand() % STORE_TEST_KEYS;  // the settings more often
+    memcpy(next, value[k], sizes[k]);
+    for (uint8_t i = 1 + rand() % 4; i; i--) next[rand() % sizes[k]] = rand();   // a few settings changed
+    uint32_t cut = rand() % 4 ? 0 : 1 + rand() % (4 * (sizes[k] / 4 + 2));
+    volatile uint8_t completed = 0;
+    uint64_t start = sitl_now_ns();
+    if (!setjmp(sitl_power_loss)) {
+      sitl_nvm_cut = cut;
+      if (storeWrite(k, next, sizes[k])) done++; else refused++;
+      sitl_nvm_cut = 0;
+      completed = 1;
+      uint64_t t = sitl_now_ns() - start;
+      ns += t;
+      if (t > ns_max) ns_max = t;
+    } else {
+      cuts++;
+    }
+    if (!completed || rand() % 8 == 0) {
+      storeInit();
+      boots++;
+    }
+    for (uint16_t j = 0; j < STORE_TEST_KEYS; j++) {
+      uint16_t n = storeRead(j, got, sizes[j]);
+      if (j == k && n == sizes[j] && !memcmp(got, next, n)) {
+        if (!completed) after++;
+        memcpy(value[j], next, n);
+        known[j] = 1;
+      } else if (j == k && completed) {
+        errors++;
+      } else if (known[j] ? n != sizes[j] || memcmp(got, value[j], n) : n != 0) {
+        errors++;
+      }
+    }
+  }
+  printf("flash store: %u writes, %u cut by a power loss (%u read the new value after the boot), %u refused,\n"
+         "  %u boots, %u records wrong\n", writes, cuts, after, refused, boots, errors);
+  printf("  %.1f flash words per write, %.2fms avg %.2fms max per complete write, %u bytes live of %u\n",
+         (double)(sitl_nvm_words - words) / writes, done ? ns * 1e-6 / done : 0, ns_max * 1e-6, store.live, store.capacity);
+  printf("  %u pages opened, erases of each page:", store.sequence);
+  for (uint8_t p = 0; p < _EEPROM_PAGE_COUNT; p++) printf(" %u", sitl_eeprom_erases[p]);
+  printf("\n");
+  return errors ? 1 : 0;
+}
+
+/*************** navigation math ***************/
+// the fixed point functions of NavMath.cpp and GPS_distance_cm_bearing() against the float formulas
+// they replaced, over the angles and random vectors and points up to 5km from a latitude of -80 to 80
+#define NAV_TEST_POINTS 1000000
+
+typedef struct {
+  double max;           // largest error
+  double at;            // where
+} nav_error_t;
+
+static void nav_error(nav_error_t *e, double error, double at) {
+  if (fabs(error) > e->max) { e->max = fabs(error); e->at = at; }
+}
+
+static double nav_rand(double lo, double hi) {
+  return lo + (hi - lo) * rand() / (double)RAND_MAX;
+}
+
+// the former GPS_distance_cm_bearing(), the float longitude scale set as GPS_calc_longitude_scaling() did
+static void nav_float_distance(int32_t lat1, int32_t lon1, int32_t lat2, int32_t lon2, float scale, uint32_t *dist,
+                               int32_t *bearing) {
+  float dLat = lat2 - lat1;
+  float dLon = (float)(lon2 - lon1) * scale;
+  *dist = sqrt(sq(dLat) + sq(dLon)) * 1.113195;
+  *bearing = 9000.0f + atan2(-dLat, dLon) * 5729.57795f;
+  if (*bearing < 0) *bearing += 36000;
+}
+
+static double nav_elapsed_ns(struct timespec *a, struct timespec *b) {
+  return (b->tv_sec - a->tv_sec) * 1e9 + (b->tv_nsec - a->tv_nsec);
+}
+
+static int nav_math_test(uint32_t seed) {
+  nav_error_t sine = {0, 0}, atan = {0, 0}, root = {0, 0}, scale = {0, 0}, dist = {0, 0}, bearing = {0, 0};
+  static int32_t pts[NAV_TEST_POINTS][4];
+  static float fscale[NAV_TEST_POINTS];
+  uint32_t dist_over = 0;
+  srand(seed);
+
+  for (int32_t a = -72000; a <= 72000; a++) {
+    nav_error(&sine, navSin(a) - 16384 * sin(radians(a / 100.0)), a / 100.0);
+    nav_error(&sine, navCos(a) - 16384 * cos(radians(a / 100.0)), a / 100.0);
+  }
+  for (int32_t lat = -900000000; lat <= 900000000; lat += 99991)
+    nav_error(&scale, navLonScale(lat) / 65536.0 - cos(radians(lat * 1e-7)), lat * 1e-7);
+  for (uint32_t i = 0; i < NAV_TEST_POINTS; i++) {
+    int32_t m = 1 << (rand() % 31), x = rand() % m - m / 2, y = rand() % m - m / 2;
+    double d = degrees(atan2((double)y, (double)x)) * 100;
+    nav_error(&atan, navAtan2(y, x) - d, d / 100);
+    uint64_t v = ((uint64_t)rand() << 31 | rand()) >> (rand() % 62);
+    uint64_t r = navSqrt(v);
+    if (r * r > v || (r + 1) * (r + 1) <= v) nav_error(&root, 1, v);
+  }
+  for (uint32_t i = 0; i < NAV_TEST_POINTS; i++) {
+    int32_t *p = pts[i];
+    p[0] = nav_rand(-80, 80) * 1e7;
+    p[1] = nav_rand(-179, 179) * 1e7;
+    double r = nav_rand(0, 5000), b = nav_rand(0, 2 * PI);
+    p[2] = p[0] + r * cos(b) / 1.113195e-2;
+    p[3] = p[1] + r * sin(b) / 1.113195e-2 / cos(radians(p[0] * 1e-7));
+    fscale[i] = cos((abs((float)p[0]) / 10000000.0) * 0.0174532925);
+    uint32_t d1, d2;
+    int32_t b1, b2;
+    nav_float_distance(p[0], p[1], p[2], p[3], fscale[i], &d1, &b1);
+    GPS_calc_longitude_scaling(p[0]);
+    GPS_distance_cm_bearing(&p[0], &p[1], &p[2], &p[3], &d2, &b2);
+    nav_error(&dist, (double)d2 - d1, d1);
+    if (fabs((double)d2 - d1) > 2 + d1 * 2e-4) dist_over++;        // 2cm and 0.02%
+    if (d1 > 10000) nav_error(&bearing, wrap_18000(b2 - b1), d1);  // 1e-7 degree is 1.1cm: from 100m
+  }
+  int errors = sine.max > 1.5 || atan.max > 2 || root.max || scale.max > 5e-5 || dist_over || bearing.max > 3;
+
+  // host time per call on the same points
+  struct timespec t0, t1, t2;
+  uint32_t d, sum = 0;
+  int32_t b;
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+  for (uint32_t i = 0; i < NAV_TEST_POINTS; i++) {
+    int32_t *p = pts[i];
+    nav_float_distance(p[0], p[1], p[2], p[3], fscale[i], &d, &b);
+    sum += d + b;
+  }
+  clock_gettime(CLOCK_MONOTONIC, &t1);
+  for (uint32_t i = 0; i < NAV_TEST_POINTS; i++) {
+    int32_t *p = pts[i];
+    GPS_distance_cm_bearing(&p[0], &p[1], &p[2], &p[3], &d, &b);
+    sum += d + b;
+  }
+  clock_gettime(CLOCK_MONOTONIC, &t2);
+
+  printf("navigation math against float, largest error:\n");
+  printf("  navSin() navCos()     %6.2f << 14 at %.2fdeg\n", sine.max, sine.at);
+  printf("  navAtan2()            %6.2f deg*100 at %.2fdeg\n", atan.max, atan.at);
+  printf("  navSqrt()             %6.0f wrong roots\n", root.max);
+  printf("  navLonScale()         %8.6f at latitude %.2f\n", scale.max, scale.at);
+  printf("  distance              %6.0f cm at %.0fcm, %u over 2cm + 0.02%%\n", dist.max, dist.at, dist_over);
+  printf("  bearing               %6.0f deg*100 at %.0fcm\n", bearing.max, bearing.at);
+  printf("GPS_distance_cm_bearing(): %.1f host ns/call, float %.1f (%u)\n", nav_elapsed_ns(&t1, &t2) / NAV_TEST_POINTS,
+         nav_elapsed_ns(&t0, &t1) / NAV_TEST_POINTS, sum & 1);
+  printf("%s\n", errors ? "FAILED" : "ok");
+  return errors;
+}
+
+// host time of mixTable() alone, with the PIDs of the last loop
+static double mixtable_ns(void) {
+  struct timespec a, b;
+  int16_t keep[8];
+  memcpy(keep, motor, sizeof(keep));
+  clock_gettime(CLOCK_MONOTONIC, &a);
+  for (uint32_t i = 0; i < MIXTABLE_CALLS; i++) {
+    axisPID[YAW] ^= i & 1;              // not a loop invariant for the compiler
+    mixTable();
+  }
+  clock_gettime(CLOCK_MONOTONIC, &b);
+  memcpy(motor, keep, sizeof(keep));
+  return ((b.tv_sec - a.tv_sec) * 1e9 + (b.tv_nsec - a.tv_nsec)) / MIXTABLE_CALLS;
+}
+
+/*************** mixer matrix ***************/
+// mixTable() with the built-in table of the frame against the PIDMIX chain it replaced, over random PIDs
+// and throttles that leave the motors between minthrottle and MAXTHROTTLE (the normalization after the
+// mix is the same code in both). The weights of PIDMIX are integer expressions: 4/3 gave PID*4/3
+// truncated, term by term. The chain is also run in double for the exact weights: the matrix, in
+// 1/MIX_ONE and rounded once, must be within 0.5 + |PID| x its weight rounding of the exact sum, and
+// the same as the chain when the weights are integers. Build the other frames with -DSITL_FRAME -D<frame>.
+#define MIX_TEST_POINTS 1000000
+
+template <typename T> static void mix_pidmix(T *m, T thr, T r, T p, T y) {
+  #define PIDMIX(X,Y,Z) thr + r*X + p*Y + y*Z
+  #if defined( BI )
+    m[0] = PIDMIX(+1, 0, 0); //LEFT
+    m[1] = PIDMIX(-1, 0, 0); //RIGHT
+  #elif defined( TRI )
+    m[0] = PIDMIX( 0,+4/3, 0); //REAR
+    m[1] = PIDMIX(-1,-2/3, 0); //RIGHT
+    m[2] = PIDMIX(+1,-2/3, 0); //LEFT
+  #elif defined( QUADP )
+    m[0] = PIDMIX( 0,+1,-1); //REAR
+    m[1] = PIDMIX(-1, 0,+1); //RIGHT
+    m[2] = PIDMIX(+1, 0,+1); //LEFT
+    m[3] = PIDMIX( 0,-1,-1); //FRONT
+  #elif defined( QUADX )
+    m[0] = PIDMIX(-1,+1,-1); //REAR_R
+    m[1] = PIDMIX(-1,-1,+1); //FRONT_R
+    m[2] = PIDMIX(+1,+1,+1); //REAR_L
+    m[3] = PIDMIX(+1,-1,-1); //FRONT_L
+  #elif defined( Y4 )
+    m[0] = PIDMIX(+0,+1,-1);   //REAR_1 CW
+    m[1] = PIDMIX(-1,-1, 0); //FRONT_R CCW
+    m[2] = PIDMIX(+0,+1,+1);   //REAR_2 CCW
+    m[3] = PIDMIX(+1,-1, 0); //FRONT_L CW
+  #elif defined( Y6 )
+    m[0] = PIDMIX(+0,+4/3,+1); //REAR
+    m[1] = PIDMIX(-1,-2/3,-1); //RIGHT
+    m[2] = PIDMIX(+1,-2/3,-1); //LEFT
+    m[3] = PIDMIX(+0,+4/3,-1); //UNDER_REAR
+    m[4] = PIDMIX(-1,-2/3,+1); //UNDER_RIGHT
+    m[5] = PIDMIX(+1,-2/3,+1); //UNDER_LEFT
+  #elif defined( HEX6 )
+    m[0] = PIDMIX(-7/8,+1/2,+1); //REAR_R
+    m[1] = PIDMIX(-7/8,-1/2,-1); //FRONT_R
+    m[2] = PIDMIX(+7/8,+1/2,+1); //REAR_L
+    m[3] = PIDMIX(+7/8,-1/2,-1); //FRONT_L
+    m[4] = PIDMIX(+0  ,-1  ,+1); //FRONT
+    m[5] = PIDMIX(+0  ,+1  ,-1); //REAR
+  #elif defined( HEX6X )
+    m[0] = PIDMIX(-1/2,+7/8,+1); //REAR_R
+    m[1] = PIDMIX(-1/2,-7/8,+1); //FRONT_R
+    m[2] = PIDMIX(+1/2,+7/8,-1); //REAR_L
+    m[3] = PIDMIX(+1/2,-7/8,-1); //FRONT_L
+    m[4] = PIDMIX(-1  ,+0  ,-1); //RIGHT
+    m[5] = PIDMIX(+1  ,+0  ,+1); //LEFT
+  #elif defined( HEX6H )
+    m[0] = PIDMIX(-1,+1,-1); //REAR_R
+    m[1] = PIDMIX(-1,-1,+1); //FRONT_R
+    m[2] = PIDMIX(+ 1,+1,+1); //REAR_L
+    m[3] = PIDMIX(+ 1,-1,-1); //FRONT_L
+    m[4] = PIDMIX(0 ,0 ,0); //RIGHT
+    m[5] = PIDMIX(0 ,0 ,0); //LEFT
+  #elif defined( OCTOX8 )
+    m[0] = PIDMIX(-1,+1,-1); //REAR_R
+    m[1] = PIDMIX(-1,-1,+1); //FRONT_R
+    m[2] = PIDMIX(+1,+1,+1); //REAR_L
+    m[3] = PIDMIX(+1,-1,-1); //FRONT_L
+    m[4] = PIDMIX(-1,+1,+1); //UNDER_REAR_R
+    m[5] = PIDMIX(-1,-1,-1); //UNDER_FRONT_R
+    m[6] = PIDMIX(+1,+1,-1); //UNDER_REAR_L
+    m[7] = PIDMIX(+1,-1,+1); //UNDER_FRONT_L
+  #elif defined( OCTOFLATP )
+    m[0] = PIDMIX(+7/10,-7/10,+1); //FRONT_L
+    m[1] = PIDMIX(-7/10,-7/10,+1); //FRONT_R
+    m[2] = PIDMIX(-7/10,+7/10,+1); //REAR_R
+    m[3] = PIDMIX(+7/10,+7/10,+1); //REAR_L
+    m[4] = PIDMIX(+0   ,-1   ,-1); //FRONT
+    m[5] = PIDMIX(-1   ,+0   ,-1); //RIGHT
+    m[6] = PIDMIX(+0   ,+1   ,-1); //REAR
+    m[7] = PIDMIX(+1   ,+0   ,-1); //LEFT
+  #elif defined( OCTOFLATX )
+    m[0] = PIDMIX(+1  ,-1/2,+1); //MIDFRONT_L
+    m[1] = PIDMIX(-1/2,-1  ,+1); //FRONT_R
+    m[2] = PIDMIX(-1  ,+1/2,+1); //MIDREAR_R
+    m[3] = PIDMIX(+1/2,+1  ,+1); //REAR_L
+    m[4] = PIDMIX(+1/2,-1  ,-1); //FRONT_L
+    m[5] = PIDMIX(-1  ,-1/2,-1); //MIDFRONT_R
+    m[6] = PIDMIX(-1/2,+1  ,-1); //REAR_R
+    m[7] = PIDMIX(+1  ,+1/2,-1); //MIDREAR_L
+  #elif defined( VTAIL4 )
+    m[0] = PIDMIX(+0,+1, +1); //REAR_R
+    m[1] = PIDMIX(-1, -1, +0); //FRONT_R
+    m[2] = PIDMIX(+0,+1, -1); //REAR_L
+    m[3] = PIDMIX(+1, -1, -0); //FRONT_L
+  #elif defined( DUALCOPTER )
+    m[0] = PIDMIX(0,0,-1);                                 //  Pin D9
+    m[1] = PIDMIX(0,0,+1);                                 //  Pin D10
+  #endif
+  #undef PIDMIX
+}
+
+static int mixer_test(uint32_t seed) {
+  double w[NUMBER_MOTOR][3], old[NUMBER_MOTOR], exact[NUMBER_MOTOR], worst_old = 0, worst_exact = 0;
+  int32_t iold[NUMBER_MOTOR];
+  uint32_t points = 0, skipped = 0, errors = 0, fractional = 0;
+  srand(seed);
+
+  for (uint8_t a = 0; a < 3; a++) {             // the exact weights, one axis at a time
+    mix_pidmix<double>(exact, 0, a == 0, a == 1, a == 2);
+    for (uint8_t i = 0; i < NUMBER_MOTOR; i++) {
+      w[i][a] = exact[i];
+      if (w[i][a] != (int32_t)w[i][a]) fractional = 1;
+    }
+  }
+  loadDefaultMixer();
+  checkMixer();
+  f.ARMED = 1;
+  rcData[THROTTLE] = MAXCHECK;
+  while (points < MIX_TEST_POINTS) {
+    int16_t pid[3];
+    for (uint8_t a = 0; a < 3; a++) pid[a] = rand() % 1001 - 500;
+    rcCommand[THROTTLE] = conf.minthrottle + rand() % (MAXTHROTTLE - conf.minthrottle + 1);
+    axisPID[ROLL] = pid[0];
+    axisPID[PITCH] = pid[1];
+    axisPID[YAW] = pid[2];
+    int16_t y = YAW_DIRECTION * axisPID[YAW];
+    mix_pidmix<int32_t>(iold, rcCommand[THROTTLE], axisPID[ROLL], axisPID[PITCH], y);
+    mix_pidmix<double>(exact, rcCommand[THROTTLE], axisPID[ROLL], axisPID[PITCH], y);
+    uint8_t inside = 1;
+    for (uint8_t i = 0; i < NUMBER_MOTOR; i++)
+      if (iold[i] < conf.minthrottle + 8 || iold[i] > MAXTHROTTLE - 8 || exact[i] < conf.minthrottle + 8 ||
+          exact[i] > MAXTHROTTLE - 8) inside = 0;
+    if (!inside) {
+      skipped++;
+      continue;
+    }
+    mixTable();
+    points++;
+    int16_t pids[3] = { axisPID[ROLL], axisPID[PITCH], y };
+    for (uint8_t i = 0; i < NUMBER_MOTOR; i++) {
+      int16_t q[3] = { conf.mixer[i].roll, conf.mixer[i].pitch, conf.mixer[i].yaw };
+      double bound = 0.5;
+      for (uint8_t a = 0; a < 3; a++) bound += abs(pids[a]) * fabs(w[i][a] - q[a] / (double)MIX_ONE);
+      old[i] = iold[i];
+      if (fabs(motor[i] - old[i]) > worst_old) worst_old = fabs(motor[i] - old[i]);
+      if (fabs(motor[i] - exact[i]) > worst_exact) worst_exact = fabs(motor[i] - exact[i]);
+      if (fabs(motor[i] - exact[i]) > bound + 1e-9 || (!fractional && motor[i] != iold[i])) errors++;
+    }
+  }
+
+  printf("mixer matrix of the frame (%u motors, %s weights) against PIDMIX, %u points (%u with a motor out of range skipped):\n",
+         NUMBER_MOTOR, fractional ? "fractional" : "integer", points, skipped);
+  printf("  largest difference to PIDMIX %.0f, to the exact weights %.2f\n", worst_old, worst_exact);
+  printf("%s\n", errors ? "FAILED" : "ok");
+  return errors ? 1 : 0;
+}
+
+static void usage(void) {
+  fprintf(stderr, "usage: sitl [-t seconds] [-s seed] [-c cpu_scale] [-l log.csv] [-e] [-a] [-m] [-g mode] [-b log.bbl] [-f writes] [-k] [-x] [-n test] [-v dps] [-z]\n"
+                  "  -t  flight time, 20s by default\n"
+                  "  -s  sensor noise seed\n"
+                  "  -c  target ns per host ns of firmware code, 30 by default, 0 for a run\n"
+                  "      that only depends on the seed\n"
+                  "  -l  one line per loop from arming: time, cycle, setpoints, attitude, estimate, altitude, motors\n"
+                  "  -e  copy what the firmware sends on Serial to stdout\n"
+                  "  -a  aggressive flight: full stick reversals on roll and pitch, yaw spin\n"
+                  "  -m  fly with a mixer matrix loaded over MSP (3/4 of the built-in yaw weights)\n"
+                  "  -g  configurator on Serial from arming: 1 one frame per command, 2 MSP_MULTI, 3 v2 frames\n"
+                  "  -b  after the report, land, disarm and download the blackbox log (BLACKBOX build)\n"
+                  "  -f  no flight: flash store writes with power losses, checked after each boot\n"
+                  "  -k  no flight: the fixed point navigation math against the float formulas\n"
+                  "  -x  no flight: the mixer matrix of the frame against the PIDMIX chain it replaced\n"
+                  "  -n  GPS navigation in wind: 1 GPS HOLD, 2 a waypoint mission (GPS_NAV build, -t 60)\n"
+                  "  -z  altitude hold: BARO mode from 8s, the throttle stick left where it was\n"
+                  "  -v  motor vibration on the gyro, deg/s\n");
+}
+
+int main(int argc, char **argv) {
+  double duration = 20;
+  uint32_t seed = 1;
+  FILE *log = 0;
+  const char *blackbox_file = 0;
+  uint32_t store_writes = 0;
+  uint8_t nav_math = 0, mixer = 0;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "t:s:c:l:eamg:b:f:kxn:v:zh")) != -1) {
+    switch (opt) {
+      case 't': duration = atof(optarg); break;
+      case 's': seed = strtoul(optarg, 0, 0); break;
+      case 'c': sitl_cpu_scale = atof(optarg); break;
+      case 'l':
+        log = fopen(optarg, "w");
+        if (!log) { perror(optarg); return 1; }
+        fprintf(log, "t,cycle_us,roll_sp,roll,roll_est,pitch_sp,pitch,pitch_est,alt,m0,m1,m2,m3\n");
+        break;
+      case 'e': sitl_uart_echo = 1; break;
+      case 'a': aggressive = 1; break;
+      case 'm': custom_mixer = 1; break;
+      case 'g': gui_mode = atoi(optarg); break;
+      case 'b': blackbox_file = optarg; break;
+      case 'f': store_writes = strtoul(optarg, 0, 0); break;
+      case 'k': nav_math = 1; break;
+      case 'x': mixer = 1; break;
+      case 'n': nav_test = atoi(optarg); break;
+      case 'z': alt_test = 1; break;
+      case 'v': sitl_vibration_dps = atof(optarg); break;
+      default: usage(); return opt == 'h' ? 0 : 1;
+    }
+  }
+
+  if (store_writes) return store_test(store_writes, seed);
+  if (nav_math) return nav_math_test(seed);
+  if (mixer) return mixer_test(seed);
+
+  sitl_sim_enter();
+  sitl_model_init();
+  sitl_sensors_init(seed);
+  pilot(0);
+  sitl_sim_leave();
+
+  MultiWii_setup();
+
+  sitl_sim_enter();
+  conf.activate[BOXANGLE] = 1 << 2;     // AUX1 high, the defaults have no box set
+  conf.activate[BOXGPSHOLD] = 1 << 5;   // AUX2 high
+  conf.activate[BOXBARO] = 1 << 11;     // AUX4 high
+  #if defined(GPS_NAV)
+    conf.activate[BOXGPSNAV] = 1 << 8;  // AUX3 high
+  #endif
+  boot_ns = sitl_now_ns();
+  uint64_t last_ns = boot_ns, cycle_min = ~0ULL, cycle_max = 0, cycle_sum = 0;
+  uint32_t loops = 0, cycle_bins[CYCLE_BINS + 1] = { 0 };
+  uint64_t reclaimed_us = 0;
+  error_t track[2] = { { 0 } }, estimate[2] = { { 0 } }, hold = { 0 };
+  #if defined(GPS_NAV)
+    error_t leg = { 0 };
+    double mission_from[2] = { 0, 0 }, mission_start = -1, mission_done = -1;
+  #endif
+  error_t vario_est = { 0 }, alt_hold = { 0 };
+  double alt_held = -1, baro_ready = -1;
+  step_t steps[2] = { { -1 }, { -1 } };
+  lag_t rc_lag = { 0 }, motor_lag = { 0 };
+  double arm_time = -1;
+  sitl_sim_leave();
+  if (custom_mixer) load_mixer();
+  #if defined(GPS_NAV)
+    if (nav_test == 2) load_mission();
+  #else
+    if (nav_test == 2) printf("-n 2: the mission needs a -DGPS_NAV build\n");
+  #endif
+
+  for (;;) {
+    MultiWii_loop();
+
+    sitl_sim_enter();
+    uint64_t now = sitl_now_ns(), cycle = now - last_ns;
+    double t = (now - boot_ns) * 1e-9, truth[3], deg[2], sp[2], est[2];
+    uint8_t done = t >= duration;
+    last_ns = now;
+    if (f.ARMED && arm_time < 0) {      // the loop is timed from arming: the ground calibrations are not flight cycles
+      arm_time = t;
+      uint8_t reset = 0xFF;
+      sitl_sim_leave();
+      if (msp_exchange(MSP_PROFILER, &reset, 1, 0) != 0) printf("MSP_PROFILER reset: no reply\n");
+      sitl_sim_enter();
+      last_ns = sitl_now_ns();
+      memset(sitl_stage_stat, 0, STAGE_ITEMS * sizeof(sitl_stage_stat_t));
+      memset(cycle_bins, 0, sizeof(cycle_bins));
+      loops = 0; cycle_sum = 0; cycle_min = ~0ULL; cycle_max = 0; reclaimed_us = 0;
+    } else if (arm_time >= 0) {
+      loops++;
+      cycle_sum += cycle;
+      reclaimed_us += interleaveReclaimed;
+      if (cycle < cycle_min) cycle_min = cycle;
+      if (cycle > cycle_max) cycle_max = cycle;
+      cycle_bins[min(cycle / 500000, (uint64_t)CYCLE_BINS)]++;
+
+      // MultiWii angles in 0.1 deg, positive right side down and nose down
+      sitl_euler(truth);
+      deg[ROLL] = degrees(truth[0]);
+      deg[PITCH] = -degrees(truth[1]);
+      for (uint8_t axis = 0; axis < 2; axis++) {
+        sp[axis] = constrain(rcCommand[axis] << 1, -500, +500) / 10.0;
+        est[axis] = att.angle[axis] / 10.0;
+        if (f.ARMED && -sitl_state.pos[2] > 0.5) {
+          error_add(&track[axis], sp[axis] - deg[axis]);
+          error_add(&estimate[axis], est[axis] - deg[axis]);
+        }
+        step_check(&steps[axis], &rc_lag, &motor_lag, axis, t);
+      }
+      gyro_trace_add(t);
+      if (baro_ready < 0 && !calibratingB) baro_ready = t;
+      if (f.ARMED && -sitl_state.pos[2] > 0.5 && baro_ready >= 0 && t >= baro_ready + 1) {
+        alt_trace_add(alt.EstAlt * 0.01 + sitl_state.pos[2]);
+        error_add(&vario_est, alt.vario * 0.01 + sitl_state.vel[2]);
+      }
+      if (alt_test && f.BARO_MODE) {
+        if (alt_held < 0) alt_held = -sitl_state.pos[2];
+        error_add(&alt_hold, -sitl_state.pos[2] - alt_held);
+      }
+      if (nav_test == 1 && f.GPS_HOLD_MODE && t >= NAV_WIND) {
+        double n, e;
+        sitl_gps_meters(GPS_hold[LAT], GPS_hold[LON], &n, &e);
+        error_add(&hold, sqrt(sq(sitl_state.pos[0] - n) + sq(sitl_state.pos[1] - e)));
+      }
+      #if defined(GPS_NAV)
+        if (nav_test == 2 && f.GPS_MISSION_MODE) {
+          uint8_t k = GPS_mission_step;
+          if (mission_start < 0) {
+            mission_start = t;
+            memcpy(mission_from, sitl_state.pos, sizeof(mission_from));
+          }
+          if (nav_mode == NAV_MODE_WP) {
+            error_add(&leg, crosstrack(sitl_state.pos, k ? mission_ne[k - 1] : mission_from, mission_ne[k]));
+          } else if (k == GPS_mission_steps - 1) {
+            if (mission_done < 0) mission_done = t;
+            error_add(&hold, sqrt(sq(sitl_state.pos[0] - mission_ne[k][0]) + sq(sitl_state.pos[1] - mission_ne[k][1])));
+          }
+        }
+      #endif
+      if (log) fprintf(log, "%.4f,%.0f,%.1f,%.2f,%.1f,%.1f,%.2f,%.1f,%.2f,%.0f,%.0f,%.0f,%.0f\n", t, cycle * 1e-3,
+                       sp[ROLL], deg[ROLL], est[ROLL], sp[PITCH], deg[PITCH], est[PITCH], -sitl_state.pos[2],
+                       sitl_state.motor[0], sitl_state.motor[1], sitl_state.motor[2], sitl_state.motor[3]);
+    }
+    uint16_t held[2] = { sticks[ROLL], sticks[PITCH] };
+    pilot(t);
+    for (uint8_t axis = 0; axis < 2; axis++)
+      if (f.ARMED && arm_time >= 0 && sticks[axis] != held[axis])
+        step_start(&steps[axis], &rc_lag, &motor_lag, axis, t, held[axis], sticks[axis]);
+    weather(t);
+    if (gui_mode && arm_time >= 0 && !done) gui_run(now);
+    sitl_sim_leave();
+    if (done) break;
+  }
+  if (log) fclose(log);
+
+  printf("MultiWii SITL: %.1fs %sflight, cpu scale %.1f, seed %u, ATTITUDE_ESTIMATOR %d, %s mixer matrix\n", duration,
+         aggressive ? "aggressive " : "", sitl_cpu_scale, seed, ATTITUDE_ESTIMATOR, custom_mixer ? "loaded" : "built-in");
+  if (arm_time < 0) {
+    printf("boot %.0fms, never armed\n", boot_ns * 1e-6);
+    return 1;
+  }
+  printf("boot %.0fms, armed %.2fs after boot, final altitude %.2fm\n", boot_ns * 1e-6, arm_time, -sitl_state.pos[2]);
+  printf("Wire: %u transfers, %u of them after a queued baro transaction, %u stuck on the masked I2C1 interrupt\n\n",
+         sitl_wire_transfers, sitl_wire_after_queue, sitl_wire_stuck);
+
+  printf("loop cycle since arming: %u loops, min %.0fus avg %.0fus max %.0fus, firmware cycleTime %uus\n", loops,
+         cycle_min * 1e-3, cycle_sum * 1e-3 / loops, cycle_max * 1e-3, cycleTime);
+  for (uint8_t i = 0; i <= CYCLE_BINS; i++) {
+    if (!cycle_bins[i]) continue;
+    if (i < CYCLE_BINS) printf("  %5.1f-%4.1fms %7u\n", i * 0.5, (i + 1) * 0.5, cycle_bins[i]);
+    else printf("  >=%4.1fms    %7u\n", i * 0.5, cycle_bins[i]);
+  }
+
+  printf("\nstage        calls   avg us   max us  us/loop  share  host ns/call\n");
+  uint64_t staged = 0;
+  for (uint8_t s = 0; s < STAGE_ITEMS; s++) {
+    sitl_stage_stat_t *st = &sitl_stage_stat[s];
+    if (stage_top[s]) staged += st->target_ns;
+    if (!st->count) continue;
+    printf("%-12s %6u %8.1f %8.1f %8.1f %5.1f%% %12.0f\n", stage_name[s], st->count, st->target_ns * 1e-3 / st->count,
+           st->max_ns * 1e-3, st->target_ns * 1e-3 / loops, 100.0 * st->target_ns / cycle_sum,
+           (double)st->host_ns / st->count);
+  }
+  sitl_stage_stat_t *imu = &sitl_stage_stat[STAGE_IMU];
+  uint64_t imu_self = imu->target_ns - sitl_stage_stat[STAGE_ATTITUDE].target_ns - sitl_stage_stat[STAGE_ANNEX].target_ns
+                      - sitl_stage_stat[STAGE_INTERLEAVE].target_ns;
+  printf("%-12s %6s %8s %8s %8.1f %5.1f%%\n", "imu self", "", "", "", imu_self * 1e-3 / loops, 100.0 * imu_self / cycle_sum);
+  // the tasks run in the interleaving delay are counted in task and in interleave
+  int64_t other = cycle_sum - staged + reclaimed_us * 1000;
+  printf("%-12s %6s %8s %8s %8.1f %5.1f%%\n", "other", "", "", "", other * 1e-3 / loops, 100.0 * other / cycle_sum);
+  printf("interleave reclaimed by the tasks: %.1fus/loop, %u overruns\n", (double)reclaimed_us / loops,
+         annex650_overrun_count);
+  if (gui_mode) {
+    static const char *gui_name[] = { "", "one frame per command", "MSP_MULTI", "v2 frames" };
+    uint32_t rounds = gui.rounds - (gui.waiting != 0);
+    double secs = (gui.last_ns - gui.first_ns) * 1e-9;
+    printf("configurator, %s: %.0f commands/s answered, %.1f rounds/s, round trip avg %.1fms max %.1fms,\n"
+           "  %u timeouts, %u bad checksums, %.0f reply bytes/s, %u replies dropped on a full TX ring\n",
+           gui_name[gui_mode % 4], gui.answered / secs,
+           rounds / secs, rounds > gui.timeouts ? gui.rtt_sum_ns * 1e-6 / (rounds - gui.timeouts) : 0,
+           gui.rtt_max_ns * 1e-6, gui.timeouts, gui.bad, gui.bytes / secs, serialTxDropped);
+  }
+  sitl_sim_enter();
+  printf("mixTable() alone: %.1f host ns/call with the %s mixer matrix\n", mixtable_ns(), custom_mixer ? "loaded" : "built-in");
+  sitl_sim_leave();
+
+  // the profiler of the firmware, over MSP while the quad keeps hovering
+  printf("\nMSP_PROFILER     count   min us   avg us   max us  <64 <128 <256 <512  <1k  <2k  <4k  4k+\n");
+  for (uint8_t s = 0; s < STAGE_ITEMS; s++) {
+    uint8_t r[64];
+    if (msp_exchange(MSP_PROFILER, &s, 1, r) != 28 || r[0] != s || r[1] != STAGE_ITEMS) {
+      printf("%-14s no reply\n", stage_name[s]);
+      continue;
+    }
+    uint32_t count = r[2] | r[3] << 8 | r[4] << 16 | (uint32_t)r[5] << 24;
+    if (!count) continue;
+    printf("%-14s %7u %8u %8u %8u", stage_name[s], count, r[6] | r[7] << 8, r[8] | r[9] << 8, r[10] | r[11] << 8);
+    for (uint8_t i = 0; i < 8; i++) printf(" %4u", r[12 + 2 * i] | r[13 + 2 * i] << 8);
+    printf("\n");
+  }
+
+  printf("\nattitude in flight (ANGLE mode), deg      rms     max\n");
+  printf("  roll  tracking error                 %7.2f %7.2f\n", error_rms(&track[ROLL]), track[ROLL].max);
+  printf("  pitch tracking error                 %7.2f %7.2f\n", error_rms(&track[PITCH]), track[PITCH].max);
+  printf("  roll  estimation error               %7.2f %7.2f\n", error_rms(&estimate[ROLL]), estimate[ROLL].max);
+  printf("  pitch estimation error               %7.2f %7.2f\n", error_rms(&estimate[PITCH]), estimate[PITCH].max);
+  double alt_offset;
+  error_t alt_est = alt_trace_error(&alt_offset);
+  printf("\naltitude in flight, m                     rms     max\n");
+  printf("  estimation error (alt.EstAlt)        %7.2f %7.2f  less the baro ground error %.2f\n", error_rms(&alt_est),
+         alt_est.max, alt_offset);
+  printf("  vario error (alt.vario), m/s         %7.2f %7.2f\n", error_rms(&vario_est), vario_est.max);
+  if (alt_test)
+    printf("  hold error, BARO from %.0fs          %7.2f %7.2f\n", ALT_START, error_rms(&alt_hold), alt_hold.max);
+  if (rc_lag.count) {
+    printf("\nstick steps of roll and pitch, ms after the stick    avg     max  missed\n");
+    printf("  rcData halfway                       %7.1f %7.1f %7u\n", rc_lag.sum / rc_lag.count, rc_lag.max,
+           rc_lag.missed);
+    if (motor_lag.count)
+      printf("  motor mix moved by %u                 %7.1f %7.1f %7u\n", STEP_MOTORS, motor_lag.sum / motor_lag.count,
+             motor_lag.max, motor_lag.missed);
+  }
+  if (nav_test) {
+    sitl_stage_stat_t *nav = &sitl_stage_stat[STAGE_NAV];
+    printf("\nGPS navigation in wind: %u GPS frames navigated, %.0f host ns per frame\n", nav->count,
+           nav->count ? (double)nav->host_ns / nav->count : 0);
+    if (nav_test == 1) {
+      printf("  GPS HOLD from %.0fs, wind from %.0fs: distance to the hold point rms %.2fm max %.2fm\n", NAV_START,
+             NAV_WIND, error_rms(&hold), hold.max);
+    }
+    #if defined(GPS_NAV)
+      if (nav_test == 2 && mission_start < 0) {
+        printf("  mission: never started, %u waypoints loaded\n", GPS_mission_steps);
+      } else if (nav_test == 2) {
+        printf("  mission of %u waypoints from %.1fs: ", GPS_mission_steps, mission_start);
+        if (mission_done >= 0) printf("done in %.1fs", mission_done - mission_start);
+        else printf("at waypoint %u at the end", GPS_mission_step + 1);
+        printf(", distance to the legs rms %.2fm max %.2fm\n", error_rms(&leg), leg.max);
+        if (mission_done >= 0)
+          printf("  held at the last waypoint: distance rms %.2fm max %.2fm\n", error_rms(&hold), hold.max);
+      }
+    #endif
+  }
+  {
+    uint32_t bytes, fixes;
+    sitl_sim_enter();
+    double ns = gps_parse_ns(&bytes, &fixes);
+    sitl_sim_leave();
+    printf("\nGPS_parse() alone: %.1f host ns/byte, %.0f host ns/fix, %.0f bytes per fix (%s)\n", ns / bytes,
+           fixes ? ns / fixes : 0, fixes ? (double)bytes / fixes : 0,
+    #if defined(UBLOX)
+           "NAV-PVT");
+    #else
+           "GGA GSA RMC VTG");
+    #endif
+  }
+  gyro_report();
+  #if defined(GYRO_FILTER)
+    sitl_sim_enter();
+    printf("Gyro_filter() alone: %.1f host ns/sample", gyro_filter_ns());
+    #if defined(GYRO_DYN_NOTCH)
+      printf(", dynamic notch at %uHz", gyroDynNotchHz);
+    #endif
+    printf("\n");
+    sitl_sim_leave();
+  #endif
+  if (blackbox_file) blackbox_download(blackbox_file);
+  return sitl_wire_stuck ? 1 : 0;
+}
@@ -0,0 +1,165 @@
+/*
+  sitl_model.cpp - quad X rigid body and RC receiver of the simulation
+
+  Front right down body axes, north east down earth axes. The motors are
+  read from the output compare registers written by writeMotors(): OCxRS
+  holds the pulse width in 1/8us, motor 0 to 3 on OC1 to OC4, placed as the
+  QUADX mixer expects them (REAR_R, FRONT_R, REAR_L, FRONT_L).
+*/
+
+#include "WProgram.h"
+
+#define STEP_NS     250000ULL   // 4kHz integration
+#define GRAVITY     9.80665
+
+#define MASS        1.0         // kg
+#define ARM         0.18        // m, motor to center along each body axis / sqrt(2)
+#define IXX         0.015       // kg.m^2, a 450mm frame
+#define IYY         0.015
+#define IZZ         0.028
+#define THRUST_MAX  GRAVITY     // N per motor at 2000us: hover close to 1500us
+#define TORQUE_K    0.016       // reaction torque per N of thrust, m
+#define MOTOR_TAU   0.030       // s, ESC and rotor lag
+#define DRAG_LIN    0.25        // 1/s
+#define DRAG_ROT    0.002       // N.m.s/rad
+
+// position factors of the QUADX mixer: roll, pitch, yaw
+static const int8_t mix[4][3] = { {-1, +1, -1}, {-1, -1, +1}, {+1, +1, +1}, {+1, -1, -1} };
+
+sitl_state_t sitl_state;
+static uint64_t model_ns;
+
+void sitl_model_init(void) {
+  memset(&sitl_state, 0, sizeof(sitl_state));
+  sitl_state.q[0] = 1;
+  sitl_state.force[2] = -GRAVITY;
+  for (uint8_t i = 0; i < 4; i++) sitl_state.motor[i] = 1000;
+  model_ns = 0;
+}
+
+static double motor_us(uint8_t i) {
+  static volatile uint32_t *const oc[4] = { &OC1RS, &OC2RS, &OC3RS, &OC4RS };
+  double us = *oc[i] >> 3;
+  return constrain(us, 1000, 2000);
+}
+
+// v_earth = R v_body
+static void rotate(const double *q, const double *v, double *out) {
+  double w = q[0], x = q[1], y = q[2], z = q[3];
+  out[0] = (1 - 2*(y*y + z*z))*v[0] + 2*(x*y - w*z)*v[1] + 2*(x*z + w*y)*v[2];
+  out[1] = 2*(x*y + w*z)*v[0] + (1 - 2*(x*x + z*z))*v[1] + 2*(y*z - w*x)*v[2];
+  out[2] = 2*(x*z - w*y)*v[0] + 2*(y*z + w*x)*v[1] + (1 - 2*(x*x + y*y))*v[2];
+}
+
+// v_body = R^T v_earth
+static void unrotate(const double *q, const double *v, double *out) {
+  double c[4] = { q[0], -q[1], -q[2], -q[3] };
+  rotate(c, v, out);
+}
+
+static void step(double dt) {
+  sitl_state_t *s = &sitl_state;
+  double thrust[4], torque[3] = { 0, 0, 0 }, total = 0;
+  double a = dt / (MOTOR_TAU + dt);
+
+  for (uint8_t i = 0; i < 4; i++) {
+    s->motor[i] += a * (motor_us(i) - s->motor[i]);
+    thrust[i] = THRUST_MAX * sq((s->motor[i] - 1000) / 1000);
+    total += thrust[i];
+    // thrust along -z at (x, y) = (-pitch * ARM, -roll * ARM)
+    torque[0] += mix[i][0] * ARM * thrust[i];
+    torque[1] += -mix[i][1] * ARM * thrust[i];
+    torque[2] += mix[i][2] * TORQUE_K * thrust[i];
+  }
+  s->thrust = total;
+
+  // rotation: I dw/dt = torque - w x Iw - damping
+  double p = s->rate[0], q = s->rate[1], r = s->rate[2];
+  s->rate[0] += dt * (torque[0] - (IZZ - IYY) * q * r - DRAG_ROT * p) / IXX;
+  s->rate[1] += dt * (torque[1] - (IXX - IZZ) * p * r - DRAG_ROT * q) / IYY;
+  s->rate[2] += dt * (torque[2] - (IYY - IXX) * p * q - DRAG_ROT * r) / IZZ;
+
+  // dq/dt = q * (0, w) / 2
+  double *o = s->q;
+  p = s->rate[0]; q = s->rate[1]; r = s->rate[2];
+  double dq[4] = {
+    0.5 * (-o[1]*p - o[2]*q - o[3]*r),
+    0.5 * ( o[0]*p + o[2]*r - o[3]*q),
+    0.5 * ( o[0]*q - o[1]*r + o[3]*p),
+    0.5 * ( o[0]*r + o[1]*q - o[2]*p) };
+  double n = 0;
+  for (uint8_t i = 0; i < 4; i++) { o[i] += dt * dq[i]; n += o[i] * o[i]; }
+  n = sqrt(n);
+  for (uint8_t i = 0; i < 4; i++) o[i] /= n;
+
+  // translation: the accelerometer sees everything but gravity
+  double fb[3] = { 0, 0, -total / MASS }, fe[3];
+  rotate(o, fb, fe);
+  for (uint8_t i = 0; i < 3; i++) fe[i] -= DRAG_LIN * (s->vel[i] - s->wind[i]);
+  double acc[3] = { fe[0], fe[1], fe[2] + GRAVITY };
+
+  if (s->pos[2] >= 0 && acc[2] >= 0) {   // on the ground: held level, heading kept
+    double yaw = atan2(2*(o[0]*o[3] + o[1]*o[2]), 1 - 2*(o[2]*o[2] + o[3]*o[3]));
+    o[0] = cos(yaw / 2); o[1] = 0; o[2] = 0; o[3] = sin(yaw / 2);
+    memset(s->rate, 0, sizeof(s->rate));
+    memset(s->vel, 0, sizeof(s->vel));
+    memset(acc, 0, sizeof(acc));
+    s->pos[2] = 0;
+  }
+  for (uint8_t i = 0; i < 3; i++) {
+    s->vel[i] += dt * acc[i];
+    s->pos[i] += dt * s->vel[i];
+  }
+  double fs[3] = { acc[0], acc[1], acc[2] - GRAVITY };
+  unrotate(o, fs, s->force);
+}
+
+void sitl_model_run(uint64_t now_ns) {
+  while (model_ns + STEP_NS <= now_ns) {
+    step(STEP_NS * 1e-9);
+    model_ns += STEP_NS;
+  }
+}
+
+void sitl_euler(double angle[3]) {
+  const double *o = sitl_state.q;
+  angle[0] = atan2(2*(o[0]*o[1] + o[2]*o[3]), 1 - 2*(o[1]*o[1] + o[2]*o[2]));
+  angle[1] = asin(constrain(2*(o[0]*o[2] - o[3]*o[1]), -1.0, 1.0));
+  angle[2] = atan2(2*(o[0]*o[3] + o[1]*o[2]), 1 - 2*(o[2]*o[2] + o[3]*o[3]));
+}
+
+/*************** RC receiver ***************/
+// a PWM receiver with the channels one after the other in each 20ms frame,
+// on PORTD bits 0..7 (THROTTLE ROLL PITCH YAW AUX1..AUX4), each edge raising
+// the change notice interrupt handled in RX.cpp
+#define RC_FRAME_NS  20000000ULL
+#define RC_CHANNELS  8
+
+extern "C" void ChangeNotice_Handler(void);
+
+static uint16_t rc_us[RC_CHANNELS] = { 1000, 1500, 1500, 1500, 1000, 1000, 1000, 1000 };
+static uint16_t frame_us[RC_CHANNELS];
+static uint64_t frame_ns;       // start of the frame being sent
+static uint8_t edge = RC_CHANNELS + 1;
+
+void sitl_rc_set(uint8_t chan, uint16_t us) {
+  if (chan < RC_CHANNELS) rc_us[chan] = us;
+}
+
+void sitl_rc_run(uint64_t now_ns) {
+  for (;;) {
+    if (edge > RC_CHANNELS) {           // next frame, with the sticks of now
+      if (frame_ns + RC_FRAME_NS > now_ns) return;
+      frame_ns += RC_FRAME_NS;
+      memcpy(frame_us, rc_us, sizeof(frame_us));
+      edge = 0;
+    }
+    uint64_t t = frame_ns;
+    for (uint8_t i = 0; i < edge; i++) t += frame_us[i] * 1000ULL;
+    if (t > now_ns) return;
+    // edge n: channel n-1 falls and channel n rises
+    PORTD = edge < RC_CHANNELS ? 1 << edge : 0;
+    if (CNEN) sitl_interrupt(t, ChangeNotice_Handler);
+    edge++;
+  }
+}
@@ -0,0 +1,486 @@
+/*
+  sitl_sensors.cpp - I2C bus and sensors of the simulated board
+
+  A 10DOF board on a 100kHz bus: MPU6050 at 0x68 and MS5611 at 0x77,
+  sampled from sitl_state when the firmware reads them. A NMEA GPS sends
+  $GNGGA, $GNGSA, $GNRMC and $GNVTG (a UBLOX build: NAV-PVT) at 5Hz, 10Hz
+  with GPS_10HZ, on Serial1 once the firmware has opened it.
+*/
+
+#include <stdio.h>
+#include <string.h>
+
+#include "WProgram.h"
+#include "Wire.h"
+#include "../config.h"
+#include "../def.h"
+
+#define I2C_BIT_NS 10000    // 100kHz
+#define GRAVITY    9.80665
+
+/*************** noise ***************/
+static uint32_t rng = 1;
+
+static double uniform(void) {
+  rng = rng * 1664525UL + 1013904223UL;
+  return ((rng >> 8) + 0.5) / 16777216.0;
+}
+
+static double gauss(void) {
+  return sqrt(-2 * log(uniform())) * cos(2 * PI * uniform());
+}
+
+/*************** bus ***************/
+#define I2C_DEVICES 4
+
+static const sitl_i2c_device_t *devices[I2C_DEVICES];
+
+void sitl_i2c_attach(const sitl_i2c_device_t *device) {
+  for (uint8_t i = 0; i < I2C_DEVICES; i++)
+    if (!devices[i]) { devices[i] = device; return; }
+}
+
+static const sitl_i2c_device_t *find(uint8_t address) {
+  for (uint8_t i = 0; i < I2C_DEVICES; i++)
+    if (devices[i] && devices[i]->address == address) return devices[i];
+  return 0;
+}
+
+// start, address byte, data bytes each with its ACK bit, stop
+static void transfer(uint8_t len) {
+  sitl_advance_ns((uint64_t)(2 + 9 * (1 + len)) * I2C_BIT_NS);
+}
+
+uint8_t sitl_i2c_write(uint8_t address, const uint8_t *data, uint8_t len) {
+  const sitl_i2c_device_t *d = find(address);
+  if (!d) {
+    transfer(0);
+    return 2;
+  }
+  transfer(len);
+  d->write(data, len);
+  return 0;
+}
+
+uint8_t sitl_i2c_read(uint8_t address, uint8_t *data, uint8_t len) {
+  const sitl_i2c_device_t *d = find(address);
+  if (!d) {
+    transfer(0);
+    return 0;
+  }
+  sitl_sync();          // the sample is taken when the transfer starts
+  d->read(data, len);
+  transfer(len);
+  return len;
+}
+
+/*************** I2C1 master ***************/
+// the module as the transaction queue of Sensors.cpp drives it: SEN RSEN PEN RCEN
+// ACKEN of I2C1CON and a byte written to I2C1TRN each start a bus event, which raises
+// the master interrupt flag when it is over, the start event of the DMA channel of the queue. The bytes written after the address go to the
+// device as one transfer at the following repeated start or stop; a read takes the
+// device data at the address byte. Wire does not go through it.
+#define I2C1_TRN_EMPTY 0x100    // the firmware only writes bytes
+#define I2C1_BUFFER    16
+
+volatile uint32_t sitl_i2c1con[4];
+volatile uint32_t I2C1STAT, I2C1RCV;
+volatile uint32_t I2C1TRN = I2C1_TRN_EMPTY;
+
+static const sitl_i2c_device_t *i2c1_device;  // addressed, 0: none
+static uint8_t i2c1_started;                  // the next byte is the address
+static uint8_t i2c1_reading;
+static uint8_t i2c1_buf[I2C1_BUFFER], i2c1_len, i2c1_index;
+static uint64_t i2c1_event_ns;                // start of the bus event in progress, 0: none
+static uint8_t wire_after_queue;              // a queued transaction ended since the last Wire transfer
+
+static void i2c1_flush(void) {
+  if (i2c1_device && !i2c1_reading && i2c1_len) i2c1_device->write(i2c1_buf, i2c1_len);
+  i2c1_len = 0;
+}
+
+static void i2c1_run(uint64_t now_ns) {
+  const uint32_t bit = 1UL << (_I2C1_MASTER_IRQ & 31);
+  volatile uint32_t *ifs = sitl_ifs[_I2C1_MASTER_IRQ >> 5];
+
+  for (;;) {
+    sitl_sfr_apply(sitl_i2c1con);
+    uint32_t event = I2C1CON & (_I2C1CON_SEN_MASK | _I2C1CON_RSEN_MASK | _I2C1CON_PEN_MASK |
+                                _I2C1CON_RCEN_MASK | _I2C1CON_ACKEN_MASK);
+    uint8_t bits;
+    if (event & _I2C1CON_RCEN_MASK) bits = 8;
+    else if (event) bits = 1;
+    else if (I2C1TRN != I2C1_TRN_EMPTY) bits = 9;
+    else {
+      i2c1_event_ns = 0;
+      return;
+    }
+    if (!i2c1_event_ns) i2c1_event_ns = now_ns;
+    uint64_t at = i2c1_event_ns + bits * I2C_BIT_NS;
+    if (at > now_ns) return;
+
+    if (event & (_I2C1CON_SEN_MASK | _I2C1CON_RSEN_MASK)) {
+      i2c1_flush();
+      i2c1_started = 1;
+    } else if (event & _I2C1CON_PEN_MASK) {
+      i2c1_flush();
+      i2c1_device = 0;
+      wire_after_queue = 1;
+    } else if (event & _I2C1CON_RCEN_MASK) {
+      I2C1RCV = i2c1_buf[i2c1_index++ % I2C1_BUFFER];
+    } else if (!event) {
+      uint8_t b = I2C1TRN;
+      I2C1TRN = I2C1_TRN_EMPTY;
+      if (i2c1_started) {
+        i2c1_started = 0;
+        i2c1_device = find(b >> 1);
+        i2c1_reading = b & 1;
+        i2c1_len = i2c1_index = 0;
+        if (i2c1_device && i2c1_reading) i2c1_device->read(i2c1_buf, I2C1_BUFFER);
+      } else if (i2c1_len < I2C1_BUFFER) {
+        i2c1_buf[i2c1_len++] = b;
+      }
+      if (i2c1_device) I2C1STAT &= ~_I2C1STAT_ACKSTAT_MASK;
+      else I2C1STAT |= _I2C1STAT_ACKSTAT_MASK;
+    }
+    I2C1CON &= ~event;
+    ifs[0] |= bit;
+    sitl_dma_event(_I2C1_MASTER_IRQ, at);
+    sitl_sfr_apply(ifs);
+    i2c1_event_ns = at;         // an event started by the handler
+  }
+}
+
+/*************** Wire ***************/
+TwoWire Wire;
+
+uint32_t sitl_wire_transfers, sitl_wire_after_queue, sitl_wire_stuck;
+
+TwoWire::TwoWire() : rxBufferIndex(0), rxBufferLength(0), txAddress(0), txBufferLength(0), transmitting(0) {}
+
+void TwoWire::begin() {
+  sitl_sfr_apply(sitl_iec[_I2C1_MASTER_IRQ >> 5]);
+  sitl_iec[_I2C1_MASTER_IRQ >> 5][0] |= 1UL << (_I2C1_MASTER_IRQ & 31);
+}
+
+// a transfer runs from the I2C1 master interrupt: 0 if it is masked, the transfer never ends
+static uint8_t wire_start(void) {
+  volatile uint32_t *iec = sitl_iec[_I2C1_MASTER_IRQ >> 5];
+  sitl_wire_transfers++;
+  if (wire_after_queue) sitl_wire_after_queue++;
+  wire_after_queue = 0;
+  sitl_sfr_apply(iec);
+  if (iec[0] & (1UL << (_I2C1_MASTER_IRQ & 31))) return 1;
+  sitl_wire_stuck++;
+  return 0;
+}
+
+void TwoWire::beginTransmission(uint8_t address) {
+  transmitting = 1;
+  txAddress = address;
+  txBufferLength = 0;
+}
+
+void TwoWire::beginTransmission(int address) {
+  beginTransmission((uint8_t)address);
+}
+
+uint8_t TwoWire::endTransmission(void) {
+  uint8_t ret = wire_start() ? sitl_i2c_write(txAddress, txBuffer, txBufferLength) : 4;
+  txBufferLength = 0;
+  transmitting = 0;
+  return ret;
+}
+
+uint8_t TwoWire::requestFrom(uint8_t address, uint8_t quantity) {
+  if (quantity > BUFFER_LENGTH) quantity = BUFFER_LENGTH;
+  rxBufferLength = wire_start() ? sitl_i2c_read(address, rxBuffer, quantity) : 0;
+  rxBufferIndex = 0;
+  return rxBufferLength;
+}
+
+uint8_t TwoWire::requestFrom(int address, int quantity) {
+  return requestFrom((uint8_t)address, (uint8_t)quantity);
+}
+
+void TwoWire::send(uint8_t data) {
+  if (transmitting && txBufferLength < BUFFER_LENGTH) txBuffer[txBufferLength++] = data;
+}
+
+void TwoWire::send(uint8_t *data, uint8_t quantity) {
+  for (uint8_t i = 0; i < quantity; i++) send(data[i]);
+}
+
+void TwoWire::send(char *data) {
+  send((uint8_t *)data, strlen(data));
+}
+
+void TwoWire::send(int data) {
+  send((uint8_t)data);
+}
+
+uint8_t TwoWire::available(void) {
+  return rxBufferLength - rxBufferIndex;
+}
+
+uint8_t TwoWire::receive(void) {
+  if (rxBufferIndex < rxBufferLength) return rxBuffer[rxBufferIndex++];
+  return 0;
+}
+
+/*************** MPU6050 ***************/
+// body rates and specific force to the sensor axes of the board as config.h
+// mounts it (GYRO_ORIENTATION and ACC_ORIENTATION of the CHIPKIT section):
+// X = q, Y = p, Z = -r for the gyro, X = fy, Y = fx, Z = -fz for the
+// accelerometer, 1g on +Z when level.
+#define GYRO_NOISE_DPS  0.05
+#define ACC_NOISE_G     0.004
+
+// -v: each motor shakes the board at its rotor frequency, VIBRATION_HZ at 2000us and proportional to the
+// pulse above 1000us (the rpm of the thrust model), with its own phase on each axis and sitl_vibration_dps / 2
+// at 1500us, also proportional to the rpm: a stopped rotor does not shake the gyro calibration. VIBRATION_HZ
+// is low for a prop: the loop samples the gyro twice per cycle, 1.3ms then 5.2ms apart at -c 0, and a tone
+// much above 60Hz would fold back to low frequencies no filter of the firmware can tell from motion.
+#define VIBRATION_HZ    80.0
+
+static uint8_t mpu_reg[128];
+static uint8_t mpu_ptr;
+static double gyro_bias[3];
+static double vibration_phase[4];
+static uint64_t vibration_ns;
+double sitl_vibration_dps;
+
+double sitl_vibration_hz(void) {
+  double hz = 0;
+  for (uint8_t i = 0; i < 4; i++) hz += VIBRATION_HZ * (sitl_state.motor[i] - 1000) / 1000 / 4;
+  return hz;
+}
+
+static void vibration(double *dps) {
+  uint64_t now = sitl_now_ns();
+  double dt = (now - vibration_ns) * 1e-9;
+  vibration_ns = now;
+  for (uint8_t i = 0; i < 4; i++) {
+    double rpm = (sitl_state.motor[i] - 1000) / 1000, a = sitl_vibration_dps * rpm;
+    vibration_phase[i] = fmod(vibration_phase[i] + 2 * PI * VIBRATION_HZ * rpm * dt, 2 * PI);
+    dps[0] += a * sin(vibration_phase[i] + i);
+    dps[1] += a * cos(vibration_phase[i] + i);
+    dps[2] += a / 4 * sin(vibration_phase[i] + 2 * i);
+  }
+}
+
+static void mpu_reset(void) {
+  memset(mpu_reg, 0, sizeof(mpu_reg));
+  mpu_reg[0x6B] = 0x40;   // SLEEP
+  mpu_reg[0x75] = 0x68;   // WHO_AM_I
+}
+
+static void put16(uint8_t reg, double value) {
+  int32_t v = (int32_t)lround(value);
+  v = constrain(v, -32768, 32767);
+  mpu_reg[reg] = (uint16_t)v >> 8;
+  mpu_reg[reg + 1] = (uint16_t)v & 0xff;
+}
+
+static void mpu_sample(void) {
+  if (mpu_reg[0x6B] & 0x40) return;   // asleep: the data registers keep their values
+  double lsb_dps = 131.0 / (1 << ((mpu_reg[0x1B] >> 3) & 3));
+  double lsb_g = 16384.0 / (1 << ((mpu_reg[0x1C] >> 3) & 3));
+  double gyro[3] = { sitl_state.rate[1], sitl_state.rate[0], -sitl_state.rate[2] };
+  double acc[3] = { sitl_state.force[1], sitl_state.force[0], -sitl_state.force[2] };
+  double shake[3] = { 0, 0, 0 };
+  if (sitl_vibration_dps) vibration(shake);
+  for (uint8_t i = 0; i < 3; i++) {
+    put16(0x3B + 2 * i, (acc[i] / GRAVITY + ACC_NOISE_G * gauss()) * lsb_g);
+    put16(0x43 + 2 * i, (degrees(gyro[i]) + gyro_bias[i] + shake[i] + GYRO_NOISE_DPS * gauss()) * lsb_dps);
+  }
+  put16(0x41, (25 - 36.53) * 340);   // TEMP_OUT for 25 deg C
+}
+
+static void mpu_write(const uint8_t *data, uint8_t len) {
+  if (len == 0) return;
+  mpu_ptr = data[0] & 0x7f;
+  for (uint8_t i = 1; i < len; i++) {
+    if (mpu_ptr == 0x6B && (data[i] & 0x80)) mpu_reset();   // DEVICE_RESET
+    else if (mpu_ptr != 0x75) mpu_reg[mpu_ptr] = data[i];
+    mpu_ptr = (mpu_ptr + 1) & 0x7f;
+  }
+}
+
+static void mpu_read(uint8_t *data, uint8_t len) {
+  mpu_sample();
+  while (len--) {
+    *data++ = mpu_reg[mpu_ptr];
+    mpu_ptr = (mpu_ptr + 1) & 0x7f;
+  }
+}
+
+static const sitl_i2c_device_t mpu6050 = { 0x68, mpu_write, mpu_read };
+
+/*************** MS5611 ***************/
+// 20 deg C, so that D2 = C5 * 2^8 and the pressure only depends on D1
+#define BARO_NOISE_PA   1.5
+#define HOME_ALT_M      150.0
+
+static const uint16_t ms_prom[8] = { 0, 40127, 36924, 23317, 23282, 33464, 28312, 0 };
+static uint8_t ms_cmd;
+static uint32_t ms_adc;         // result of the last conversion, 0 once read
+static uint32_t ms_next;        // conversion in progress
+static uint64_t ms_done_ns;
+
+static uint32_t ms_d1(void) {
+  double h = HOME_ALT_M - sitl_state.pos[2];
+  double p = 101325.0 * pow(1 - 2.25577e-5 * h, 5.25588) + BARO_NOISE_PA * gauss();
+  double off = (double)ms_prom[2] * 65536;
+  double sens = (double)ms_prom[1] * 32768;
+  return (uint32_t)((p * 32768 + off) * 2097152 / sens);
+}
+
+static void ms_write(const uint8_t *data, uint8_t len) {
+  if (len == 0) return;
+  ms_cmd = data[0];
+  if (ms_cmd == 0x1E) {                                  // reset
+    ms_adc = ms_next = 0;
+    ms_done_ns = 0;
+  } else if ((ms_cmd & 0xE0) == 0x40) {                  // convert D1 (0x4x) or D2 (0x5x)
+    ms_next = (ms_cmd & 0x10) ? (uint32_t)ms_prom[5] << 8 : ms_d1();
+    ms_done_ns = sitl_now_ns() + 9040000;                // OSR 4096
+  }
+}
+
+static void ms_read(uint8_t *data, uint8_t len) {
+  uint8_t buf[3] = { 0, 0, 0 };
+  if ((ms_cmd & 0xF0) == 0xA0) {                         // PROM read
+    uint16_t c = ms_prom[(ms_cmd >> 1) & 7];
+    buf[0] = c >> 8;
+    buf[1] = c & 0xff;
+  } else if (ms_cmd == 0x00) {                           // ADC read
+    if (ms_next && sitl_now_ns() >= ms_done_ns) {
+      ms_adc = ms_next;
+      ms_next = 0;
+    }
+    buf[0] = ms_adc >> 16;
+    buf[1] = ms_adc >> 8;
+    buf[2] = ms_adc;
+    ms_adc = 0;
+  }
+  for (uint8_t i = 0; i < len; i++) data[i] = i < 3 ? buf[i] : 0;
+}
+
+static const sitl_i2c_device_t ms5611 = { 0x77, ms_write, ms_read };
+
+/*************** GPS ***************/
+#define GPS_PORT        1
+#if defined(GPS_10HZ)
+  #define GPS_PERIOD_NS 100000000ULL    // 10Hz
+#else
+  #define GPS_PERIOD_NS 200000000ULL    // 5Hz
+#endif
+#define HOME_LAT        43.6045
+#define HOME_LON        1.4440
+#define EARTH_RADIUS    6371000.0
+
+static uint64_t gps_next_ns;
+
+#if !defined(UBLOX)
+static uint16_t nmea_put(uint8_t *buf, uint16_t size, const char *body) {
+  uint8_t cs = 0;
+  for (const char *c = body; *c; c++) cs ^= *c;
+  int n = snprintf((char *)buf, size, "$%s*%02X\r\n", body, cs);
+  return n < size ? n : 0;
+}
+
+// ddmm.mmmmm for latitudes, dddmm.mmmmm for longitudes
+static void nmea_coord(char *buf, size_t size, double deg, uint8_t digits) {
+  deg = fabs(deg);
+  int d = (int)deg;
+  snprintf(buf, size, "%0*d%08.5f", digits, d, (deg - d) * 60);
+}
+#else
+static void ubx_put32(uint8_t *p, int32_t v) {
+  for (uint8_t i = 0; i < 4; i++) p[i] = (uint32_t)v >> (8 * i);
+}
+#endif
+
+uint16_t sitl_gps_epoch(uint8_t *buf, uint16_t size, uint64_t at_ns) {
+  double la = HOME_LAT + degrees(sitl_state.pos[0] / EARTH_RADIUS);
+  double lo = HOME_LON + degrees(sitl_state.pos[1] / (EARTH_RADIUS * cos(radians(HOME_LAT))));
+  double speed = sqrt(sq(sitl_state.vel[0]) + sq(sitl_state.vel[1]));
+  double course = degrees(atan2(sitl_state.vel[1], sitl_state.vel[0]));
+  uint32_t cs = at_ns / 10000000;   // centiseconds since noon
+  if (course < 0) course += 360;
+
+#if defined(UBLOX)
+  // NAV-PVT: fix type 3D, fix valid, 9 satellites
+  uint8_t m[6 + 92 + 2] = { 0xB5, 0x62, 0x01, 0x07, 92, 0 };
+  uint8_t *p = m + 6;
+  ubx_put32(p + 0, (43200000UL + cs * 10) % 604800000UL);
+  p[20] = 3; p[21] = 0x01; p[23] = 9;
+  ubx_put32(p + 24, lround(lo * 1e7));
+  ubx_put32(p + 28, lround(la * 1e7));
+  ubx_put32(p + 32, lround((HOME_ALT_M + 47.0 - sitl_state.pos[2]) * 1000));
+  ubx_put32(p + 36, lround((HOME_ALT_M - sitl_state.pos[2]) * 1000));
+  ubx_put32(p + 48, lround(sitl_state.vel[0] * 1000));
+  ubx_put32(p + 52, lround(sitl_state.vel[1] * 1000));
+  ubx_put32(p + 56, lround(sitl_state.vel[2] * 1000));
+  ubx_put32(p + 60, lround(speed * 1000));
+  ubx_put32(p + 64, lround(course * 1e5));
+  uint8_t a = 0, b = 0;
+  for (uint8_t i = 2; i < 6 + 92; i++) b += (a += m[i]);
+  m[6 + 92] = a; m[6 + 92 + 1] = b;
+  if (size < sizeof(m)) return 0;
+  memcpy(buf, m, sizeof(m));
+  return sizeof(m);
+#else
+  // a multi-constellation receiver: GN talker, GGA GSA RMC VTG
+  char body[128], lat[24], lon[24], hms[16];
+  uint16_t n = 0;
+  nmea_coord(lat, sizeof(lat), la, 2);
+  nmea_coord(lon, sizeof(lon), lo, 3);
+  snprintf(hms, sizeof(hms), "%02u%02u%02u.%02u", (unsigned)(12 + cs / 360000 % 12), (unsigned)(cs / 6000 % 60),
+           (unsigned)(cs / 100 % 60), (unsigned)(cs % 100));
+  snprintf(body, sizeof(body), "GNGGA,%s,%s,%c,%s,%c,1,09,0.9,%.1f,M,47.0,M,,", hms, lat, la < 0 ? 'S' : 'N',
+           lon, lo < 0 ? 'W' : 'E', HOME_ALT_M - sitl_state.pos[2]);
+  n += nmea_put(buf + n, size - n, body);
+  n += nmea_put(buf + n, size - n, "GNGSA,A,3,02,05,12,15,18,24,25,29,31,,,,1.6,0.9,1.3");
+  snprintf(body, sizeof(body), "GNRMC,%s,A,%s,%c,%s,%c,%.2f,%.1f,170126,,,A", hms, lat, la < 0 ? 'S' : 'N',
+           lon, lo < 0 ? 'W' : 'E', speed / 0.514444, course);
+  n += nmea_put(buf + n, size - n, body);
+  snprintf(body, sizeof(body), "GNVTG,%.1f,T,,M,%.2f,N,%.2f,K,A", course, speed / 0.514444, speed * 3.6);
+  n += nmea_put(buf + n, size - n, body);
+  return n;
+#endif
+}
+
+static void gps_send(uint64_t at_ns) {
+  uint8_t buf[512];
+  sitl_uart_inject(GPS_PORT, buf, sitl_gps_epoch(buf, sizeof(buf), at_ns), at_ns);
+}
+
+// GPS_coord units: 1deg = 10 000 000
+void sitl_gps_coord(double north, double east, int32_t *lat, int32_t *lon) {
+  *lat = lround((HOME_LAT + degrees(north / EARTH_RADIUS)) * 1e7);
+  *lon = lround((HOME_LON + degrees(east / (EARTH_RADIUS * cos(radians(HOME_LAT))))) * 1e7);
+}
+
+void sitl_gps_meters(int32_t lat, int32_t lon, double *north, double *east) {
+  *north = radians(lat * 1e-7 - HOME_LAT) * EARTH_RADIUS;
+  *east = radians(lon * 1e-7 - HOME_LON) * EARTH_RADIUS * cos(radians(HOME_LAT));
+}
+
+/*************** sensors ***************/
+void sitl_sensors_init(uint32_t seed) {
+  rng = seed ? seed : 1;
+  for (uint8_t i = 0; i < 3; i++) gyro_bias[i] = 2 * (uniform() - 0.5);   // +/-1 deg/s
+  mpu_reset();
+  sitl_i2c_attach(&mpu6050);
+  sitl_i2c_attach(&ms5611);
+}
+
+void sitl_sensors_run(uint64_t now_ns) {
+  i2c1_run(now_ns);
+  while (gps_next_ns <= now_ns) {
+    if (sitl_uart_baud(GPS_PORT)) gps_send(gps_next_ns);
+    gps_next_ns += GPS_PERIOD_NS;
+  }
+}
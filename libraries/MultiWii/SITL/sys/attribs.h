@@ -0,0 +1,20 @@
+/*
+  sys/attribs.h - PIC32 interrupt attributes for the SITL build of MultiWii
+
+  An __ISR handler becomes a plain function, called by the simulator when
+  the event it serves happens (see sitl_rc_update()).
+*/
+
+#ifndef _SYS_ATTRIBS_H
+#define _SYS_ATTRIBS_H
+
+#define __ISR(vector, ipl)
+
+#define _CHANGE_NOTICE_VECTOR 26
+#define _DMA_0_VECTOR 36
+#define _DMA_1_VECTOR 37
+#define _DMA_2_VECTOR 38
+#define _DMA_3_VECTOR 39
+#define _DMA_4_VECTOR 40
+
+#endif
@@ -0,0 +1,21 @@
+/*
+  sys/kmem.h - PIC32 address translation for the SITL build of MultiWii
+
+  A DMA channel takes physical addresses in 32 bit registers. Here the
+  physical address is the offset from sitl_pa_base, which keeps the
+  addresses of the static data of the program in 32 bits on a 64 bit host.
+  There is no cache: the cached and the uncached views are the same.
+*/
+
+#ifndef _SYS_KMEM_H
+#define _SYS_KMEM_H
+
+#include <stdint.h>
+
+extern uint8_t sitl_pa_base;
+
+#define KVA_TO_PA(v) ((uint32_t)((uintptr_t)(v) - (uintptr_t)&sitl_pa_base))
+#define PA_TO_KVA1(pa) ((void *)((uintptr_t)&sitl_pa_base + (int32_t)(pa)))
+#define KVA0_TO_KVA1(v) (v) // no cache
+
+#endif
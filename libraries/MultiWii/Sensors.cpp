@@ -15,11 +15,15 @@
 #include "EEPROM.h"
 #include "IMU.h"
 #include "LCD.h"
+#include "Sensors.h"
 
-void i2c_BMP085_UT_Start(void);
+#if defined(CHIPKIT)
+  #include <sys/attribs.h> // __ISR
+  #include <sys/kmem.h>    // KVA_TO_PA
+  #include <p32_defs.h>    // p32_regset
+#endif
 
 void waitTransmissionI2C();
-void i2c_MS561101BA_UT_Start();
 #if BARO
 void Baro_Common();
 #endif
@@ -180,25 +184,201 @@ static uint32_t neutralizeTime = 0;
 // I2C general functions
 // ************************************************************************************************************
 #if defined(CHIPKIT)  //EDH
+// Wire only puts a write on the bus at endTransmission(): i2c_rep_start() in write
+// direction opens it, i2c_write() queues the bytes and i2c_stop() sends them, so that
+// i2c_writeReg() sends register and value in one transfer. Reads go through i2c_read_to_buf().
+//
+// The queue of i2c_queue() runs its transactions from the I2C1 master interrupt flag: each bus
+// event (start, byte, repeated start, receive, acknowledge, stop) raises it when it is over
+// and the handler starts the next one, so that the loop only pays for queuing them. The I2C1
+// vector belongs to Wire, as for the MPU6050 ISR of PMultiWii: the flag is used as the start
+// event of a DMA channel instead, which moves one dummy byte, and the block complete interrupt
+// of the channel steps the queue. The I2C1 interrupt stays masked while the queue has the bus.
+// Wire drives the same module: the blocking functions first let the queue finish, which turns
+// the channel off.
+
+#define I2C_QUEUE_SIZE  4   // transactions waiting or running
+#define I2C_QUEUE_WRITE 2   // bytes written at most: a command, or a register and its value
+#define I2C_QUEUE_DMA   4   // must match the vector of the handler below; 0 to 3: the TX rings of Serial.cpp, 7: CHECKSUM
+#define I2C_QUEUE_IPL   2   // must match the ipl of the handler below
+
+typedef struct {
+  uint8_t address;                // 7 bit
+  uint8_t wlen, rlen;             // bytes written, then read after a repeated start
+  uint8_t w[I2C_QUEUE_WRITE];
+  uint8_t *r;
+  volatile uint8_t *status;
+} i2c_transaction_t;
+
+static i2c_transaction_t i2cQueue[I2C_QUEUE_SIZE];
+static volatile uint8_t i2cQueueHead, i2cQueueTail; // next free entry, running one
+static volatile uint8_t i2cQueueRun;                // from the start of a transaction to the stop of the last one
+static uint8_t i2cStep, i2cIndex, i2cStatus;        // of the running transaction
+static uint32_t i2cWireIEC;                         // the I2C1 interrupt enable of Wire, put back when the queue is idle
+
+enum i2c_step { I2C_STEP_START, I2C_STEP_WRITE, I2C_STEP_RESTART, I2C_STEP_READ, I2C_STEP_RECEIVE, I2C_STEP_ACK, I2C_STEP_STOP };
+
+// ifs, iec and ipc registers are consecutive p32_regset: the one of an irq is at irq/32, of a vector at vector/4
+#define I2C_IRQ_BIT (1UL << (_I2C1_MASTER_IRQ & 31))
+#define I2C_IFS     (((p32_regset *)&IFS0) + (_I2C1_MASTER_IRQ >> 5))
+#define I2C_IEC     (((p32_regset *)&IEC0) + (_I2C1_MASTER_IRQ >> 5))
+#define I2C_DMA_IRQ_BIT (1UL << ((_DMA0_IRQ + I2C_QUEUE_DMA) & 31))
+#define I2C_DMA_IFS     (((p32_regset *)&IFS0) + ((_DMA0_IRQ + I2C_QUEUE_DMA) >> 5))
+#define I2C_DMA_IEC     (((p32_regset *)&IEC0) + ((_DMA0_IRQ + I2C_QUEUE_DMA) >> 5))
+
+// registers of one DMA channel, each one followed by its CLR SET INV
+typedef struct {
+  p32_regset con, econ, intr, ssa, dsa, ssiz, dsiz, sptr, dptr, csiz, cptr, dat;
+} dma_channel;
+#define I2C_DMA ((dma_channel *)&DCH0CON + I2C_QUEUE_DMA)
+
+static uint8_t i2cDMAByte;                          // source and destination of the channel
+
+// a bus event is over: start the next one of the running transaction, or the next transaction
+static void i2cQueueStep(void) {
+  i2c_transaction_t *t = &i2cQueue[i2cQueueTail];
+  I2C_IFS->clr = I2C_IRQ_BIT;
+  switch (i2cStep) {
+    case I2C_STEP_START:                        // address, in the direction of the first part
+      i2cIndex = 0;
+      i2cStatus = I2C_DONE;
+      i2cStep = t->wlen ? I2C_STEP_WRITE : I2C_STEP_READ;
+      I2C1TRN = (t->address << 1) | (t->wlen ? 0 : 1);
+      return;
+    case I2C_STEP_WRITE:                        // address or byte sent
+      if (I2C1STAT & _I2C1STAT_ACKSTAT_MASK) i2cStatus = I2C_FAILED;
+      else if (i2cIndex < t->wlen) {
+        I2C1TRN = t->w[i2cIndex++];
+        return;
+      } else if (t->rlen) {
+        i2cStep = I2C_STEP_RESTART;
+        I2C1CONSET = _I2C1CON_RSEN_MASK;
+        return;
+      }
+      break;
+    case I2C_STEP_RESTART:
+      i2cIndex = 0;
+      i2cStep = I2C_STEP_READ;
+      I2C1TRN = (t->address << 1) | 1;
+      return;
+    case I2C_STEP_READ:                         // read address sent
+      if (I2C1STAT & _I2C1STAT_ACKSTAT_MASK) {
+        i2cStatus = I2C_FAILED;
+        break;
+      }
+      i2cStep = I2C_STEP_RECEIVE;
+      I2C1CONSET = _I2C1CON_RCEN_MASK;
+      return;
+    case I2C_STEP_RECEIVE:                      // byte received: acknowledge all but the last one
+      t->r[i2cIndex++] = I2C1RCV;
+      if (i2cIndex < t->rlen) I2C1CONCLR = _I2C1CON_ACKDT_MASK;
+      else I2C1CONSET = _I2C1CON_ACKDT_MASK;
+      i2cStep = I2C_STEP_ACK;
+      I2C1CONSET = _I2C1CON_ACKEN_MASK;
+      return;
+    case I2C_STEP_ACK:
+      if (i2cIndex < t->rlen) {
+        i2cStep = I2C_STEP_RECEIVE;
+        I2C1CONSET = _I2C1CON_RCEN_MASK;
+        return;
+      }
+      break;
+    default: {                                  // stopped: the transaction is over
+      uint8_t tail = i2cQueueTail + 1;
+      if (tail == I2C_QUEUE_SIZE) tail = 0;
+      *t->status = i2cStatus;
+      i2cQueueTail = tail;
+      if (tail != i2cQueueHead) {
+        i2cStep = I2C_STEP_START;
+        I2C1CONSET = _I2C1CON_SEN_MASK;
+      } else {
+        I2C_DMA->con.clr = _DCH0CON_CHEN_MASK;  // Wire's bus events do not start it
+        I2C_IEC->set = i2cWireIEC;              // Wire's handler gets the bus back
+        i2cQueueRun = 0;
+      }
+      return;
+    }
+  }
+  if (i2cStatus == I2C_FAILED) i2c_errors_count++;
+  i2cStep = I2C_STEP_STOP;
+  I2C1CONSET = _I2C1CON_PEN_MASK;
+}
+
+extern "C" {
+  void __ISR(_DMA_4_VECTOR, ipl2) I2CQueue_Handler(void) {
+    I2C_DMA->intr.clr = _DCH0INT_CHBCIF_MASK;
+    I2C_DMA_IFS->clr = I2C_DMA_IRQ_BIT;
+    I2C_DMA->con.set = _DCH0CON_CHEN_MASK;    // off at the end of each block
+    i2cQueueStep();
+  }
+}
+
+// queue a transaction: wlen bytes written, then rlen bytes read into r. status is I2C_QUEUED
+// until it is over. return 0 when the queue is full
+uint8_t i2c_queue(uint8_t add, const uint8_t *w, uint8_t wlen, uint8_t *r, uint8_t rlen, volatile uint8_t *status) {
+  uint8_t head = i2cQueueHead, next = head + 1;
+  if (next == I2C_QUEUE_SIZE) next = 0;
+  if (next == i2cQueueTail || wlen > I2C_QUEUE_WRITE) return 0;
+  i2c_transaction_t *t = &i2cQueue[head];
+  t->address = add;
+  t->wlen = wlen;
+  t->rlen = rlen;
+  memcpy(t->w, w, wlen);
+  t->r = r;
+  t->status = status;
+  *status = I2C_QUEUED;
+  I2C_DMA_IEC->clr = I2C_DMA_IRQ_BIT;   // the handler also starts transactions
+  i2cQueueHead = next;
+  if (!i2cQueueRun) {
+    i2cQueueRun = 1;
+    i2cStep = I2C_STEP_START;
+    i2cWireIEC = I2C_IEC->reg & I2C_IRQ_BIT;
+    I2C_IEC->clr = I2C_IRQ_BIT;         // Wire's handler stays out of the transactions
+    I2C_IFS->clr = I2C_IRQ_BIT;
+    I2C_DMA->con.set = _DCH0CON_CHEN_MASK;
+    I2C1CONSET = _I2C1CON_SEN_MASK;
+  }
+  I2C_DMA_IEC->set = I2C_DMA_IRQ_BIT;
+  return 1;
+}
+
+void i2c_queue_wait(void) {
+  while (i2cQueueRun) delayMicroseconds(10);
+}
 
 void i2c_init(void) {
 //  Serial.println("i2c_init");
+  p32_regset *ipc = ((p32_regset *)&IPC0) + ((_DMA_0_VECTOR + I2C_QUEUE_DMA) >> 2);
+  uint8_t shift = 8 * ((_DMA_0_VECTOR + I2C_QUEUE_DMA) & 3);
+
   Wire.begin(); // setup I2C
+  I2C_DMA_IEC->clr = I2C_DMA_IRQ_BIT;
+  I2C_DMA->con.clr = _DCH0CON_CHEN_MASK;
+  DMACONSET = _DMACON_ON_MASK;
+  I2C_DMA->econ.reg = ((uint32_t)_I2C1_MASTER_IRQ << _DCH0ECON_CHSIRQ_POSITION) | _DCH0ECON_SIRQEN_MASK;
+  I2C_DMA->ssa.reg  = KVA_TO_PA(&i2cDMAByte);
+  I2C_DMA->dsa.reg  = KVA_TO_PA(&i2cDMAByte);
+  I2C_DMA->ssiz.reg = 1;
+  I2C_DMA->dsiz.reg = 1;
+  I2C_DMA->csiz.reg = 1;                     // one block per bus event
+  I2C_DMA->intr.reg = _DCH0INT_CHBCIE_MASK;  // block complete
+  I2C_DMA_IFS->clr = I2C_DMA_IRQ_BIT;
+  ipc->clr = 0x1F << shift;
+  ipc->set = (I2C_QUEUE_IPL << 2) << shift;
 }
 
 void i2c_rep_start(uint8_t address) {
+  i2c_queue_wait();
+  if (!(address & 1)) Wire.beginTransmission(address>>1); // write direction only
 }
 
 void i2c_stop(void) { 
+  if (Wire.endTransmission() != 0) i2c_errors_count++;
 }
 
 void i2c_write(uint8_t data ) {
   //Serial.println("i2c_write"); Serial.println((int)data); 
   Wire.send((int)data);
-  //Serial.println("endTransmission"); 
-  int ret = Wire.endTransmission(); 
-  //Serial.print("ret: ");Serial.println(ret);
-  delay(1);
 }
 
 uint8_t i2c_read(uint8_t ack) {
@@ -219,6 +399,7 @@ void waitTransmissionI2C() {
 
 size_t i2c_read_to_buf(uint8_t add, void *buf, size_t size) {
   //Serial.println("i2c_read_to_buf"); 
+  i2c_queue_wait();
   Wire.requestFrom(add, (uint8_t)size);
   
   size_t bytes_read = 0;
@@ -234,9 +415,10 @@ size_t i2c_read_to_buf(uint8_t add, void *buf, size_t size) {
 
 size_t i2c_read_reg_to_buf(uint8_t add, uint8_t reg, void *buf, size_t size) {
   //Serial.println("i2c_read_reg_to_buf"); 
-  Wire.beginTransmission(add); 
-  
+  i2c_rep_start(add<<1);
   i2c_write(reg);        // register selection
+  i2c_stop();
+  delay(1);
   
   return i2c_read_to_buf(add, buf, size);
 }
@@ -322,6 +504,22 @@ size_t i2c_read_reg_to_buf(uint8_t add, uint8_t reg, void *buf, size_t size) {
   return i2c_read_to_buf(add, buf, size);
 }
 
+// no interrupt driven TWI here: the transaction is done at once
+uint8_t i2c_queue(uint8_t add, const uint8_t *w, uint8_t wlen, uint8_t *r, uint8_t rlen, volatile uint8_t *status) {
+  int16_t errors = i2c_errors_count;
+  if (wlen) {
+    i2c_rep_start(add<<1);
+    while (wlen--) i2c_write(*w++);
+    if (!rlen) i2c_stop();
+  }
+  if (rlen) i2c_read_to_buf(add, r, rlen);
+  *status = i2c_errors_count == errors ? I2C_DONE : I2C_FAILED;
+  return 1;
+}
+
+void i2c_queue_wait(void) {
+}
+
 #endif
 
 /* transform a series of bytes from big endian to little
@@ -358,6 +556,155 @@ uint8_t i2c_readReg(uint8_t add, uint8_t reg) {
   return val;
 }
 
+#if defined(GYRO_FILTER)
+/* GYRO_FILTER: the biquads of config.h on each axis, in direct form I with the samples in 1/16 and the
+   coefficients in 1/2^GYRO_BIQUAD_SHIFT, designed for the average time between two samples (again when it
+   drifts by 1/32). The dynamic notch runs the difference of two roll and pitch samples (the motion of the quad
+   is slow, the noise is not) through GYRO_DYN_NOTCH_BINS Goertzel filters. Every GYRO_DYN_NOTCH_SAMPLES the
+   strongest bin, placed between its neighbours, draws the notch to it if it stands out of the other bins. */
+#define GYRO_SHIFT        4
+#define GYRO_BIQUAD_SHIFT 24
+#define GOERTZEL_SHIFT    14
+
+typedef struct {
+  int32_t b0, b1, b2, a1, a2;
+} gyro_biquad_coef_t;
+
+typedef struct {
+  int32_t x1, x2, y1, y2;
+} gyro_biquad_t;
+
+static int32_t gyroBiquad(const gyro_biquad_coef_t *c, gyro_biquad_t *s, int32_t x) {
+  int32_t y = ((int64_t)c->b0 * x + (int64_t)c->b1 * s->x1 + (int64_t)c->b2 * s->x2
+               - (int64_t)c->a1 * s->y1 - (int64_t)c->a2 * s->y2) >> GYRO_BIQUAD_SHIFT;
+  s->x2 = s->x1; s->x1 = x;
+  s->y2 = s->y1; s->y1 = y;
+  return y;
+}
+
+// the low pass (q = 1/sqrt(2): Butterworth) or the notch at hz for samples dt us apart, in 1/2^GYRO_BIQUAD_SHIFT
+static void gyroBiquadCoefficients(gyro_biquad_coef_t *c, float hz, float q, uint8_t notch, uint16_t dt) {
+  float w = 2 * PI * hz * dt * 1e-6f, cs = cos(w), alpha = sin(w) / (2 * q);
+  float scale = (1L << GYRO_BIQUAD_SHIFT) / (1 + alpha);
+  if (notch) {
+    c->b0 = c->b2 = scale;
+    c->b1 = -2 * cs * scale;
+  } else {
+    c->b0 = c->b2 = (1 - cs) / 2 * scale;
+    c->b1 = (1 - cs) * scale;
+  }
+  c->a1 = -2 * cs * scale;
+  c->a2 = (1 - alpha) * scale;
+}
+
+#if defined(GYRO_DYN_NOTCH)
+static const uint16_t gyroDynNotchRange[] = GYRO_DYN_NOTCH;
+uint16_t gyroDynNotchHz;
+
+static float gyroDynNotchBinHz(float k) {
+  return gyroDynNotchRange[0] + (gyroDynNotchRange[1] - gyroDynNotchRange[0]) * k / (GYRO_DYN_NOTCH_BINS - 1);
+}
+#endif
+
+// one sample of imu.gyroADC, read at now
+void Gyro_filter(uint16_t now) {
+  static uint16_t sampleTime, sampleAvg = 1400, coefSample;
+  uint16_t dt;
+  uint8_t axis;
+  int32_t x;
+  #if defined(GYRO_LPF_HZ)
+    static gyro_biquad_coef_t lpf;
+    static gyro_biquad_t lpfState[3];
+  #endif
+  #if defined(GYRO_NOTCH_HZ)
+    static gyro_biquad_coef_t notch;
+    static gyro_biquad_t notchState[3];
+  #endif
+  #if defined(GYRO_DYN_NOTCH)
+    static gyro_biquad_coef_t dyn;
+    static gyro_biquad_t dynState[3];
+    static int32_t bin[GYRO_DYN_NOTCH_BINS], s1[2][GYRO_DYN_NOTCH_BINS], s2[2][GYRO_DYN_NOTCH_BINS];
+    static int16_t previous[2];
+    static uint8_t count;
+    static float center;
+    uint8_t k;
+  #endif
+
+  dt = now - sampleTime;
+  sampleTime = now;
+  if (dt < 20000) sampleAvg += ((int16_t)(dt - sampleAvg)) >> 4;   // not across a gap (calibration)
+  if (!coefSample || sampleAvg > coefSample + (coefSample >> 5) || sampleAvg < coefSample - (coefSample >> 5)) {
+    coefSample = sampleAvg;
+    #if defined(GYRO_LPF_HZ)
+      gyroBiquadCoefficients(&lpf, GYRO_LPF_HZ, 0.7071068f, 0, coefSample);
+    #endif
+    #if defined(GYRO_NOTCH_HZ)
+      gyroBiquadCoefficients(&notch, GYRO_NOTCH_HZ, (float)GYRO_NOTCH_HZ * GYRO_NOTCH_CUTOFF_HZ /
+                             ((float)GYRO_NOTCH_HZ * GYRO_NOTCH_HZ - (float)GYRO_NOTCH_CUTOFF_HZ * GYRO_NOTCH_CUTOFF_HZ),
+                             1, coefSample);
+    #endif
+    #if defined(GYRO_DYN_NOTCH)
+      for (k = 0; k < GYRO_DYN_NOTCH_BINS; k++)
+        bin[k] = 2 * cos(2 * PI * gyroDynNotchBinHz(k) * coefSample * 1e-6f) * (1L << GOERTZEL_SHIFT);
+      if (!center) center = gyroDynNotchBinHz((GYRO_DYN_NOTCH_BINS - 1) / 2.0f);
+      gyroDynNotchHz = center;
+      gyroBiquadCoefficients(&dyn, center, GYRO_DYN_NOTCH_Q, 1, coefSample);
+    #endif
+  }
+
+  #if defined(GYRO_DYN_NOTCH)
+    for (axis = 0; axis < 2; axis++) {
+      int32_t d = imu.gyroADC[axis] - previous[axis];
+      previous[axis] = imu.gyroADC[axis];
+      for (k = 0; k < GYRO_DYN_NOTCH_BINS; k++) {
+        int32_t s = d + (int32_t)(((int64_t)bin[k] * s1[axis][k]) >> GOERTZEL_SHIFT) - s2[axis][k];
+        s2[axis][k] = s1[axis][k];
+        s1[axis][k] = s;
+      }
+    }
+    if (++count == GYRO_DYN_NOTCH_SAMPLES) {
+      float p[GYRO_DYN_NOTCH_BINS], sum = 0, peak;
+      uint8_t top = 0;
+      count = 0;
+      for (k = 0; k < GYRO_DYN_NOTCH_BINS; k++) {   // power of each bin
+        p[k] = 0;
+        for (axis = 0; axis < 2; axis++) {
+          float a = s1[axis][k], b = s2[axis][k];
+          p[k] += a * a + b * b - a * b * bin[k] / (1L << GOERTZEL_SHIFT);
+          s1[axis][k] = s2[axis][k] = 0;
+        }
+        sum += p[k];
+        if (p[k] > p[top]) top = k;
+      }
+      if (p[top] * (GYRO_DYN_NOTCH_BINS - 1) > 4 * (sum - p[top])) {   // 4 times the average of the others
+        peak = top;
+        if (top > 0 && top < GYRO_DYN_NOTCH_BINS - 1) {                // the vertex of the parabola through the 3 bins
+          float den = p[top - 1] - 2 * p[top] + p[top + 1];
+          if (den < 0) peak += (p[top - 1] - p[top + 1]) / (2 * den);
+        }
+        center += (gyroDynNotchBinHz(peak) - center) / 4;
+        gyroDynNotchHz = center;
+        gyroBiquadCoefficients(&dyn, center, GYRO_DYN_NOTCH_Q, 1, coefSample);
+      }
+    }
+  #endif
+
+  for (axis = 0; axis < 3; axis++) {
+    x = (int32_t)imu.gyroADC[axis] << GYRO_SHIFT;
+    #if defined(GYRO_NOTCH_HZ)
+      x = gyroBiquad(&notch, &notchState[axis], x);
+    #endif
+    #if defined(GYRO_DYN_NOTCH)
+      x = gyroBiquad(&dyn, &dynState[axis], x);
+    #endif
+    #if defined(GYRO_LPF_HZ)
+      x = gyroBiquad(&lpf, &lpfState[axis], x);
+    #endif
+    imu.gyroADC[axis] = constrain((x + (1 << (GYRO_SHIFT - 1))) >> GYRO_SHIFT, -32768, 32767);
+  }
+}
+#endif
+
 // ****************
 // GYRO common part
 // ****************
@@ -435,6 +782,9 @@ void GYRO_Common() {
 #endif    
     previousGyroADC[axis] = imu.gyroADC[axis];
   }
+  #if defined(GYRO_FILTER)
+    Gyro_filter(micros());
+  #endif
 
   #if defined(SENSORS_TILT_45DEG_LEFT)
     int16_t temp  = ((imu.gyroADC[PITCH] - imu.gyroADC[ROLL] )*7)/10;
@@ -563,8 +913,11 @@ static struct {
   int16_t  b1, b2, mb, mc, md;
   union {uint16_t val; uint8_t raw[2]; } ut; //uncompensated T
   union {uint32_t val; uint8_t raw[4]; } up; //uncompensated P
-  uint8_t  state;
+  int32_t  b5;                    // temperature term of the pressure, from the last UT
+  uint8_t  state;                 // 0: UT conversion, 1: UP conversion
+  uint8_t  pending;               // the result read is queued
   uint32_t deadline;
+  volatile uint8_t read, start;   // I2C queue status of the result read and of the next conversion start
 } bmp085_ctx;  
 #define OSS 3
 
@@ -580,57 +933,40 @@ void i2c_BMP085_readCalibration(){
   }
 }
 
+// queue the start of a conversion: 0x2E temperature, 0x34+(OSS<<6) pressure
+static uint8_t i2c_BMP085_Start(uint8_t control) {
+  uint8_t w[2] = {0xF4, control};
+  return i2c_queue(BMP085_ADDRESS, w, 2, 0, 0, &bmp085_ctx.start);
+}
+
+// queue the read of the result registers, MSB first
+static uint8_t i2c_BMP085_Read(uint8_t *raw, uint8_t len) {
+  static const uint8_t reg = 0xF6;
+  return i2c_queue(BMP085_ADDRESS, &reg, 1, raw, len, &bmp085_ctx.read);
+}
+
 void  Baro_init() {
   delay(10);
   i2c_BMP085_readCalibration();
   delay(5);
-  i2c_BMP085_UT_Start(); 
+  i2c_BMP085_Start(0x2E); 
+  i2c_queue_wait();
   bmp085_ctx.deadline = currentTime+5000;
 }
 
-// read uncompensated temperature value: send command first
-void i2c_BMP085_UT_Start(void) {
-  i2c_writeReg(BMP085_ADDRESS,0xf4,0x2e);
-  i2c_rep_start(BMP085_ADDRESS<<1);
-  i2c_write(0xF6);
-  i2c_stop();
-}
-
-// read uncompensated pressure value: send command first
-void i2c_BMP085_UP_Start () {
-  i2c_writeReg(BMP085_ADDRESS,0xf4,0x34+(OSS<<6)); // control register value for oversampling setting 3
-  i2c_rep_start(BMP085_ADDRESS<<1); //I2C write direction => 0
-  i2c_write(0xF6);
-  i2c_stop();
-}
-
-// read uncompensated pressure value: read result bytes
-// the datasheet suggests a delay of 25.5 ms (oversampling settings 3) after the send command
-void i2c_BMP085_UP_Read () {
-  i2c_rep_start((BMP085_ADDRESS<<1) | 1);//I2C read direction => 1
-  bmp085_ctx.up.raw[2] = i2c_readAck();
-  bmp085_ctx.up.raw[1] = i2c_readAck();
-  bmp085_ctx.up.raw[0] = i2c_readNak();
-}
-
-// read uncompensated temperature value: read result bytes
-// the datasheet suggests a delay of 4.5 ms after the send command
-void i2c_BMP085_UT_Read() {
-  i2c_rep_start((BMP085_ADDRESS<<1) | 1);//I2C read direction => 1
-  bmp085_ctx.ut.raw[1] = i2c_readAck();
-  bmp085_ctx.ut.raw[0] = i2c_readNak();
+// temperature, and the temperature term of the pressure
+void i2c_BMP085_Temperature() {
+  int32_t  x1, x2;
+  x1 = ((int32_t)bmp085_ctx.ut.val - bmp085_ctx.ac6) * bmp085_ctx.ac5 >> 15;
+  x2 = ((int32_t)bmp085_ctx.mc << 11) / (x1 + bmp085_ctx.md);
+  bmp085_ctx.b5 = x1 + x2;
+  baroTemperature = (bmp085_ctx.b5 * 10 + 8) >> 4; // in 0.01 degC (same as MS561101BA temperature)
 }
 
-void i2c_BMP085_Calculate() {
-  int32_t  x1, x2, x3, b3, b5, b6, p, tmp;
+void i2c_BMP085_Pressure() {
+  int32_t  x1, x2, x3, b3, b6, p, tmp;
   uint32_t b4, b7;
-  // Temperature calculations
-  x1 = ((int32_t)bmp085_ctx.ut.val - bmp085_ctx.ac6) * bmp085_ctx.ac5 >> 15;
-  x2 = ((int32_t)bmp085_ctx.mc << 11) / (x1 + bmp085_ctx.md);
-  b5 = x1 + x2;
-  baroTemperature = (b5 * 10 + 8) >> 4; // in 0.01 degC (same as MS561101BA temperature)
-  // Pressure calculations
-  b6 = b5 - 4000;
+  b6 = bmp085_ctx.b5 - 4000;
   x1 = (bmp085_ctx.b2 * (b6 * b6 >> 12)) >> 11; 
   x2 = bmp085_ctx.ac2 * b6 >> 11;
   x3 = x1 + x2;
@@ -649,25 +985,38 @@ void i2c_BMP085_Calculate() {
   baroPressure = p + ((x1 + x2 + 3791) >> 4);
 }
 
+// the I2C transfers go through the queue: at the end of a conversion the read of its result and the
+// start of the next one are queued, the math is done at one of the next calls once they are over
 //return 0: no data available, no computation ;  1: new value available  ; 2: no new value, but computation time
 uint8_t Baro_update() {                   // first UT conversion is started in init procedure
-  if (currentTime < bmp085_ctx.deadline) return 0; 
-  bmp085_ctx.deadline = currentTime+6000; // 1.5ms margin according to the spec (4.5ms T convetion time)
+  uint8_t r = 0;
+  if (bmp085_ctx.pending && bmp085_ctx.start != I2C_QUEUED) { // the start is queued after the read
+    bmp085_ctx.pending = 0;
+    if (bmp085_ctx.read == I2C_DONE) {
+      if (bmp085_ctx.state) {             // UP conversion started, UT read
+        swap_endianness(bmp085_ctx.ut.raw, 2);
+        i2c_BMP085_Temperature();
+        r = 2;
+      } else {
+        swap_endianness(bmp085_ctx.up.raw, 3);
+        i2c_BMP085_Pressure(); 
+        Baro_Common();
+        r = 1;
+      }
+    }
+  }
+  if (bmp085_ctx.pending || currentTime < bmp085_ctx.deadline) return r; 
   TWBR = ((F_CPU / 400000L) - 16) / 2; // change the I2C clock rate to 400kHz, BMP085 is ok with this speed
   if (bmp085_ctx.state == 0) {
-    i2c_BMP085_UT_Read(); 
-    i2c_BMP085_UP_Start(); 
-    bmp085_ctx.state = 1; 
-    Baro_Common();
-    bmp085_ctx.deadline += 21000;   // 6000+21000=27000 1.5ms margin according to the spec (25.5ms P convetion time with OSS=3)
-    return 1;
+    if (!i2c_BMP085_Read(bmp085_ctx.ut.raw, 2) || !i2c_BMP085_Start(0x34+(OSS<<6))) return r; // oversampling setting 3
+    bmp085_ctx.deadline = micros()+27000; // 1.5ms margin according to the spec (25.5ms P convetion time with OSS=3)
   } else {
-    i2c_BMP085_UP_Read(); 
-    i2c_BMP085_UT_Start(); 
-    i2c_BMP085_Calculate(); 
-    bmp085_ctx.state = 0; 
-    return 2;
+    if (!i2c_BMP085_Read(bmp085_ctx.up.raw, 3) || !i2c_BMP085_Start(0x2E)) return r;
+    bmp085_ctx.deadline = micros()+6000;  // 1.5ms margin according to the spec (4.5ms T convetion time)
   }
+  bmp085_ctx.state ^= 1;
+  bmp085_ctx.pending = 1;
+  return r;
 }
 #endif
 
@@ -698,8 +1047,11 @@ static struct {
   uint16_t c[7];
   union {uint32_t val; uint8_t raw[4]; } ut; //uncompensated T
   union {uint32_t val; uint8_t raw[4]; } up; //uncompensated P
-  uint8_t  state;
+  int64_t  off, sens;             // pressure offset and sensitivity at the temperature of the last UT
+  uint8_t  state;                 // 0: UT conversion, 1: UP conversion
+  uint8_t  pending;               // the ADC read is queued
   uint32_t deadline;
+  volatile uint8_t read, start;   // I2C queue status of the ADC read and of the next conversion start
 } ms561101ba_ctx;
 
 void i2c_MS561101BA_reset(){
@@ -709,62 +1061,38 @@ void i2c_MS561101BA_reset(){
 void i2c_MS561101BA_readCalibration(){
   union {uint16_t val; uint8_t raw[2]; } data;
   for(uint8_t i=0;i<6;i++) {
-    i2c_rep_start(MS561101BA_ADDRESS<<1);
-    i2c_write(0xA2+2*i);
-    delay(10);
-    i2c_rep_start((MS561101BA_ADDRESS<<1) | 1);//I2C read direction => 1
     delay(10);
-    data.raw[1] = i2c_readAck();  // read a 16 bit register
-    data.raw[0] = i2c_readNak();
+    i2c_read_reg_to_buf(MS561101BA_ADDRESS, 0xA2+2*i, &data.raw, 2); // read a 16 bit register
+    swap_endianness(&data.raw, 2);
     ms561101ba_ctx.c[i+1] = data.val;
   }
 }
 
+// queue the start of a conversion
+static uint8_t i2c_MS561101BA_Start(uint8_t command) {
+  command += OSR;
+  return i2c_queue(MS561101BA_ADDRESS, &command, 1, 0, 0, &ms561101ba_ctx.start);
+}
+
+// queue the read of the last conversion result
+static uint8_t i2c_MS561101BA_Read(uint8_t *raw) {
+  static const uint8_t adc = 0;
+  return i2c_queue(MS561101BA_ADDRESS, &adc, 1, raw, 3, &ms561101ba_ctx.read);
+}
+
 void  Baro_init() {
   delay(10);
   i2c_MS561101BA_reset();
   delay(100);
   i2c_MS561101BA_readCalibration();
   delay(10);
-  i2c_MS561101BA_UT_Start(); 
+  i2c_MS561101BA_Start(MS561101BA_TEMPERATURE); 
+  i2c_queue_wait();
   ms561101ba_ctx.deadline = currentTime+10000; 
 }
 
-// read uncompensated temperature value: send command first
-void i2c_MS561101BA_UT_Start() {
-  i2c_rep_start(MS561101BA_ADDRESS<<1);      // I2C write direction
-  i2c_write(MS561101BA_TEMPERATURE + OSR);  // register selection
-  i2c_stop();
-}
-
-// read uncompensated pressure value: send command first
-void i2c_MS561101BA_UP_Start () {
-  i2c_rep_start(MS561101BA_ADDRESS<<1);      // I2C write direction
-  i2c_write(MS561101BA_PRESSURE + OSR);     // register selection
-  i2c_stop();
-}
-
-// read uncompensated pressure value: read result bytes
-void i2c_MS561101BA_UP_Read () {
-  i2c_rep_start(MS561101BA_ADDRESS<<1);
-  i2c_write(0);
-  i2c_rep_start((MS561101BA_ADDRESS<<1) | 1);
-  ms561101ba_ctx.up.raw[2] = i2c_readAck();
-  ms561101ba_ctx.up.raw[1] = i2c_readAck();
-  ms561101ba_ctx.up.raw[0] = i2c_readNak();
-}
-
-// read uncompensated temperature value: read result bytes
-void i2c_MS561101BA_UT_Read() {
-  i2c_rep_start(MS561101BA_ADDRESS<<1);
-  i2c_write(0);
-  i2c_rep_start((MS561101BA_ADDRESS<<1) | 1);
-  ms561101ba_ctx.ut.raw[2] = i2c_readAck();
-  ms561101ba_ctx.ut.raw[1] = i2c_readAck();
-  ms561101ba_ctx.ut.raw[0] = i2c_readNak();
-}
-
-void i2c_MS561101BA_Calculate() {
+// temperature, and the offset and sensitivity of the pressure at it
+void i2c_MS561101BA_Temperature() {
   int32_t off2,sens2,delt;
 
   int64_t dT       = (int32_t)ms561101ba_ctx.ut.val - ((int32_t)ms561101ba_ctx.c[5] << 8);
@@ -786,28 +1114,45 @@ void i2c_MS561101BA_Calculate() {
     off  -= off2; 
     sens -= sens2;
   }
+  ms561101ba_ctx.off  = off;
+  ms561101ba_ctx.sens = sens;
+}
 
-  baroPressure     = (( (ms561101ba_ctx.up.val * sens ) >> 21) - off) >> 15;
+void i2c_MS561101BA_Pressure() {
+  baroPressure     = (( (ms561101ba_ctx.up.val * ms561101ba_ctx.sens ) >> 21) - ms561101ba_ctx.off) >> 15;
 }
 
+// the I2C transfers go through the queue: at the end of a conversion the read of its result and the
+// start of the next one are queued, the math is done at one of the next calls once they are over
 //return 0: no data available, no computation ;  1: new value available  ; 2: no new value, but computation time
 uint8_t Baro_update() {                            // first UT conversion is started in init procedure
-  if (currentTime < ms561101ba_ctx.deadline) return 0; 
-  ms561101ba_ctx.deadline = currentTime+10000;  // UT and UP conversion take 8.5ms so we do next reading after 10ms 
-  TWBR = ((F_CPU / 400000L) - 16) / 2;          // change the I2C clock rate to 400kHz, MS5611 is ok with this speed
+  uint8_t r = 0;
+  if (ms561101ba_ctx.pending && ms561101ba_ctx.start != I2C_QUEUED) { // the start is queued after the read
+    ms561101ba_ctx.pending = 0;
+    if (ms561101ba_ctx.read == I2C_DONE) {
+      if (ms561101ba_ctx.state) {                  // UP conversion started, UT read
+        swap_endianness(ms561101ba_ctx.ut.raw, 3);
+        i2c_MS561101BA_Temperature();
+        r = 2;
+      } else {
+        swap_endianness(ms561101ba_ctx.up.raw, 3);
+        i2c_MS561101BA_Pressure();
+        Baro_Common();
+        r = 1;
+      }
+    }
+  }
+  if (ms561101ba_ctx.pending || currentTime < ms561101ba_ctx.deadline) return r; 
+  TWBR = ((F_CPU / 400000L) - 16) / 2;            // change the I2C clock rate to 400kHz, MS5611 is ok with this speed
   if (ms561101ba_ctx.state == 0) {
-    i2c_MS561101BA_UT_Read(); 
-    i2c_MS561101BA_UP_Start(); 
-    Baro_Common();                              // moved here for less timecycle spike
-    ms561101ba_ctx.state = 1;
-    return 1;
+    if (!i2c_MS561101BA_Read(ms561101ba_ctx.ut.raw) || !i2c_MS561101BA_Start(MS561101BA_PRESSURE)) return r;
   } else {
-    i2c_MS561101BA_UP_Read();
-    i2c_MS561101BA_UT_Start(); 
-    i2c_MS561101BA_Calculate();
-    ms561101ba_ctx.state = 0; 
-    return 2;
+    if (!i2c_MS561101BA_Read(ms561101ba_ctx.up.raw) || !i2c_MS561101BA_Start(MS561101BA_TEMPERATURE)) return r;
   }
+  ms561101ba_ctx.deadline = micros()+10000;       // UT and UP conversion take 8.5ms so we do next reading after 10ms 
+  ms561101ba_ctx.state ^= 1;
+  ms561101ba_ctx.pending = 1;
+  return r;
 }
 #endif
 
@@ -1433,14 +1778,15 @@ void Gyro_getADC () {
   Serial.print("rawADC[3]:");Serial.println((int)rawADC[3]);
   Serial.print("rawADC[4]:");Serial.println((int)rawADC[4]);
   Serial.print("rawADC[5]:");Serial.println((int)rawADC[5]);*/
-  GYRO_ORIENTATION( ((rawADC[0]<<8) | rawADC[1])>>2 , // range: +/- 8192; +/- 2000 deg/sec
-                    ((rawADC[2]<<8) | rawADC[3])>>2 ,
-                    ((rawADC[4]<<8) | rawADC[5])>>2 );
+  // int16_t casts: int is 32 bit on the PIC32, the sign is in bit 15
+  GYRO_ORIENTATION( ((int16_t)((rawADC[0]<<8) | rawADC[1]))>>2 , // range: +/- 8192; +/- 2000 deg/sec
+                    ((int16_t)((rawADC[2]<<8) | rawADC[3]))>>2 ,
+                    ((int16_t)((rawADC[4]<<8) | rawADC[5]))>>2 );
   GYRO_Common();
 }
 
 void ACC_init () {
-  Serial.println("ACC_init");
+  //Serial.println("ACC_init");
   i2c_writeReg(MPU6050_ADDRESS, 0x1C, 0x10);             //ACCEL_CONFIG  -- AFS_SEL=2 (Full Scale = +/-8G)  ; ACCELL_HPF=0   //note something is wrong in the spec.
   //note: something seems to be wrong in the spec here. With AFS=2 1G = 4096 but according to my measurement: 1G=2048 (and 2048/8 = 256)
   //confirmed here: http://www.multiwii.com/forum/viewtopic.php?f=8&t=1080&start=10#p7480
@@ -1458,18 +1804,18 @@ void ACC_init () {
 }
 
 void ACC_getADC () {
-  Serial.println("ACC_getADC");  
+  //Serial.println("ACC_getADC");  
   i2c_getSixRawADC(MPU6050_ADDRESS, 0x3B);
-  ACC_ORIENTATION( ((rawADC[0]<<8) | rawADC[1])>>3 ,
-                   ((rawADC[2]<<8) | rawADC[3])>>3 ,
-                   ((rawADC[4]<<8) | rawADC[5])>>3 );
-  Serial.print("accADC[ROLL]: ");  Serial.print(ROLL);Serial.print("  ");Serial.println(imu.accADC[ROLL]);
+  ACC_ORIENTATION( ((int16_t)((rawADC[0]<<8) | rawADC[1]))>>3 ,
+                   ((int16_t)((rawADC[2]<<8) | rawADC[3]))>>3 ,
+                   ((int16_t)((rawADC[4]<<8) | rawADC[5]))>>3 );
+  /*Serial.print("accADC[ROLL]: ");  Serial.print(ROLL);Serial.print("  ");Serial.println(imu.accADC[ROLL]);
   Serial.print("accADC[PITCH]: ");  Serial.print(PITCH);Serial.print("  ");Serial.println(imu.accADC[PITCH]);
-  Serial.print("accADC[YAW]: ");  Serial.print(YAW);Serial.print("  ");Serial.println(imu.accADC[YAW]);
+  Serial.print("accADC[YAW]: ");  Serial.print(YAW);Serial.print("  ");Serial.println(imu.accADC[YAW]);*/
   ACC_Common();
-  Serial.print("accADC[ROLL]: ");  Serial.print(ROLL);Serial.print("  ");Serial.println(imu.accADC[ROLL]);
+  /*Serial.print("accADC[ROLL]: ");  Serial.print(ROLL);Serial.print("  ");Serial.println(imu.accADC[ROLL]);
   Serial.print("accADC[PITCH]: ");  Serial.print(PITCH);Serial.print("  ");Serial.println(imu.accADC[PITCH]);
-  Serial.print("accADC[YAW]: ");  Serial.print(YAW);Serial.print("  ");Serial.println(imu.accADC[YAW]);
+  Serial.print("accADC[YAW]: ");  Serial.print(YAW);Serial.print("  ");Serial.println(imu.accADC[YAW]);*/
 
 }
 
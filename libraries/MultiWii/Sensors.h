@@ -13,6 +13,13 @@ void ACC_getADC ();
 void Gyro_getADC ();
 #endif
 
+#if defined(GYRO_FILTER)
+void Gyro_filter(uint16_t now);
+#endif
+#if defined(GYRO_DYN_NOTCH)
+extern uint16_t gyroDynNotchHz;
+#endif
+
 #if MAG
 uint8_t Mag_getADC();
 #endif
@@ -31,5 +38,12 @@ uint8_t i2c_readReg(uint8_t add, uint8_t reg);
 uint8_t i2c_readAck();
 uint8_t i2c_readNak();
 
+// I2C transaction queue: status of a queued transaction
+#define I2C_QUEUED 0
+#define I2C_DONE   1
+#define I2C_FAILED 2    // NACK of the address or of a written byte
+uint8_t i2c_queue(uint8_t add, const uint8_t *w, uint8_t wlen, uint8_t *r, uint8_t rlen, volatile uint8_t *status);
+void i2c_queue_wait(void);
+
 
 #endif /* SENSORS_H_ */
@@ -15,6 +15,12 @@
 #include "GPS.h"
 #include "MultiWii.h"
 
+#if defined(CHIPKIT) && defined(CHIPKIT_DMA_TX)
+  #include <sys/attribs.h> // __ISR
+  #include <sys/kmem.h>    // KVA_TO_PA
+  #include <p32_defs.h>    // p32_regset
+#endif
+
 uint16_t read16();
 uint8_t read8();
 void serialize8(uint8_t a);
@@ -41,13 +47,33 @@ void serialize8(uint8_t a);
 #else
   #define RX_BUFFER_SIZE 64
 #endif
-#define TX_BUFFER_SIZE 128
-#define INBUF_SIZE 64
+#if defined(CHIPKIT)
+  #define TX_BUFFER_SIZE 256 // room for a MSP_MULTI reply
+  #define INBUF_SIZE 512     // the v2 frames can carry more than 255 bytes
+#else
+  #define TX_BUFFER_SIZE 128
+  #define INBUF_SIZE 64
+#endif
+#define MSP_MULTI_MAX (TX_BUFFER_SIZE-10) // payload of a MSP_MULTI reply: the ring holds it with a v2 header and checksum
+#if defined(CHIPKIT)
+  typedef uint16_t txindex_t;  // any TX_BUFFER_SIZE: the 32 bit core reads and writes it in one access
+#else
+  typedef uint8_t txindex_t;   // one access on the AVR, shared with the UDRE interrupts
+  #if TX_BUFFER_SIZE > 256
+    #error "TX_BUFFER_SIZE above 256 needs the 16 bit TX indices of the chipKIT"
+  #endif
+#endif
 
 static volatile uint8_t serialHeadRX[UART_NUMBER],serialTailRX[UART_NUMBER];
 static uint8_t serialBufferRX[RX_BUFFER_SIZE][UART_NUMBER];
-static volatile uint8_t serialHeadTX[UART_NUMBER],serialTailTX[UART_NUMBER];
-static uint8_t serialBufferTX[TX_BUFFER_SIZE][UART_NUMBER];
+static volatile txindex_t serialHeadTX[UART_NUMBER],serialTailTX[UART_NUMBER];
+#if defined(CHIPKIT) && defined(CHIPKIT_DMA_TX)
+  static uint8_t serialBufferTX[UART_NUMBER][TX_BUFFER_SIZE]; // one block per port, read by its DMA channel
+  #define TXBUF(t,port) serialBufferTX[port][t]
+#else
+  static uint8_t serialBufferTX[TX_BUFFER_SIZE][UART_NUMBER];
+  #define TXBUF(t,port) serialBufferTX[t][port]
+#endif
 static uint8_t inBuf[INBUF_SIZE][UART_NUMBER];
 
 #define BIND_CAPABLE 0;  //Used for Spektrum today; can be used in the future for any RX type that needs a bind and has a MultiWii module. 
@@ -87,9 +113,14 @@ const uint32_t capability = 0+BIND_CAPABLE;
 #define MSP_MOTOR_PINS           115   //out message         which pins are in use for motors & servos, for GUI 
 #define MSP_BOXNAMES             116   //out message         the aux switch names
 #define MSP_PIDNAMES             117   //out message         the PID names
-#define MSP_WP                   118   //out message         get a WP, WP# is in the payload, returns (WP#, lat, lon, alt, flags) WP#0-home, WP#16-poshold
+#define MSP_WP                   118   //out message         get a WP, WP# is in the payload, returns (WP#, lat, lon, alt, flags) WP#0-home, WP#16-poshold (255 with GPS_NAV)
 #define MSP_BOXIDS               119   //out message         get the permanent IDs associated to BOXes
 #define MSP_SERVO_CONF           120   //out message         Servo settings
+#define MSP_MIXER_MATRIX         121   //out message         roll, pitch, yaw weights of each motor (int16, 256 = 1)
+#define MSP_BLACKBOX             122   //out message         flight recorder: state, size, used, frames, dropped, ring max/size, log/flush/word us
+#define MSP_BLACKBOX_READ        123   //in/out message      address in, (address, up to 128 bytes of the log) out
+#define MSP_PROFILER             125   //in/out message      stage# in, (stage#, stages, count, min, avg, max, histogram) out; stage# 255 resets
+#define MSP_MULTI                126   //in/out message      several commands in one frame: (cmd, size, payload) in, (cmd, size, reply) out for each answered one
 
 #define MSP_SET_RAW_RC           200   //in message          8 rc chan
 #define MSP_SET_RAW_GPS          201   //in message          fix, numsat, lat, lon, alt, speed
@@ -104,18 +135,41 @@ const uint32_t capability = 0+BIND_CAPABLE;
 #define MSP_SELECT_SETTING       210   //in message          Select Setting Number (0-2)
 #define MSP_SET_HEAD             211   //in message          define a new heading hold direction
 #define MSP_SET_SERVO_CONF       212   //in message          Servo settings
+#define MSP_SET_MIXER_MATRIX     213   //in message          roll, pitch, yaw weights of each motor (int16, 256 = 1), not armed
 #define MSP_SET_MOTOR            214   //in message          PropBalance function
+#define MSP_BLACKBOX_ERASE       215   //in message          erase the flight recorder log, not armed (about 1s)
 
 #define MSP_BIND                 240   //in message          no param
 
+#if defined(GPS_NAV)
+  #define WP_HOLD                255   // WP# of the poshold point in MSP_WP and MSP_SET_WP, 1 to 254 are the mission waypoints
+#else
+  #define WP_HOLD                16
+#endif
+
 #define MSP_EEPROM_WRITE         250   //in message          no param
 
 #define MSP_DEBUGMSG             253   //out message         debug string buffer
 #define MSP_DEBUG                254   //out message         debug1,debug2,debug3,debug4
 
-static uint8_t checksum[UART_NUMBER];
-static uint8_t indRX[UART_NUMBER];
-static uint8_t cmdMSP[UART_NUMBER];
+// MSP v2 frames: $X< flag:8 cmd:16 size:16 payload crc8, answered with $X> or $X!
+static uint8_t checksum[UART_NUMBER];   // xor for v1, crc8 dvb-s2 for v2
+static uint16_t indRX[UART_NUMBER];
+static uint16_t dataSize[UART_NUMBER];
+static uint16_t cmdMSP[UART_NUMBER];
+static uint8_t mspV2[UART_NUMBER];      // the frame being read or answered is a v2 one
+
+// while MSP_MULTI evaluates its commands, their replies go here instead of the TX ring
+static uint8_t mspBatch, mspBatchErr;
+static uint16_t mspBatchLen, mspBatchEnd;  // end of the payload of the command evaluated
+static uint16_t mspBatchMax;               // what the TX ring can take of the reply
+static uint8_t mspBatchBuf[MSP_MULTI_MAX];
+
+#if defined(CHIPKIT) && defined(CHIPKIT_DMA_TX)
+  // serialize8() never waits for the DMA: a reply larger than the free room of the ring is dropped whole
+  static uint8_t txDrop[UART_NUMBER];     // the reply being written is dropped
+  uint16_t serialTxDropped = 0;           // replies and bytes dropped on a full TX ring
+#endif
 
 #if defined(PROMINI)
   #define CURRENTPORT 0
@@ -134,19 +188,54 @@ uint16_t read16() {
   return t;
 }
 uint8_t read8()  {
-  return inBuf[indRX[CURRENTPORT]++][CURRENTPORT]&0xff;
+  uint16_t i = indRX[CURRENTPORT]++;
+  if (mspBatch && i >= mspBatchEnd) return 0; // a command of MSP_MULTI reads its own payload only
+  return i < INBUF_SIZE ? inBuf[i][CURRENTPORT] : 0;
 }
 
-void headSerialResponse(uint8_t err, uint8_t s) {
+uint8_t crc8_dvb_s2(uint8_t crc, uint8_t a) {
+  crc ^= a;
+  for (uint8_t i = 0; i < 8; i++) crc = (crc & 0x80) ? (crc << 1) ^ 0xD5 : crc << 1;
+  return crc;
+}
+
+// free bytes of the TX ring of CURRENTPORT
+static uint16_t serialTxRoom() {
+  return TX_BUFFER_SIZE - 1 - (serialHeadTX[CURRENTPORT]+TX_BUFFER_SIZE-serialTailTX[CURRENTPORT])%TX_BUFFER_SIZE;
+}
+
+void headSerialResponse(uint8_t err, uint16_t s) {
+  if (mspBatch) {            // inside MSP_MULTI: command and size only
+    mspBatchErr |= err;
+    serialize8(cmdMSP[CURRENTPORT]);
+    serialize8(s);
+    return;
+  }
+  #if defined(CHIPKIT) && defined(CHIPKIT_DMA_TX)
+    if (s + (mspV2[CURRENTPORT] ? 9 : 6) > serialTxRoom()) { // header, payload and checksum
+      txDrop[CURRENTPORT] = 1;
+      serialTxDropped++;
+      return;
+    }
+  #endif
   serialize8('$');
-  serialize8('M');
-  serialize8(err ? '!' : '>');
-  checksum[CURRENTPORT] = 0; // start calculating a new checksum
-  serialize8(s);
-  serialize8(cmdMSP[CURRENTPORT]);
+  if (mspV2[CURRENTPORT]) {
+    serialize8('X');
+    serialize8(err ? '!' : '>');
+    checksum[CURRENTPORT] = 0; // start calculating a new checksum
+    serialize8(0);
+    serialize16(cmdMSP[CURRENTPORT]);
+    serialize16(s);
+  } else {
+    serialize8('M');
+    serialize8(err ? '!' : '>');
+    checksum[CURRENTPORT] = 0; // start calculating a new checksum
+    serialize8(s);
+    serialize8(cmdMSP[CURRENTPORT]);
+  }
 }
 
-void headSerialReply(uint8_t s) {
+void headSerialReply(uint16_t s) {
   headSerialResponse(0, s);
 }
 
@@ -155,6 +244,13 @@ void inline headSerialError(uint8_t s) {
 }
 
 void tailSerialReply() {
+  if (mspBatch) return;
+  #if defined(CHIPKIT) && defined(CHIPKIT_DMA_TX)
+    if (txDrop[CURRENTPORT]) {
+      txDrop[CURRENTPORT] = 0;
+      return;
+    }
+  #endif
   serialize8(checksum[CURRENTPORT]);UartSendData();
 }
 
@@ -167,8 +263,7 @@ void serializeNames(PGM_P s) {
 
 void serialCom() {
   uint8_t c,n;  
-  static uint8_t offset[UART_NUMBER];
-  static uint8_t dataSize[UART_NUMBER];
+  static uint16_t offset[UART_NUMBER];
   static enum _serial_state {
     IDLE,
     HEADER_START,
@@ -176,6 +271,8 @@ void serialCom() {
     HEADER_ARROW,
     HEADER_SIZE,
     HEADER_CMD,
+    HEADER_X,
+    HEADER_V2,
   } c_state[UART_NUMBER];// = IDLE;
 //  Serial.println("Start serialCom");
 
@@ -200,8 +297,9 @@ void serialCom() {
       #define SBUS_COND && (SBUS_SERIAL_PORT != CURRENTPORT)
     #endif
     uint8_t cc = SerialAvailable(CURRENTPORT);
+    uint16_t start = cc ? micros() : 0; // MSP_BUDGET_US from here
     while (cc-- GPS_COND SPEK_COND SBUS_COND) {
-      uint8_t bytesTXBuff = ((uint8_t)(serialHeadTX[CURRENTPORT]-serialTailTX[CURRENTPORT]))%TX_BUFFER_SIZE; // indicates the number of occupied bytes in TX buffer
+      uint16_t bytesTXBuff = (serialHeadTX[CURRENTPORT]+TX_BUFFER_SIZE-serialTailTX[CURRENTPORT])%TX_BUFFER_SIZE; // indicates the number of occupied bytes in TX buffer
       if (bytesTXBuff > TX_BUFFER_SIZE - 50 ) return; // ensure there is enough free TX buffer to go further (50 bytes margin)
       c = SerialRead(CURRENTPORT);
       #ifdef SUPPRESS_ALL_SERIAL_MSP
@@ -213,7 +311,7 @@ void serialCom() {
           c_state[CURRENTPORT] = (c=='$') ? HEADER_START : IDLE;
           if (c_state[CURRENTPORT] == IDLE) evaluateOtherData(c); // evaluate all other incoming serial data
         } else if (c_state[CURRENTPORT] == HEADER_START) {
-          c_state[CURRENTPORT] = (c=='M') ? HEADER_M : IDLE;
+          c_state[CURRENTPORT] = (c=='M') ? HEADER_M : (c=='X') ? HEADER_X : IDLE;
         } else if (c_state[CURRENTPORT] == HEADER_M) {
           c_state[CURRENTPORT] = (c=='<') ? HEADER_ARROW : IDLE;
         } else if (c_state[CURRENTPORT] == HEADER_ARROW) {
@@ -225,14 +323,36 @@ void serialCom() {
           offset[CURRENTPORT] = 0;
           checksum[CURRENTPORT] = 0;
           indRX[CURRENTPORT] = 0;
+          mspV2[CURRENTPORT] = 0;
           checksum[CURRENTPORT] ^= c;
           c_state[CURRENTPORT] = HEADER_SIZE;  // the command is to follow
         } else if (c_state[CURRENTPORT] == HEADER_SIZE) {
           cmdMSP[CURRENTPORT] = c;
           checksum[CURRENTPORT] ^= c;
           c_state[CURRENTPORT] = HEADER_CMD;
+        } else if (c_state[CURRENTPORT] == HEADER_X) {
+          c_state[CURRENTPORT] = (c=='<') ? HEADER_V2 : IDLE;
+          offset[CURRENTPORT] = 0;
+          checksum[CURRENTPORT] = 0;
+        } else if (c_state[CURRENTPORT] == HEADER_V2) {  // flag, then command and payload size, little endian
+          checksum[CURRENTPORT] = crc8_dvb_s2(checksum[CURRENTPORT], c);
+          switch (offset[CURRENTPORT]++) {
+            case 1: cmdMSP[CURRENTPORT] = c; break;
+            case 2: cmdMSP[CURRENTPORT] |= c<<8; break;
+            case 3: dataSize[CURRENTPORT] = c; break;
+            case 4:
+              dataSize[CURRENTPORT] |= c<<8;
+              if (dataSize[CURRENTPORT] > INBUF_SIZE) {
+                c_state[CURRENTPORT] = IDLE;
+                continue;
+              }
+              offset[CURRENTPORT] = 0;
+              indRX[CURRENTPORT] = 0;
+              mspV2[CURRENTPORT] = 1;
+              c_state[CURRENTPORT] = HEADER_CMD;
+          }
         } else if (c_state[CURRENTPORT] == HEADER_CMD && offset[CURRENTPORT] < dataSize[CURRENTPORT]) {
-          checksum[CURRENTPORT] ^= c;
+          checksum[CURRENTPORT] = mspV2[CURRENTPORT] ? crc8_dvb_s2(checksum[CURRENTPORT], c) : checksum[CURRENTPORT] ^ c;
           inBuf[offset[CURRENTPORT]++][CURRENTPORT] = c;
         } else if (c_state[CURRENTPORT] == HEADER_CMD && offset[CURRENTPORT] >= dataSize[CURRENTPORT]) {
           if (checksum[CURRENTPORT] == c) {  // compare calculated and transferred checksum
@@ -240,7 +360,7 @@ void serialCom() {
           }
  
           c_state[CURRENTPORT] = IDLE;
-          cc = 0; // no more than one MSP per port and per cycle
+          if ((uint16_t)((uint16_t)micros() - start) >= MSP_BUDGET_US) cc = 0; // the next frames wait for the next cycle
         }
       #endif // SUPPRESS_ALL_SERIAL_MSP
     }
@@ -258,6 +378,45 @@ void s_struct_w(uint8_t *cb,uint8_t siz) {
 }
 
 #ifndef SUPPRESS_ALL_SERIAL_MSP
+// payload read by each in message of evaluateCommand(), 0 for the others: a command of MSP_MULTI
+// is evaluated only when its size is this one, under the same conditions as its case
+static uint16_t mspInSize(uint8_t cmd) {
+  switch(cmd) {
+    case MSP_SET_RAW_RC:       return 16;
+    #if GPS
+    case MSP_SET_RAW_GPS:      return 14;
+    #endif
+    case MSP_SET_PID:          return 3*PIDITEMS;
+    case MSP_SET_BOX:          return CHECKBOXITEMS*2;
+    case MSP_SET_RC_TUNING:    return 7;
+    #if !defined(DISABLE_SETTINGS_TAB)
+    case MSP_SET_MISC:         return 22;
+    #endif
+    #if defined (DYNBALANCE)
+    case MSP_SET_MOTOR:        return 16;
+    #endif
+    #ifdef MULTIPLE_CONFIGURATION_PROFILES
+    case MSP_SELECT_SETTING:   return 1;
+    #endif
+    case MSP_SET_HEAD:         return 2;
+    case MSP_SET_SERVO_CONF:   return 56;
+    #if defined(MOTOR_MIXER)
+    case MSP_SET_MIXER_MATRIX: return 6*NUMBER_MOTOR;
+    #endif
+    #if defined(USE_MSP_WP)
+    case MSP_WP:               return 1;
+    case MSP_SET_WP:           return 18;
+    #endif
+    #if defined(LOOP_PROFILER)
+    case MSP_PROFILER:         return 1;
+    #endif
+    #if defined(BLACKBOX)
+    case MSP_BLACKBOX_READ:    return 4;
+    #endif
+    default:                   return 0;
+  }
+}
+
 void evaluateCommand() {
   uint32_t tmp=0; 
   switch(cmdMSP[CURRENTPORT]) {
@@ -412,6 +571,9 @@ void evaluateCommand() {
      #if GPS
        if(f.GPS_HOME_MODE) tmp |= 1<<BOXGPSHOME; 
        if(f.GPS_HOLD_MODE) tmp |= 1<<BOXGPSHOLD;
+       #if defined(GPS_NAV)
+         if(f.GPS_MISSION_MODE) tmp |= 1<<BOXGPSNAV;
+       #endif
      #endif
      #if defined(FIXEDWING) || defined(HELICOPTER)
        if(f.PASSTHRU_MODE) tmp |= 1<<BOXPASSTHRU;
@@ -458,6 +620,19 @@ void evaluateCommand() {
    case MSP_SET_SERVO_CONF:
      s_struct_w((uint8_t*)&conf.servoConf[0].min,56);
      break;
+   #if defined(MOTOR_MIXER)
+   case MSP_MIXER_MATRIX:
+     s_struct((uint8_t*)&conf.mixer[0].roll,6*NUMBER_MOTOR);
+     break;
+   case MSP_SET_MIXER_MATRIX:
+     if(f.ARMED) {
+       headSerialError(0);
+     } else {
+       s_struct_w((uint8_t*)&conf.mixer[0].roll,6*NUMBER_MOTOR);
+       checkMixer();
+     }
+     break;
+   #endif
    case MSP_MOTOR:
      s_struct((uint8_t*)&motor,16);
      break;
@@ -518,23 +693,35 @@ void evaluateCommand() {
    #if defined(USE_MSP_WP)    
    case MSP_WP:
      {
-       int32_t lat = 0,lon = 0;
+       int32_t lat = 0,lon = 0,alt = AltHold;
+       int16_t heading = 0;
+       uint16_t stay = 0;
+       uint8_t flag = 0;
        uint8_t wp_no = read8();        //get the wp number  
        headSerialReply(18);
        if (wp_no == 0) {
          lat = GPS_home[LAT];
          lon = GPS_home[LON];
-       } else if (wp_no == 16) {
+       } else if (wp_no == WP_HOLD) {
          lat = GPS_hold[LAT];
          lon = GPS_hold[LON];
+       #if defined(GPS_NAV)
+       } else if (recallWP(wp_no)) {   // a waypoint of the mission
+         lat = mission_step.pos[LAT];
+         lon = mission_step.pos[LON];
+         alt = mission_step.altitude;
+         heading = mission_step.heading;
+         stay = mission_step.stay;
+         flag = mission_step.flag;
+       #endif
        }
        serialize8(wp_no);
        serialize32(lat);
        serialize32(lon);
-       serialize32(AltHold);           //altitude (cm) will come here -- temporary implementation to test feature with apps
-       serialize16(0);                 //heading  will come here (deg)
-       serialize16(0);                 //time to stay (ms) will come here 
-       serialize8(0);                  //nav flag will come here
+       serialize32(alt);               //altitude (cm) will come here -- temporary implementation to test feature with apps
+       serialize16(heading);           //heading (deg)
+       serialize16(stay);              //time to stay (ms)
+       serialize8(flag);               //nav flag
      }
      break;
    case MSP_SET_WP:
@@ -544,16 +731,22 @@ void evaluateCommand() {
        lat = read32();
        lon = read32();
        alt = read32();                 // to set altitude (cm)
-       read16();                       // future: to set heading (deg)
-       read16();                       // future: to set time to stay (ms)
-       read8();                        // future: to set nav flag
+       #if defined(GPS_NAV)
+         int16_t heading = read16();   // heading (deg), time to stay (ms) and nav flag of a mission waypoint
+         uint16_t stay = read16();
+         uint8_t flag = read8();
+       #else
+         read16();                     // future: to set heading (deg)
+         read16();                     // future: to set time to stay (ms)
+         read8();                      // future: to set nav flag
+       #endif
        if (wp_no == 0) {
          GPS_home[LAT] = lat;
          GPS_home[LON] = lon;
          f.GPS_HOME_MODE = 0;          // with this flag, GPS_set_next_wp will be called in the next loop -- OK with SERIAL GPS / OK with I2C GPS
          f.GPS_FIX_HOME  = 1;
          if (alt != 0) AltHold = alt;  // temporary implementation to test feature with apps
-       } else if (wp_no == 16) {       // OK with SERIAL GPS  --  NOK for I2C GPS / needs more code dev in order to inject GPS coord inside I2C GPS
+       } else if (wp_no == WP_HOLD) {  // OK with SERIAL GPS  --  NOK for I2C GPS / needs more code dev in order to inject GPS coord inside I2C GPS
          GPS_hold[LAT] = lat;
          GPS_hold[LON] = lon;
          if (alt != 0) AltHold = alt;  // temporary implementation to test feature with apps
@@ -561,6 +754,17 @@ void evaluateCommand() {
            nav_mode      = NAV_MODE_WP;
            GPS_set_next_wp(&GPS_hold[LAT],&GPS_hold[LON]);
          #endif
+       #if defined(GPS_NAV)
+       } else if (!f.ARMED) {          // a waypoint of the mission, read at the next arming
+         mission_step.number = wp_no;
+         mission_step.pos[LAT] = lat;
+         mission_step.pos[LON] = lon;
+         mission_step.altitude = alt;
+         mission_step.heading = heading;
+         mission_step.stay = stay;
+         mission_step.flag = flag;
+         storeWP();
+       #endif
        }
      }
      headSerialReply(0);
@@ -591,6 +795,99 @@ void evaluateCommand() {
    case MSP_DEBUG:
      s_struct((uint8_t*)&debug,8);
      break;
+   #if defined(LOOP_PROFILER)
+   case MSP_PROFILER:
+     {
+       uint8_t s = read8();
+       if (s == 0xFF) {
+         profilerReset();
+         headSerialReply(0);
+       } else if (s < STAGE_ITEMS) {
+         profiler_stage_t *p = &profiler[s];
+         headSerialReply(12+2*PROFILER_BINS);
+         serialize8(s);
+         serialize8(STAGE_ITEMS);
+         serialize32(p->count);
+         serialize16(p->count ? p->min : 0);
+         serialize16(p->count ? p->sum / p->count : 0);
+         serialize16(p->max);
+         for(uint8_t i=0;i<PROFILER_BINS;i++) serialize16(p->bins[i]);
+       } else {
+         headSerialError(0);
+       }
+     }
+     break;
+   #endif
+   #if defined(BLACKBOX)
+   case MSP_BLACKBOX:
+     headSerialReply(27);
+     serialize8(blackbox.state);
+     serialize32(blackboxSize());
+     serialize32(blackbox.used);
+     serialize32(blackbox.frames);
+     serialize32(blackbox.dropped);
+     serialize16(blackbox.ringMax);
+     serialize16(BLACKBOX_RING);
+     serialize16(blackbox.logMax);
+     serialize16(blackbox.flushMax);
+     serialize16(blackbox.wordCost);
+     break;
+   case MSP_BLACKBOX_READ:
+     {
+       uint32_t address = read32();
+       uint8_t buf[128], n = blackboxRead(address, buf, sizeof(buf));
+       headSerialReply(4+n);
+       serialize32(address);
+       for(uint8_t i=0;i<n;i++) serialize8(buf[i]);
+     }
+     break;
+   case MSP_BLACKBOX_ERASE:
+     if(f.ARMED) {
+       headSerialError(0);
+     } else {
+       blackboxErase();
+       headSerialReply(0);
+     }
+     break;
+   #endif
+   case MSP_MULTI:
+     if (mspBatch) {                 // not nested
+       headSerialError(0);
+       break;
+     }
+     {
+       uint16_t cmd = cmdMSP[CURRENTPORT], len, size;
+       mspBatch = 1;
+       mspBatchLen = 0;
+       mspBatchMax = MSP_MULTI_MAX;
+       #if defined(CHIPKIT) && defined(CHIPKIT_DMA_TX)
+         // the replies that fit the ring now, the configurator asks again for the others
+         if (serialTxRoom() < MSP_MULTI_MAX + 9) mspBatchMax = serialTxRoom() > 9 ? serialTxRoom() - 9 : 0;
+       #endif
+       while (dataSize[CURRENTPORT] - indRX[CURRENTPORT] >= 2) { // each command: cmd, size, payload
+         mspBatchEnd = dataSize[CURRENTPORT];
+         cmdMSP[CURRENTPORT] = read8();
+         size = read8();
+         if (size > dataSize[CURRENTPORT] - indRX[CURRENTPORT]) break; // truncated: stop there
+         mspBatchEnd = indRX[CURRENTPORT] + size;
+         if (cmdMSP[CURRENTPORT] != MSP_MULTI && size == mspInSize(cmdMSP[CURRENTPORT])) {
+           len = mspBatchLen;
+           mspBatchErr = 0;
+           evaluateCommand();
+           if (mspBatchLen > mspBatchMax) {             // no room: stop there
+             mspBatchLen = len;
+             break;
+           }
+           if (mspBatchErr || indRX[CURRENTPORT] != mspBatchEnd) mspBatchLen = len; // the unknown commands are left out
+         }
+         indRX[CURRENTPORT] = mspBatchEnd;              // the next command, whatever this one read
+       }
+       mspBatch = 0;
+       cmdMSP[CURRENTPORT] = cmd;
+       headSerialReply(mspBatchLen);
+       for (len = 0; len < mspBatchLen; len++) serialize8(mspBatchBuf[len]);
+     }
+     break;
    #ifdef DEBUGMSG
    case MSP_DEBUGMSG:
      {
@@ -699,22 +996,185 @@ void serialize16(int16_t a) {
 }
 
 void serialize8(uint8_t a) {
-  uint8_t t = serialHeadTX[CURRENTPORT];
+  if (mspBatch) {
+    if (mspBatchLen < MSP_MULTI_MAX) mspBatchBuf[mspBatchLen] = a;
+    mspBatchLen++;
+    return;
+  }
+  #if defined(CHIPKIT) && defined(CHIPKIT_DMA_TX)
+    if (txDrop[CURRENTPORT]) return;
+  #endif
+  txindex_t t = serialHeadTX[CURRENTPORT];
   if (++t >= TX_BUFFER_SIZE) t = 0;
-  serialBufferTX[t][CURRENTPORT] = a;
-  checksum[CURRENTPORT] ^= a;
+  #if defined(CHIPKIT) && defined(CHIPKIT_DMA_TX)
+    if (t == serialTailTX[CURRENTPORT]) { // ring full, only SerialWrite() gets here: the byte is dropped
+      serialTxDropped++;
+      return;
+    }
+  #endif
+  TXBUF(t,CURRENTPORT) = a;
+  checksum[CURRENTPORT] = mspV2[CURRENTPORT] ? crc8_dvb_s2(checksum[CURRENTPORT], a) : checksum[CURRENTPORT] ^ a;
   serialHeadTX[CURRENTPORT] = t;
 }
 
 #if defined(CHIPKIT) //EDH
-  void UartSendData() {
-        while(serialHeadTX[0] != serialTailTX[0]) {
-           if (++serialTailTX[0] >= TX_BUFFER_SIZE) serialTailTX[0] = 0;
-           Serial.write(serialBufferTX[serialTailTX[0]][0]);
-         }    
+  // MultiWii port n is the chipKIT Serial n; Serial2 and Serial3 only exist on the MAX32
+  HardwareSerial *chipkitSerial(uint8_t port) {
+    switch (port) {
+      case 1: return &Serial1;
+      #if defined(_BOARD_MEGA_)
+        case 2: return &Serial2;
+        case 3: return &Serial3;
+      #endif
+    }
+    return &Serial;
   }
+
+  #if defined(CHIPKIT_DMA_TX)
+    // The UART vectors belong to the core, whose handler drops the transmit interrupt. The transmit interrupt
+    // is used as the start event of a DMA channel instead: port n is sent by channel n, one byte each time
+    // the UART raises it, that is while its FIFO has room (UTXISEL 00, left so by the core). The block
+    // complete interrupt of the channel plays the part of the AVR UDRE handlers: it moves the tail and
+    // starts the next block, or leaves the channel off when the ring is empty. CHECKSUM takes channel 7.
+    // UART of each MultiWii port, the MAX32 wiring of the core: Serial on UART1, Serial1 on UART4,
+    // Serial2 on UART3, Serial3 on UART2
+    #if !defined(CHIPKIT_SERIAL0_UART)
+      #define CHIPKIT_SERIAL0_UART 1
+    #endif
+    #if !defined(CHIPKIT_SERIAL1_UART)
+      #if defined(_BOARD_MEGA_)
+        #define CHIPKIT_SERIAL1_UART 4
+      #else
+        #define CHIPKIT_SERIAL1_UART 2
+      #endif
+    #endif
+    #if !defined(CHIPKIT_SERIAL2_UART)
+      #define CHIPKIT_SERIAL2_UART 3
+    #endif
+    #if !defined(CHIPKIT_SERIAL3_UART)
+      #define CHIPKIT_SERIAL3_UART 2
+    #endif
+    #define UART_CAT(a, b, c)   a##b##c
+    #define UART_XCAT(a, b, c)  UART_CAT(a, b, c)
+    #define UART_TXREG(n)       UART_XCAT(U, n, TXREG)
+    #define UART_TXIRQ(n)       UART_XCAT(_UART, n, _TX_IRQ)
+
+    #define TX_DMA_BLOCK 32   // bytes per DMA block: the tail moves every 32 bytes, 2.8ms at 115200
+    #define TX_DMA_IPL   3    // must match the ipl of the handlers below
+
+    // registers of one DMA channel, each one followed by its CLR SET INV
+    typedef struct {
+      p32_regset con, econ, intr, ssa, dsa, ssiz, dsiz, sptr, dptr, csiz, cptr, dat;
+    } dma_channel;
+    #define TX_DMA(port) ((dma_channel *)&DCH0CON + (port))
+
+    static volatile uint8_t txDMARun[UART_NUMBER]; // bytes of the block being sent, 0: channel off
+
+    // ifs, iec and ipc registers are consecutive p32_regset: the one of an irq is at irq/32, of a vector at vector/4
+    #define TX_DMA_IRQ_BIT(port)  (1UL << ((_DMA0_IRQ + (port)) & 31))
+    #define TX_DMA_IFS(port)      (((p32_regset *)&IFS0) + ((_DMA0_IRQ + (port)) >> 5))
+    #define TX_DMA_IEC(port)      (((p32_regset *)&IEC0) + ((_DMA0_IRQ + (port)) >> 5))
+
+    // start the next block of the ring, the channel being off
+    static void SerialTXStart(uint8_t port) {
+      dma_channel *dma = TX_DMA(port);
+      txindex_t t = serialTailTX[port];
+      uint16_t n = (serialHeadTX[port] + TX_BUFFER_SIZE - t) % TX_BUFFER_SIZE;
+      if (++t >= TX_BUFFER_SIZE) t = 0;
+      if (n > TX_BUFFER_SIZE - t) n = TX_BUFFER_SIZE - t; // up to the end of the ring
+      if (n > TX_DMA_BLOCK) n = TX_DMA_BLOCK;
+      txDMARun[port] = n;
+      if (n == 0) return;
+      dma->ssa.reg  = KVA_TO_PA(&TXBUF(t,port));
+      dma->ssiz.reg = n;
+      dma->con.set  = _DCH0CON_CHEN_MASK;
+    }
+
+    static void SerialTXDone(uint8_t port) {
+      TX_DMA(port)->intr.clr = _DCH0INT_CHBCIF_MASK;
+      TX_DMA_IFS(port)->clr = TX_DMA_IRQ_BIT(port);
+      uint16_t t = serialTailTX[port] + txDMARun[port];
+      serialTailTX[port] = t % TX_BUFFER_SIZE;
+      SerialTXStart(port);
+    }
+
+    extern "C" {
+      void __ISR(_DMA_0_VECTOR, ipl3) SerialTX0_Handler(void) { SerialTXDone(0); }
+      void __ISR(_DMA_1_VECTOR, ipl3) SerialTX1_Handler(void) { SerialTXDone(1); }
+      void __ISR(_DMA_2_VECTOR, ipl3) SerialTX2_Handler(void) { SerialTXDone(2); }
+      void __ISR(_DMA_3_VECTOR, ipl3) SerialTX3_Handler(void) { SerialTXDone(3); }
+    }
+
+    static void SerialTXKick(uint8_t port) {
+      p32_regset *iec = TX_DMA_IEC(port);
+      iec->clr = TX_DMA_IRQ_BIT(port);  // the handler also starts blocks
+      if (txDMARun[port] == 0) SerialTXStart(port);
+      iec->set = TX_DMA_IRQ_BIT(port);
+    }
+
+    void UartSendData() {
+      SerialTXKick(CURRENTPORT);
+    }
+
+    static void SerialTXStop(uint8_t port) {
+      TX_DMA_IEC(port)->clr = TX_DMA_IRQ_BIT(port);
+      TX_DMA(port)->con.clr = _DCH0CON_CHEN_MASK;
+      txDMARun[port] = 0;
+    }
+
+    // the channel of the port, started by the transmit interrupt flag of its UART
+    static void SerialTXOpen(uint8_t port) {
+      volatile void *txreg;
+      uint8_t irq;
+      switch (port) {
+        case 1:  txreg = &UART_TXREG(CHIPKIT_SERIAL1_UART); irq = UART_TXIRQ(CHIPKIT_SERIAL1_UART); break;
+        #if defined(_BOARD_MEGA_)
+          case 2:  txreg = &UART_TXREG(CHIPKIT_SERIAL2_UART); irq = UART_TXIRQ(CHIPKIT_SERIAL2_UART); break;
+          case 3:  txreg = &UART_TXREG(CHIPKIT_SERIAL3_UART); irq = UART_TXIRQ(CHIPKIT_SERIAL3_UART); break;
+        #endif
+        default: txreg = &UART_TXREG(CHIPKIT_SERIAL0_UART); irq = UART_TXIRQ(CHIPKIT_SERIAL0_UART);
+      }
+      dma_channel *dma = TX_DMA(port);
+      p32_regset *ipc = ((p32_regset *)&IPC0) + ((_DMA_0_VECTOR + port) >> 2);
+      uint8_t shift = 8 * ((_DMA_0_VECTOR + port) & 3);
+
+      SerialTXStop(port);
+      DMACONSET = _DMACON_ON_MASK;
+      dma->econ.reg = ((uint32_t)irq << _DCH0ECON_CHSIRQ_POSITION) | _DCH0ECON_SIRQEN_MASK;
+      dma->dsa.reg  = KVA_TO_PA(txreg);
+      dma->dsiz.reg = 1;
+      dma->csiz.reg = 1;                     // one byte per transmit interrupt
+      dma->intr.reg = _DCH0INT_CHBCIE_MASK;  // block complete
+      ipc->clr = 0x1F << shift;
+      ipc->set = (TX_DMA_IPL << 2) << shift;
+      TX_DMA_IFS(port)->clr = TX_DMA_IRQ_BIT(port);
+      SerialTXKick(port);                    // what was left in the ring goes at the new speed
+    }
+  #else
+    void UartSendData() {
+          HardwareSerial *uart = chipkitSerial(CURRENTPORT);
+          while(serialHeadTX[CURRENTPORT] != serialTailTX[CURRENTPORT]) {
+             if (++serialTailTX[CURRENTPORT] >= TX_BUFFER_SIZE) serialTailTX[CURRENTPORT] = 0;
+             uart->write(TXBUF(serialTailTX[CURRENTPORT],CURRENTPORT));
+           }    
+    }
+  #endif
+  #if defined(GPS_SERIAL)
+    bool SerialTXfree(uint8_t port) {
+      return (serialHeadTX[port] == serialTailTX[port]);
+    }
+  #endif
   void SerialOpen(uint8_t port, uint32_t baud) {
-  	if (port == 0) Serial.begin(baud); // initialize serial port
+  	chipkitSerial(port)->begin(baud); // initialize serial port
+    #if defined(CHIPKIT_DMA_TX)
+      SerialTXOpen(port);
+    #endif
+  }
+  void SerialEnd(uint8_t port) {
+    #if defined(CHIPKIT_DMA_TX)
+      SerialTXStop(port);
+    #endif
+  	chipkitSerial(port)->end();
   }
 #else
 
@@ -884,8 +1344,7 @@ void store_uart_in_buf(uint8_t data, uint8_t portnum) {
 
 uint8_t SerialRead(uint8_t port) {
   #if defined(CHIPKIT) //EDH
-       if (port == 0) return Serial.read();
-       else return 0;
+       return chipkitSerial(port)->read();
   #endif     
   #if defined(PROMICRO)
     #if defined(TEENSY20)
@@ -906,6 +1365,31 @@ uint8_t SerialRead(uint8_t port) {
   return c;
 }
 
+// copies up to size received bytes of port to buf, for the parsers taking them by blocks:
+// the ring interleaves the ports, one pass here leaves them contiguous
+uint8_t SerialReadBuf(uint8_t port, uint8_t *buf, uint8_t size) {
+  uint8_t n = 0;
+  #if defined(CHIPKIT)
+    HardwareSerial *uart = chipkitSerial(port);
+    while (n < size && uart->available()) buf[n++] = uart->read();
+  #else
+    #if defined(PROMICRO)
+      if(port == 0) {
+        while (n < size && SerialAvailable(0)) buf[n++] = SerialRead(0);
+        return n;
+      }
+    #endif
+    uint8_t t = serialTailRX[port];
+    uint8_t h = serialHeadRX[port];
+    while (n < size && t != h) {
+      buf[n++] = serialBufferRX[t][port];
+      if (++t >= RX_BUFFER_SIZE) t = 0;
+    }
+    serialTailRX[port] = t;
+  #endif
+  return n;
+}
+
 #if defined(SPEKTRUM)
   uint8_t SerialPeek(uint8_t port) {
     uint8_t c = serialBufferRX[serialTailRX[port]][port];
@@ -915,7 +1399,7 @@ uint8_t SerialRead(uint8_t port) {
 
 uint8_t SerialAvailable(uint8_t port) {
 #if defined(CHIPKIT) //EDH
-   return (uint8_t)Serial.available();
+   return (uint8_t)chipkitSerial(port)->available();
 #endif
   #if defined(PROMICRO)
     #if !defined(TEENSY20)
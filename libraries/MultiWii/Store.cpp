@@ -0,0 +1,213 @@
+#if defined(ARDUINO) && ARDUINO >= 100
+#include "Arduino.h"
+#else
+#include "WProgram.h"
+#endif
+
+#include "config.h"
+#include "def.h"
+#include "types.h"
+#include "Store.h"
+
+#if defined(CHIPKIT)
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+#include <peripheral/nvm.h>
+#ifdef __cplusplus
+}
+#endif
+
+/*
+  Record store in the NVM pages of Deeprom.cpp, used instead of its byte emulation: a whole struct is
+  written in one record, found again through a RAM index instead of a scan of the pages.
+
+  The pages are a ring written in order. A page starts with STORE_MAGIC, its sequence number and the
+  complement of it, then holds records:
+    key | size << 12 | check << 24    header word, check: CRC-16/CCITT of key and size, low byte
+    data                              size bytes in (size + 3) / 4 words, 0xFF padded
+    crc << 16 | ~crc                  CRC-16/CCITT of the header and the data, written last
+  A write appends a record to the head page and the index then points at it. A record cut by a power
+  loss fails its CRC and the previous record of its key stays the value; the boot scan goes on with
+  the next word that starts a valid record, and the head page with the word after the last one
+  written, the commit word of a complete record never being erased flash. When the head page is full,
+  the next page, always erased, becomes the head, and the latest records still in the page after it
+  (the oldest) are copied to the head before it is erased, so that an erased page is always ahead:
+  the pages are erased in turn, and a copy cut by a power loss is finished at the next boot.
+*/
+
+#define STORE_PAGES  _EEPROM_PAGE_COUNT
+#define STORE_WORDS  _EEPROM_PAGE_SIZE            // words of a page
+#define STORE_MAGIC  0x3153574DUL                 // "MWS1"
+#define STORE_HEADER 3                            // magic, sequence, ~sequence
+#define STORE_NONE   0                            // index of a key without record: a page header word
+#define RECORD_WORDS(size) (2 + ((size) + 3) / 4)
+#define RECORD_KEY(h)  ((h) & 0xFFF)
+#define RECORD_SIZE(h) (((h) >> 12) & 0xFFF)
+
+#if STORE_PAGES < 3
+  #error "the flash store needs 3 NVM pages: one being written, one erased ahead and one for the copies"
+#endif
+
+extern unsigned int eedata_addr[_EEPROM_PAGE_COUNT][1024];   // Deeprom.cpp
+#define FLASH(at) ((&eedata_addr[0][0])[at])                  // word at of the pages
+
+store_t store;
+
+static uint16_t storeIndex[STORE_KEYS];           // first word of the latest record of each key
+static uint16_t storeNext;                        // next word written, in the head page
+static uint8_t  storeHead;
+
+static uint16_t crc16(uint16_t crc, const uint8_t *p, uint16_t n) {
+  while (n--) {
+    crc ^= (uint16_t)*p++ << 8;
+    for (uint8_t i = 0; i < 8; i++) crc = crc & 0x8000 ? (crc << 1) ^ 0x1021 : crc << 1;
+  }
+  return crc;
+}
+
+static uint32_t commitWord(uint16_t crc) {
+  return (uint32_t)crc << 16 | (uint16_t)~crc;
+}
+
+static uint32_t headerWord(uint16_t key, uint16_t size) {
+  uint32_t h = key | (uint32_t)size << 12;
+  return h | (uint32_t)(uint8_t)crc16(0xFFFF, (const uint8_t *)&h, 3) << 24;
+}
+
+static uint8_t pageValid(uint8_t p) {
+  uint16_t at = p * STORE_WORDS;
+  return FLASH(at) == STORE_MAGIC && FLASH(at + 1) == ~FLASH(at + 2);
+}
+
+static uint8_t pageErased(uint8_t p) {
+  for (uint16_t at = p * STORE_WORDS; at < (p + 1) * STORE_WORDS; at++)
+    if (FLASH(at) != 0xFFFFFFFF) return 0;
+  return 1;
+}
+
+static void erasePage(uint8_t p) {
+  if (!pageErased(p)) NVMErasePage((void *)&eedata_addr[p][0]);
+}
+
+// the sequence words first: a page cut before its magic is not valid, and erased at the next boot
+static void openPage(uint8_t p) {
+  uint16_t at = p * STORE_WORDS;
+  store.sequence++;
+  NVMWriteWord((void *)&FLASH(at + 1), store.sequence);
+  NVMWriteWord((void *)&FLASH(at + 2), ~store.sequence);
+  NVMWriteWord((void *)&FLASH(at), STORE_MAGIC);
+  storeHead = p;
+  storeNext = at + STORE_HEADER;
+}
+
+// a record at the end of the head page, which has room for it: index of the record
+static uint16_t append(uint16_t key, const uint8_t *src, uint16_t size) {
+  uint16_t at = storeNext, w = at;
+  uint32_t header = headerWord(key, size), d;
+  uint16_t crc = crc16(crc16(0xFFFF, (const uint8_t *)&header, 4), src, size);
+
+  NVMWriteWord((void *)&FLASH(w++), header);
+  for (uint16_t i = 0; i < size; i += 4) {
+    d = 0xFFFFFFFF;
+    memcpy(&d, src + i, min(size - i, 4));
+    NVMWriteWord((void *)&FLASH(w++), d);
+  }
+  NVMWriteWord((void *)&FLASH(w++), commitWord(crc));
+  storeNext = w;
+  return at;
+}
+
+// the latest records of the page after the head go to the head, then that page is erased
+static void reclaim() {
+  uint8_t old = (storeHead + 1) % STORE_PAGES;
+  for (uint16_t k = 0; k < STORE_KEYS; k++) {
+    uint16_t at = storeIndex[k];
+    if (at != STORE_NONE && at / STORE_WORDS == old)
+      storeIndex[k] = append(k, (const uint8_t *)&FLASH(at + 1), RECORD_SIZE(FLASH(at)));
+  }
+  erasePage(old);
+}
+
+// words of the complete record at word at, ending before word end; 0 when there is none
+static uint16_t recordWords(uint16_t at, uint16_t end) {
+  uint32_t h = FLASH(at);
+  uint16_t size = RECORD_SIZE(h), n = RECORD_WORDS(size);
+  if (h != headerWord(RECORD_KEY(h), size) || RECORD_KEY(h) >= STORE_KEYS || at + n > end) return 0;
+  uint16_t crc = crc16(0xFFFF, (const uint8_t *)&FLASH(at), 4 + size);
+  return FLASH(at + n - 1) == commitWord(crc) ? n : 0;
+}
+
+// word after the last one written in page p
+static uint16_t pageEnd(uint8_t p) {
+  uint16_t at = (p + 1) * STORE_WORDS;
+  while (at > p * STORE_WORDS + STORE_HEADER && FLASH(at - 1) == 0xFFFFFFFF) at--;
+  return at;
+}
+
+void storeInit() {
+  uint8_t order[STORE_PAGES], pages = 0, p, i;
+  uint16_t at, end, n, k;
+
+  memset(storeIndex, 0, sizeof(storeIndex));
+  store.sequence = 0;
+  for (p = 0; p < STORE_PAGES; p++) {             // the valid pages by sequence, the others erased
+    if (pageValid(p)) {
+      for (i = pages++; i > 0 && FLASH(order[i - 1] * STORE_WORDS + 1) > FLASH(p * STORE_WORDS + 1); i--) order[i] = order[i - 1];
+      order[i] = p;
+    } else {
+      erasePage(p);                               // the Deeprom layout before, or an erase cut by a power loss
+    }
+  }
+  for (i = 0; i < pages; i++) {                   // oldest first: a later record of a key replaces the index
+    p = order[i];
+    end = pageEnd(p);
+    for (at = p * STORE_WORDS + STORE_HEADER; at < end; at += n ? n : 1) {
+      if ((n = recordWords(at, end))) storeIndex[RECORD_KEY(FLASH(at))] = at;
+    }
+    storeHead = p;
+    storeNext = end;
+    store.sequence = FLASH(p * STORE_WORDS + 1);
+  }
+  if (!pages) openPage(0);
+  reclaim();                                      // a copy cut by a power loss ends here
+  store.live = 0;
+  for (k = 0; k < STORE_KEYS; k++)
+    if (storeIndex[k] != STORE_NONE) store.live += 4 * RECORD_WORDS(RECORD_SIZE(FLASH(storeIndex[k])));
+  store.capacity = (STORE_PAGES - 2) * (STORE_WORDS - STORE_HEADER) * 4;
+}
+
+// a missing record reads as an erased eeprom: 0xFF, which fails the checksum of the structs
+uint16_t storeRead(uint16_t key, void *dst, uint16_t size) {
+  uint16_t at = key < STORE_KEYS ? storeIndex[key] : STORE_NONE, n = 0;
+  if (at != STORE_NONE) {
+    n = min(RECORD_SIZE(FLASH(at)), size);
+    memcpy(dst, (const uint8_t *)&FLASH(at + 1), n);
+  }
+  memset((uint8_t *)dst + n, 0xFF, size - n);
+  return n;
+}
+
+// 1 when the record is in flash; an unchanged value is not written again
+uint8_t storeWrite(uint16_t key, const void *src, uint16_t size) {
+  uint16_t words = RECORD_WORDS(size), at, before = 0;
+
+  if (key >= STORE_KEYS || words > (STORE_WORDS - STORE_HEADER) / 2) return 0; // half a page: the copies always find room
+  at = storeIndex[key];
+  if (at != STORE_NONE) {
+    if (RECORD_SIZE(FLASH(at)) == size && !memcmp((const uint8_t *)&FLASH(at + 1), src, size)) return 1;
+    before = 4 * RECORD_WORDS(RECORD_SIZE(FLASH(at)));
+  }
+  if (store.live - before + 4 * words > store.capacity) return 0;
+  for (uint8_t turns = 0; storeNext + words > (storeHead + 1) * STORE_WORDS; turns++) {
+    if (turns == 2 * STORE_PAGES) return 0;
+    openPage((storeHead + 1) % STORE_PAGES);
+    reclaim();
+  }
+  storeIndex[key] = append(key, (const uint8_t *)src, size);
+  store.live += 4 * words - before;
+  return 1;
+}
+
+#endif
@@ -0,0 +1,23 @@
+#ifndef STORE_H_
+#define STORE_H_
+
+// keys of the records of the flash store (CHIPKIT), the latest record of a key is its value
+#define STORE_GLOBAL 0              // global_conf
+#define STORE_CONF   1              // conf, one per profile: STORE_CONF + currentSet
+#define STORE_PLOG   4              // plog
+#define STORE_WP     5              // mission_step, one per waypoint: STORE_WP + number
+#define STORE_KEYS   (STORE_WP + 255)
+
+typedef struct {
+  uint32_t sequence;  // pages opened since the store was created: each page is erased about sequence/pages times
+  uint16_t live;      // bytes of flash held by the latest records
+  uint16_t capacity;  // most live bytes the store accepts
+} store_t;
+
+extern store_t store;
+
+void storeInit();
+uint16_t storeRead(uint16_t key, void *dst, uint16_t size);
+uint8_t storeWrite(uint16_t key, const void *src, uint16_t size);
+
+#endif /* STORE_H_ */
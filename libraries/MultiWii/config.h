@@ -8,6 +8,11 @@
 
 #define  CHIPKIT   //EDH
 
+/*************************************************************************************************/
+/*****  SITL: the CHIPKIT build above can also be compiled on a PC with -DSITL, against       ****/
+/****  simulated sensors, RC, GPS and a quad model instead of the board (see SITL/ReadMe.txt)  ****/
+/*************************************************************************************************/
+
 
 /*************************************************************************************************/
 /****           CONFIGURABLE PARAMETERS                                                       ****/
@@ -45,7 +50,9 @@
     //#define BI
     //#define TRI
     //#define QUADP
+    #if !defined(SITL_FRAME) // the SITL mixer check (-x) sets the frame on the command line
     #define QUADX//EDH
+    #endif
     //#define Y4
     //#define Y6
     //#define HEX6
@@ -61,6 +68,8 @@
     //#define DUALCOPTER
     //#define HELI_120_CCPM
     //#define HELI_90_DEG
+    /* the multirotor frames mix by the weights of Output.cpp in 1/256: TRI and Y6 (4/3, 2/3) and OCTOFLATP (7/10)
+       are off by at most 1/768 of the PID, HEX6 HEX6X OCTOFLATX (7/8, 1/2) and the others are exact */
 
   /****************************    Motor minthrottle    *******************************/
     /* Set the minimum throttle command sent to the ESC (Electronic Speed Controller)
@@ -184,6 +193,9 @@
       /* I2C barometer */
       //#define BMP085
       //#define MS561101BA
+      #if defined(SITL)
+        #define MS561101BA  // the simulated board is a 10DOF MPU6050 + MS561101BA
+      #endif
 
       /* I2C magnetometer */
       //#define HMC5843
@@ -227,6 +239,16 @@
      * */
     #define PID_CONTROLLER 1
 
+  /********************************  Attitude estimator  *******************************/
+    /* choose the roll/pitch estimator of IMU.cpp
+     * 1 = complementary filter on the gravity vector, small angle rotation (v2.3)
+     * 2 = Mahony quaternion filter, float
+     * 3 = Mahony quaternion filter, fixed point (Q30) for the targets without FPU like the PIC32
+     * */
+    #if !defined(ATTITUDE_ESTIMATOR) // can be set on the command line by the SITL benchmark
+      #define ATTITUDE_ESTIMATOR 1
+    #endif
+
     /* NEW: not used anymore for servo coptertypes  <== NEEDS FIXING - MOVE TO WIKI */
     #define YAW_DIRECTION 1
     //#define YAW_DIRECTION -1 // if you want to reverse the yaw correction direction
@@ -460,6 +482,19 @@
     #define SERIAL2_COM_SPEED 115200
     #define SERIAL3_COM_SPEED 115200
 
+    /* serialCom() answers the complete MSP frames waiting on a port until this time in micro seconds is spent,
+       the first frame of each port always runs. 0 gives the former one frame per port and per loop */
+    #if !defined(MSP_BUDGET_US) // can be set on the command line by the SITL benchmark
+      #define MSP_BUDGET_US 1000
+    #endif
+
+    /* CHIPKIT: the replies leave the TX ring on the DMA channels 0 to 3 (one per port), started by the UART
+       transmit interrupt, so that no loop waits for the UART. Comment it to write them with the blocking
+       Serial.write() of the core, when these channels are needed elsewhere */
+    #if !defined(CHIPKIT_BLOCKING_TX) // can be set on the command line by the SITL benchmark
+      #define CHIPKIT_DMA_TX
+    #endif
+
     /* interleaving delay in micro seconds between 2 readings WMP/NK in a WMP+NK config
        if the ACC calibration time is very long (20 or 30s), try to increase this delay up to 4000
        it is relevent only for a conf with NK */
@@ -509,6 +544,20 @@
     /************************    Moving Average Gyros    **********************************/
       //#define MMGYRO 10                      // (*) Active Moving Average Function for Gyros
       //#define MMGYROVECTORLENGTH 15          // Length of Moving Average Vector (maximum value for tunable MMGYRO
+
+    /************************    Gyro filters    **********************************/
+      /* Biquad filters on each gyro sample in GYRO_Common(), designed for the average time between two samples
+         (two per loop, about 700Hz at a 2.8ms cycle): keep every frequency under half of that rate.
+         GYRO_LPF_HZ: a Butterworth low pass. computeIMU then takes the last filtered sample instead of its
+         weighted blend of the last three reads.
+         GYRO_NOTCH_HZ: a notch at a fixed frequency, GYRO_NOTCH_CUTOFF_HZ is its lower -3dB edge.
+         GYRO_DYN_NOTCH: a notch that follows the strongest noise peak of roll and pitch between two frequencies
+         (motor and prop noise moves with the throttle), searched every 32 samples by a bank of Goertzel filters.
+         Retune the D terms after a change, the low pass delays the gyro. */
+      //#define GYRO_LPF_HZ 90
+      //#define GYRO_NOTCH_HZ 200
+      //#define GYRO_NOTCH_CUTOFF_HZ 150
+      //#define GYRO_DYN_NOTCH {80, 300}       // range of the dynamic notch in Hz
       /* Moving Average ServoGimbal Signal Output */
       //#define MMSERVOGIMBAL                  // Active Output Moving Average Function for Servos Gimbal
       //#define MMSERVOGIMBALVECTORLENGHT 32   // Lenght of Moving Average Vector
@@ -620,6 +669,17 @@
        +/-40 uncommend and change the value below if you want to change it. */
     //#define ALT_HOLD_THROTTLE_NEUTRAL_ZONE 40 
 
+    /* RC smoothing, instead of the average of the last 4 reads at 50Hz with a +/-3 hysteresis (about 60ms behind
+       the sticks): computeRC runs every loop, takes each frame of the receiver once it is whole, at the time the
+       RX interrupt saw it, and filters each channel up to the loop rate with one of:
+         RC_FILTER_NONE    the last frame as is, steps of one frame
+         RC_FILTER_PT1     first order low pass at RC_FILTER_HZ
+         RC_FILTER_BIQUAD  second order low pass (Butterworth) at RC_FILTER_HZ
+         RC_FILTER_INTERP  a ramp from where the channel is to the new frame over one frame interval
+       the list is in the order of rcData: ROLL, PITCH, YAW, THROTTLE, AUX1...; the channels not in it are NONE. */
+    //#define RC_FILTER {RC_FILTER_INTERP, RC_FILTER_INTERP, RC_FILTER_INTERP, RC_FILTER_PT1}
+    #define RC_FILTER_HZ 30
+
 
   /**************************************************************************************/
   /***********************                  GPS                **************************/
@@ -632,6 +692,9 @@
        at least 5Hz update rate. uncomment the first line to select the GPS serial port of the arduino */
        
     //#define GPS_SERIAL 2         // should be 2 for flyduino v2. It's the serial port number on arduino MEGA
+    #if defined(SITL)
+      #define GPS_SERIAL 1         // simulated NMEA GPS on Serial1
+    #endif
     //#define GPS_PROMINI_SERIAL   // Will Autosense if GPS is connected when ardu boots.
 
     // avoid using 115200 baud because with 16MHz arduino the 115200 baudrate have more than 2% speed error (57600 have 0.8% error)
@@ -639,17 +702,26 @@
 
    /* GPS protocol 
        NMEA  - Standard NMEA protocol GGA, GSA and RMC  sentences are needed
+               (GGA RMC GSA VTG are decoded, from any talker: GP GN GL...; a fix is a GGA)
        UBLOX - U-Blox binary protocol, use the ublox config file (u-blox-config.ublox.txt) from the source tree 
        MTK_BINARY16 and MTK_BINARY19 - MTK3329 chipset based GPS with DIYDrones binary firmware (v1.6 or v1.9)
        With UBLOX and MTK_BINARY you don't have to use GPS_FILTERING in multiwii code !!! */
 
     
     //#define NMEA
+    #if defined(SITL) && !defined(UBLOX)
+      #define NMEA                 // -DUBLOX builds the simulator with a NAV-PVT receiver
+    #endif
     //#define UBLOX
+    //#define UBLOX_PVT           // u-blox 7 and later: one NAV-PVT message per fix instead of POSLLH, SOL and VELNED
     //#define MTK_BINARY16
     //#define MTK_BINARY19
     //#define INIT_MTK_GPS        // initialize MTK GPS for using selected speed, 5Hz update rate and GGA & RMC sentence or binary settings
 
+    /* 10Hz fixes instead of 5Hz: UBLOX and INIT_MTK_GPS set the receiver rate to 100ms, a NMEA receiver
+       must be set to it beforehand. GGA RMC GSA and VTG are about 2400 bytes/s at 10Hz: GPS_BAUD 38400 or more */
+    //#define GPS_10HZ
+
     
     /* I2C GPS device made with an independant arduino + GPS device
        including some navigation functions
@@ -696,6 +768,12 @@
     
     //#define GPS_FILTERING                        // add a 5 element moving average filter to GPS coordinates, helps eliminate gps noise but adds latency comment out to disable
     #define GPS_WP_RADIUS              200       // if we are within this distance to a waypoint then we consider it reached (distance is in cm)
+
+    /* Waypoint missions flown with the MISSION box: waypoints 1 to 254 written with MSP_SET_WP (the poshold point
+       becomes WP#255), the last one flagged 0xA5. They are read out of the eeprom at arming with the legs between
+       them, then flown one after the other, each held for its time to stay; the last one is held */
+    //#define GPS_NAV
+    #define GPS_MISSION_STEPS          32        // most waypoints of a mission kept in RAM
     #define NAV_SLEW_RATE              30        // Adds a rate control to nav output, will smoothen out nav angle spikes
 
 
@@ -857,6 +935,16 @@
    */
   #define ALTHOLD_FAST_THROTTLE_CHANGE
 
+  /* Kalman filter of altitude, vertical speed and accelerometer bias in place of the baro low pass and the
+   * complementary filter of the speed. The baro altitude comes from a table instead of log(), from the last
+   * pressure read instead of the average of the last 20: the filter takes the noise out with the accelerometer.
+   * The noises tune it: more baro noise trusts the accelerometer longer, more acc noise follows the baro closer.
+   */
+  //#define ALT_KALMAN
+  #define ALT_KALMAN_BARO_NOISE 40    // cm, rms of one baro altitude
+  #define ALT_KALMAN_ACC_NOISE  40    // cm/s2, rms of the vertical acceleration
+  #define ALT_KALMAN_BIAS_NOISE 2     // cm/s2 per sqrt(s), drift of the accelerometer bias
+
   /********************************************************************/
   /****           altitude variometer                              ****/
   /********************************************************************/
@@ -998,6 +1086,26 @@
        set to 3, adds additional powerconsumption on a per motor basis (this uses the big array and is a memory hog, if POWERMETER <> PM_SOFT) */
     //#define LOG_VALUES 1
 
+    /* to time the stages of the main loop: computeRC, the mag, baro, altitude and GPS tasks, the GPS navigation,
+       computeIMU, serialCom, PID, mixTable, writeServos/writeMotors and the whole cycle. min/avg/max in us and a
+       histogram of each, read with MSP_PROFILER. Costs two micros() calls per stage. */
+    #define LOOP_PROFILER
+
+    /* CHIPKIT flight recorder: while armed, rcCommand, gyro, acc, angles, the P, I and D terms and the motors are
+       logged every BLACKBOX_RATE cycles, delta and varint coded, into a RAM ring written to BLACKBOX_PAGES pages of
+       4kB of program flash in the spare time of the loop (MSP_BLACKBOX for the state and the costs, MSP_BLACKBOX_READ
+       to download, MSP_BLACKBOX_ERASE). tools/blackbox_decode.py turns the log into CSV files */
+    //#define BLACKBOX
+    #if !defined(BLACKBOX_RATE) // can be set on the command line by the SITL benchmark
+      #define BLACKBOX_RATE 1       // a frame every n cycles
+    #endif
+    #if !defined(BLACKBOX_PAGES)
+      #define BLACKBOX_PAGES 48     // 192kB of the 512kB of a MAX32, less on an Uno32
+    #endif
+    #if !defined(BLACKBOX_FLUSH_US)
+      #define BLACKBOX_FLUSH_US 200 // flash writes at the end of a cycle when the ring is a quarter full, us
+    #endif
+
     /* Permanent logging to eeprom - survives (most) upgrades and parameter resets.
      * used to track number of flights etc. over lifetime of controller board.
      * Writes to end of eeprom - should not conflict with stored parameters yet.
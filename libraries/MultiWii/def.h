@@ -224,6 +224,14 @@
   #endif
 #endif
 
+/**************************  motor mixer matrix  ***************************/
+// the frames whose motors are a weighted sum of the PIDs, mixed by the conf.mixer matrix (Output.cpp)
+#if (defined(BI) || defined(TRI) || defined(QUADP) || defined(QUADX) || defined(Y4) || defined(VTAIL4) || \
+     defined(Y6) || defined(HEX6) || defined(HEX6X) || defined(HEX6H) || \
+     defined(OCTOX8) || defined(OCTOFLATP) || defined(OCTOFLATX) || defined(DUALCOPTER)) && !defined(MY_PRIVATE_MIXING)
+  #define MOTOR_MIXER
+#endif
+
 #if (defined(SERVO_TILT)|| defined(SERVO_MIX_TILT))&& defined(CAMTRIG)
   #define SEC_SERVO_FROM   1 // use servo from 1 to 3
   #define SEC_SERVO_TO     3
@@ -1620,6 +1628,19 @@
   #define GPS 0
 #endif
 
+#if defined(GPS_10HZ) && defined(GPS_SERIAL) && (GPS_BAUD < 38400)
+  #error "GPS_10HZ needs GPS_BAUD 38400 or more"
+#endif
+
+#define GPS_CHUNK 32    // bytes of the GPS serial port parsed at once
+
+#if !GPS || defined(I2C_GPS)
+  #undef GPS_NAV          // the missions are flown by the navigation of the serial GPS code
+#endif
+#if defined(GPS_NAV) && !defined(USE_MSP_WP)
+  #define USE_MSP_WP      // the waypoints are written with MSP_SET_WP
+#endif
+
 #if defined(SRF02) || defined(SRF08) || defined(SRF10) || defined(SRC235) || defined(TINY_GPS_SONAR) || defined(I2C_GPS_SONAR)
   #define SONAR 1
 #else
@@ -1822,6 +1843,25 @@
   #define RC_CHANS 8
 #endif
 
+#define RC_FILTER_NONE    0    // the filters of RC_FILTER in config.h
+#define RC_FILTER_PT1     1
+#define RC_FILTER_BIQUAD  2
+#define RC_FILTER_INTERP  3
+
+#if defined(RC_FILTER) && defined(OPENLRSv2MULTI)
+  #error "RC_FILTER needs the frame times of the receiver, OPENLRSv2MULTI has none"
+#endif
+
+#if defined(GYRO_LPF_HZ) || defined(GYRO_NOTCH_HZ) || defined(GYRO_DYN_NOTCH)
+  #define GYRO_FILTER
+#endif
+#if defined(GYRO_NOTCH_HZ) && !defined(GYRO_NOTCH_CUTOFF_HZ)
+  #error "GYRO_NOTCH_HZ needs GYRO_NOTCH_CUTOFF_HZ, the lower edge of the notch"
+#endif
+#define GYRO_DYN_NOTCH_BINS     12   // Goertzel filters of the dynamic notch, evenly spread over the GYRO_DYN_NOTCH range
+#define GYRO_DYN_NOTCH_SAMPLES  32   // gyro samples per search of the peak
+#define GYRO_DYN_NOTCH_Q        3    // center frequency / width of the dynamic notch
+
 
 /**************************************************************************************/
 /***************                       I2C GPS                     ********************/
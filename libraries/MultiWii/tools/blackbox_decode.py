@@ -0,0 +1,146 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+#
+# blackbox_decode.py - MultiWii flight recorder log to CSV (BLACKBOX in config.h)
+#
+#   blackbox_decode.py log.bbl [prefix]          decode a log file
+#   blackbox_decode.py -p /dev/ttyUSB0 log.bbl    download it over MSP first (pyserial), 115200 bauds
+#
+# Writes prefix_1.csv, prefix_2.csv... one per flight, the frames of the log format described
+# in Blackbox.cpp: 'H' header, 'I' absolute and 'P' delta frames of zigzag varints, 'E' end.
+
+import struct
+import sys
+
+MSP_BLACKBOX = 122
+MSP_BLACKBOX_READ = 123
+
+
+def msp(port, cmd, data=b''):
+    frame = bytearray(b'$M<') + bytearray([len(data), cmd]) + bytearray(data)
+    cs = 0
+    for c in frame[3:]:
+        cs ^= c
+    port.write(bytes(frame + bytearray([cs])))
+    while True:
+        head = bytearray(port.read(5))
+        if len(head) < 5:
+            raise IOError('no reply to MSP command %d' % cmd)
+        if head[:3] == b'$M>' and head[4] == cmd:
+            break
+        if head[:3] == b'$M!':
+            raise IOError('MSP command %d refused' % cmd)
+    reply = bytearray(port.read(head[3] + 1))
+    cs = head[3] ^ head[4]
+    for c in reply[:-1]:
+        cs ^= c
+    if cs != reply[-1]:
+        raise IOError('bad checksum on MSP command %d' % cmd)
+    return reply[:-1]
+
+
+def download(device, name):
+    import serial
+    port = serial.Serial(device, 115200, timeout=1)
+    status = msp(port, MSP_BLACKBOX)
+    used = struct.unpack('<I', bytes(status[5:9]))[0]
+    log = bytearray()
+    while len(log) < used:
+        reply = msp(port, MSP_BLACKBOX_READ, struct.pack('<I', len(log)))
+        if len(reply) <= 4:
+            break
+        log += reply[4:]
+        sys.stderr.write('\r%d / %d bytes' % (len(log), used))
+    sys.stderr.write('\n')
+    open(name, 'wb').write(bytes(log))
+
+
+class Reader:
+    def __init__(self, data):
+        self.data = data
+        self.pos = 0
+
+    def byte(self):
+        c = self.data[self.pos]
+        self.pos += 1
+        return c
+
+    def varint(self):
+        v, shift = 0, 0
+        while True:
+            c = self.byte()
+            v |= (c & 0x7F) << shift
+            shift += 7
+            if c < 0x80:
+                return v
+
+    def signed(self):
+        v = self.varint()
+        return (v >> 1) ^ -(v & 1)
+
+
+def decode(data, prefix):
+    r = Reader(bytearray(data))
+    flight, out, names, last, lost = 0, None, [], None, False
+    while r.pos < len(r.data):
+        start = r.pos
+        try:
+            kind = chr(r.byte())
+            if kind == 'H':
+                version, rate, count = r.byte(), r.byte(), r.byte()
+                end = r.data.index(0, r.pos)
+                names = r.data[r.pos:end].decode('ascii').split(',')
+                r.pos = end + 1
+                if version != 1 or len(names) != count:
+                    raise ValueError('unknown header')
+                if out:
+                    out.close()
+                flight += 1
+                out = open('%s_%d.csv' % (prefix, flight), 'w')
+                out.write(','.join(names) + '\n')
+                last, frames = None, 0
+                sys.stderr.write('flight %d: a frame every %d cycles, %d fields\n' % (flight, rate, count))
+            elif kind == 'I' and names:
+                last = [r.signed() for _ in names]
+                out.write(','.join(map(str, last)) + '\n')
+                frames += 1
+                lost = False
+            elif kind == 'P' and last is not None:
+                last = [v + r.signed() for v in last]
+                out.write(','.join(map(str, last)) + '\n')
+                frames += 1
+            elif kind == 'E' and names:
+                logged, dropped = r.varint(), r.varint()
+                sys.stderr.write('  %d frames decoded, %d logged, %d dropped\n' % (frames, logged, dropped))
+                names, last = [], None
+            elif kind == '\xff':
+                pass  # padding to a flash word
+            else:
+                raise ValueError('unexpected byte')
+        except (IndexError, ValueError) as e:
+            # a truncated or damaged frame: start again from the next 'I' frame
+            if not lost:
+                sys.stderr.write('  offset %d: %s, looking for the next frame\n' % (start, e))
+            r.pos = start + 1
+            last, lost = None, True
+    if out:
+        out.close()
+    return flight
+
+
+def main(argv):
+    args = argv[1:]
+    if len(args) >= 3 and args[0] == '-p':
+        download(args[1], args[2])
+        args = args[2:]
+    if not args:
+        sys.stderr.write('usage: blackbox_decode.py [-p serial_port] log.bbl [prefix]\n')
+        return 1
+    prefix = args[1] if len(args) > 1 else args[0].rsplit('.', 1)[0]
+    flights = decode(open(args[0], 'rb').read(), prefix)
+    sys.stderr.write('%d flight(s) written to %s_*.csv\n' % (flights, prefix))
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main(sys.argv))
@@ -56,6 +56,9 @@ enum box {
   #if GPS
     BOXGPSHOME,
     BOXGPSHOLD,
+    #if defined(GPS_NAV)
+      BOXGPSNAV,
+    #endif
   #endif
   #if defined(FIXEDWING) || defined(HELICOPTER)
     BOXPASSTHRU,
@@ -82,6 +85,27 @@ enum box {
   CHECKBOXITEMS
 };
 
+enum stage {       // stages of the main loop, timed by STAGE_BEGIN/STAGE_END
+  STAGE_RC,        // 50Hz RC block: computeRC, sticks and boxes
+  STAGE_COMPUTERC, // computeRC, inside the RC block; with RC_FILTER every loop, before it
+  STAGE_MAG,       // taskOrder slots: Mag_getADC
+  STAGE_BARO,      // Baro_update
+  STAGE_ALT,       // getEstimatedAltitude
+  STAGE_GPS,       // GPS_NewData
+  STAGE_NAV,       // navigation of a GPS frame, inside GPS_NewData
+  STAGE_IMU,       // computeIMU, including the attitude, annex and interleave below
+  STAGE_ATTITUDE,  // getEstimatedAttitude
+  STAGE_ANNEX,     // annexCode
+  STAGE_SERIAL,    // serialCom, inside annexCode
+  STAGE_INTERLEAVE,// wait between the two gyro reads, the taskOrder slot may run there
+  STAGE_PID,       // PID controller
+  STAGE_MIX,       // mixTable
+  STAGE_WRITE,     // writeServos, writeMotors
+  STAGE_BLACKBOX,  // blackboxLog and the flash writes at the end of the cycle
+  STAGE_CYCLE,     // the whole loop: cycleTime
+  STAGE_ITEMS
+};
+
 typedef struct {
   int16_t  accSmooth[3];
   int16_t  gyroData[3];
@@ -118,6 +142,7 @@ typedef struct {
   uint8_t BARO_MODE :1 ;
   uint8_t GPS_HOME_MODE :1 ;
   uint8_t GPS_HOLD_MODE :1 ;
+  uint8_t GPS_MISSION_MODE :1 ;
   uint8_t HEADFREE_MODE :1 ;
   uint8_t PASSTHRU_MODE :1 ;
   uint8_t GPS_FIX :1 ;
@@ -148,6 +173,15 @@ struct servo_conf_ {  // this is a generic way to configure a servo, every multi
   int8_t  rate;       // range [-100;+100] ; can be used to ajust a rate 0-100% and a direction
 };
 
+#define MIX_SHIFT 8
+#define MIX_ONE   (1<<MIX_SHIFT)
+
+struct mix_rule_ {    // weights of the PIDs in one motor, MIX_ONE is 1: motor = throttle + (roll*R + pitch*P + yaw*Y) / MIX_ONE
+  int16_t roll;
+  int16_t pitch;
+  int16_t yaw;
+};
+
 typedef struct {
   pid_    pid[PIDITEMS];
   uint8_t rcRate8;
@@ -164,6 +198,9 @@ typedef struct {
     int16_t mag_declination;
   #endif
   servo_conf_ servoConf[8];
+  #if defined(MOTOR_MIXER)
+    mix_rule_ mixer[NUMBER_MOTOR];
+  #endif
   #if defined(GYRO_SMOOTHING)
     uint8_t Smoothing[3];
   #endif
@@ -210,4 +247,16 @@ typedef struct {
 } plog_t;
 #endif
 
+#define MISSION_FLAG_END 0xA5     // flag of the last waypoint of a mission
+
+typedef struct {
+  int32_t  pos[2];        // LAT LON, 1deg = 10 000 000
+  int32_t  altitude;      // cm, kept for the ground station, not flown
+  int16_t  heading;       // deg, kept for the ground station
+  uint16_t stay;          // ms held at the waypoint before the leg to the next one
+  uint8_t  number;        // 1 to 254
+  uint8_t  flag;          // MISSION_FLAG_END on the last waypoint
+  uint8_t  checksum;      // MUST BE ON LAST POSITION OF STRUCTURE !
+} mission_step_struct;
+
 #endif /* TYPES_H_ */
@@ -0,0 +1,91 @@
+/*
+  WProgram.h - MPIDE 0023 core API for the HOST build of PMultiWii
+
+  Stands in for the chipKIT Uno32 core when the PMultiWii sources are compiled
+  on a PC with -DHOST -IHOST. Time is the host_us of host.h, set by the host
+  program; the PIC32 registers are plain variables and the MPU6050 answers
+  from host_mpu (host_hal.cpp).
+*/
+
+#ifndef WProgram_h
+#define WProgram_h
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "host.h"
+
+#define F_CPU 80000000L
+
+#define HIGH 0x1
+#define LOW  0x0
+#define INPUT  0x0
+#define OUTPUT 0x1
+
+#define DEC 10
+#define HEX 16
+#define PI 3.1415926535897932384626433832795
+
+#define min(a,b) ((a)<(b)?(a):(b))
+#define max(a,b) ((a)>(b)?(a):(b))
+#define abs(x) ((x)>0?(x):-(x))
+#define constrain(amt,low,high) ((amt)<(low)?(low):((amt)>(high)?(high):(amt)))
+
+typedef uint8_t byte;
+typedef uint8_t boolean;
+
+// a single execution context: the interrupts are calls of the host program
+#define cli()
+#define sei()
+
+#define _CP0_GET_COUNT() (host_ticks)
+
+unsigned long millis(void);
+unsigned long micros(void);
+void delay(unsigned long ms);
+void pinMode(uint8_t pin, uint8_t mode);
+
+// Serial goes to stdout when host_echo is set, Serial1 reads what host_serial1_feed() gave it
+class HardwareSerial {
+  public:
+    int available(void);
+    int read(void);
+    void begin(unsigned long baud);
+    void print(const char *s);
+    void print(char c);
+    void print(int n, int base = DEC);
+    void print(unsigned int n, int base = DEC);
+    void print(long n, int base = DEC);
+    void print(unsigned long n, int base = DEC);
+    void print(double n, int digits = 2);
+    void println(void);
+    void println(const char *s);
+    void println(char c);
+    void println(int n, int base = DEC);
+    void println(unsigned int n, int base = DEC);
+    void println(long n, int base = DEC);
+    void println(unsigned long n, int base = DEC);
+    void println(double n, int digits = 2);
+};
+
+extern HardwareSerial Serial, Serial1;
+
+// PIC32 registers written by the CHIPKIT code
+extern volatile uint32_t T2CON, T2CONSET, TMR2, PR2;
+extern volatile uint32_t OC1CON, OC1CONSET, OC1R, OC1RS;
+extern volatile uint32_t OC2CON, OC2CONSET, OC2R, OC2RS;
+extern volatile uint32_t OC3CON, OC3CONSET, OC3R, OC3RS;
+extern volatile uint32_t OC4CON, OC4CONSET, OC4R, OC4RS;
+typedef struct { uint32_t OCM:3; uint32_t :29; } host_occon_bits;
+extern host_occon_bits OC1CONbits, OC2CONbits, OC3CONbits, OC4CONbits;
+extern volatile uint32_t AD1PCFGSET, TRISBSET, CNCON, CNENSET, CNPUESET, PORTB;
+extern volatile uint32_t IPC6SET, IFS1CLR, IEC1SET;
+extern volatile uint32_t I2C1BRG;
+// UART1, the UART of Serial: the transmit FIFO is never full, a write goes to host_uart
+struct host_txreg { void operator=(uint32_t c); };
+extern volatile uint32_t U1STA, U2MODECLR, U2MODESET;
+extern host_txreg U1TXREG;
+
+#endif
@@ -0,0 +1,311 @@
+/*
+  bench_pid.cpp - the fixed point angle and PID pipeline of PMultiWii against
+  the double one it replaced, on the PC
+
+  Both run the same MPU6050 samples of a synthetic flight (roll and pitch
+  swings, vibration noise, stick steps at 50Hz) from the raw ADC to motor[]:
+    fixed   MPU_getADC() (ACC_Common, GYRO_Common), computePID(), RunMotors()
+            of the library sources
+    double  the loop before: ACC_Common and GYRO_Common in double with
+            atan2/sqrt/pow/cos, the double PID and mix, kept below
+  and a double model of the fixed point formulas checks the angles and the
+  PID outputs of the fixed point code.
+
+  Built with -DTRACE_POINTS=..., the fixed loop runs its trace points and
+  traceDrain(): the timing shows their cost, -o writes the trace of the check
+  pass for tools/trace_decode.py.
+
+  bench_pid [-t seconds] [-s seed] [-r passes] [-o trace file]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#if defined(__x86_64__) || defined(__i386__)
+  #include <x86intrin.h>
+  #define HOST_CYCLES() __rdtsc()
+#else
+  #define HOST_CYCLES() 0ULL
+#endif
+
+#include "WProgram.h"
+#include "../config.h"
+#include "../def.h"
+#include "../types.h"
+#include "../PMultiWii.h"
+#include "../POutput.h"
+#include "../PSensors.h"
+#include "../PTrace.h"
+
+extern int16_t motor[4];
+extern uint32_t cycleTime;
+
+#define SAMPLE_US 1000                   // the 1kHz of the MPU6050
+#define GYRO_LSB  (32768.0 / 2000.0)     // per deg/s
+#define ACC_LSB   4096.0                 // per g
+
+typedef struct {
+  int16_t acc[3], gyro[3];
+  int16_t stick[2];                      // rcCommand ROLL & PITCH
+} step_t;
+
+static step_t *steps;
+static uint32_t stepCount;
+
+static double noise(double amplitude) {
+  return amplitude * (2.0 * rand() / RAND_MAX - 1.0);
+}
+
+// roll and pitch swinging at 0.7Hz and 1.3Hz, up to 25deg, with the gyro rates and the ACC gravity
+static void makeFlight(uint32_t seconds) {
+  double roll, pitch, rollRate, pitchRate;
+  int16_t stick[2] = {0, 0};
+
+  stepCount = seconds * (1000000 / SAMPLE_US);
+  steps = (step_t *)malloc(stepCount * sizeof(step_t));
+  for (uint32_t i = 0; i < stepCount; i++) {
+    double t = i * SAMPLE_US / 1e6;
+    roll       = 25.0 * sin(2 * M_PI * 0.7 * t);
+    pitch      = 15.0 * sin(2 * M_PI * 1.3 * t + 1.0);
+    rollRate   = 25.0 * 2 * M_PI * 0.7 * cos(2 * M_PI * 0.7 * t);
+    pitchRate  = 15.0 * 2 * M_PI * 1.3 * cos(2 * M_PI * 1.3 * t + 1.0);
+    double r = roll * M_PI / 180, p = pitch * M_PI / 180;
+    steps[i].acc[ROLL]   = ACC_LSB * sin(r) + noise(150);
+    steps[i].acc[PITCH]  = ACC_LSB * sin(p) + noise(150);
+    steps[i].acc[YAW]    = ACC_LSB * cos(r) * cos(p) + noise(150);
+    steps[i].gyro[ROLL]  =  rollRate * GYRO_LSB + noise(20);      // c_angle[ROLL] integrates +gyro
+    steps[i].gyro[PITCH] = -pitchRate * GYRO_LSB + noise(20);     // c_angle[PITCH] integrates -gyro
+    steps[i].gyro[YAW]   = noise(20);
+    if (i % 20 == 0) {                                              // 50Hz RC
+      if (i % 500 == 0) {
+        stick[ROLL]  = rand() % 401 - 200;
+        stick[PITCH] = rand() % 401 - 200;
+      }
+    }
+    steps[i].stick[ROLL]  = stick[ROLL];
+    steps[i].stick[PITCH] = stick[PITCH];
+  }
+}
+
+static void feed(uint32_t i) {
+  host_mpu_sample(steps[i].acc, 0, steps[i].gyro);
+  host_us += SAMPLE_US;
+  cycleTime = SAMPLE_US;
+  rcCommand[ROLL]  = steps[i].stick[ROLL];
+  rcCommand[PITCH] = steps[i].stick[PITCH];
+}
+
+/**************************************************************************************/
+/***************        the double loop before the fixed point          ***************/
+/**************************************************************************************/
+static struct {
+  double daccADC[3], dgyroADC[3];
+  double c_angle[2], prev_c_roll, prev_c_pitch;
+  double evx, evy, evz;
+  uint32_t previousTime;
+  int16_t last_error[3];
+  int32_t sum_error[3];
+  double axisPID[3];
+} old;
+static const double oldKp[3] = {0.6,0.6,0.6};
+static const double oldKi[3] = {0.1,0.1,0.1};
+static const double oldKd[3] = {0.3,0.3,0.3};
+
+static void oldLoop() {
+  uint8_t raw[14], axis;
+  int16_t acc[3], gyro[3], error, delta_error;
+  double e_roll, e_pitch, i_roll, i_pitch, eax, eay, eaz, a = 0.98;
+  uint32_t currentTime, dt;
+
+  i2c_read_reg_to_buf(0x68, 0x3B, raw, 14);
+  for (axis = 0; axis < 3; axis++) {
+    acc[axis]  = ((raw[2 * axis] << 8) | raw[2 * axis + 1]) - accZero[axis];
+    gyro[axis] = ((raw[8 + 2 * axis] << 8) | raw[9 + 2 * axis]) - gyroZero[axis];
+    old.daccADC[axis]  = acc[axis] * 16.0 / 65536;
+    old.dgyroADC[axis] = gyro[axis] * 4000.0 / 65536;
+  }
+  e_roll   = atan2(old.daccADC[ROLL],   sqrt(pow(old.daccADC[YAW]+1, 2.0) + pow(old.daccADC[PITCH], 2.0)));
+  e_pitch  = atan2(old.daccADC[PITCH],  sqrt(pow(old.daccADC[YAW]+1, 2.0) + pow(old.daccADC[ROLL],  2.0)));
+  currentTime = micros();
+  if (old.previousTime > 0) {
+    dt = currentTime - old.previousTime;
+    i_roll =          old.dgyroADC[0] * M_PI/180.0 * (double)dt/1000000.0;
+    i_pitch = -1.00 * old.dgyroADC[1] * M_PI/180.0 * (double)dt/1000000.0;
+    old.c_angle[0]  = a * (old.prev_c_roll  + i_roll)  + (1 - a) * e_roll;
+    old.prev_c_roll = old.c_angle[0];
+    old.c_angle[1] = a * (old.prev_c_pitch + i_pitch) + (1 - a) * e_pitch;
+    old.prev_c_pitch = old.c_angle[1];
+    eax = old.daccADC[PITCH] * cos(old.c_angle[0]);
+    eay = old.daccADC[ROLL]  * cos(old.c_angle[1]);
+    eaz = old.daccADC[YAW]   * cos(old.c_angle[0]) * cos(old.c_angle[1]);
+    old.evx += eax * 9.81 * (double)dt/1000000.0;
+    old.evy += eay * 9.81 * (double)dt/1000000.0;
+    old.evz += eaz * 9.81 * (double)dt/1000000.0;
+  }
+  old.previousTime = currentTime;
+
+  for (axis = 0; axis < 2; axis++) {
+    error = rcCommand[axis] - (int16_t)(old.c_angle[axis]*159.0);
+    old.sum_error[axis] += (int32_t) (error * cycleTime);
+    delta_error = (error - old.last_error[axis])/(int32_t)cycleTime;
+    delta_error = ((int32_t) delta_error * ((uint16_t)0xFFFF / (cycleTime>>4)))>>6;
+    old.axisPID[axis] = (oldKp[axis]*error) + (oldKi[axis]*old.sum_error[axis]) + (oldKd[axis]*delta_error);
+    old.last_error[axis] = error;
+  }
+  old.axisPID[YAW] = 0;
+
+  int16_t maxMotor;
+#define OLDMIX(X,Y,Z) rcCommand[THROTTLE] + old.axisPID[ROLL]*X + old.axisPID[PITCH]*Y + YAW_DIRECTION * old.axisPID[YAW]*Z
+  motor[0] = OLDMIX(-1,+1,-1);
+  motor[1] = OLDMIX(-1,-1,+1);
+  motor[2] = OLDMIX(+1,+1,+1);
+  motor[3] = OLDMIX(+1,-1,-1);
+  maxMotor = motor[0];
+  for (uint8_t i = 1; i < 4; i++) if (motor[i] > maxMotor) maxMotor = motor[i];
+  for (uint8_t i = 0; i < 4; i++) {
+    if (maxMotor > MAXCOMMAND) motor[i] -= maxMotor - MAXCOMMAND;
+    motor[i] = constrain(motor[i], MINCOMMAND, MAXCOMMAND);
+    if (rcData[THROTTLE] < MINCHECK) motor[i] = MINCOMMAND;
+  }
+  writeMotors();
+}
+
+static void fixedLoop() {
+  MPU_getADC();
+  computePID();
+  RunMotors();
+#if TRACE_POINTS
+  traceDrain();
+#endif
+}
+
+/**************************************************************************************/
+/***************      double model of the fixed point formulas         ****************/
+/**************************************************************************************/
+static struct {
+  double c_angle[2], ITerm[2], axisPID[2];
+  uint8_t started;
+} ref;
+
+static void refStep(uint32_t i) {
+  const step_t *s = &steps[i];
+  double acc[3], gyro[3], e[2], gains[3][2] = {{PID_ROLL_P, PID_PITCH_P}, {PID_ROLL_I, PID_PITCH_I}, {PID_ROLL_D, PID_PITCH_D}};
+  for (uint8_t axis = 0; axis < 3; axis++) {
+    acc[axis]  = s->acc[axis] - accZero[axis];
+    gyro[axis] = s->gyro[axis] - gyroZero[axis];
+  }
+  e[ROLL]  = atan2(acc[ROLL],  sqrt(pow(acc[YAW] + ACC_LSB, 2) + acc[PITCH] * acc[PITCH]));
+  e[PITCH] = atan2(acc[PITCH], sqrt(pow(acc[YAW] + ACC_LSB, 2) + acc[ROLL] * acc[ROLL]));
+  double radPerLsbUs = 4000.0 / 65536 * M_PI / 180 / 1e6;
+  double rate[2] = {gyro[ROLL], -gyro[PITCH]};
+  for (uint8_t axis = 0; axis < 2; axis++) {
+    if (ref.started) {
+      double c = ref.c_angle[axis] + rate[axis] * SAMPLE_US * radPerLsbUs;
+      ref.c_angle[axis] = c + 0.02 * (e[axis] - c);
+    }
+    double error = s->stick[axis] - ref.c_angle[axis] * 159;
+    ref.ITerm[axis] = constrain(ref.ITerm[axis] + gains[1][axis] * error * SAMPLE_US / 1e6, -PID_I_MAX, PID_I_MAX);
+    double pid = gains[0][axis] * error + ref.ITerm[axis] - gains[2][axis] * rate[axis] * 4000.0 / 65536 * M_PI / 180 * 159;
+    ref.axisPID[axis] = constrain(pid, -(MAXCOMMAND - MINCOMMAND), MAXCOMMAND - MINCOMMAND);
+  }
+  ref.started = 1;
+}
+
+/**************************************************************************************/
+
+typedef struct { double ns, cycles; } cost_t;
+
+static cost_t timePass(void (*step)()) {
+  auto t0 = std::chrono::steady_clock::now();
+  uint64_t c0 = HOST_CYCLES();
+  for (uint32_t i = 0; i < stepCount; i++) {
+    feed(i);
+    if (step) step();
+  }
+  uint64_t c1 = HOST_CYCLES();
+  auto t1 = std::chrono::steady_clock::now();
+  cost_t c = {std::chrono::duration<double, std::nano>(t1 - t0).count() / stepCount, (double)(c1 - c0) / stepCount};
+  return c;
+}
+
+static cost_t best(void (*step)(), int passes) {
+  cost_t b = timePass(step);
+  for (int p = 1; p < passes; p++) {
+    cost_t c = timePass(step);
+    if (c.ns < b.ns) b = c;
+  }
+  return b;
+}
+
+int main(int argc, char **argv) {
+  uint32_t seconds = 60, seed = 1;
+  int passes = 5;
+  const char *traceFile = NULL;
+
+  for (int a = 1; a < argc; a++) {
+    if (!strcmp(argv[a], "-t") && a + 1 < argc) seconds = atoi(argv[++a]);
+    else if (!strcmp(argv[a], "-s") && a + 1 < argc) seed = atoi(argv[++a]);
+    else if (!strcmp(argv[a], "-r") && a + 1 < argc) passes = atoi(argv[++a]);
+    else if (!strcmp(argv[a], "-o") && a + 1 < argc) traceFile = argv[++a];
+    else {
+      fprintf(stderr, "usage: bench_pid [-t seconds] [-s seed] [-r passes] [-o trace file]\n");
+      return 1;
+    }
+  }
+  srand(seed);
+
+  // Patan2 against atan2 on the range of the ACC
+  double atanErr = 0;
+  for (int32_t y = -40000; y <= 40000; y += 373)
+    for (int32_t x = -40000; x <= 40000; x += 419) {
+      double d = fabs(Patan2(y, x) / 65536.0 - atan2(y, x));
+      if (d > M_PI) d = 2 * M_PI - d;
+      if (d > atanErr) atanErr = d;
+    }
+
+  // boot on the ground: calibration at rest, the motors tests in delay()
+  int16_t acc[3] = {0, 0, (int16_t)ACC_LSB}, gyro[3] = {0, 0, 0};
+  host_mpu_sample(acc, 0, gyro);
+  MultiWii_setup();
+  rcData[THROTTLE] = rcCommand[THROTTLE] = 1500;
+
+  makeFlight(seconds);
+
+  // fixed point against its double model, the trace of this pass in traceFile
+  if (traceFile && !(host_uart = fopen(traceFile, "wb"))) {
+    perror(traceFile);
+    return 1;
+  }
+  double angleErr = 0, angleRms = 0, pidErr = 0;
+  for (uint32_t i = 0; i < stepCount; i++) {
+    feed(i);
+    fixedLoop();
+    refStep(i);
+    for (uint8_t axis = 0; axis < 2; axis++) {
+      double d = fabs(c_angle[axis] / 65536.0 - ref.c_angle[axis]) * 180 / M_PI;
+      angleRms += d * d;
+      if (d > angleErr) angleErr = d;
+      d = fabs(axisPID[axis] - ref.axisPID[axis]);
+      if (d > pidErr) pidErr = d;
+    }
+  }
+  angleRms = sqrt(angleRms / (2 * stepCount));
+  if (host_uart) {
+    fclose(host_uart);
+    host_uart = NULL;                      // the timed passes trace without the file writes
+  }
+
+  cost_t harness = best(NULL, passes);
+  cost_t fixed   = best(fixedLoop, passes);
+  cost_t dbl     = best(oldLoop, passes);
+
+  printf("%u s of flight, %u loops of %u us\n", seconds, stepCount, SAMPLE_US);
+  printf("Patan2 max error                      %.5f rad\n", atanErr);
+  printf("fixed point against its double model  angle max %.4f deg rms %.4f deg, axisPID max %.1f\n",
+         angleErr, angleRms, pidErr);
+  printf("per loop, raw ADC to motor[]          ns      cycles\n");
+  printf("  double                            %6.1f   %7.0f\n", dbl.ns - harness.ns, dbl.cycles - harness.cycles);
+  printf("  fixed point                       %6.1f   %7.0f\n", fixed.ns - harness.ns, fixed.cycles - harness.cycles);
+  free(steps);
+  return 0;
+}
@@ -0,0 +1,356 @@
+/*
+  bench_rx.cpp - the RC decoding of PRX.cpp against the handlers it replaced,
+  on simulated receiver streams
+
+  The receiver edges go through a model of the PIC32: an edge is taken by the
+  change notice interrupt ENTRY ns after it, or once the interrupt before it
+  has returned, or once a section with the interrupts disabled has ended (one
+  of -d ns every ms, at a random time). The handler reads PORTB when it enters
+  and the time TIME ns later; the edges while it runs wait for the next entry.
+    old  the change notice handler before: micros() and the pulse widths in
+         the interrupt (with SERIAL_SUM_PPM, the rxInt of MultiWii, on the
+         rising edges of RB1), kept below
+    new  ChangeNotice_Handler of PRX.cpp: the core timer and PORTB into the
+         edge FIFO, rxDecode() once per frame
+  and the widths in rcValue are compared with the pulses sent. The durations
+  of the handlers on the PIC32 are assumed inputs (-o, -n), not measured nor
+  counted: the width errors follow from them. The handlers are also timed on
+  the PC.
+
+  Build with -DSERIAL_SUM_PPM=... for the PPM sum, with -DSBUS for the SBUS
+  frames, which only checks the decoding: the UART takes the bytes.
+
+  bench_rx [-t seconds] [-s seed] [-m seq|sync] [-o ns] [-n ns] [-d ns] [-r passes]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#if defined(__x86_64__) || defined(__i386__)
+  #include <x86intrin.h>
+  #define HOST_CYCLES() __rdtsc()
+#else
+  #define HOST_CYCLES() 0ULL
+#endif
+
+#include "WProgram.h"
+#include "../config.h"
+#include "../def.h"
+#include "../types.h"
+#include "../PMultiWii.h"
+#include "../PRX.h"
+
+extern "C" void ChangeNotice_Handler(void);
+
+#define ENTRY_NS   300                   // interrupt entry and prologue, up to the read of PORTB
+#define OLD_TIME   300                   // PORTB to the core timer read inside micros()
+#define NEW_TIME   0                     // the core timer is read first
+
+#if !defined(SBUS)
+static double noise(double amplitude) {
+  return amplitude * (2.0 * rand() / RAND_MAX - 1.0);
+}
+
+/**************************************************************************************/
+/***************          the handlers before, for the comparison       ****************/
+/**************************************************************************************/
+static uint16_t oldValue[RC_SLOTS];
+
+#if defined(SERIAL_SUM_PPM)
+static void oldHandler() {               // MultiWii rxInt, attachInterrupt(RISING)
+  static uint32_t lastb, last;
+  static uint8_t chan;
+  uint32_t thisb = PORTB, now, diff;
+  if ((thisb ^ lastb) & thisb & 0x02) {
+    now = micros();
+    diff = now - last;
+    last = now;
+    if (diff > 3000) chan = 0;
+    else {
+      if (900 < diff && diff < 2200 && chan < RC_SLOTS) oldValue[chan] = diff;
+      chan++;
+    }
+  }
+  lastb = thisb;
+}
+#else
+static void oldHandler() {               // ChangeNotice_Handler before the edge FIFO, the 5 if of RB1-RB5 as a loop
+  static uint32_t edgeTime[5];
+  static uint16_t lastb;
+  uint16_t thisb;
+  uint32_t currTime, dTime;
+
+  thisb = PORTB;
+  currTime = micros();
+  for (uint8_t chan = 0; chan < 5; chan++) {
+    uint16_t bit = 0x02 << chan;
+    if ((thisb ^ lastb) & bit) {
+      if (!(thisb & bit)) {
+        dTime = currTime - edgeTime[chan];
+        if (900 < dTime && dTime < 2200) oldValue[chan] = (uint16_t)dTime;
+      }
+      else
+        edgeTime[chan] = currTime;
+    }
+  }
+  lastb = thisb;
+}
+#endif
+
+/**************************************************************************************/
+/***************                 receiver and CPU model                 ****************/
+/**************************************************************************************/
+typedef struct { uint64_t ns; uint16_t bit; uint8_t high; } edge_t;
+typedef struct { uint64_t check; double us[RC_SLOTS]; } frame_t;   // widths sent, checked at check
+
+static std::vector<edge_t> edges;
+static std::vector<frame_t> frames;
+
+static bool edgeBefore(const edge_t &a, const edge_t &b) { return a.ns < b.ns; }
+
+static void makeStream(uint32_t seconds, bool sync) {
+#if defined(SERIAL_SUM_PPM)
+  const uint64_t period = 22500000;      // ns, 8 channels
+  const uint8_t slots = 8;
+#else
+  const uint64_t period = 20000000;
+  const uint8_t slots = RC_CHANS;
+#endif
+  uint32_t count = seconds * 1000000000ULL / period;
+  for (uint32_t f = 0; f < count; f++) {
+    frame_t fr;
+    uint64_t start = f * period + 50000, at;
+    double t = f * period / 1e9;
+    for (uint8_t c = 0; c < RC_SLOTS; c++)                        // sticks moving, widths not on whole us
+      fr.us[c] = c < slots ? 1500 + 420 * sin(2 * M_PI * (0.3 + 0.17 * c) * t + c) + noise(0.5) : 0;
+#if defined(SERIAL_SUM_PPM)
+    at = start;
+    for (uint8_t c = 0; c <= slots; c++) {                        // a 400us low pulse before each rising edge
+      edges.push_back((edge_t){at, 0x02, 0});
+      edges.push_back((edge_t){at + 400000, 0x02, 1});
+      if (c < slots) at += (uint64_t)(fr.us[c] * 1000);
+    }
+    fr.check = (f + 1) * period + 50000 + 500000;                 // published at the sync, the next rising edge
+    (void)sync;
+#else
+    at = start;
+    for (uint8_t c = 0; c < slots; c++) {
+      uint64_t w = (uint64_t)(fr.us[c] * 1000);
+      edges.push_back((edge_t){at, (uint16_t)(0x02 << c), 1});
+      edges.push_back((edge_t){at + w, (uint16_t)(0x02 << c), 0});
+      if (!sync) at += w;                                         // seq: one after the other
+    }
+    fr.check = start + 15000000;
+#endif
+    frames.push_back(fr);
+  }
+  std::stable_sort(edges.begin(), edges.end(), edgeBefore);
+}
+
+typedef struct { uint32_t port, us, ticks; } entry_t;             // what a handler saw, for the timing
+
+typedef struct {
+  double sum, sq, max;
+  uint32_t n, off1;                                               // widths, widths off by 1us or more
+  std::vector<entry_t> entries;
+} result_t;
+
+static void compare(result_t *r, const frame_t *fr, uint16_t (*value)(uint8_t)) {
+  for (uint8_t chan = 0; chan < RC_CHANS; chan++) {
+#if defined(SERIAL_SUM_PPM)
+    static const uint8_t order[] = {SERIAL_SUM_PPM};
+    double sent = fr->us[order[chan]];
+#else
+    double sent = fr->us[chan];
+#endif
+    double d = fabs(value(chan) - sent);
+    r->sum += d; r->sq += d * d; r->n++;
+    if (d > r->max) r->max = d;
+    if (d >= 1.0) r->off1++;
+  }
+}
+
+static uint16_t oldRead(uint8_t chan) {
+#if defined(SERIAL_SUM_PPM)
+  static const uint8_t order[] = {SERIAL_SUM_PPM};
+  return oldValue[order[chan]];
+#else
+  return oldValue[chan];
+#endif
+}
+
+static void simulate(result_t *r, bool isNew, uint32_t durationNs, uint32_t diNs, uint32_t seed) {
+  uint64_t cpuFree = 0, diMs = 0, diStart = 0, entry;
+  uint32_t port = 0;
+  size_t e = 0, f = 0;
+  srand(seed);
+  r->sum = r->sq = r->max = 0;
+  r->n = r->off1 = 0;
+  r->entries.clear();
+  while (e < edges.size()) {
+    entry = edges[e].ns + ENTRY_NS;
+    if (entry < cpuFree) entry = cpuFree;
+    while ((diMs + 1) * 1000000 <= entry)                         // the di section of the loop in each ms
+      diStart = ++diMs * 1000000 + rand() % 1000000;
+    if (entry >= diStart && entry < diStart + diNs) entry = diStart + diNs;
+    while (f < frames.size() && frames[f].check <= entry) {       // the loop reads the channels
+      if (isNew) rxDecode();
+      if (f >= 2)                                                 // the first frames fill the channels
+        compare(r, &frames[f], isNew ? readRawRC : oldRead);
+      f++;
+    }
+    for (; e < edges.size() && edges[e].ns <= entry; e++)        // the port when the handler reads it
+      port = edges[e].high ? port | edges[e].bit : port & ~edges[e].bit;
+    uint64_t t = entry + (isNew ? NEW_TIME : OLD_TIME);
+    entry_t en = {port, (uint32_t)(t / 1000), (uint32_t)(t * 40 / 1000)};
+    PORTB = en.port; host_us = en.us; host_ticks = en.ticks;
+    if (isNew) ChangeNotice_Handler();
+    else oldHandler();
+    r->entries.push_back(en);
+    cpuFree = entry + durationNs;
+  }
+}
+
+typedef struct { double ns, cycles; } cost_t;
+
+// per call of the handler, on the entries of the simulation; rxDecode() outside of the measure
+static cost_t timeHandler(const std::vector<entry_t> &entries, void (*handler)(), int passes) {
+  cost_t best = {1e30, 1e30};
+  for (int p = 0; p < passes; p++) {
+    double ns = 0, cycles = 0;
+    for (size_t i = 0; i < entries.size(); i += 32) {
+      size_t end = min(entries.size(), i + 32);
+      auto t0 = std::chrono::steady_clock::now();
+      uint64_t c0 = HOST_CYCLES();
+      for (size_t j = i; j < end; j++) {
+        PORTB = entries[j].port; host_us = entries[j].us; host_ticks = entries[j].ticks;
+        if (handler) handler();
+      }
+      uint64_t c1 = HOST_CYCLES();
+      auto t1 = std::chrono::steady_clock::now();
+      ns += std::chrono::duration<double, std::nano>(t1 - t0).count();
+      cycles += c1 - c0;
+      rxDecode();
+    }
+    if (ns < best.ns) best.ns = ns, best.cycles = cycles;
+  }
+  best.ns /= entries.size();
+  best.cycles /= entries.size();
+  return best;
+}
+
+static void newHandler() { ChangeNotice_Handler(); }
+
+static void report(const char *name, const result_t *r, uint32_t durationNs, cost_t c, cost_t harness) {
+  printf("  %-4s %6.3f %6.3f %6.2f %7.2f%%   %5u     %6.1f %7.0f\n", name, r->sum / r->n, sqrt(r->sq / r->n),
+         r->max, 100.0 * r->off1 / r->n, durationNs, c.ns - harness.ns, c.cycles - harness.cycles);
+}
+#endif
+
+int main(int argc, char **argv) {
+  uint32_t seconds = 60, seed = 1;
+#if !defined(SBUS)
+  uint32_t oldNs = 2500, newNs = 700, diNs = 1000;   // assumed PIC32 times, see ReadMe.txt
+  int passes = 5;
+  bool sync = false;
+#endif
+
+  for (int a = 1; a < argc; a++) {
+    if (!strcmp(argv[a], "-t") && a + 1 < argc) seconds = atoi(argv[++a]);
+    else if (!strcmp(argv[a], "-s") && a + 1 < argc) seed = atoi(argv[++a]);
+#if !defined(SBUS)
+    else if (!strcmp(argv[a], "-m") && a + 1 < argc) sync = !strcmp(argv[++a], "sync");
+    else if (!strcmp(argv[a], "-o") && a + 1 < argc) oldNs = atoi(argv[++a]);
+    else if (!strcmp(argv[a], "-n") && a + 1 < argc) newNs = atoi(argv[++a]);
+    else if (!strcmp(argv[a], "-d") && a + 1 < argc) diNs = atoi(argv[++a]);
+    else if (!strcmp(argv[a], "-r") && a + 1 < argc) passes = atoi(argv[++a]);
+#endif
+    else {
+#if defined(SBUS)
+      fprintf(stderr, "usage: bench_rx [-t seconds] [-s seed]\n");
+#else
+      fprintf(stderr, "usage: bench_rx [-t seconds] [-s seed] [-m seq|sync] [-o ns] [-n ns] [-d ns] [-r passes]\n");
+#endif
+      return 1;
+    }
+  }
+  srand(seed);
+  configureReceiver();
+
+#if defined(SBUS)
+  // frames of 16 channels of 11 bits, with bytes lost and noise between some of them
+  uint32_t sent = 0, bad = 0;
+  for (uint32_t f = 0; f < seconds * 1000 / 14; f++) {
+    uint16_t ch[16];
+    uint8_t frame[25] = {0x0F}, junk[7];
+    uint32_t bits = 0, n = 0, b = 1;
+    for (uint8_t c = 0; c < 16; c++) {
+      ch[c] = 172 + rand() % 1640;
+      bits |= (uint32_t)ch[c] << n;
+      for (n += 11; n >= 8; n -= 8, bits >>= 8) frame[b++] = bits & 0xFF;
+    }
+    frame[23] = rand() & 0x03;
+    frame[24] = 0x00;
+    host_us += 14000;                    // a frame every 14ms
+    if (f % 50 == 7) {                   // cut frame, then garbage: it must not be taken
+      host_serial1_feed(frame, 11);
+      for (uint8_t i = 0; i < sizeof(junk); i++) junk[i] = rand() & 0xF0;
+      host_serial1_feed(junk, sizeof(junk));
+      rxDecode();
+      continue;
+    }
+    host_serial1_feed(frame, 25);
+    uint32_t published = rxStats.frames;
+    rxDecode();
+    sent++;
+    if (rxStats.frames == published) continue;
+    static const uint8_t order[RC_CHANS] = {PITCH,YAW,THROTTLE,ROLL,AUX1};
+    for (uint8_t chan = 0; chan < RC_CHANS; chan++)
+      if (readRawRC(chan) != ch[order[chan]] / 2 + 976) bad++;
+  }
+  printf("SBUS: %u frames sent, %u published, %u rejected, %u channels wrong\n",
+         sent, rxStats.frames, rxStats.rejected, bad);
+  return bad != 0 || rxStats.frames != sent;
+#else
+  makeStream(seconds, sync);
+
+  result_t oldR, newR;
+  simulate(&oldR, false, oldNs, diNs, seed);
+  simulate(&newR, true, newNs, diNs, seed);
+
+  cost_t harness = timeHandler(newR.entries, NULL, passes);
+  cost_t oldC = timeHandler(oldR.entries, oldHandler, passes);
+  cost_t newC = timeHandler(newR.entries, newHandler, passes);
+
+  // rxDecode per edge, out of the interrupt, the handlers outside of the measure
+  double decodeNs = 0;
+  for (size_t i = 0; i < newR.entries.size(); i += 32) {
+    for (size_t j = i; j < min(newR.entries.size(), i + 32); j++) {
+      PORTB = newR.entries[j].port; host_ticks = newR.entries[j].ticks;
+      ChangeNotice_Handler();
+    }
+    auto t0 = std::chrono::steady_clock::now();
+    rxDecode();
+    auto t1 = std::chrono::steady_clock::now();
+    decodeNs += std::chrono::duration<double, std::nano>(t1 - t0).count();
+  }
+  decodeNs /= newR.entries.size();
+
+#if defined(SERIAL_SUM_PPM)
+  printf("PPM sum, 8 channels at 22.5ms");
+#else
+  printf("PWM, %u channels at 20ms, %s", RC_CHANS, sync ? "pulses starting together" : "pulses one after the other");
+#endif
+  printf(", %u s, %u edges; di sections of %u ns every ms\n", seconds, (uint32_t)edges.size(), diNs);
+  printf("  width error, us                          PIC32   per interrupt on the PC\n");
+  printf("       mean    rms    max   >= 1us     ns (assumed) ns      cycles\n");
+  report("old", &oldR, oldNs, oldC, harness);
+  report("new", &newR, newNs, newC, harness);
+  printf("  the PIC32 handler times are assumed inputs (-o, -n), the width errors follow from them\n");
+  printf("  rxDecode in the loop: %.1f ns per edge on the PC; edges lost %u, pulses rejected %u\n",
+         decodeNs, rxStats.overflows, rxStats.rejected);
+  return 0;
+#endif
+}
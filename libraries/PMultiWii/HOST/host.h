@@ -0,0 +1,20 @@
+/*
+  host.h - what the host programs of HOST/ drive in the PMultiWii sources
+*/
+
+#ifndef HOST_H_
+#define HOST_H_
+
+#include <stdint.h>
+#include <stdio.h>
+
+extern uint32_t host_us;            // micros() of the target, set by the host program; delay() moves it
+extern uint32_t host_ticks;         // core timer of the target, 40MHz, set by the host program
+extern uint8_t  host_mpu_reg[128];  // MPU6050 registers: a read from 0x3B returns the sample written there
+extern uint8_t  host_echo;          // 1: Serial prints to stdout
+extern FILE    *host_uart;          // the bytes written to U1TXREG (the trace of PTrace.cpp), NULL: dropped
+
+void host_serial1_feed(const uint8_t *data, uint16_t n);  // bytes received by Serial1
+void host_mpu_sample(const int16_t acc[3], int16_t temperature, const int16_t gyro[3]);
+
+#endif /* HOST_H_ */
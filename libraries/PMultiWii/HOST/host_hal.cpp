@@ -0,0 +1,86 @@
+/*
+  host_hal.cpp - the chipKIT core and the MPU6050 for the HOST build of PMultiWii
+*/
+
+#include <stdio.h>
+
+#include "WProgram.h"
+#include "Wire.h"
+
+uint32_t host_us = 0;
+uint32_t host_ticks = 0;
+uint8_t  host_mpu_reg[128];
+uint8_t  host_echo = 0;
+FILE    *host_uart = NULL;
+
+volatile uint32_t T2CON, T2CONSET, TMR2, PR2;
+volatile uint32_t OC1CON, OC1CONSET, OC1R, OC1RS;
+volatile uint32_t OC2CON, OC2CONSET, OC2R, OC2RS;
+volatile uint32_t OC3CON, OC3CONSET, OC3R, OC3RS;
+volatile uint32_t OC4CON, OC4CONSET, OC4R, OC4RS;
+host_occon_bits OC1CONbits, OC2CONbits, OC3CONbits, OC4CONbits;
+volatile uint32_t AD1PCFGSET, TRISBSET, CNCON, CNENSET, CNPUESET, PORTB;
+volatile uint32_t IPC6SET, IFS1CLR, IEC1SET;
+volatile uint32_t I2C1BRG;
+volatile uint32_t U1STA, U2MODECLR, U2MODESET;
+host_txreg U1TXREG;
+
+void host_txreg::operator=(uint32_t c) { if (host_uart) fputc(c, host_uart); }
+
+HardwareSerial Serial, Serial1;
+TwoWire Wire;
+
+unsigned long micros(void) { return host_us; }
+unsigned long millis(void) { return host_us / 1000; }
+void delay(unsigned long ms) { host_us += ms * 1000; }
+void pinMode(uint8_t pin, uint8_t mode) { }
+
+// big endian registers from ACCEL_XOUT_H 0x3B, as the MPU6050
+void host_mpu_sample(const int16_t acc[3], int16_t temperature, const int16_t gyro[3]) {
+  int16_t v[7] = {acc[0], acc[1], acc[2], temperature, gyro[0], gyro[1], gyro[2]};
+  for (uint8_t i = 0; i < 7; i++) {
+    host_mpu_reg[0x3B + 2 * i]     = (uint16_t)v[i] >> 8;
+    host_mpu_reg[0x3B + 2 * i + 1] = v[i] & 0xFF;
+  }
+}
+
+/***************                   Wire                   ********************/
+static uint8_t wireReg, wireFirst;
+
+void TwoWire::begin() { }
+void TwoWire::beginTransmission(uint8_t address) { wireFirst = 1; }
+void TwoWire::send(uint8_t data) {
+  if (wireFirst) wireReg = data;             // the register address, then the values written
+  else host_mpu_reg[wireReg++ & 0x7F] = data;
+  wireFirst = 0;
+}
+uint8_t TwoWire::endTransmission(void) { return 0; }
+uint8_t TwoWire::requestFrom(uint8_t address, uint8_t quantity) { return quantity; }
+uint8_t TwoWire::receive(void) { return host_mpu_reg[wireReg++ & 0x7F]; }
+
+/***************                   Serial                 ********************/
+static uint8_t serial1Ring[256];
+static uint8_t serial1Head, serial1Tail;
+
+void host_serial1_feed(const uint8_t *data, uint16_t n) {
+  while (n--) serial1Ring[serial1Head++] = *data++;        // 256 bytes, the oldest are overwritten
+}
+
+void HardwareSerial::begin(unsigned long baud) { }
+int HardwareSerial::available(void) { return this == &Serial1 ? (uint8_t)(serial1Head - serial1Tail) : 0; }
+int HardwareSerial::read(void) { return available() ? serial1Ring[serial1Tail++] : -1; }
+void HardwareSerial::print(const char *s) { if (host_echo) fputs(s, stdout); }
+void HardwareSerial::print(char c) { if (host_echo) putchar(c); }
+void HardwareSerial::print(int n, int base) { print((long)n, base); }
+void HardwareSerial::print(unsigned int n, int base) { print((unsigned long)n, base); }
+void HardwareSerial::print(long n, int base) { if (host_echo) printf(base == HEX ? "%lX" : "%ld", n); }
+void HardwareSerial::print(unsigned long n, int base) { if (host_echo) printf(base == HEX ? "%lX" : "%lu", n); }
+void HardwareSerial::print(double n, int digits) { if (host_echo) printf("%.*f", digits, n); }
+void HardwareSerial::println(void) { print("\n"); }
+void HardwareSerial::println(const char *s) { print(s); println(); }
+void HardwareSerial::println(char c) { print(c); println(); }
+void HardwareSerial::println(int n, int base) { print(n, base); println(); }
+void HardwareSerial::println(unsigned int n, int base) { print(n, base); println(); }
+void HardwareSerial::println(long n, int base) { print(n, base); println(); }
+void HardwareSerial::println(unsigned long n, int base) { print(n, base); println(); }
+void HardwareSerial::println(double n, int digits) { print(n, digits); println(); }
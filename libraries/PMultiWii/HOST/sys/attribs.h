@@ -0,0 +1,13 @@
+/*
+  sys/attribs.h - PIC32 interrupt attributes for the HOST build of PMultiWii:
+  an __ISR handler becomes a plain function, the host program calls it.
+*/
+
+#ifndef _SYS_ATTRIBS_H
+#define _SYS_ATTRIBS_H
+
+#define __ISR(vector, ipl)
+
+#define _CHANGE_NOTICE_VECTOR 26
+
+#endif
@@ -7,6 +7,7 @@
 #include "POutput.h"
 #include "PRX.h"
 #include "PSensors.h"
+#include "PTrace.h"
 
 
 uint32_t currentTime = 0;
@@ -15,11 +16,15 @@ uint32_t cycleTime = 0;
 uint16_t calibratingA = 0;  
 uint16_t calibratingG = 0;
 
-static int16_t last_error[3] = {0,0,0};
-static int32_t sum_error[3] = {0,0,0};
-double Kp[3] = {0.6,0.6,0.6};
-double Ki[3] = {0.1,0.1,0.1};
-double Kd[3] = {0.3,0.3,0.3};
+#define PID_Q16(x)       ((int32_t)((x) * 65536.0 + 0.5))  // gain of config.h to Q16, folded by the compiler
+#define PID_MAX          (MAXCOMMAND - MINCOMMAND)         // a larger correction saturates all motors anyway
+#define US_TO_S_Q32      4295                              // 1/1000000, Q32
+#define GYRO_RATE_Q16    11100                             // gyro LSB at +/- 2000 deg/sec to rcCommand units/s (159/rad), Q16
+
+static int32_t ITerm[2] = {0,0};                           // Q16
+int32_t Kp[2] = {PID_Q16(PID_ROLL_P), PID_Q16(PID_PITCH_P)};
+int32_t Ki[2] = {PID_Q16(PID_ROLL_I), PID_Q16(PID_PITCH_I)};
+int32_t Kd[2] = {PID_Q16(PID_ROLL_D), PID_Q16(PID_PITCH_D)};
 int16_t gyroZero[3] = {0,0,0};
 int16_t accZero[3] = {0,0,0};
 imu_t imu;
@@ -29,16 +34,27 @@ int16_t rcSerial[8];         // interval [1000;2000] - is rcData coming from MSP
 int16_t rcCommand[4];        // interval [1000;2000] for THROTTLE and [-500;+500] for ROLL/PITCH/YAW
 uint8_t rcSerialCount = 0;   // a counter to select legacy RX when there is no more MSP rc serial data
 
+#if TRACE_POINTS & TRACE_LOOP
+static uint32_t loopCount = 0;      // loop-time counters, traced and cleared every second
+static uint32_t cycleSum = 0;
+static uint32_t cycleMin = 0xFFFFFFFF, cycleMax = 0;
+static uint32_t loopTraceTime = 0;
+#endif
+
 
-double axisPID[3];
-double c_angle[2];
+int16_t axisPID[3];
+int32_t c_angle[2];          // Euler angles ROLL & PITCH in rad, Q16
 
 char* sz_blade[] = {"REAR_RIGHT","FRONT_RIGHT","REAR_LEFT","FRONT_LEFT"};
 char* sz_axis[] = {"ROLL","PITCH","YAW","THROTTLE","AUX1"};
 
 bool MultiWii_setup() {
     
+#if TRACE_POINTS
+  Serial.begin(TRACE_BAUD); // the records of the trace points take more than 9600 bauds
+#else
   Serial.begin(9600); // initialize serial 
+#endif
   
 #if defined(TRACE)
   Serial.println("********************* INIT ***********************");
@@ -124,9 +140,7 @@ bool MultiWii_setup() {
 
   while (calibratingG > 0 || calibratingA > 0)
   { 
-     ACC_getADC();
-  
-     Gyro_getADC();
+     MPU_getADC();
   }
 
 #if defined(TRACE)
@@ -163,6 +177,10 @@ bool MultiWii_setup() {
 
   writeAllMotors(MINCOMMAND);
 
+#if TRACE_POINTS
+  traceInit();
+#endif
+
   return true;
 }
 
@@ -171,55 +189,95 @@ bool MultiWii_setup() {
 
 void MultiWii_loop () {
  
-  uint8_t axis;
-  int16_t error = 0;
-  int16_t delta_error = 0;
-  int16_t PTerm = 0, ITerm = 0, DTerm = 0;
+#if defined(RC_FILTER)
+  computeRC(); // every loop: the frames of the receiver in, rcData and rcCommand filtered out
+#else
   static uint32_t rcTime  = 0;
   
+  rxDecode(); // every loop: the RC edges and the SBUS bytes never wait long
   
   if ((currentTime > rcTime )|| (rcTime  == 0)) { // 50Hz: PPM frequency of the RC, no change happen within 20ms except first time
     rcTime = currentTime + 20000;
     
     computeRC();
   }
+#endif
+  //**** Read IMU ****   
+  MPU_getADC(); // with MPU6050_INT, waits for the next sample: the loop runs at the 1kHz of the MPU6050
+
   currentTime = micros();
   cycleTime = currentTime - previousTime;
-  previousTime = currentTime 
-  //**** Read IMU ****   
-  ACC_getADC();
-  
-  Gyro_getADC();
+  previousTime = currentTime;
+
   //**** ROLL & PITCH & YAW PID ****
-   
+  computePID();
+
+  RunMotors();
+
+#if TRACE_POINTS & TRACE_LOOP
+  if (loopTraceTime == 0) {
+    loopTraceTime = currentTime;   // the cycle of the trace just before is not counted
+  } else {
+    loopCount++;
+    cycleSum += cycleTime;
+    if (cycleTime < cycleMin) cycleMin = cycleTime;
+    if (cycleTime > cycleMax) cycleMax = cycleTime;
+  }
+  if (currentTime - loopTraceTime >= 1000000) {
+    TRACE_POINT(TRACE_LOOP, TRC_LOOP, (int32_t)loopCount, (int32_t)cycleMin,
+                (int32_t)(loopCount ? cycleSum / loopCount : 0), (int32_t)cycleMax);
+    TRACE_POINT(TRACE_LOOP, TRC_MPU_STATS, mpuStats.missed, mpuStats.timeouts, mpuStats.errors, mpuStats.readMax);
+    TRACE_POINT(TRACE_LOOP, TRC_RX_STATS, (int32_t)rxStats.edges, (int32_t)rxStats.frames, rxStats.overflows,
+                rxStats.rejected, rxStats.failsafes);
+    loopCount = cycleSum = 0;
+    cycleMin = 0xFFFFFFFF; cycleMax = 0;
+    loopTraceTime = 0;
+  }
+#endif
+
+#if TRACE_POINTS
+  traceDrain();
+#endif
+}
+
+
+/*******************************************************************************/
+/*                    computePID                                               */
+/*  - axisPID[ROLL] & axisPID[PITCH] from the angle error, in fixed point:     */
+/*         error = rcCommand[axis] - c_angle[axis] converted to [-500;+500]    */
+/*         P: Kp * error                                                       */
+/*         I: Ki * sum(error * cycleTime in s), limited to +/-PID_I_MAX and    */
+/*            reset while the throttle is under MINCHECK                       */
+/*         D: Kd * angle rate in rcCommand units/s, from imu.gyroADC           */
+/*  - axisPID[YAW] = 0                                                         */
+/*******************************************************************************/
+
+void computePID() {
+  uint8_t axis;
+  int16_t error, rate;
+  int64_t PID;
+  uint32_t dt = min(cycleTime, 20000); // us: the first loop, or after a stall, integrates 20ms at most
+
   // ROLL & PITCH
   for(axis=0;axis<2;axis++) {
   	
-    error =  rcCommand[axis] - (int16_t)(c_angle[axis]*159.0); // convert c_angle from -pi;+pi to -500;+500
-    sum_error[axis] += (int32_t) (error * cycleTime);
+    error = rcCommand[axis] - ((c_angle[axis] * 159) >> 16); // convert c_angle from -pi;+pi to -500;+500
+    rate  = axis == ROLL ? imu.gyroADC[ROLL] : -imu.gyroADC[PITCH]; // the sign of the c_angle integration
     
-    delta_error = (error - last_error[axis])/cycleTime;
-    delta_error = ((int32_t) delta_error * ((uint16_t)0xFFFF / (cycleTime>>4)))>>6;
+    if (rcData[THROTTLE] < MINCHECK) {
+      ITerm[axis] = 0;
+    } else {
+      ITerm[axis] += ((int64_t)Ki[axis] * error * dt * US_TO_S_Q32) >> 32;
+      ITerm[axis] = constrain(ITerm[axis], -((int32_t)PID_I_MAX << 16), (int32_t)PID_I_MAX << 16);
+    }
     
-    axisPID[axis] =  (Kp[axis]*error) + (Ki[axis]*sum_error[axis]) + (Kd[axis]*delta_error);
-    
-    last_error[axis] = error;
+    PID  = (int64_t)Kp[axis] * error + ITerm[axis];
+    PID -= ((int64_t)Kd[axis] * rate * GYRO_RATE_Q16) >> 16;
+    axisPID[axis] = constrain(PID >> 16, -PID_MAX, PID_MAX);
 
-#if defined(TRACE)  
-    Serial.print(">MultiWii_loop: c_angle[");Serial.print(sz_axis[axis]);Serial.print("]:");Serial.println(c_angle[axis]);
-    Serial.print(">MultiWii_loop: rcCommand[");Serial.print(sz_axis[axis]);Serial.print("]:");Serial.println(rcCommand[axis]);
-    Serial.print(">MultiWii_loop: sum_error[");Serial.print(sz_axis[axis]);Serial.print("]:");Serial.println(sum_error[axis]);
-    Serial.print(">MultiWii_loop: error:");Serial.println(error);
-    Serial.print(">MultiWii_loop: axisPID[");Serial.print(sz_axis[axis]);Serial.print("]:");Serial.println(axisPID[axis]);
- #endif     
+    TRACE_POINT(TRACE_PID, TRC_PID, axis, c_angle[axis], rcCommand[axis], ITerm[axis], error, axisPID[axis]);
   }
 
   //YAW
   axisPID[YAW] = 0;
-  
-#if defined(TRACE5)  
-  Serial.print(">MultiWii_loop: axisPID[");Serial.print((int)YAW);Serial.print("]:");Serial.println(axisPID[YAW]);
-#endif
-
-  RunMotors();
 }
@@ -18,7 +18,8 @@ extern imu_t imu;
 extern int16_t gyroZero[3];
 extern int16_t accZero[3];
 
-extern double axisPID[3];
+extern int32_t Kp[2], Ki[2], Kd[2];
+extern int16_t axisPID[3];
 
 extern int16_t rcData[RC_CHANS];
 extern int16_t rcSerial[8];
@@ -27,6 +28,7 @@ extern int16_t rcCommand[4];
 
 bool MultiWii_setup();
 void MultiWii_loop ();
+void computePID();
 
 
 #endif /* MULTIWII_H_ */
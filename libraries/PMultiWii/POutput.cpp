@@ -4,6 +4,7 @@
 #include "def.h"
 #include "types.h"
 #include "PMultiWii.h"
+#include "PTrace.h"
 
 uint8_t PWM_PIN[4] = {3,5,6,9};      // OC1, 0C2, OC3, OC4 = rear, right, left, front   
 int16_t motor[4];
@@ -14,11 +15,7 @@ int16_t motor[4];
 /**************************************************************************************/
 void writeMotors() { // [936;1875] => [312;625]
 
-#if defined(TRACE8)
-  for (int i = 0; i < 4; i++) { 
-        Serial.print(">>>writeMotors: motor[");Serial.print(i);Serial.print("]:");Serial.println(motor[i]);
-  }
-#endif  
+  TRACE_POINT(TRACE_MOTORS, TRC_MOTORS, motor[0], motor[1], motor[2], motor[3]);
 
   OC1RS = motor[0]/3;
   OC2RS = motor[1]/3; 
@@ -140,16 +137,8 @@ void RunMotors() {
     motor[2] = PIDMIX(+1,+1,+1); //REAR_L
     motor[3] = PIDMIX(+1,-1,-1); //FRONT_L
 
-#if defined(TRACE)
-    Serial.print(">>>RunMotors: rcCommand[THROTTLE]:");Serial.print(rcCommand[THROTTLE]);Serial.print(" *** ");
-    Serial.print("axisPID[ROLL]:");Serial.print(axisPID[ROLL]);Serial.print(" *** ");
-    Serial.print("axisPID[PITCH]:");Serial.print(axisPID[PITCH]);Serial.print(" *** ");
-    Serial.print("axisPID[YAW]:");Serial.println(axisPID[YAW]);
-   
-    for (i = 0; i < 4; i++) { 
-        Serial.print(">>>RunMotors: motor[");Serial.print(i);Serial.print("]:");Serial.println(motor[i]);
-  }
-#endif
+    TRACE_POINT(TRACE_MOTORS, TRC_MIX, rcCommand[THROTTLE], axisPID[ROLL], axisPID[PITCH], axisPID[YAW]);
+
     maxMotor=motor[0];
     for(i=1; i< 4; i++)
       if (motor[i]>maxMotor) maxMotor=motor[i];
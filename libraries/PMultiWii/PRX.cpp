@@ -1,40 +1,102 @@
 #include "WProgram.h"
 #include <sys/attribs.h> //used for __ISR
+#if !defined(HOST)
+#include <cp0defs.h> //used for _CP0_GET_COUNT, the core timer
+#define cli()  asm volatile("di") //turn intrupts off
+#define sei()  asm volatile("ei") //turn intrupts on
+#endif
 
 #include "config.h"
 #include "def.h"
 #include "types.h"
 #include "PMultiWii.h"
+#include "PRX.h"
+#include "PTrace.h"
 
-/**************************************************************************************/
-/***************             Global RX related variables           ********************/
-/**************************************************************************************/
-//RAW RC values will be store here
-volatile uint16_t rcValue[RC_CHANS] = {1500, 1500, 1500, 1000, 1000}; // interval [1000;2000]
+/*
+  RC decoding: the change notice interrupt of RB1-RB5 only takes the time of the edge from the core
+  timer (40MHz, 25ns) and the state of PORTB into the edge FIFO; rxDecode(), in the loop, turns the
+  edges into pulse widths. The FIFO has one writer, the interrupt, and one reader, rxDecode(): no
+  interrupt is disabled to read the channels. A full FIFO drops the edge, the widths it breaks fall
+  out of [900;2200] and are rejected.
+    STANDARD_RX     one PWM pulse per channel on RB1-RB5: ROLL, PITCH, YAW, THROTTLE, AUX1
+    SERIAL_SUM_PPM  the PPM sum on RB1, the time between two rising edges is a channel, more than
+                    3ms is the sync; a frame is published at the sync when all its pulses were valid
+    SBUS            Futaba SBUS on UART2 (Serial1) at 100000 bauds 8E2, inverted by the UART; a frame
+                    is published when its 25 bytes are in, a gap of 2ms in the bytes starts a frame
+  rcValue[] holds the channels of the receiver in its order, rcChannel[] gives the one of each rc
+  function; the PPM and SBUS frames are decoded into a work buffer and copied whole. A PWM frame is
+  whole once the four sticks have a new pulse and none is high. rxFrameTime is the core timer at the
+  end of the last frame, for the RC_FILTER of computeRC.
+*/
+
+#define RX_EDGES      64            // edges between two rxDecode(), a power of 2
+#define RX_TICKS_US   40            // core timer ticks per us: half the 80MHz system clock
+#define RX_PINS       0x3e          // RB1-RB5
+#define RX_STICKS     0x0f          // the channels of ROLL, PITCH, YAW and THROTTLE in rcValue[], PWM
+
+#if defined(SBUS)
+  #define SBUS_SYNCBYTE  0x0F
+  #define SBUS_FRAME     25
+  #define SBUS_GAP_US    2000        // between frames: 3ms and more, between bytes of a frame 120us
+  static const uint8_t rcChannel[RC_CHANS] = {PITCH,YAW,THROTTLE,ROLL,AUX1};
+#elif defined(SERIAL_SUM_PPM)
+  static const uint8_t rcChannel[] = {SERIAL_SUM_PPM};
+#else
+  static const uint8_t rcChannel[RC_CHANS] = {ROLL,PITCH,YAW,THROTTLE,AUX1};  // RB1-RB5
+#endif
+
+rx_stats_t rxStats;
+static uint16_t rcValue[RC_SLOTS];  // interval [1000;2000]
+static uint32_t rxFrameTime;        // core timer
+
+#if !defined(SBUS)
+static volatile uint32_t rxEdgeTime[RX_EDGES], rxEdgePort[RX_EDGES];
+static volatile uint8_t rxEdgeHead, rxEdgeTail;
+#endif
 
 
 /**************************************************************************************/
 /***************                   RX Pin Setup                    ********************/
 /**************************************************************************************/
 void configureReceiver() {
+  uint8_t chan;
 
 #if defined(TRACE)  
   Serial.println(">>Start configureReceiver"); 
 #endif
-     
-  asm volatile("di");      //disable CPU interrupts
+
+  for (chan = 0; chan < RC_CHANS; chan++)   // sticks centered, THROTTLE and AUX1 low until the first pulses
+    rcValue[rcChannel[chan]] = chan < THROTTLE ? 1500 : 1000;
+
+#if defined(SBUS)
+  Serial1.begin(100000);   //UART2: 80MHz/16/100000 - 1 = 49, exact
+  U2MODECLR = 0x8000;      //UART2 off while its mode changes
+  U2MODESET = 0x0013;      //RXINV (bit 4), PDSEL=01: 8 bits even parity, STSEL: 2 stop bits
+  U2MODESET = 0x8000;      //UART2 on
+#else
+  cli();                   //disable CPU interrupts
   
+#if defined(SERIAL_SUM_PPM)
+  AD1PCFGSET = 0x00000002; //set analog pin RB1 to digital
+  TRISBSET =   0x00000002; //set RB1 as input
+  CNCON = 0x00008000;      //enable the CN module ON
+  CNENSET = 0x00000008;    //enable pin RB1 (CN3) for interrupt
+  CNPUESET = 0x00000008;   //enable weak pull up for pin RB1 (CN3)
+#else
   AD1PCFGSET = 0x0000003e; //set analog pins RB1-RB5 to digital 0x3e=111110
   TRISBSET =   0x0000003e; //set RB1-RB5 as inputs
   CNCON = 0x00008000;      //enable the CN module ON
   CNENSET = 0x000000f8;    //enable pins RB1-RB5 (CN3-CN7) for interrupt 0xf8=11111000
   CNPUESET = 0x000000f8;   //enable weak pull up for pins RB1-RB5 (CN3-CN7)
+#endif
   PORTB;                   //read PortB to clear any mismatch
   IPC6SET = 0x001f0000;    //set priority to 7 sub 4 0x00060000 for priority 1 sub 0 
   IFS1CLR = 0x0001;        //clear the CN interrupt flag bit
   IEC1SET = 0x0001;        //enable the CN interrupt enable bit
   
-  asm volatile("ei");      //enable CPU interrupts
+  sei();                   //enable CPU interrupts
+#endif
   
 #if defined(TRACE)  
   Serial.println("<<End   configureReceiver"); 
@@ -45,82 +107,142 @@ void configureReceiver() {
 /**************************************************************************************/
 /***************                   RX Interrupt                   ********************/
 /**************************************************************************************/
+#if !defined(SBUS)
 #ifdef __cplusplus
 extern "C" {
 #endif
 void __ISR(_CHANGE_NOTICE_VECTOR, ipl7) ChangeNotice_Handler(void) {  //priority 7 
+  uint8_t head = rxEdgeHead, next = (head + 1) & (RX_EDGES - 1);
 
-    static uint32_t edgeTime[5];
-    static uint16_t lastb; // previous PORTB
-    uint16_t thisb; // current PORTB
-    uint32_t currTime, dTime; // current time, delta time
+  rxEdgeTime[head] = _CP0_GET_COUNT(); // the time first, the edges after it are seen by the next interrupt
+  rxEdgePort[head] = PORTB;            // the read ends the mismatch
+  if (next != rxEdgeTail) rxEdgeHead = next;
+  else rxStats.overflows++;
+  IFS1CLR = 0x0001; // Be sure to clear the CN interrupt status flag before exiting the service routine.
+}
+#ifdef __cplusplus
+}
+#endif                  
+#endif
 
-    
-    thisb = PORTB;          // read PORT B   
-    currTime = micros();    
-
-    if ((thisb ^ lastb) & 0x02) {  // RB1 changed (0x02= 10)  ROLLPIN    
-      if (!(thisb & 0x02)) {       // RB1 is low                        
-        dTime = currTime-edgeTime[0];                            
-        if (900<dTime && dTime<2200) {  // filter erroneous values                             
-          rcValue[0] = (uint16_t)dTime;                             
-        }                                                            
-      }
-      else
-        edgeTime[0] = currTime; // RB1 is high                            
-    }        
-        
-    if ((thisb ^ lastb) & 0x04) {  // RB2 changed (0x04= 100)  PITCHPIN     
-      if (!(thisb & 0x04)) {       // RB2 is low                        
-        dTime = currTime-edgeTime[1];                             
-        if (900<dTime && dTime<2200) {  // filter erroneous values                              
-          rcValue[1] = (uint16_t)dTime;                             
-        }                                                            
-      }
-      else
-        edgeTime[1] = currTime; // RB2 is high                            
-    }        
-
-    if ((thisb ^ lastb) & 0x08) {  // RB3 changed (0x08= 1000)   YAWPIN    
-      if (!(thisb & 0x08)) {       // RB3 is low                        
-        dTime = currTime-edgeTime[2];                             
-        if (900<dTime && dTime<2200) {  // filter erroneous values                              
-          rcValue[2] = (uint16_t)dTime;                             
-        }                                                            
-      }
-      else
-        edgeTime[2] = currTime; // RB3 is high                            
-    }        
-
-   if ((thisb ^ lastb) & 0x10) {  // RB4 changed (0x10= 10000)   THROTTLEPIN  
-      if (!(thisb & 0x10)) {       // RB4 is low                        
-        dTime = currTime-edgeTime[3];                             
-        if (900<dTime && dTime<2200) {  // filter erroneous values                              
-          rcValue[3] = (uint16_t)dTime;                             
-        }                                                            
+
+/**************************************************************************************/
+/***************                   RX decoding                    ********************/
+/**************************************************************************************/
+#if !defined(SBUS)
+// a pulse in [900;2200] us, 0 otherwise
+static uint16_t rxPulse(uint32_t ticks) {
+  uint32_t us = (ticks + RX_TICKS_US / 2) / RX_TICKS_US;
+  if (900 < us && us < 2200) return us;
+  rxStats.rejected++;
+  return 0;
+}
+#endif
+
+#if defined(SBUS)
+static void rxSBus() {
+  static uint8_t sbus[SBUS_FRAME], sbusIndex = 0;
+  static uint32_t sbusLast;
+  uint16_t work[RC_SLOTS];
+  uint32_t bits, now = micros();
+  uint8_t slot, n, b;
+
+  if (!Serial1.available()) return;
+  if (now - sbusLast > SBUS_GAP_US && sbusIndex) {  // cut frame: its last bytes were lost
+    rxStats.rejected++;
+    sbusIndex = 0;
+  }
+  sbusLast = now;
+  while (Serial1.available()) {
+    uint8_t c = Serial1.read();
+    if (sbusIndex == 0 && c != SBUS_SYNCBYTE) continue;
+    sbus[sbusIndex++] = c;
+    if (sbusIndex < SBUS_FRAME) continue;
+    sbusIndex = 0;
+    if (sbus[SBUS_FRAME - 1] != 0x00) {       // not the end byte: out of step, the next sync byte starts again
+      rxStats.rejected++;
+      continue;
+    }
+    bits = 0; n = 0; b = 1;
+    for (slot = 0; slot < 16; slot++) {       // 16 channels of 11 bits, LSB first
+      while (n < 11) {
+        bits |= (uint32_t)sbus[b++] << n;
+        n += 8;
       }
-      else
-        edgeTime[3] = currTime; // RB4 is high                            
-    }        
-
-   if ((thisb ^ lastb) & 0x20) {  // RB5 changed (0x20= 100000)   AUX1PIN    
-      if (!(thisb & 0x20)) {       // RB5 is low                        
-        dTime = currTime-edgeTime[4];                             
-        if (900<dTime && dTime<2200) {   // filter erroneous values                             
-          rcValue[4] = (uint16_t)dTime;                             
-        }                                                            
+      work[slot] = (bits & 0x07FF) / 2 + 976;
+      bits >>= 11;
+      n -= 11;
+    }
+    work[16] = sbus[23] & 0x01 ? 2000 : 1000; // the two digital channels
+    work[17] = sbus[23] & 0x02 ? 2000 : 1000;
+    if (sbus[23] & 0x08) rxStats.failsafes++; // the receiver lost the transmitter: its failsafe values
+    memcpy(rcValue, work, sizeof(rcValue));
+    rxFrameTime = _CP0_GET_COUNT();
+    rxStats.frames++;
+  }
+}
+#else
+static void rxEdge(uint32_t time, uint32_t port) {
+  static uint32_t lastPort;
+#if defined(SERIAL_SUM_PPM)
+  static uint32_t lastRise;
+  static uint16_t work[RC_SLOTS];
+  static uint8_t slot = RC_SLOTS + 1;         // no frame until a sync
+  uint32_t ticks;
+
+  if ((port ^ lastPort) & port & 0x02) {      // RB1 rising
+    ticks = time - lastRise;
+    lastRise = time;
+    if (ticks > 3000 * RX_TICKS_US) {         // sync: the frame before is whole when all its pulses were
+      if (slot >= 4 && slot <= RC_SLOTS) {
+        memcpy(rcValue, work, sizeof(rcValue));
+        rxFrameTime = time;
+        rxStats.frames++;
       }
-      else
-        edgeTime[4] = currTime; // RB5 is high                            
-    }        
-   
-    lastb = thisb;    // Memorize the current state of PORT B
-    IFS1CLR = 0x0001; // Be sure to clear the CN interrupt status flag before exiting the service routine.
-   
-#ifdef __cplusplus
+      slot = 0;
+    } else if (slot < RC_SLOTS) {
+      if ((work[slot] = rxPulse(ticks))) slot++;
+      else slot = RC_SLOTS + 1;
+    }
+  }
+#else
+  static uint32_t rise[RC_CHANS];
+  static uint8_t pulses;                                         // channels with a new pulse
+  uint32_t changed = (port ^ lastPort) & RX_PINS;
+  uint16_t us;
+
+  for (uint8_t chan = 0; changed; chan++, changed >>= 1) {
+    if (!(changed & 0x02)) continue;
+    if (port & (0x02 << chan)) rise[chan] = time;                // RBn rising
+    else if ((us = rxPulse(time - rise[chan]))) {
+      rcValue[chan] = us;
+      pulses |= 1 << chan;
+    }
+  }
+  // with the channels one after the other, the frame ends on the last stick whatever the first pulse seen
+  if ((pulses & RX_STICKS) == RX_STICKS && !((port >> 1) & RX_STICKS)) {
+    pulses = 0;
+    rxFrameTime = time;
+    rxStats.frames++;
+  }
+#endif
+  lastPort = port;
 }
-#endif                  
-               
+#endif
+
+// the edges or the SBUS bytes received since the last call into rcValue[]: at least every 20ms
+void rxDecode() {
+#if defined(SBUS)
+  rxSBus();
+#else
+  uint8_t tail = rxEdgeTail;
+  while (tail != rxEdgeHead) {
+    rxEdge(rxEdgeTime[tail], rxEdgePort[tail]);
+    tail = (tail + 1) & (RX_EDGES - 1);
+    rxStats.edges++;
+  }
+  rxEdgeTail = tail;
+#endif
 }
 
 /**************************************************************************************
@@ -128,22 +250,116 @@ void __ISR(_CHANGE_NOTICE_VECTOR, ipl7) ChangeNotice_Handler(void) {  //priority
 **************************************************************************************/
 
 uint16_t readRawRC(uint8_t chan) {
-  uint16_t data;
-   
-  asm volatile("di");    // turn intrupts off
-  data = rcValue[chan];  // Let's copy the data Atomically
-  asm volatile("ei");    // turn intrupts on
- 
-  return data; // We return the value correctly copied when the IRQ's where disabled
+  return rcValue[rcChannel[chan]]; // written by rxDecode only, in the loop
+}
+
+
+#if defined(RC_FILTER)
+/* RC_FILTER: computeRC runs every loop. A new frame (rxStats.frames moved) is read with the core
+   timer of its end, then each channel of rcData follows it through its filter: the PT1 for the time
+   since the last loop, the biquad with coefficients for the average loop time (computed again when
+   it drifts by 1/8), the ramp of INTERP over the average frame interval from the end of the frame.
+   The channels run in 1/16us. */
+#define RC_SHIFT        4
+#define RC_BIQUAD_SHIFT 24
+
+static const uint8_t rcFilterType[] = RC_FILTER;
+
+typedef struct {
+  int32_t x1, x2, y1, y2;
+} rc_biquad_t;
+
+// the Butterworth low pass at RC_FILTER_HZ for a loop of dt us, in 1/2^RC_BIQUAD_SHIFT
+static void rcBiquadCoefficients(int32_t *c, uint32_t dt) {
+  float w = 2 * PI * RC_FILTER_HZ * dt * 1e-6f, cs = cos(w), alpha = sin(w) * 0.7071068f;   // Q = 1/sqrt(2)
+  float scale = (1L << RC_BIQUAD_SHIFT) / (1 + alpha);
+  c[0] = (1 - cs) / 2 * scale;  // b0 = b2, b1 = 2 b0
+  c[1] = -2 * cs * scale;       // a1
+  c[2] = (1 - alpha) * scale;   // a2
 }
 
+static void rcFilter() {
+  static uint32_t frames, frameTime, frameInterval = 20000, loopTime, loopAvg, coefLoop;
+  static int32_t from[RC_CHANS], to[RC_CHANS], out[RC_CHANS], coef[3];
+  static rc_biquad_t biquad[RC_CHANS];
+  static uint8_t started, ramped;
+  uint32_t now = _CP0_GET_COUNT(), dt, age;
+  int32_t k, ramp;
+  uint8_t chan;
+
+  if (frames != rxStats.frames) {                            // a new frame
+    uint32_t interval = (rxFrameTime - frameTime) / RX_TICKS_US;
+    frames = rxStats.frames;
+    if (started && interval < 50000)                         // not after a loss of the receiver
+      frameInterval += ((int32_t)(interval - frameInterval)) >> 2;
+    frameTime = rxFrameTime;
+    ramped = 0;
+    for (chan = 0; chan < RC_CHANS; chan++) {
+      from[chan] = out[chan];
+      to[chan] = (int32_t)readRawRC(chan) << RC_SHIFT;
+      if (!started) {
+        from[chan] = out[chan] = to[chan];
+        biquad[chan].x1 = biquad[chan].x2 = biquad[chan].y1 = biquad[chan].y2 = to[chan];
+      }
+    }
+    if (!started) {
+      loopTime = now;
+      loopAvg = coefLoop = 1000;                             // the 1kHz of the MPU6050
+      rcBiquadCoefficients(coef, coefLoop);
+    }
+    started = 1;
+  }
+  if (!started) {                                            // no frame yet: the values of configureReceiver
+    for (chan = 0; chan < RC_CHANS; chan++) rcData[chan] = readRawRC(chan);
+    return;
+  }
+
+  dt = (now - loopTime) / RX_TICKS_US;
+  loopTime = now;
+  loopAvg += ((int32_t)(dt - loopAvg)) >> 4;
+  if (loopAvg > coefLoop + (coefLoop >> 3) || loopAvg < coefLoop - (coefLoop >> 3)) {
+    coefLoop = loopAvg;
+    rcBiquadCoefficients(coef, coefLoop);
+  }
+  k = ((int32_t)dt << 15) / (dt + (uint32_t)(1000000 / (2 * PI * RC_FILTER_HZ)));   // PT1 gain, 1/32768
+  age = (now - frameTime) / RX_TICKS_US;
+  if (age >= frameInterval) ramped = 1;                     // and stays there until the next frame, the core timer may wrap
+  ramp = ramped ? 1L << 15 : ((int32_t)age << 15) / frameInterval;   // INTERP, 1/32768
+
+  for (chan = 0; chan < RC_CHANS; chan++) {
+    switch (chan < sizeof(rcFilterType) ? rcFilterType[chan] : RC_FILTER_NONE) {
+      case RC_FILTER_PT1:
+        out[chan] += ((to[chan] - out[chan]) * k) >> 15;
+        break;
+      case RC_FILTER_BIQUAD: {
+        rc_biquad_t *b = &biquad[chan];
+        int32_t y = ((int64_t)coef[0] * (to[chan] + 2 * b->x1 + b->x2) - (int64_t)coef[1] * b->y1
+                     - (int64_t)coef[2] * b->y2) >> RC_BIQUAD_SHIFT;
+        b->x2 = b->x1; b->x1 = to[chan];
+        b->y2 = b->y1; b->y1 = y;
+        out[chan] = y;
+        break;
+      }
+      case RC_FILTER_INTERP:
+        out[chan] = from[chan] + (((to[chan] - from[chan]) * ramp) >> 15);
+        break;
+      default:
+        out[chan] = to[chan];
+    }
+    rcData[chan] = (out[chan] + (1 << (RC_SHIFT - 1))) >> RC_SHIFT;
+  }
+}
+#endif
 
 /****************************************************************************/
 /*                    computeRC                                             */
+/*  - call rxDecode for the pulses received since the last loop             */
 /*  - call readRawRC to get:                                                */
 /*         rcData4Values[chan][rc4ValuesIndex]                              */
 /*    and make average on 4 values to get:                                  */
 /*         rcData[chan] interval [#1000;#2000]                              */
+/*    with RC_FILTER, every loop: rcFilter, each channel through its own  */
+/*    filter from the frames of the receiver                                */
 /*  - compute rcCommand[axis] from rcData[chan] using ratio/expo & min/max  */      
 /*            interval [#-500;#+500] for ROLL & PITCH                       */
 /*            interval [-500;+500] for YAW                                  */
@@ -152,25 +368,22 @@ uint16_t readRawRC(uint8_t chan) {
 /****************************************************************************/
 
 void computeRC() {
-  static uint16_t rcData4Values[RC_CHANS][4], rcDataMean[RC_CHANS];
-  static uint8_t rc4ValuesIndex = 0;
-  static uint8_t rcinit = 0;
   uint8_t axis;
-  uint8_t chan,a;
   
-#if defined(TRACE9)
-    Serial.println(">computeRC");
-#endif 
+    rxDecode();
+#if defined(RC_FILTER)
+    rcFilter();
+#else
+    static uint16_t rcData4Values[RC_CHANS][4], rcDataMean[RC_CHANS];
+    static uint8_t rc4ValuesIndex = 0;
+    static uint8_t rcinit = 0;
+    uint8_t chan,a;
 
     rc4ValuesIndex++;
     if (rc4ValuesIndex == 4) {rc4ValuesIndex = 0; rcinit = 1;}
     
     for (chan = 0; chan < RC_CHANS; chan++) { // read data from all channels
         rcData4Values[chan][rc4ValuesIndex] = readRawRC(chan);
-#if defined(TRACE9)  
-        Serial.print("rcData4Values[");Serial.print((int)chan);Serial.print("][");
-        Serial.print((int)rc4ValuesIndex);Serial.print("]:");Serial.println(rcData4Values[chan][rc4ValuesIndex]);
-#endif
         if (rcinit == 1) {
             rcDataMean[chan] = 0;
             for (a=0;a<4;a++) rcDataMean[chan] += rcData4Values[chan][a];  // make average on 4 values
@@ -183,28 +396,21 @@ void computeRC() {
         {
             rcData[chan] = rcData4Values[chan][rc4ValuesIndex];  // not 4 reads yet
         }
-#if defined(TRACE9)  
-        Serial.print("rcData[");Serial.print((int)chan);Serial.print("]:");Serial.println(rcData[chan]);
-#endif       
     } // end read data from all channels
+#endif
+    TRACE_POINT(TRACE_RC, TRC_RCDATA, rcData[ROLL], rcData[PITCH], rcData[YAW], rcData[THROTTLE], rcData[AUX1]);
 
     //ROLL & PITCH & YAW 
     for(axis=0;axis<3;axis++) { 
         rcCommand[axis] = min(abs(rcData[axis]-MIDRC),500);         // interval [#1000;#2000] 
         if (rcData[axis]<MIDRC) rcCommand[axis] = -rcCommand[axis]; // translated to interval [-500; +500]
-           
-#if defined(TRACE9) 
-        Serial.print("rcCommand[");Serial.print((int)axis);Serial.print("]:");Serial.println(rcCommand[axis]);
-#endif         
     }  // end for ROLL & PITCH & YAW
     
     // THROTTLE
     rcCommand[THROTTLE] = constrain(rcData[THROTTLE],MINTHROTTLE,MAXTHROTTLE);  // interval  [#1000;#2000] restricted to interval [MINTHROTTLE; MAXTHROTTLE]
                                                                 // usually MINTHROTTLE = 1150, MAXTHROTTLE = 1850
-          
-#if defined(TRACE9) 
-    Serial.print("rcCommand[");Serial.print((int)THROTTLE);Serial.print("]:");Serial.println(rcCommand[THROTTLE]);
-#endif
+
+    TRACE_POINT(TRACE_RC, TRC_RCCOMMAND, rcCommand[ROLL], rcCommand[PITCH], rcCommand[YAW], rcCommand[THROTTLE]);
 }
 
 
@@ -1,8 +1,11 @@
 #ifndef RX_H_
 #define RX_H_
 
+extern rx_stats_t rxStats;
+
 void computeRC();
 void configureReceiver();
 uint16_t readRawRC(uint8_t chan);
+void rxDecode();
 
 #endif /* RX_H_ */
@@ -1,11 +1,17 @@
 #include "WProgram.h"
 #include "Wire.h" // used for I2C protocol (lib)
+#include <sys/attribs.h> //used for __ISR
+#if !defined(HOST)
+#define cli()  asm volatile("di") //turn intrupts off
+#define sei()  asm volatile("ei") //turn intrupts on
+#endif
 
 #include "config.h"
 #include "def.h"
 #include "types.h"
 #include "PMultiWii.h"
 #include "PSensors.h"
+#include "PTrace.h"
 
 /*** I2C address ***/
 #define MPU6050_ADDRESS     0x68 // address pin AD0 low (GND)
@@ -15,8 +21,11 @@
 #define G_FORCE            9.81
 #define PI                 3.14159265359
 
-uint8_t rawADC[6];
+#define MPU_SAMPLE_BYTES   14   // ACCEL_XOUT_H 0x3B to GYRO_ZOUT_L 0x48: accel, temperature, gyro
+
 uint8_t rawTemp[2];
+mpu_stats_t mpuStats;
+static uint32_t sampleTime;     // micros() of the sample in imu
 
   
 // ************************************************************************************************************
@@ -29,6 +38,9 @@ void i2c_init() {
 #endif 
 
   Wire.begin(); // setup I2C
+#if defined(CHIPKIT)
+  I2C1BRG = F_CPU / (2 * I2C_SPEED) - 10; // Wire.begin() sets 100kHz; BRG = (1/(2*Fsck) - 104ns) * PBCLK - 2, PBCLK = F_CPU
+#endif
   
 #if defined(TRACE)	
   Serial.println("<<<End   i2c_init");
@@ -48,8 +60,7 @@ size_t i2c_read_reg_to_buf(uint8_t devAddr, uint8_t regAddr, void *buf, size_t s
       Serial.print("devAddr: ");Serial.println((int)devAddr,HEX);
   }
 #endif                          
-  delay(1);
-  
+  // the register address is sent when endTransmission() returns, the read can follow at once
   Wire.requestFrom(devAddr, (uint8_t)size);
   size_t bytes_read = 0;
   uint8_t *b = (uint8_t*)buf;
@@ -62,10 +73,6 @@ size_t i2c_read_reg_to_buf(uint8_t devAddr, uint8_t regAddr, void *buf, size_t s
 }	
 
 
-void i2c_getSixRawADC(uint8_t add, uint8_t reg) {
-  i2c_read_reg_to_buf(add, reg, &rawADC, 6);
-}
-
 void i2c_getTemperature(uint8_t add, uint8_t reg) {
   i2c_read_reg_to_buf(add, reg, &rawTemp, 2);
 }
@@ -104,6 +111,8 @@ bool MPU_init() {
   if (ret> 0) return false;
   ret=i2c_writeReg(MPU6050_ADDRESS, 0x1A, 0x00); //CONFIG        -- EXT_SYNC_SET 0 (disable input pin for data sync) ; DLPF_CFG = 0 => ACC bandwidth = 260Hz  GYRO bandwidth = 256Hz)
   if (ret> 0) return false;
+  ret=i2c_writeReg(MPU6050_ADDRESS, 0x19, 0x07); //SMPLRT_DIV    -- 8kHz gyro output rate (DLPF_CFG 0) / (1+7) => 1kHz sample rate, the rate of the ACC
+  if (ret> 0) return false;
 
 #if defined(TRACE)	
   Serial.println("<<<End OK MPU_init");
@@ -181,27 +190,205 @@ bool initSensors() {
     
 #if defined(TRACE)	  
   Serial.print("Temperature: "); Serial.println(((double)imu.temperature + 12412.0) / 340.0);
+#endif 
+
+#if defined(MPU6050_INT)
+  if (!MPU_startSampling())
+  {
+#if defined(TRACE)	  
+   Serial.println("<<End KO MPU_startSampling: no data-ready interrupt");
+#endif    
+    return false;
+  }
+#endif
+
+#if defined(TRACE)	  
   Serial.println("<<End OK initSensors");
 #endif 
   return true;
 }
 
 
+// ************************************************************************************************************
+// MPU6050 data-ready sampling
+// ************************************************************************************************************
+#if defined(MPU6050_INT)
+/*
+  On each data-ready pulse of the MPU6050 (1kHz) the interrupt reads the 14 bytes of the sample in one burst
+  into the back buffer, driving the I2C1 module itself, then makes it the front buffer: MPU_getADC() copies
+  the front buffer while the next sample is read. Once the sampling runs, Wire no longer uses the bus.
+  A burst is about 420us at 400kHz; the interrupt is under the RC change notice (priority 7).
+*/
+#if   MPU6050_INT == 0
+  #define MPU_INT_VECTOR  _EXTERNAL_0_VECTOR
+  #define MPU_INT_IPCSET  IPC0SET
+#elif MPU6050_INT == 1
+  #define MPU_INT_VECTOR  _EXTERNAL_1_VECTOR
+  #define MPU_INT_IPCSET  IPC1SET
+#elif MPU6050_INT == 2
+  #define MPU_INT_VECTOR  _EXTERNAL_2_VECTOR
+  #define MPU_INT_IPCSET  IPC2SET
+#elif MPU6050_INT == 3
+  #define MPU_INT_VECTOR  _EXTERNAL_3_VECTOR
+  #define MPU_INT_IPCSET  IPC3SET
+#elif MPU6050_INT == 4
+  #define MPU_INT_VECTOR  _EXTERNAL_4_VECTOR
+  #define MPU_INT_IPCSET  IPC4SET
+#else
+  #error "MPU6050_INT is the external interrupt INT0 to INT4"
+#endif
+#define MPU_INT_BIT       (1UL << (3 + 4 * MPU6050_INT)) // INTxIF in IFS0, INTxIE in IEC0
+#define MPU_INT_PRIORITY  0x0c000000                     // IPCx<28:26>: priority 3 sub 0
+
+#define I2C_SEN     0x0001  // I2C1CON  start
+#define I2C_RSEN    0x0002  //          repeated start
+#define I2C_PEN     0x0004  //          stop
+#define I2C_RCEN    0x0008  //          receive a byte
+#define I2C_ACKEN   0x0010  //          send the acknowledge
+#define I2C_ACKDT   0x0020  //          the acknowledge is a NACK
+#define I2C_TRSTAT  0x4000  // I2C1STAT transmitting
+#define I2C_ACKSTAT 0x8000  //          NACK received
+#define I2C_POLLS   4000    // polls of a bus event before giving up, a byte is 22us at 400kHz
+
+static uint8_t mpuBuf[2][MPU_SAMPLE_BYTES];
+static uint32_t mpuTime[2];
+static volatile uint8_t mpuFront = 0;
+static volatile uint32_t mpuSequence = 0;  // samples read by the interrupt
+
+// wait for the module to clear the I2C1CON bits of the event started: 0 on time out
+static uint8_t i2cDone(uint32_t bits) {
+  for (uint16_t n = I2C_POLLS; n; n--) if (!(I2C1CON & bits)) return 1;
+  return 0;
+}
+
+// 1 when the byte is acknowledged
+static uint8_t i2cSend(uint8_t b) {
+  I2C1TRN = b;
+  for (uint16_t n = I2C_POLLS; n; n--) if (!(I2C1STAT & I2C_TRSTAT)) return !(I2C1STAT & I2C_ACKSTAT);
+  return 0;
+}
+
+static uint8_t i2cBurst(uint8_t devAddr, uint8_t regAddr, uint8_t *buf, uint8_t size) {
+  uint8_t ok;
+
+  I2C1CONSET = I2C_SEN;
+  ok = i2cDone(I2C_SEN) && i2cSend(devAddr << 1) && i2cSend(regAddr);
+  if (ok) {
+    I2C1CONSET = I2C_RSEN;
+    ok = i2cDone(I2C_RSEN) && i2cSend(devAddr << 1 | 1);
+  }
+  for (uint8_t i = 0; ok && i < size; i++) {
+    I2C1CONSET = I2C_RCEN;
+    ok = i2cDone(I2C_RCEN);
+    buf[i] = I2C1RCV;
+    if (i == size - 1) I2C1CONSET = I2C_ACKDT; // NACK the last byte
+    else               I2C1CONCLR = I2C_ACKDT;
+    I2C1CONSET = I2C_ACKEN;
+    ok = ok && i2cDone(I2C_ACKEN);
+  }
+  I2C1CONSET = I2C_PEN;
+  return i2cDone(I2C_PEN) && ok;
+}
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+void __ISR(MPU_INT_VECTOR, ipl3) MPU_DataReady_Handler(void) {  //priority 3
+  uint32_t start = micros();
+  uint8_t back = mpuFront ^ 1;
+
+  if (i2cBurst(MPU6050_ADDRESS, 0x3B, mpuBuf[back], MPU_SAMPLE_BYTES)) {
+    mpuTime[back] = start;
+    mpuFront = back;
+    mpuSequence++;
+  } else {
+    mpuStats.errors++;  // the front buffer stays the last good sample
+  }
+  uint32_t t = micros() - start;
+  if (t > mpuStats.readMax) mpuStats.readMax = t;
+  IFS0CLR = MPU_INT_BIT;
+}
+#ifdef __cplusplus
+}
+#endif
+
+bool MPU_startSampling() {
+  uint8_t ret=0;
+
+  ret=i2c_writeReg(MPU6050_ADDRESS, 0x37, 0x10); //INT_PIN_CFG   -- INT active high, push-pull, 50us pulse; INT_RD_CLEAR 1
+  if (ret> 0) return false;
+  ret=i2c_writeReg(MPU6050_ADDRESS, 0x38, 0x01); //INT_ENABLE    -- DATA_RDY_EN 1
+  if (ret> 0) return false;
+
+  cli();                        //disable CPU interrupts
+  IEC0CLR = 0xe0000000;         //I2C1 bus, slave and master interrupts off: the bus is driven from MPU_DataReady_Handler
+  INTCONSET = 1 << MPU6050_INT; //INTxEP: rising edge
+  MPU_INT_IPCSET = MPU_INT_PRIORITY;
+  IFS0CLR = MPU_INT_BIT;        //clear the INTx interrupt flag bit
+  IEC0SET = MPU_INT_BIT;        //enable the INTx interrupt enable bit
+  sei();                        //enable CPU interrupts
+
+  delay(10);
+  return mpuSequence > 0;
+}
+#endif
+
+
+// ************************************************************************
+// fixed point helpers of the angle estimation
+// ************************************************************************
+#define PI_Q16          205887  // PI rad, Q16
+#define HALF_PI_Q16     102944
+#define GYRO_RAD_Q48    299844  // rad per LSB per us of the gyro at +/- 2000 deg/sec, Q48
+#define ACC_WEIGHT_Q15  655     // 1 - 0.98: weight of the ACC angle in the complementary filter, Q15
+#define GYRO_DT_MAX     20000   // us: a longer gap between samples is integrated as 20ms
+
+// digit by digit, without branches in the loop: 13 rounds for the 2^24 of a 1G sum of squares
+static uint32_t isqrt32(uint32_t n) {
+  uint32_t root = 0, bit, t, take;
+
+  if (n == 0) return 0;
+  bit = 1UL << ((31 - __builtin_clz(n)) & ~1);
+  while (bit) {
+    t = root + bit;
+    take = -(uint32_t)(n >= t);   // all ones when the bit is in the root
+    n -= t & take;
+    root = (root >> 1) + (bit & take);
+    bit >>= 2;
+  }
+  return root;
+}
+
+// atan2(y, x) in radians Q16, |x| and |y| below 131072, within 0.0015 rad:
+// z = min/max in [0;1] Q15, atan(z) ~ PI/4*z + z*(1-z)*(0.2447 + 0.0663*z), then the octant
+int32_t Patan2(int32_t y, int32_t x) {
+  uint32_t ax = abs(x), ay = abs(y);
+  int32_t z, a;
+
+  if (ax == 0 && ay == 0) return 0;
+  z = ay <= ax ? (ay << 15) / ax : (ax << 15) / ay;
+  a = ((z * 25736) >> 15) + ((((z * (32768 - z)) >> 15) * (8018 + ((z * 2173) >> 15))) >> 15);
+  a <<= 1;
+  if (ay > ax) a = HALF_PI_Q16 - a;
+  if (x < 0)   a = PI_Q16 - a;
+  return y < 0 ? -a : a;
+}
+
+
 // ************************************************************************
 // GYRO common part
 // adjust imu.gyroADC according gyroZero and 
-// limit the variation between two consecutive readings (anti gyro glitch)
+// compute the Euler angles c_angle: complementary filter of the gyro
+// integration and the ACC angles, in fixed point
 // ************************************************************************
 void GYRO_Common() {
   static int32_t g[3];
   uint8_t axis;
-  double e_roll, e_pitch;
-  double i_roll, i_pitch;
-  double eax, eay, eaz;
-  double evx, evy, evz;
-  static double prev_c_roll  = 0.0;
-  static double prev_c_pitch = 0.0;
-  double a = 0.98;
+  int32_t e_roll, e_pitch;
+  int32_t i_roll, i_pitch;
+  int32_t az;
+  static int32_t prev_c_roll  = 0;
+  static int32_t prev_c_pitch = 0;
   uint32_t currentTime;
   static uint32_t previousTime = 0;
   uint32_t dt;
@@ -235,72 +422,34 @@ void GYRO_Common() {
     for (axis = 0; axis < 3; axis++) {
       imu.gyroADC[axis] -= gyroZero[axis];  
     }
-    
-    //Convert raw value to real value based an selectivity defined at init: +/- 2000 deg/sec
-    imu.dgyroADC[ROLL]  = imu.gyroADC[ROLL]  * 4000.0 / 65536; 
-    imu.dgyroADC[PITCH] = imu.gyroADC[PITCH] * 4000.0 / 65536; 
-    imu.dgyroADC[YAW]   = imu.gyroADC[YAW]   * 4000.0 / 65536; 
-#if defined(TRACE6)  
-    Serial.print(">>>GYRO_Common: imu.dgyroADC[ROLL]:");Serial.print(imu.dgyroADC[ROLL]);Serial.print(" *** ");
-    Serial.print("imu.dgyroADC[PITCH]:");Serial.print(imu.dgyroADC[PITCH]);Serial.print(" *** ");
-    Serial.print("imu.dgyroADC[YAW]:");Serial.println(imu.dgyroADC[YAW]);
-#endif 
+    TRACE_POINT(TRACE_IMU, TRC_GYRO, imu.gyroADC[ROLL], imu.gyroADC[PITCH], imu.gyroADC[YAW]);
 
-    // compute Euler angles between [-PI;+PI], re-add gravity1G
-	e_roll   = atan2(imu.daccADC[ROLL],   sqrt(pow(imu.daccADC[YAW]+1, 2.0) + pow(imu.daccADC[PITCH], 2.0)));
-	e_pitch  = atan2(imu.daccADC[PITCH],  sqrt(pow(imu.daccADC[YAW]+1, 2.0) + pow(imu.daccADC[ROLL],  2.0)));
+    // compute Euler angles between [-PI;+PI] Q16, re-add gravity1G (accZero removed it from imu.accADC[YAW])
+    az = imu.accADC[YAW] + ACC_1G;
+    e_roll  = Patan2(imu.accADC[ROLL],  isqrt32((uint32_t)(az*az) + (uint32_t)(imu.accADC[PITCH]*imu.accADC[PITCH])));
+    e_pitch = Patan2(imu.accADC[PITCH], isqrt32((uint32_t)(az*az) + (uint32_t)(imu.accADC[ROLL]*imu.accADC[ROLL])));
 
-#if defined(TRACE6)  
-    Serial.print(">>>GYRO_Common: e_roll:");Serial.print(e_roll);Serial.print(" *** ");
-    Serial.print("e_pitch:");Serial.println(e_pitch);   
-#endif   
+    TRACE_POINT(TRACE_IMU, TRC_ACC_ANGLE, e_roll, e_pitch);
     
-    // compute delta time DT in millis for gyro integration
-    currentTime = millis();
+    // compute delta time DT in micros between the samples for gyro integration
+    currentTime = sampleTime;
     if (previousTime > 0) {
-        dt = currentTime-previousTime;
+        dt = min(currentTime-previousTime, GYRO_DT_MAX);
   
-        // integrate the gyros angular velocity in deg/sec to determine angles in radians
-        i_roll =          imu.dgyroADC[0] * PI/180.0 * (double)dt/1000.0;
-        i_pitch = -1.00 * imu.dgyroADC[1] * PI/180.0 * (double)dt/1000.0;
-#if defined(TRACE6)  
-        Serial.print(">>>GYRO_Common: i_roll:");Serial.print(i_roll);Serial.print(" *** ");
-        Serial.print("i_pitch:");Serial.print(i_pitch);Serial.print(" *** ");
-        Serial.print("dt:");Serial.println(dt);
-        Serial.print(">>>GYRO_Common: prev_c_roll:");Serial.print(prev_c_roll);Serial.print(" *** ");
-        Serial.print("prev_c_pitch:");Serial.println(prev_c_pitch);
-#endif   
-        // adjust angles Roll & Pitch using complementary filter between [-PI;+PI]
-        c_angle[0]  = a * (prev_c_roll  + i_roll)  + (1 - a) * e_roll;
-	    prev_c_roll = c_angle[0];
-	    	    
-	    c_angle[1] = a * (prev_c_pitch + i_pitch) + (1 - a) * e_pitch;
-	    prev_c_pitch = c_angle[1];
-
-#if defined(TRACE6)  
-        Serial.print(">>>GYRO_Common: c_angle[0] in:");Serial.print(c_angle[0]*180.0/PI);Serial.print(" *** ");
-        Serial.print("c_angle[1] in:");Serial.println(c_angle[1]*180.0/PI);
-#endif  
-
-	    // Convert the acceleration to earth coordinates
-	    eax = imu.daccADC[PITCH] * cos(c_angle[0]);
-	    eay = imu.daccADC[ROLL]  * cos(c_angle[1]);
-	    eaz = imu.daccADC[YAW]   * cos(c_angle[0]) * cos(c_angle[1]);
-
-#if defined(TRACE6)  
-        Serial.print(">>>GYRO_Common: eax:");Serial.print(eax);Serial.print(" *** ");
-        Serial.print("eay:");Serial.print(eay);Serial.print(" *** ");
-        Serial.print("eaz:");Serial.println(eaz);
-#endif
-	    // Integrate acceleration to speed and convert in earth's X and Y axes meters per second
-	    evx += eax * G_FORCE * (double)dt/1000.0;
-	    evy += eay * G_FORCE * (double)dt/1000.0;
-	    evz += eaz * G_FORCE * (double)dt/1000.0;
-#if defined(TRACE6)  
-        Serial.print(">>>GYRO_Common: evx:");Serial.print(evx);Serial.print(" *** ");
-        Serial.print("evy:");Serial.print(evy);Serial.print(" *** ");
-        Serial.print("evz:");Serial.println(evz);
-#endif
+        // integrate the gyros angular velocity to determine angles in radians Q16
+        i_roll  =  (int32_t)(((int64_t)imu.gyroADC[0] * dt * GYRO_RAD_Q48) >> 32);
+        i_pitch = -(int32_t)(((int64_t)imu.gyroADC[1] * dt * GYRO_RAD_Q48) >> 32);
+        TRACE_POINT(TRACE_IMU, TRC_GYRO_ANGLE, i_roll, i_pitch, (int32_t)dt);
+        // adjust angles Roll & Pitch using complementary filter between [-PI;+PI]: 0.98 gyro, 0.02 ACC
+        c_angle[0]  = prev_c_roll + i_roll;
+        c_angle[0] += ((e_roll - c_angle[0]) * ACC_WEIGHT_Q15) >> 15;
+        prev_c_roll = c_angle[0];
+
+        c_angle[1]  = prev_c_pitch + i_pitch;
+        c_angle[1] += ((e_pitch - c_angle[1]) * ACC_WEIGHT_Q15) >> 15;
+        prev_c_pitch = c_angle[1];
+
+        TRACE_POINT(TRACE_IMU, TRC_ANGLE, c_angle[0], c_angle[1]);
     }
     else
     {
@@ -313,32 +462,6 @@ void GYRO_Common() {
 
 }
 
-
-/*******************************************************************************/
-/*                    Gyro_getADC                                              */
-/*  - call i2c_getSixRawADC to get raw values for:                             */
-/*                            imu.gyroADC[axis]                                */
-/*  - call GYRO_Common to adjust imu.gyroADC[axis] with gyroZero and           */
-/*    limit the variation between two consecutive readings (anti gyro glitch)  */
-/*    interval [-8192;+8192]                                                   */
-/*******************************************************************************/
-
-void Gyro_getADC () {
-   
-  i2c_getSixRawADC(MPU6050_ADDRESS, 0x43); 
-  
-  imu.gyroADC[ROLL]  = (rawADC[0] << 8) | rawADC[1];
-  imu.gyroADC[PITCH] = (rawADC[2] << 8) | rawADC[3];
-  imu.gyroADC[YAW]   = (rawADC[4] << 8) | rawADC[5]; 
-#if defined(TRACE6)  
-    Serial.print(">>>Gyro_getADC(1): imu.gyroADC[ROLL]:");Serial.print(imu.gyroADC[ROLL]);Serial.print(" *** ");
-    Serial.print("imu.gyroADC[PITCH]:");Serial.print(imu.gyroADC[PITCH]);Serial.print(" *** ");
-    Serial.print("imu.gyroADC[YAW]:");Serial.println(imu.gyroADC[YAW]);
-#endif 
-
-  GYRO_Common();
-}
-
 // ************************************************************************
 // ACC common part
 // adjust imu.accADC according accZero
@@ -377,48 +500,63 @@ void ACC_Common() {
     for (axis = 0; axis < 3; axis++) {
       imu.accADC[axis]  -= accZero[axis];
     }
-#if defined(TRACE6)  
-    Serial.print(">>>ACC_Common: imu.accADC[ROLL]:");Serial.print(imu.accADC[ROLL]);Serial.print(" *** ");
-    Serial.print("imu.accADC[PITCH]:");Serial.print(imu.accADC[PITCH]);Serial.print(" *** ");
-    Serial.print("imu.accADC[YAW]:");Serial.println(imu.accADC[YAW]);
-#endif
+    TRACE_POINT(TRACE_IMU, TRC_ACC, imu.accADC[ROLL], imu.accADC[PITCH], imu.accADC[YAW]);
   
-    //Convert raw value to real value based an selectivity defined at init: +/- 8g
-    imu.daccADC[ROLL]  = imu.accADC[ROLL]  * 16.0 / 65536;
-    imu.daccADC[PITCH] = imu.accADC[PITCH] * 16.0 / 65536;
-    imu.daccADC[YAW]   = imu.accADC[YAW]   * 16.0 / 65536;
-#if defined(TRACE6)  
-    Serial.print(">>>ACC_Common: imu.daccADC[ROLL]:");Serial.print(imu.daccADC[ROLL]);Serial.print(" *** ");
-    Serial.print("imu.daccADC[PITCH]:");Serial.print(imu.daccADC[PITCH]);Serial.print(" *** ");
-    Serial.print("imu.daccADC[YAW]:");Serial.println(imu.daccADC[YAW]);
-#endif    
   }
 }
 
 
 /****************************************************************/
-/*                    ACC_getADC                                */
-/*  - call i2c_getSixRawADC to get raw values for:              */
-/*                            imu.accADC[axis]                  */
+/*                    MPU_getADC                                */
+/*  - take the next sample of the MPU6050, read in one burst:   */
+/*         imu.accADC[axis], imu.temperature, imu.gyroADC[axis] */
+/*    with MPU6050_INT, wait for the data-ready interrupt       */
+/*    to have read it                                           */
 /*  - call ACC_Common to adjust imu.accADC[axis] with accZero   */
-/*    interval [-4096;+4096]                                    */
-/*  - call ComputeEulerAngles to get the Euler angles in radians*/
+/*  - call GYRO_Common to adjust imu.gyroADC[axis] with         */
+/*    gyroZero and compute the Euler angles c_angle, rad Q16    */
 /****************************************************************/
 
-void ACC_getADC () {
-  
-  i2c_getSixRawADC(MPU6050_ADDRESS, 0x3B);
-    
-  imu.accADC[ROLL]  = (rawADC[0] << 8) | rawADC[1];
-  imu.accADC[PITCH] = (rawADC[2] << 8) | rawADC[3];
-  imu.accADC[YAW]   = (rawADC[4] << 8) | rawADC[5]; 
-#if defined(TRACE6)  
-    Serial.print(">>>ACC_getADC(1): imu.accADC[ROLL]:");Serial.print(imu.accADC[ROLL]);Serial.print(" *** ");
-    Serial.print("imu.accADC[PITCH]:");Serial.print(imu.accADC[PITCH]);Serial.print(" *** ");
-    Serial.print("imu.accADC[YAW]:");Serial.println(imu.accADC[YAW]);
+void MPU_getADC () {
+  uint8_t raw[MPU_SAMPLE_BYTES];
+
+#if defined(MPU6050_INT)
+  static uint32_t sequence = 0;
+  uint32_t last, start = micros();
+
+  while (mpuSequence == sequence) {        // the next sample, 3 periods at most: then the last one again
+#if TRACE_POINTS
+    traceDrain();                          // the UART takes the trace while the loop waits
+#endif
+    if (micros() - start > 3000) {
+      mpuStats.timeouts++;
+      break;
+    }
+  }
+  cli();                                   // the front buffer cannot change during the copy
+  memcpy(raw, mpuBuf[mpuFront], MPU_SAMPLE_BYTES);
+  sampleTime = mpuTime[mpuFront];
+  last = mpuSequence;
+  sei();
+  if (mpuStats.samples > 0 && last - sequence > 1) mpuStats.missed += last - sequence - 1;
+  sequence = last;
+#else
+  i2c_read_reg_to_buf(MPU6050_ADDRESS, 0x3B, raw, MPU_SAMPLE_BYTES);
+  sampleTime = micros();
 #endif
+  mpuStats.samples++;
+
+  imu.accADC[ROLL]   = (raw[0]  << 8) | raw[1];
+  imu.accADC[PITCH]  = (raw[2]  << 8) | raw[3];
+  imu.accADC[YAW]    = (raw[4]  << 8) | raw[5];
+  imu.temperature    = (raw[6]  << 8) | raw[7];
+  imu.gyroADC[ROLL]  = (raw[8]  << 8) | raw[9];
+  imu.gyroADC[PITCH] = (raw[10] << 8) | raw[11];
+  imu.gyroADC[YAW]   = (raw[12] << 8) | raw[13];
+  TRACE_POINT(TRACE_IMU, TRC_MPU, imu.accADC[ROLL], imu.accADC[PITCH], imu.accADC[YAW],
+              imu.gyroADC[ROLL], imu.gyroADC[PITCH], imu.gyroADC[YAW], imu.temperature);
 
   ACC_Common();
-  
-}
 
+  GYRO_Common();
+}
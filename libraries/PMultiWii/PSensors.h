@@ -1,17 +1,16 @@
 #ifndef SENSORS_H_
 #define SENSORS_H_
 
-extern double c_angle[2];
-double Patan2(double x, double y);
+extern int32_t c_angle[2];
+extern mpu_stats_t mpuStats;
+int32_t Patan2(int32_t y, int32_t x);
 
 void ACC_Common();
-void ACC_getADC ();
 bool ACC_init ();
 void GYRO_Common();
-void Gyro_getADC ();
 bool Gyro_init();
+void MPU_getADC ();
 
-void i2c_getSixRawADC(uint8_t add, uint8_t reg);
 void i2c_getTemperature(uint8_t add, uint8_t reg);
 void i2c_init();
 size_t i2c_read_reg_to_buf(uint8_t devAddr, uint8_t regAddr, void *buf, size_t size);
@@ -19,5 +18,6 @@ uint8_t i2c_writeReg(uint8_t devAddr, uint8_t regAddr, uint8_t val);
 
 bool initSensors();
 bool MPU_init();
+bool MPU_startSampling();
 
 #endif /* SENSORS_H_ */
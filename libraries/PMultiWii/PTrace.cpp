@@ -0,0 +1,117 @@
+#include "WProgram.h"
+
+#include "config.h"
+#include "def.h"
+#include "types.h"
+#include "PTrace.h"
+
+#if TRACE_POINTS
+
+/*
+  Binary trace: a trace point codes its record into a RAM ring in a few us, traceDrain() moves the
+  ring to the transmit FIFO of the UART of Serial (UART1) as long as the FIFO has room, and never
+  waits: the loop calls it at its end and while it waits for the MPU6050 sample. The ring has one
+  writer, the trace points of the loop, and one reader, traceDrain(): the head is published once
+  the whole record is in the ring, a full ring drops the record, and the next record written tells
+  how many were lost.
+
+  Stream, after the boot messages of TRACE:
+    0x00 'P' 'T' version time           sync: time, varint, is micros(); at the first record, then every second
+    id | values << 5  dt  value * values  record: dt, varint, us since the record before; zigzag varints
+  The ids and the names of the values are in PTrace.h, tools/trace_decode.py prints the records.
+*/
+
+#define TRACE_VERSION  1
+#define TRACE_RING     2048                                // bytes, a power of 2
+#define TRACE_SYNC_US  1000000
+#define TRACE_BYTES    (1 + 5 + 5 * TRACE_VALUES_MAX)      // longest record
+#define UART_UTXBF     (1 << 9)                            // U1STA: the transmit FIFO is full
+
+#define TRACE_BARRIER() asm volatile("" ::: "memory")      // the ring bytes before the index that shows them
+
+trace_t trace;
+
+static uint8_t traceRing[TRACE_RING];
+static volatile uint16_t traceHead, traceTail;
+static uint32_t traceLast;                                 // micros() of the last record in the ring
+static uint32_t traceSyncTime;
+static uint32_t traceLost;                                 // records dropped since the last one in the ring
+static uint8_t traceOn;
+
+static uint8_t *traceVarint(uint8_t *p, uint32_t v) {
+  while (v >= 0x80) {
+    *p++ = v | 0x80;
+    v >>= 7;
+  }
+  *p++ = v;
+  return p;
+}
+
+static uint8_t *traceSigned(uint8_t *p, int32_t v) {
+  return traceVarint(p, (v << 1) ^ (v >> 31));             // zigzag: small values of both signs stay short
+}
+
+static uint8_t *traceHeader(uint8_t *p, uint8_t id, uint8_t values, uint32_t dt) {
+  *p++ = id | values << 5;
+  return traceVarint(p, dt);
+}
+
+// the records start once the boot messages are out: the stream is then binary only
+void traceInit() {
+  traceOn = 1;
+  traceSyncTime = micros() - TRACE_SYNC_US;
+}
+
+void traceRecord(uint8_t id, const int32_t *v, uint8_t n) {
+  uint8_t rec[8 + 2 * TRACE_BYTES], *p = rec;             // sync, dropped and the record
+  uint32_t now, last = traceLast;
+  uint16_t len, pending, head = traceHead, i;
+  uint8_t sync;
+
+  if (!traceOn) return;
+  now = micros();
+  sync = now - traceSyncTime >= TRACE_SYNC_US;
+  if (sync) {                                              // the decoder can start from there
+    *p++ = TRC_SYNC; *p++ = 'P'; *p++ = 'T'; *p++ = TRACE_VERSION;
+    p = traceVarint(p, now);
+    last = now;
+  }
+  if (traceLost) {
+    p = traceHeader(p, TRC_DROPPED, 1, now - last);
+    p = traceSigned(p, traceLost);
+    last = now;
+  }
+  p = traceHeader(p, id, n, now - last);
+  for (i = 0; i < n; i++) p = traceSigned(p, v[i]);
+
+  len = p - rec;
+  pending = (head - traceTail) & (TRACE_RING - 1);
+  if (len > TRACE_RING - 1 - pending) {
+    traceLost++;
+    trace.dropped++;
+    return;
+  }
+  for (i = 0; i < len; i++) traceRing[(head + i) & (TRACE_RING - 1)] = rec[i];
+  TRACE_BARRIER();
+  traceHead = (head + len) & (TRACE_RING - 1);
+
+  traceLast = now;
+  if (sync) traceSyncTime = now;
+  traceLost = 0;
+  trace.records++;
+  if (pending + len > trace.ringMax) trace.ringMax = pending + len;
+}
+
+// as many bytes as the 8 bytes transmit FIFO takes, no wait
+void traceDrain() {
+  uint16_t tail = traceTail, head = traceHead;
+
+  TRACE_BARRIER();
+  while (tail != head && !(U1STA & UART_UTXBF)) {
+    U1TXREG = traceRing[tail];
+    tail = (tail + 1) & (TRACE_RING - 1);
+  }
+  traceTail = tail;
+}
+
+#endif
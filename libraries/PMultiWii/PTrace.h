@@ -0,0 +1,55 @@
+#ifndef TRACE_H_
+#define TRACE_H_
+
+// ids of the records, the comment names the values of the record in order: tools/trace_decode.py reads them here
+enum trace_id {
+  TRC_SYNC,       // time
+  TRC_DROPPED,    // records
+  TRC_RCDATA,     // ROLL PITCH YAW THROTTLE AUX1
+  TRC_RCCOMMAND,  // ROLL PITCH YAW THROTTLE
+  TRC_MPU,        // accROLL accPITCH accYAW gyroROLL gyroPITCH gyroYAW temperature
+  TRC_ACC,        // accROLL accPITCH accYAW
+  TRC_GYRO,       // gyroROLL gyroPITCH gyroYAW
+  TRC_ACC_ANGLE,  // e_roll e_pitch
+  TRC_GYRO_ANGLE, // i_roll i_pitch dt
+  TRC_ANGLE,      // c_angleROLL c_anglePITCH
+  TRC_PID,        // axis c_angle rcCommand ITerm error axisPID
+  TRC_MIX,        // THROTTLE axisPIDROLL axisPIDPITCH axisPIDYAW
+  TRC_MOTORS,     // motor0 motor1 motor2 motor3
+  TRC_LOOP,       // loops cycleMin cycleAvg cycleMax
+  TRC_MPU_STATS,  // missed timeouts errors readMax
+  TRC_RX_STATS,   // edges frames overflows rejected failsafes
+  TRC_ITEMS
+};
+
+#define TRACE_VALUES_MAX 7   // values of a record
+
+/*
+  A trace point of class cls: the record id with the values, int32_t, into the RAM ring. The class
+  is known at compile time, the trace points of the classes not in TRACE_POINTS are no code.
+  Only the loop traces: the ring has one writer and one reader, traceDrain().
+*/
+#if TRACE_POINTS
+#define TRACE_POINT(cls, id, ...) do {                                          \
+    if (TRACE_POINTS & (cls)) {                                                 \
+      const int32_t trace_v[] = {__VA_ARGS__};                                  \
+      traceRecord(id, trace_v, sizeof(trace_v) / sizeof(trace_v[0]));          \
+    }                                                                           \
+  } while (0)
+#else
+#define TRACE_POINT(cls, id, ...) do { } while (0)
+#endif
+
+typedef struct {
+  uint32_t records;  // records written to the ring
+  uint32_t dropped;  // records lost on a full ring
+  uint16_t ringMax;  // most bytes waiting in the ring
+} trace_t;
+
+extern trace_t trace;
+
+void traceInit();
+void traceRecord(uint8_t id, const int32_t *v, uint8_t n);
+void traceDrain();
+
+#endif /* TRACE_H_ */
@@ -81,9 +81,21 @@
     #define MINCOMMAND  936
     #define MAXCOMMAND 1875
 
+  /****************************    PID gains         *********************************/
+    /* angle PID of ROLL and PITCH, run in fixed point (Q16 gains):
+         axisPID = P * error + I * sum(error * dt) - D * angle rate
+       error = rcCommand - angle in rcCommand units (PI rad = 500), dt in s, angle rate from the gyro in rcCommand units/s */
+    #define PID_ROLL_P   0.6
+    #define PID_ROLL_I   0.1
+    #define PID_ROLL_D   0.03
+    #define PID_PITCH_P  0.6
+    #define PID_PITCH_I  0.1
+    #define PID_PITCH_D  0.03
+    #define PID_I_MAX    250    // limit of the I term, rcCommand units; it is reset while the throttle is under MINCHECK
+
   /**********************************    I2C speed   ************************************/
-    #define I2C_SPEED 100000L     //100kHz normal mode, this value must be used for a genuine WMP
-    //#define I2C_SPEED 400000L   //400kHz fast mode, it works only with some WMP clones
+    //#define I2C_SPEED 100000L   //100kHz normal mode, this value must be used for a genuine WMP
+    #define I2C_SPEED 400000L     //400kHz fast mode, it works only with some WMP clones, needed by MPU6050_INT
 
   /***************************    Internal i2c Pullups   ********************************/
     /* enable internal I2C pull ups (in most cases it is better to use external pullups) */
@@ -324,7 +336,7 @@
   /**************************************************************************************/
 
     /****************************    PPM Sum Reciver    ***********************************/
-      /* The following lines apply only for specific receiver with only one PPM sum signal, on digital PIN 2
+      /* The following lines apply only for specific receiver with only one PPM sum signal, on RB1 (the ROLL input)
          Select the right line depending on your radio brand. Feel free to modify the order in your PPM order is different */
       //#define SERIAL_SUM_PPM         PITCH,YAW,THROTTLE,ROLL,AUX1,AUX2,AUX3,AUX4,8,9,10,11 //For Graupner/Spektrum
       //#define SERIAL_SUM_PPM         ROLL,PITCH,THROTTLE,YAW,AUX1,AUX2,AUX3,AUX4,8,9,10,11 //For Robe/Hitec/Futaba
@@ -356,8 +368,8 @@
       //#define SPEK_BIND_DATA   6
 
     /*******************************    SBUS RECIVER    ************************************/
-      /* The following line apply only for Futaba S-Bus Receiver on MEGA boards at RX1 only (Serial 1).
-         You have to invert the S-Bus-Serial Signal e.g. with a Hex-Inverter like IC SN74 LS 04 */
+      /* The following line apply only for Futaba S-Bus Receiver on the RX of UART2 (Serial1, pin 39 of the Uno32).
+         The UART inverts the S-Bus signal itself (RXINV), no Hex-Inverter is needed */
       //#define SBUS
       //#define SBUS_SERIAL_PORT 1
 
@@ -501,6 +513,12 @@
       //#define MPU6050_LPF_10HZ
       //#define MPU6050_LPF_5HZ       // Use this only in extreme cases, rather change motors and/or props
 
+      /* MPU6050 data-ready sampling (CHIPKIT): the INT pin of the MPU6050 is wired to the external interrupt
+         INT<MPU6050_INT> of the chipKIT (INT1: pin 2 of the Uno32 and of the Max32). The MPU6050 samples at 1kHz,
+         the interrupt reads accel, temperature and gyro in one 14 bytes burst, the loop runs once per sample.
+         Comment it to read the same burst from the loop. */
+      #define MPU6050_INT 1
+
     /******                Gyro smoothing    **********************************/
       /* GYRO_SMOOTHING. In case you cannot reduce vibrations _and_ _after_ you have tried the low pass filter options, you
          may try this gyro smoothing via averaging. Not suitable for multicopters!
@@ -621,6 +639,17 @@
        +/-40 uncommend and change the value below if you want to change it. */
     //#define ALT_HOLD_THROTTLE_NEUTRAL_ZONE 40 
 
+    /* RC smoothing, instead of the average of the last 4 reads at 50Hz with a +/-3 hysteresis (about 60ms behind
+       the sticks): computeRC runs every loop, takes each frame of the receiver once it is whole, at the time of
+       its last edge, and filters each channel up to the loop rate with one of:
+         RC_FILTER_NONE    the last frame as is, steps of one frame
+         RC_FILTER_PT1     first order low pass at RC_FILTER_HZ
+         RC_FILTER_BIQUAD  second order low pass (Butterworth) at RC_FILTER_HZ
+         RC_FILTER_INTERP  a ramp from where the channel is to the new frame over one frame interval
+       the list is in the order of rcData: ROLL, PITCH, YAW, THROTTLE, AUX1; the channels not in it are NONE. */
+    //#define RC_FILTER {RC_FILTER_INTERP, RC_FILTER_INTERP, RC_FILTER_INTERP, RC_FILTER_PT1}
+    #define RC_FILTER_HZ 30
+
 
   /**************************************************************************************/
   /***********************                  GPS                **************************/
@@ -1028,6 +1057,14 @@
     /* Enable string transmissions from copter to GUI */
     //#define DEBUGMSG
 
+    /* binary trace (PTrace.cpp): the trace points of the classes of TRACE_POINTS write records into a RAM
+       ring instead of printing, the loop sends them on Serial at TRACE_BAUD when the UART has room, and
+       tools/trace_decode.py prints them. Classes: TRACE_RC, TRACE_IMU, TRACE_PID, TRACE_MOTORS, TRACE_LOOP.
+       TRACE_PID and TRACE_MOTORS take about 50 bytes per loop, TRACE_IMU as much again: a record that finds the ring
+       full is dropped and counted. 1Mbaud is exact at the 80MHz peripheral bus and the FTDI of the Uno32 takes it */
+    //#define TRACE_POINTS (TRACE_LOOP | TRACE_PID | TRACE_MOTORS)
+    #define TRACE_BAUD 1000000
+
 
   /********************************************************************/
   /****           ESCs calibration                                 ****/
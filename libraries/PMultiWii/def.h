@@ -3,6 +3,20 @@
 
 #define TRACE
 
+// classes of the binary trace points (PTrace.h), TRACE_POINTS of config.h selects the ones compiled in
+#define TRACE_RC      0x01   // computeRC: rcData, rcCommand
+#define TRACE_IMU     0x02   // MPU_getADC, ACC_Common, GYRO_Common: the sample and the angles
+#define TRACE_PID     0x04   // computePID
+#define TRACE_MOTORS  0x08   // RunMotors, writeMotors
+#define TRACE_LOOP    0x10   // loop time and MPU6050 counters, every second
+#if !defined(TRACE_POINTS)
+  #define TRACE_POINTS 0
+#endif
+
+#if defined(HOST)   // the PC build of HOST/: no MPU6050 interrupt, the loop reads the samples
+  #undef MPU6050_INT
+#endif
+
 /**************************************************************************************/
 /***************             test configurations                   ********************/
 /**************************************************************************************/
@@ -1818,6 +1832,20 @@
 
 #define RC_CHANS 5
 
+// channels of the receiver kept by PRX.cpp, RC_CHANS of them are used
+#if defined(SBUS)
+  #define RC_SLOTS 18
+#elif defined(SERIAL_SUM_PPM)
+  #define RC_SLOTS 12
+#else
+  #define RC_SLOTS RC_CHANS
+#endif
+
+#define RC_FILTER_NONE    0    // the filters of RC_FILTER in config.h
+#define RC_FILTER_PT1     1
+#define RC_FILTER_BIQUAD  2
+#define RC_FILTER_INTERP  3
+
 
 
 /**************************************************************************************/
@@ -0,0 +1,184 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+#
+# trace_decode.py - PMultiWii binary trace to text or CSV (TRACE_POINTS in config.h)
+#
+#   trace_decode.py trace.bin [-c prefix]                   decode a capture of the Serial output
+#   trace_decode.py -p /dev/ttyUSB0 [-b 115200] [-c prefix]  read the board as it flies (pyserial)
+#
+# Prints one line per record, time in s and the values by name, or with -c writes prefix_<record>.csv,
+# one file per record id. The stream is the one described in PTrace.cpp: the boot messages in text,
+# then sync records and records of zigzag varints. The record ids and the names of their values are
+# read from the enum trace_id of PTrace.h.
+
+import os
+import re
+import sys
+
+TRACE_VERSION = 1
+SYNC = bytearray(b'\x00PT') + bytearray([TRACE_VERSION])
+
+
+def load_ids(header):
+    ids = []
+    inside = False
+    for line in open(header):
+        if line.startswith('enum trace_id'):
+            inside = True
+        elif inside:
+            m = re.match(r'\s*TRC_(\w+),\s*//\s*(.*)$', line)
+            if m:
+                ids.append((m.group(1), m.group(2).split()))
+            elif line.strip().startswith('}'):
+                break
+    return ids
+
+
+class Decoder:
+    def __init__(self, ids, out):
+        self.ids = ids
+        self.out = out
+        self.buf = bytearray()
+        self.synced = False
+        self.booting = True
+        self.time = 0
+        self.records = 0
+        self.dropped = 0
+
+    def varint(self, pos):
+        v, shift = 0, 0
+        while True:
+            c = self.buf[pos]
+            pos += 1
+            v |= (c & 0x7F) << shift
+            shift += 7
+            if c < 0x80:
+                return v, pos
+
+    def signed(self, pos):
+        v, pos = self.varint(pos)
+        return (v >> 1) ^ -(v & 1), pos
+
+    def resync(self):
+        at = self.buf.find(SYNC)
+        keep = at if at >= 0 else max(0, len(self.buf) - len(SYNC) + 1)
+        if self.booting:
+            sys.stderr.write(self.buf[:keep].decode('latin-1'))   # the boot messages of TRACE
+        elif keep:
+            sys.stderr.write('%d bytes skipped, looking for a sync record\n' % keep)
+        del self.buf[:keep]
+        self.synced = at >= 0
+        if self.synced:
+            self.booting = False
+
+    # decodes the complete records of the buffer, the rest waits for more bytes
+    def feed(self, data):
+        self.buf += data
+        while True:
+            if not self.synced:
+                self.resync()
+                if not self.synced:
+                    return
+            pos = 0
+            try:
+                head = self.buf[pos]
+                if head == 0:
+                    if self.buf[:len(SYNC)] != SYNC:
+                        if len(self.buf) < len(SYNC):
+                            return
+                        raise ValueError('bad sync record')
+                    self.time, pos = self.varint(len(SYNC))
+                else:
+                    rid, count = head & 0x1F, head >> 5
+                    if rid >= len(self.ids) or len(self.ids[rid][1]) != count:
+                        raise ValueError('unknown record %d with %d values' % (rid, count))
+                    dt, pos = self.varint(pos + 1)
+                    values = []
+                    for _ in range(count):
+                        v, pos = self.signed(pos)
+                        values.append(v)
+                    self.time = (self.time + dt) & 0xFFFFFFFF
+                    self.records += 1
+                    if self.ids[rid][0] == 'DROPPED':
+                        self.dropped += values[0]
+                    self.out.record(self.time, self.ids[rid], values)
+            except IndexError:
+                return
+            except ValueError as e:
+                sys.stderr.write('%s\n' % e)
+                del self.buf[:1]
+                self.synced = False
+                continue
+            del self.buf[:pos]
+
+
+class TextOut:
+    def record(self, time, rid, values):
+        name, fields = rid
+        sys.stdout.write('%12.6f %-12s %s\n' % (time / 1e6, name,
+                         ' '.join('%s=%d' % f for f in zip(fields, values))))
+
+    def close(self):
+        pass
+
+
+class CsvOut:
+    def __init__(self, prefix):
+        self.prefix = prefix
+        self.files = {}
+
+    def record(self, time, rid, values):
+        name, fields = rid
+        if name not in self.files:
+            f = open('%s_%s.csv' % (self.prefix, name.lower()), 'w')
+            f.write(','.join(['time'] + fields) + '\n')
+            self.files[name] = f
+        self.files[name].write(','.join(map(str, [time] + values)) + '\n')
+
+    def close(self):
+        for f in self.files.values():
+            f.close()
+
+
+def main(argv):
+    args = argv[1:]
+    port, baud, prefix, name = None, 115200, None, None
+    header = os.path.join(os.path.dirname(os.path.abspath(__file__)), '..', 'PTrace.h')
+    while args:
+        a = args.pop(0)
+        if a == '-p' and args:
+            port = args.pop(0)
+        elif a == '-b' and args:
+            baud = int(args.pop(0))
+        elif a == '-c' and args:
+            prefix = args.pop(0)
+        elif a == '-H' and args:
+            header = args.pop(0)
+        elif not a.startswith('-') and name is None:
+            name = a
+        else:
+            name = port = None
+            break
+    if (name is None) == (port is None):
+        sys.stderr.write('usage: trace_decode.py [-H PTrace.h] [-c prefix] (trace.bin | -p serial_port [-b baud])\n')
+        return 1
+
+    out = CsvOut(prefix) if prefix else TextOut()
+    dec = Decoder(load_ids(header), out)
+    try:
+        if port:
+            import serial
+            link = serial.Serial(port, baud, timeout=0.1)
+            while True:
+                dec.feed(bytearray(link.read(4096)))
+        else:
+            dec.feed(bytearray(open(name, 'rb').read()))
+    except KeyboardInterrupt:
+        pass
+    out.close()
+    sys.stderr.write('%d records, %d dropped by the board\n' % (dec.records, dec.dropped))
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main(sys.argv))
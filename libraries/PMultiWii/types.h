@@ -86,11 +86,25 @@ typedef struct {
   int16_t  magADC[3];
   int16_t  gyroADC[3];
   int16_t  accADC[3];
-  double   dgyroADC[3];
-  double   daccADC[3];
   int16_t  temperature;
 } imu_t;
 
+typedef struct {
+  uint32_t samples;            // MPU6050 samples taken by the loop
+  uint16_t missed;             // samples read by the data-ready interrupt, replaced before the loop took them
+  uint16_t timeouts;           // waits for a sample given up
+  uint16_t errors;             // failed burst reads
+  uint16_t readMax;            // longest burst read in us
+} mpu_stats_t;
+
+typedef struct {
+  uint32_t edges;              // RC edges decoded
+  uint32_t frames;             // frames published: PPM, SBUS, or PWM once the four sticks have a new pulse
+  uint16_t overflows;          // edges lost on a full FIFO
+  uint16_t rejected;           // pulses out of [900;2200], SBUS frames out of step
+  uint16_t failsafes;          // SBUS frames with the failsafe flag of the receiver
+} rx_stats_t;
+
 typedef struct {
   uint8_t  vbat;               // battery voltage in 0.1V steps
   uint16_t intPowerMeterSum;
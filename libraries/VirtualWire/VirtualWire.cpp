@@ -41,7 +41,7 @@
 #endif
 
 #include "VirtualWire.h"
-#include <util/crc16.h>
+#include "utility/checksum.h"
 
 
 static uint8_t vw_tx_buf[(VW_MAX_MESSAGE_LEN * 2) + VW_HEADER_LEN] 
@@ -144,11 +144,7 @@ extern "C"
 // This should only be ever called at user level, not interrupt level
 uint16_t vw_crc(uint8_t *ptr, uint8_t count)
 {
-    uint16_t crc = 0xffff;
-
-    while (count-- > 0) 
-	crc = _crc_ccitt_update(crc, *ptr++);
-    return crc;
+    return checksum_crc_ccitt(0xffff, ptr, count);
 }
 
 // Convert a 6 bit encoded symbol into its 4 bit decoded equivalent
@@ -420,6 +416,9 @@ void vw_setup(uint16_t speed)
     {
         return; // fault
     }
+
+    // let the FCS use the DMA CRC generator
+    checksum_begin();
     
  // Initialization TIMER2
   T2CON = 0x0000 ;  // 0x0000=0000000000000000 
@@ -702,7 +701,8 @@ uint8_t vw_send(uint8_t* buf, uint8_t len)
     vw_wait_tx();
 
     // Encode the message length
-    crc = _crc_ccitt_update(crc, count);
+    crc = checksum_crc_ccitt(crc, &count, 1);
+    crc = checksum_crc_ccitt(crc, buf, len);
     p[index++] = symbols[count >> 4];
     p[index++] = symbols[count & 0xf];
 
@@ -713,7 +713,6 @@ uint8_t vw_send(uint8_t* buf, uint8_t len)
     for (i = 0; i < len; i++)
     {
     //Serial.print(buf[i],HEX);
-	crc = _crc_ccitt_update(crc, buf[i]);
 	p[index++] = symbols[buf[i] >> 4];
 	p[index++] = symbols[buf[i] & 0xf];
     }
@@ -143,6 +143,8 @@
 ///               Minor improvements to timer setup for Maple. Name vw_tx_active() changed from incorrect
 ///               vx_tx_active()
 /// \version 1.20 Added support for ATtiny84, patched by Chuck Benedict.
+/// \version 1.21 The FCS is computed through the Checksum library (table driven, or the
+///               DMA CRC generator on chipKIT), built from utility/checksum.c.
 ///
 /// \par Implementation Details
 /// See: http://www.airspayce.com/mikem/arduino/VirtualWire.pdf